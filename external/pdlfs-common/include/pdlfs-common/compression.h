@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "pdlfs-common/compression_type.h"
+#include "pdlfs-common/slice.h"
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace pdlfs {
+
+// A dictionary shared by many small inputs compressed with
+// kZstdCompression.  Dictionaries are digested once at construction for
+// either compression or decompression.
+class CompressionDict {
+ public:
+  CompressionDict(const Slice& contents, bool for_compression);
+  ~CompressionDict();
+
+  const std::string& contents() const { return contents_; }
+  const void* zstd_cdict() const { return cdict_; }
+  const void* zstd_ddict() const { return ddict_; }
+
+ private:
+  std::string contents_;
+  void* cdict_;  // Zstd digested form for compression
+  void* ddict_;  // Zstd digested form for decompression
+
+  // No copying allowed
+  void operator=(const CompressionDict&);
+  CompressionDict(const CompressionDict&);
+};
+
+// Compress "input" using "type" and store the result in "*output".  Return
+// false if "type" is not supported by this build.  "dict" is only used by
+// kZstdCompression and may be NULL.
+extern bool Compress(CompressionType type, const Slice& input,
+                     std::string* output, const CompressionDict* dict = NULL);
+
+// Reverse Compress().  "dict" must match the one used for compression.
+// Return false on corrupted inputs or unsupported types.
+extern bool Uncompress(CompressionType type, const Slice& input,
+                       std::string* output,
+                       const CompressionDict* dict = NULL);
+
+// Same as Uncompress(), but store the result in a new[] allocated buffer.
+extern bool Uncompress(CompressionType type, const Slice& input, char** buf,
+                       size_t* size, const CompressionDict* dict = NULL);
+
+// Train a dictionary of at most "max_size" bytes from a set of samples
+// stored back to back in "samples".  Return false if no dictionary could be
+// trained, such as when zstd is not supported or samples are too few.
+extern bool TrainCompressionDict(const Slice& samples,
+                                 const std::vector<size_t>& sample_sizes,
+                                 size_t max_size, std::string* dict);
+
+// Return true iff "type" is supported by this build.
+extern bool CompressionTypeSupported(CompressionType type);
+
+}  // namespace pdlfs
@@ -26,7 +26,9 @@ enum CompressionType {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kLZ4Compression = 0x2,
+  kZstdCompression = 0x3
 };
 
 }  // namespace pdlfs
@@ -15,12 +15,31 @@
 
 #include "pdlfs-common/slice.h"
 
+#include <string>
+
 namespace pdlfs {
 
 class ECT {
  public:
   static ECT* Default(size_t key_len, size_t n, const Slice* keys);
 
+  // Return an index that partitions keys by their leading bits into buckets
+  // of about keys_per_bucket keys each and encodes a separate trie for each
+  // bucket. A two-level directory maps each bucket to the start of its trie,
+  // so lookups only decode a single small trie and cost the same regardless
+  // of the total number of keys. Keys are expected to be uniformly
+  // distributed, such as hashes. Skewed keys are still indexed correctly but
+  // lookups may decode larger tries.
+  static ECT* Bucketed(size_t key_len, size_t n, const Slice* keys,
+                       size_t keys_per_bucket = 64);
+
+  // Recreate an index from the output of EncodeTo(). Return NULL if the
+  // input is malformed.
+  static ECT* Decode(const Slice& input);
+
+  // Append a serialized form of the index to *dst.
+  virtual void EncodeTo(std::string* dst) const = 0;
+
   // Return the internal memory usage in bits.
   virtual size_t MemUsage() const = 0;
 
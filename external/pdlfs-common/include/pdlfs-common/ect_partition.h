@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "pdlfs-common/slice.h"
+#include "pdlfs-common/status.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace pdlfs {
+
+struct DBOptions;
+class ECT;
+class RandomAccessFile;
+class WritableFile;
+
+// An ECT partition is an immutable file mapping keys to values, meant for
+// read-only snapshots of metadata partitions, such as the contents of an
+// archived directory dumped from a DB. Records are stored in the order of
+// the 64-bit hashes of their keys. An ECT index built over these hashes
+// maps each key to the rank of its record, so a lookup costs one rank
+// computation in memory and one record read.
+//
+// File format:
+//    [record 0]
+//    ...
+//    [record n-1]
+//    [record offsets: fixed32 * (n+1)]
+//    [ECT index]
+//    [footer]
+// where each record is
+//    key_len: varint32
+//    key: char[key_len]
+//    value: char[until the next record]
+// and the footer is
+//    num_entries: fixed64
+//    offsets_offset: fixed64
+//    ect_offset: fixed64
+//    seed: fixed32  (Seed of the key hashes)
+//    crc: fixed32  (Masked crc32c of the offsets and the ECT index)
+//    magic: fixed64
+class ECTPartitionBuilder {
+ public:
+  // Create a builder that will write to *file. Does not take ownership of
+  // the file. The caller is responsible for syncing and closing the file
+  // after Finish() returns.
+  explicit ECTPartitionBuilder(WritableFile* file);
+  ~ECTPartitionBuilder();
+
+  // Add a record to the partition. Records are buffered in memory until
+  // Finish() is called and may be added in any order.
+  // REQUIRES: key has not been added before.
+  // REQUIRES: Finish() has not been called.
+  void Add(const Slice& key, const Slice& value);
+
+  // Sort all records and write the partition.
+  // REQUIRES: Finish() has not been called.
+  Status Finish();
+
+  // Number of calls to Add() so far.
+  size_t NumEntries() const { return records_.size(); }
+
+  // Size of the file written. Only valid after Finish() returns OK.
+  uint64_t FileSize() const { return offset_; }
+
+ private:
+  struct Record {
+    uint64_t hash;
+    size_t off;  // Offset of the record in buf_
+    size_t len;
+  };
+  struct RecordCompare;
+  // Hash all keys with a given seed and sort records by their hashes.
+  // Return false if two keys share the same hash.
+  bool SortRecords(uint32_t seed);
+  Status Append(const Slice& data);
+
+  WritableFile* const file_;
+  std::string buf_;  // Encoded records in insertion order
+  std::vector<Record> records_;
+  uint64_t offset_;
+  bool finished_;
+
+  // No copying allowed
+  void operator=(const ECTPartitionBuilder&);
+  ECTPartitionBuilder(const ECTPartitionBuilder&);
+};
+
+class ECTPartition {
+ public:
+  // Open a partition stored in *file of size "file_size". Stores a pointer
+  // to the partition in *result and returns OK on success. The record
+  // offsets are read in place if the file is memory-mapped, as is the case
+  // for files opened through the default Env, and copied into memory
+  // otherwise. The ECT index is always decoded into memory. Does not take
+  // ownership of the file. *file must remain live while the partition is
+  // in use. Caller should delete *result when it is no longer needed.
+  static Status Open(RandomAccessFile* file, uint64_t file_size,
+                     ECTPartition** result);
+
+  ~ECTPartition();
+
+  // Store the value of a given key in *value and return OK. Return
+  // NotFound if the partition does not contain the key. Thread-safe.
+  Status Get(const Slice& key, std::string* value) const;
+
+  size_t NumEntries() const { return num_entries_; }
+
+  // Return the memory used by the ECT index in bits.
+  size_t IndexMemUsage() const;
+
+ private:
+  ECTPartition() {}
+  RandomAccessFile* file_;
+  ECT* ect_;
+  uint32_t seed_;
+  size_t num_entries_;
+  Slice offsets_;
+  std::string offsets_buf_;  // Storage for offsets_ unless memory-mapped
+
+  // No copying allowed
+  void operator=(const ECTPartition&);
+  ECTPartition(const ECTPartition&);
+};
+
+// Build an ECT partition from the Table files that DB::Dump() wrote under
+// "dump_dir" and write it to "fname". options.comparator must be the
+// comparator of the db that produced the dump. If options.env is NULL,
+// Env::Default() will be used. The values of the dump are stored verbatim.
+// If "num_entries" is not NULL, the number of records is piggy-backed to
+// the caller. Return OK on success, or a non-OK status on errors.
+extern Status BuildECTPartitionFromDump(const DBOptions& options,
+                                        const std::string& dump_dir,
+                                        const std::string& fname,
+                                        size_t* num_entries = NULL);
+
+}  // namespace pdlfs
@@ -246,6 +246,12 @@ class RandomAccessFile {
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
 
+  // Return true iff Read() always sets "*result" to point at memory owned
+  // by the file, such as a mmapped region, that stays valid for as long as
+  // the file is alive.  Read() then never touches "scratch", which may be
+  // NULL.  The default implementation returns false.
+  virtual bool IsMemoryResident() const;
+
  private:
   // No copying allowed
   RandomAccessFile(const RandomAccessFile&);
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+#pragma once
+
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/port.h"
+#include "pdlfs-common/random.h"
+
+#include <stdint.h>
+
+namespace pdlfs {
+
+// Latency and faults injected into one type of file operation.
+struct FaultSpec {
+  FaultSpec();
+
+  // Each operation is delayed by a latency uniformly drawn from
+  // [min_micros, max_micros].
+  // Default: 0
+  int min_micros;
+  int max_micros;
+
+  // One in every "tail_one_in" operations is further delayed by
+  // "tail_micros" to emulate tail latency. Disabled if 0.
+  // Default: 0
+  int tail_one_in;
+  int tail_micros;
+
+  // One in every "error_one_in" operations fails with an IOError without
+  // reaching the underlying Env. Disabled if 0.
+  // Default: 0
+  int error_one_in;
+};
+
+struct FaultInjectionOptions {
+  FaultInjectionOptions();
+
+  // Applied to SequentialFile::Read and RandomAccessFile::Read.
+  FaultSpec read;
+
+  // Applied to WritableFile::Append.
+  FaultSpec append;
+
+  // Applied to WritableFile::Sync.
+  FaultSpec sync;
+
+  // Max number of bytes read per second across all files. Reads exceeding
+  // the budget are delayed. Unlimited if 0.
+  // Default: 0
+  uint64_t read_bytes_per_sec;
+
+  // Max number of bytes appended per second across all files. Unlimited
+  // if 0.
+  // Default: 0
+  uint64_t write_bytes_per_sec;
+
+  // Every "stall_period_micros" all reads, appends, and syncs stall for
+  // "stall_micros" to emulate periodic storage hiccups such as fsync
+  // storms or garbage collection. Disabled if 0.
+  // Default: 0
+  uint64_t stall_period_micros;
+  uint64_t stall_micros;
+
+  // Seed for the random draws above. Runs using the same seed and the same
+  // sequence of operations see the same latencies and errors.
+  // Default: 301
+  uint32_t seed;
+};
+
+// Counters kept by a FaultInjectionEnv.
+struct FaultInjectionStats {
+  FaultInjectionStats() { Reset(); }
+  void Reset();
+
+  uint64_t reads;
+  uint64_t read_bytes;
+  uint64_t appends;
+  uint64_t append_bytes;
+  uint64_t syncs;
+  uint64_t errors;         // Number of operations failed on purpose
+  uint64_t delay_micros;   // Total time operations were delayed
+};
+
+// An Env wrapper injecting latency, bandwidth limits, periodic stalls, and
+// errors into file reads, appends, and syncs of files opened through it.
+// Used to emulate slow or unreliable storage in tests and benchmarks.
+// Other Env calls are forwarded to the base Env unchanged.
+class FaultInjectionEnv : public EnvWrapper {
+ public:
+  FaultInjectionEnv(Env* base, const FaultInjectionOptions& options);
+  virtual ~FaultInjectionEnv();
+
+  // Replace current options. Affects all files including those already
+  // opened.
+  void SetOptions(const FaultInjectionOptions& options);
+
+  FaultInjectionStats GetStats();
+  void ResetStats();
+
+  virtual Status NewSequentialFile(const char* f, SequentialFile** r);
+  virtual Status NewRandomAccessFile(const char* f, RandomAccessFile** r);
+  virtual Status NewWritableFile(const char* f, WritableFile** r);
+
+  enum OpType { kRead, kAppend, kSync };
+  // Delay the calling thread as configured for an operation of the given
+  // type moving "n" bytes. Return non-OK if the operation should fail.
+  Status Inject(OpType type, size_t n);
+
+ private:
+  port::Mutex mutex_;
+  FaultInjectionOptions options_;
+  FaultInjectionStats stats_;
+  Random rnd_;
+  const uint64_t epoch_;     // Start time of stall periods
+  uint64_t read_ready_;      // Time at which the read budget frees up
+  uint64_t write_ready_;
+};
+
+}  // namespace pdlfs
@@ -34,10 +34,33 @@ struct Fentry {
 #endif
 };
 
+// Options controlling a write-back caching Fio.
+struct WriteBackFioOptions {
+  WriteBackFioOptions();
+
+  // Writes to an open file are buffered until this many bytes are pending
+  // or a write is not adjacent to the data already buffered. Larger writes
+  // bypass the buffer.
+  // Default: 64KB
+  size_t write_buffer_size;
+
+  // Total bytes buffered across all open files. Once exceeded, buffers are
+  // flushed in least-recently-written order until usage is back in budget.
+  // Default: 8MB
+  size_t max_buffered_bytes;
+};
+
 // Abstract service to access file data.
 class Fio {
  public:
   static Fio* Open(const char* fio_name, const char* fio_conf);
+
+  // Return a Fio that buffers writes to each open file and serves Fstat()
+  // from cached size and mtime unless "skip_cache" is set. Buffered data is
+  // written to "base" on Flush(), Close(), Ftrunc(), reads overlapping it, or
+  // memory pressure. Trunc(), Stat(), and Drop() bypass the cache. The result
+  // owns "base" and deletes it when deleted.
+  static Fio* WriteBack(const WriteBackFioOptions& options, Fio* base);
 #ifndef NDEBUG
   class Handle {  // Allows dynamic type checks
    protected:
@@ -63,6 +86,40 @@ class Fio {
                       uint64_t size, char* scratch) = 0;
   virtual Status Pread(const Fentry& fentry, Handle* fh, Slice* result,
                        uint64_t off, uint64_t size, char* scratch) = 0;
+
+  // A positional read or write within a vectored or asynchronous call.
+  // A write sends "data" to file "fh" at offset "off".  A read fills at most
+  // "size" bytes of "scratch" with data from file "fh" at offset "off" and
+  // sets "result" to the data read.  "status" is set to the outcome.
+  struct Request {
+    Request() : fentry(NULL), fh(NULL), off(0), size(0), scratch(NULL) {}
+    const Fentry* fentry;
+    Handle* fh;
+    uint64_t off;
+    Slice data;     // Data to write
+    uint64_t size;  // Number of bytes to read
+    char* scratch;  // Space for data read
+    Slice result;   // Data read
+    Status status;
+  };
+
+  // Perform a batch of positional reads (or writes), possibly in parallel.
+  // Requests may target different files.  Return OK iff all requests
+  // succeed, otherwise the first error in request order.  The default
+  // implementations issue requests one after another.
+  virtual Status Preadv(Request* reqs, size_t n);
+  virtual Status Pwritev(Request* reqs, size_t n);
+
+  // Same as Preadv() and Pwritev(), but return immediately and call
+  // (*done)(arg) once all requests have completed, possibly from a
+  // different thread.  Check the status of each request for errors.
+  // "reqs" and all buffers referenced by them must remain live until then.
+  // The default implementations complete all requests before returning.
+  virtual void AsyncPreadv(Request* reqs, size_t n, void (*done)(void*),
+                           void* arg);
+  virtual void AsyncPwritev(Request* reqs, size_t n, void (*done)(void*),
+                            void* arg);
+
   virtual Status Ftrunc(const Fentry& fentry, Handle* fh, uint64_t size) = 0;
   virtual Status Flush(const Fentry& fentry, Handle* fh,
                        bool force_sync = false) = 0;
@@ -12,7 +12,10 @@
 
 #include "pdlfs-common/fsdbbase.h"
 #include "pdlfs-common/coding.h"
+#include "pdlfs-common/hash.h"
+#include "pdlfs-common/status.h"
 
+#include <assert.h>
 #include <vector>
 
 namespace pdlfs {
@@ -27,11 +30,44 @@ enum MXDBFormat {
   // balancing straightforward. IndexFS uses this format.
   kNameInValue,
   // Filename is stored as key suffix.
-  // TableFS uses this format.
-  kNameInKey
+  // Directory entries are sorted by name and can be listed without decoding
+  // values. Keys sharing a directory prefix are prefix-compressed by the
+  // DB's block encoding. TableFS uses this format.
+  kNameInKey,
+  // Like kNameInValue, but safe against hash collisions. Each value starts
+  // with a 32-bit fingerprint of its filename and the position of the entry
+  // in its overflow chain, followed by the filename and then the stat. So
+  // lookups verify filenames before decoding stats. A filename whose hash
+  // is taken is stored under the next free hash value, forming a short
+  // overflow chain under the same key prefix. Key suffixes must be 8-byte
+  // hashes. Hashes are treated as big-endian integers so chains stay
+  // adjacent in key order. Code redistributing entries by hash, such as
+  // directory splitting, must rehash filenames rather than use key suffixes.
+  kNameInValueChained
 };
 
 class DB;
+struct ReadOptions;
+
+// Return a secondary fingerprint of a filename for kNameInValueChained.
+inline uint32_t MXDBFingerprint(const Slice& name) {
+  return Hash(name.data(), name.size(), 0x7f4a7c15);
+}
+
+// Store the key suffix of the i-th slot of the overflow chain starting at a
+// given 8-byte hash in dst[0..7].
+inline void MXDBChainSlot(char* dst, const Slice& hash, uint64_t i) {
+  assert(hash.size() == 8);
+  uint64_t h = 0;
+  for (int j = 0; j < 8; j++) {
+    h = (h << 8) | static_cast<unsigned char>(hash[j]);
+  }
+  h += i;
+  for (int j = 7; j >= 0; j--) {
+    dst[j] = static_cast<char>(h & 0xff);
+    h >>= 8;
+  }
+}
 
 // This is a set of templates for access filesystem metadata as KV pairs in a
 // KV-store. Providing this as templates allows for different key types and DB
@@ -42,12 +78,20 @@ class DB;
 // equivalent interface exposing operations including Get, Put, Delete, Write,
 // NewIterator, GetSnapshot, and ReleaseSnapshot, using option structs such as
 // ReadOptions and WriteOptions, and using an Iterator object for range queries.
+// In the kNameInValueChained format, PUT and DELETE probe the DB with a
+// default-constructed xreadoptions to resolve collisions.
 template <typename DX = DB, typename xslice = Slice,  // Foreign slice
           typename xstatus =
               Status,  // Foreign db status type to which we must port
-          MXDBFormat fmt = kNameInValue>
+          MXDBFormat fmt = kNameInValue,
+          typename xreadoptions = ReadOptions>  // Foreign db read options
 class MXDB {
  public:
+  // Max number of filenames sharing a hash in kNameInValueChained.
+  enum { kMaxChainLength = 8 };
+  // Fixed32 fingerprint + 1-byte chain position.
+  enum { kChainHeaderSize = 5 };
+
   explicit MXDB(DX* dx) : dx_(dx) {}
   ~MXDB();
 
@@ -62,14 +106,21 @@ class MXDB {
     return tx;
   }
 
+  // In the kNameInValueChained format, GET, DELETE, and EXISTS require the
+  // filename of the entry in "fname" in addition to its hash in "suf", and
+  // return InvalidArgument without it. The entry whose filename matches is
+  // operated on. Collisions are resolved against committed entries only, so
+  // an uncommitted TX must not create two filenames sharing a hash. Without
+  // a TX, DELETE applies all its updates atomically.
   template <typename KX, typename TX, typename OPT, typename PERF>
   Status GET(const DirId& id, const Slice& suf, Stat* stat, std::string* name,
-             OPT* opt, TX* tx, PERF* perf);
+             OPT* opt, TX* tx, PERF* perf, const Slice& fname = Slice());
   template <typename KX, typename TX, typename OPT, typename PERF>
   Status PUT(const DirId& id, const Slice& suf, const Stat& stat,
              const Slice& name, OPT* opt, TX* tx, PERF* perf);
   template <typename KX, typename TX, typename OPT>
-  Status DELETE(const DirId& id, const Slice& suf, OPT* opt, TX* tx);
+  Status DELETE(const DirId& id, const Slice& suf, OPT* opt, TX* tx,
+                const Slice& fname = Slice());
 
   template <typename Iter>
   struct Dir {
@@ -79,6 +130,10 @@ class MXDB {
   };
   template <typename Iter, typename KX, typename TX, typename OPT>
   Dir<Iter>* OPENDIR(const DirId& id, OPT* opt, TX* tx);
+  // Fetch the next entry of a directory. Entries are returned in key order,
+  // which in the kNameInKey format is the bytewise order of their names.
+  // Either stat or name may be NULL if not needed. In the kNameInKey format,
+  // a NULL stat saves the decoding of the value.
   template <typename Iter>
   Status READDIR(Dir<Iter>* dir, Stat* stat, std::string* name);
   template <typename Iter>
@@ -90,7 +145,8 @@ class MXDB {
   size_t LIST(const DirId& id, StatList* stats, NameList* names, OPT* opt,
               TX* tx, size_t limit);
   template <typename KX, typename TX, typename OPT>
-  Status EXISTS(const DirId& id, const Slice& suf, OPT* opt, TX* tx);
+  Status EXISTS(const DirId& id, const Slice& suf, OPT* opt, TX* tx,
+                const Slice& fname = Slice());
 
   template <typename TX, typename OPT>
   Status COMMIT(OPT* opt, TX* tx) {
@@ -111,13 +167,21 @@ class MXDB {
     }
   }
 
+  // Locate the entry of a given filename in the overflow chain of a given
+  // hash. On success, store the chain position of the entry in *pos and its
+  // value in *value. Otherwise, return NotFound and store the position of
+  // the first free slot in *pos, or kMaxChainLength if the chain is full.
+  template <typename KX, typename OPT>
+  Status FINDSLOT(const DirId& id, const Slice& hash, const Slice& fname,
+                  OPT* opt, uint32_t* pos, std::string* value);
+
   DX* const dx_;
 };
 
-#define MXDBTEMDECL(a, b, c, d) \
-  template <typename a, typename b, typename c, MXDBFormat d>
-MXDBTEMDECL(DX, xslice, xstatus, fmt)
-MXDB<DX, xslice, xstatus, fmt>::~MXDB() {  ////
+#define MXDBTEMDECL(a, b, c, d, e) \
+  template <typename a, typename b, typename c, MXDBFormat d, typename e>
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
+MXDB<DX, xslice, xstatus, fmt, xreadoptions>::~MXDB() {  ////
   // Empty.
 }
 
@@ -136,14 +200,38 @@ MXDB<DX, xslice, xstatus, fmt>::~MXDB() {  ////
 #define KEY_INITIALIZER(id, tp) id.ino, tp
 #endif
 
-MXDBTEMDECL(DX, xslice, xstatus, fmt)
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
 template <typename KX, typename TX, typename OPT, typename PERF>
-Status MXDB<DX, xslice, xstatus, fmt>::PUT(  ////
+Status MXDB<DX, xslice, xstatus, fmt, xreadoptions>::PUT(  ////
     const DirId& id, const Slice& suf, const Stat& stat, const Slice& name,
     OPT* opt, TX* tx, PERF* perf) {
   Status s;
   KX key(KEY_INITIALIZER(id, kDirEntType));
-  key.SetSuffix(suf);
+  uint32_t pos = 0;
+  if (fmt == kNameInValueChained) {
+    // Overwrite the entry of the same filename if there is one. Otherwise,
+    // take the first free slot of the chain.
+    xreadoptions ropts;
+    if (tx != NULL) {
+      ropts.snapshot = tx->snap;
+    }
+    std::string ignored;
+    s = FINDSLOT<KX>(id, suf, name, &ropts, &pos, &ignored);
+    if (s.IsNotFound()) {
+      if (pos >= kMaxChainLength) {
+        return Status::BufferFull("Too many filenames sharing a hash");
+      }
+      s = Status::OK();
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    char slot[8];
+    MXDBChainSlot(slot, suf, pos);
+    key.SetSuffix(Slice(slot, sizeof(slot)));
+  } else {
+    key.SetSuffix(suf);
+  }
   xslice keyenc = xslice(key.data(), key.size());
   // If value size < 200, we use an immediate buf space.
   // Otherwise, we use dynamic mem.
@@ -153,6 +241,13 @@ Status MXDB<DX, xslice, xstatus, fmt>::PUT(  ////
   Slice stat_encoding = stat.EncodeTo(tmp);
   if (fmt == kNameInKey) {
     value = xslice(stat_encoding.data(), stat_encoding.size());
+  } else if (fmt == kNameInValueChained) {
+    buf.reserve(kChainHeaderSize + 5 + name.size() + stat_encoding.size());
+    PutFixed32(&buf, MXDBFingerprint(name));
+    buf.push_back(static_cast<char>(pos));
+    PutLengthPrefixedSlice(&buf, name);
+    buf.append(stat_encoding.data(), stat_encoding.size());
+    value = xslice(buf);
   } else if (5 + name.size() < sizeof(tmp) - stat_encoding.size()) {
     char* const begin = tmp;
     char* end = begin + stat_encoding.size();
@@ -185,11 +280,11 @@ Status MXDB<DX, xslice, xstatus, fmt>::PUT(  ////
   return s;
 }
 
-MXDBTEMDECL(DX, xslice, xstatus, fmt)
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
 template <typename KX, typename TX, typename OPT, typename PERF>
-Status MXDB<DX, xslice, xstatus, fmt>::GET(  ////
+Status MXDB<DX, xslice, xstatus, fmt, xreadoptions>::GET(  ////
     const DirId& id, const Slice& suf, Stat* stat, std::string* name, OPT* opt,
-    TX* tx, PERF* perf) {
+    TX* tx, PERF* perf, const Slice& fname) {
   Status s;
   KX key(KEY_INITIALIZER(id, kDirEntType));
   key.SetSuffix(suf);
@@ -198,23 +293,43 @@ Status MXDB<DX, xslice, xstatus, fmt>::GET(  ////
   if (tx != NULL) {
     opt->snapshot = tx->snap;
   }
-  xstatus st = dx_->Get(*opt, keyenc, &tmp);
-  if (st.ok()) {
-    Slice input(tmp);
-    Slice filename;
-    if (!stat->DecodeFrom(&input)) {
-      s = Status::Corruption(Slice());
-    } else if (name != NULL) {  // Filename requested
-      if (fmt == kNameInKey) {
-        *name = suf.ToString();
-      } else if (!GetLengthPrefixedSlice(&input, &filename)) {
+  if (fmt == kNameInValueChained) {
+    if (fname.empty()) {
+      return Status::InvalidArgument("Filename required");
+    }
+    uint32_t pos;
+    s = FINDSLOT<KX>(id, suf, fname, opt, &pos, &tmp);
+    if (s.ok()) {
+      // Filename already verified
+      Slice input(tmp);
+      Slice filename;
+      input.remove_prefix(kChainHeaderSize);
+      GetLengthPrefixedSlice(&input, &filename);
+      if (!stat->DecodeFrom(&input)) {
         s = Status::Corruption(Slice());
-      } else {
-        *name = filename.ToString();
+      } else if (name != NULL) {
+        name->assign(filename.data(), filename.size());
       }
     }
   } else {
-    s = XSTATUS(st);
+    xstatus st = dx_->Get(*opt, keyenc, &tmp);
+    if (st.ok()) {
+      Slice input(tmp);
+      Slice filename;
+      if (!stat->DecodeFrom(&input)) {
+        s = Status::Corruption(Slice());
+      } else if (name != NULL) {  // Filename requested
+        if (fmt == kNameInKey) {
+          *name = suf.ToString();
+        } else if (!GetLengthPrefixedSlice(&input, &filename)) {
+          s = Status::Corruption(Slice());
+        } else {
+          *name = filename.ToString();
+        }
+      }
+    } else {
+      s = XSTATUS(st);
+    }
   }
 
   // Collect performance stats
@@ -227,12 +342,69 @@ Status MXDB<DX, xslice, xstatus, fmt>::GET(  ////
   return s;
 }
 
-MXDBTEMDECL(DX, xslice, xstatus, fmt)
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
 template <typename KX, typename TX, typename OPT>
-Status MXDB<DX, xslice, xstatus, fmt>::DELETE(  ////
-    const DirId& id, const Slice& suf, OPT* opt, TX* tx) {
+Status MXDB<DX, xslice, xstatus, fmt, xreadoptions>::DELETE(  ////
+    const DirId& id, const Slice& suf, OPT* opt, TX* tx, const Slice& fname) {
   Status s;
   KX key(KEY_INITIALIZER(id, kDirEntType));
+  if (fmt == kNameInValueChained) {
+    if (fname.empty()) {
+      return Status::InvalidArgument("Filename required");
+    }
+    xreadoptions ropts;
+    if (tx != NULL) {
+      ropts.snapshot = tx->snap;
+    }
+    uint32_t pos;
+    std::string value;
+    s = FINDSLOT<KX>(id, suf, fname, &ropts, &pos, &value);
+    if (!s.ok()) {
+      return s.IsNotFound() ? Status::OK() : s;
+    }
+    // Without a TX, all updates go to a batch of our own that is applied
+    // at once, so readers never see a chain that is only partly updated.
+    TX local;
+    TX* const t = tx != NULL ? tx : &local;
+    // Lookups stop at the first free slot of a chain. So instead of leaving
+    // a hole, fill it with the next following entry that may legally move
+    // into it, which is an entry whose own chain starts at or before the
+    // hole. Repeat for the new hole this leaves behind.
+    char slot[8];
+    uint32_t hole = pos;
+    for (uint32_t i = pos + 1; i - hole < kMaxChainLength; i++) {
+      MXDBChainSlot(slot, suf, i);
+      key.SetSuffix(Slice(slot, sizeof(slot)));
+      xslice keyenc = xslice(key.data(), key.size());
+      xstatus st = dx_->Get(ropts, keyenc, &value);
+      if (st.IsNotFound()) {
+        break;
+      } else if (!st.ok()) {
+        return XSTATUS(st);
+      } else if (value.size() < kChainHeaderSize) {
+        return Status::Corruption("Cannot parse chain header");
+      }
+      const uint32_t distance = static_cast<unsigned char>(value[4]);
+      if (distance >= i - hole) {
+        value[4] = static_cast<char>(distance - (i - hole));
+        MXDBChainSlot(slot, suf, hole);
+        key.SetSuffix(Slice(slot, sizeof(slot)));
+        keyenc = xslice(key.data(), key.size());
+        t->bat.Put(keyenc, xslice(value));
+        hole = i;
+      }
+    }
+    MXDBChainSlot(slot, suf, hole);
+    key.SetSuffix(Slice(slot, sizeof(slot)));
+    t->bat.Delete(xslice(key.data(), key.size()));
+    if (tx == NULL) {
+      xstatus st = dx_->Write(*opt, &local.bat);
+      if (!st.ok()) {
+        s = XSTATUS(st);
+      }
+    }
+    return s;
+  }
   key.SetSuffix(suf);
   xslice keyenc = xslice(key.data(), key.size());
   if (tx == NULL) {
@@ -246,16 +418,18 @@ Status MXDB<DX, xslice, xstatus, fmt>::DELETE(  ////
   return s;
 }
 
-MXDBTEMDECL(DX, xslice, xstatus, fmt)
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
 template <typename Iter, typename KX, typename TX, typename OPT>
-typename MXDB<DX, xslice, xstatus, fmt>::template Dir<Iter>*
-MXDB<DX, xslice, xstatus, fmt>::OPENDIR(  ////
+typename MXDB<DX, xslice, xstatus, fmt, xreadoptions>::template Dir<Iter>*
+MXDB<DX, xslice, xstatus, fmt, xreadoptions>::OPENDIR(  ////
     const DirId& id, OPT* opt, TX* tx) {
   KX key_prefix(KEY_INITIALIZER(id, kDirEntType));
   if (tx != NULL) {
     opt->snapshot = tx->snap;
   }
-  xslice prefix = xslice(key_prefix.data(), key_prefix.size());
+  // Indexfs keys are never without suffixes, so only take the prefix
+  Slice encoding = key_prefix.prefix();
+  xslice prefix = xslice(encoding.data(), encoding.size());
   Iter* const iter = dx_->NewIterator(*opt);
   if (iter == NULL) {
     return NULL;
@@ -270,9 +444,9 @@ MXDB<DX, xslice, xstatus, fmt>::OPENDIR(  ////
   return dir;
 }
 
-MXDBTEMDECL(DX, xslice, xstatus, fmt)
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
 template <typename Iter>
-Status MXDB<DX, xslice, xstatus, fmt>::READDIR(  ////
+Status MXDB<DX, xslice, xstatus, fmt, xreadoptions>::READDIR(  ////
     Dir<Iter>* dir, Stat* stat, std::string* name) {
   if (dir == NULL) return Status::NotFound(Slice());
   Iter* const iter = dir->iter;
@@ -292,20 +466,38 @@ Status MXDB<DX, xslice, xstatus, fmt>::READDIR(  ////
   Slice key = Slice(xkey.data(), xkey.size());
   if (!key.starts_with(dir->key_prefix))  // Hitting the end of directory
     return Status::NotFound(Slice());
-  if (!stat->DecodeFrom(&input)) {
-    return Status::Corruption("Cannot parse Stat");
+  Slice filename;
+  if (fmt == kNameInValueChained) {
+    if (input.size() < kChainHeaderSize) {
+      return Status::Corruption("Cannot parse chain header");
+    }
+    input.remove_prefix(kChainHeaderSize);
+    if (!GetLengthPrefixedSlice(&input, &filename)) {
+      return Status::Corruption("Cannot parse filename");
+    }
   }
 
-  Slice filename;
+  // Names stored in keys are obtained without touching the value. So the
+  // value is decoded only when its stat is requested. In kNameInValue, names
+  // follow their stats, so stats are always decoded in that case.
+  Stat ignored;
+  if (stat != NULL || fmt == kNameInValue) {
+    if (!(stat != NULL ? stat : &ignored)->DecodeFrom(&input)) {
+      return Status::Corruption("Cannot parse Stat");
+    }
+  }
 
   if (fmt == kNameInKey) {
     key.remove_prefix(dir->key_prefix.length());
     filename = key;
-  } else if (!GetLengthPrefixedSlice(&input, &filename)) {
+  } else if (fmt == kNameInValue &&
+             !GetLengthPrefixedSlice(&input, &filename)) {
     return Status::Corruption("Cannot parse filename");
   }
 
-  *name = filename.ToString();
+  if (name != NULL) {
+    name->assign(filename.data(), filename.size());
+  }
   dir->n++;  // +1 entries scanned
   // Seek to the next entry
   iter->Next();
@@ -313,9 +505,9 @@ Status MXDB<DX, xslice, xstatus, fmt>::READDIR(  ////
   return Status::OK();
 }
 
-MXDBTEMDECL(DX, xslice, xstatus, fmt)
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
 template <typename Iter>
-void MXDB<DX, xslice, xstatus, fmt>::CLOSEDIR(  ////
+void MXDB<DX, xslice, xstatus, fmt, xreadoptions>::CLOSEDIR(  ////
     Dir<Iter>* dir) {
   if (dir != NULL) {
     delete dir->iter;
@@ -323,9 +515,9 @@ void MXDB<DX, xslice, xstatus, fmt>::CLOSEDIR(  ////
   }
 }
 
-MXDBTEMDECL(DX, xslice, xstatus, fmt)
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
 template <typename Iter, typename KX, typename TX, typename OPT>
-size_t MXDB<DX, xslice, xstatus, fmt>::LIST(  ////
+size_t MXDB<DX, xslice, xstatus, fmt, xreadoptions>::LIST(  ////
     const DirId& id, StatList* stats, NameList* names, OPT* opt, TX* tx,
     size_t limit) {
   KX prefix_key(KEY_INITIALIZER(id, kDirEntType));
@@ -346,14 +538,25 @@ size_t MXDB<DX, xslice, xstatus, fmt>::LIST(  ////
     Slice key = Slice(xkey.data(), xkey.size());
     if (!key.starts_with(prefix))  // Hitting end of directory
       break;
-    if (!stat.DecodeFrom(&input)) {
-      break;  // Error
+    if (fmt == kNameInValueChained) {
+      if (input.size() < kChainHeaderSize) {
+        break;  // Error
+      }
+      input.remove_prefix(kChainHeaderSize);
+      if (!GetLengthPrefixedSlice(&input, &name)) {
+        break;  // Error
+      }
+    }
+    if (stats != NULL || fmt == kNameInValue) {
+      if (!stat.DecodeFrom(&input)) {
+        break;  // Error
+      }
     }
 
     if (fmt == kNameInKey) {
       key.remove_prefix(prefix.size());
       name = key;
-    } else if (!GetLengthPrefixedSlice(&input, &name)) {
+    } else if (fmt == kNameInValue && !GetLengthPrefixedSlice(&input, &name)) {
       break;  // Error
     }
 
@@ -370,10 +573,10 @@ size_t MXDB<DX, xslice, xstatus, fmt>::LIST(  ////
   return num_entries;
 }
 
-MXDBTEMDECL(DX, xslice, xstatus, fmt)
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
 template <typename KX, typename TX, typename OPT>
-Status MXDB<DX, xslice, xstatus, fmt>::EXISTS(  ////
-    const DirId& id, const Slice& suf, OPT* opt, TX* tx) {
+Status MXDB<DX, xslice, xstatus, fmt, xreadoptions>::EXISTS(  ////
+    const DirId& id, const Slice& suf, OPT* opt, TX* tx, const Slice& fname) {
   Status s;
   KX key(KEY_INITIALIZER(id, kDirEntType));
   key.SetSuffix(suf);
@@ -382,6 +585,13 @@ Status MXDB<DX, xslice, xstatus, fmt>::EXISTS(  ////
     opt->snapshot = tx->snap;
   }
   std::string ignored;
+  if (fmt == kNameInValueChained) {
+    if (fname.empty()) {
+      return Status::InvalidArgument("Filename required");
+    }
+    uint32_t pos;
+    return FINDSLOT<KX>(id, suf, fname, opt, &pos, &ignored);
+  }
   xstatus st = dx_->Get(*opt, keyenc, &ignored);
   if (!st.ok()) {
     s = XSTATUS(st);
@@ -389,6 +599,50 @@ Status MXDB<DX, xslice, xstatus, fmt>::EXISTS(  ////
   return s;
 }
 
+MXDBTEMDECL(DX, xslice, xstatus, fmt, xreadoptions)
+template <typename KX, typename OPT>
+Status MXDB<DX, xslice, xstatus, fmt, xreadoptions>::FINDSLOT(  ////
+    const DirId& id, const Slice& hash, const Slice& fname, OPT* opt,
+    uint32_t* pos, std::string* value) {
+  if (hash.size() != 8) {
+    return Status::InvalidArgument("Key suffix is not an 8-byte hash");
+  }
+  const uint32_t fingerprint = MXDBFingerprint(fname);
+  KX key(KEY_INITIALIZER(id, kDirEntType));
+  char slot[8];
+  for (uint32_t i = 0; i < kMaxChainLength; i++) {
+    MXDBChainSlot(slot, hash, i);
+    key.SetSuffix(Slice(slot, sizeof(slot)));
+    xslice keyenc = xslice(key.data(), key.size());
+    xstatus st = dx_->Get(*opt, keyenc, value);
+    if (st.IsNotFound()) {
+      *pos = i;
+      return Status::NotFound(Slice());
+    } else if (!st.ok()) {
+      return XSTATUS(st);
+    } else if (value->size() < kChainHeaderSize) {
+      return Status::Corruption("Cannot parse chain header");
+    }
+    // Skip other filenames, including those overflowing from nearby hashes,
+    // mostly without looking at their names.
+    if (DecodeFixed32(value->data()) != fingerprint ||
+        static_cast<unsigned char>((*value)[4]) != i) {
+      continue;
+    }
+    Slice input(*value);
+    Slice filename;
+    input.remove_prefix(kChainHeaderSize);
+    if (!GetLengthPrefixedSlice(&input, &filename)) {
+      return Status::Corruption("Cannot parse filename");
+    } else if (filename == fname) {
+      *pos = i;
+      return Status::OK();
+    }
+  }
+  *pos = kMaxChainLength;
+  return Status::NotFound(Slice());
+}
+
 #undef KEY_INITIALIZER
 #undef XSTATUS
 #undef MXDBTEM
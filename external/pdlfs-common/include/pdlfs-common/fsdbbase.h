@@ -24,13 +24,26 @@ enum KeyType {
   kInoType = 7  // Dedicated inode entry that can be hard linked (tablefs only)
 };
 
+#if !defined(DELTAFS) && !defined(INDEXFS)
+// Number of bytes reserved for keys storing intact filenames. Such keys are
+// kept in an immediate buf space unless they are longer than this.
+#define FS_KEY_RESERV 128
+#endif
+
 // Keys for naming metadata stored in KV-stores. Each key has a type. In
 // general, a key consists of a prefix and a suffix. The prefix encodes parent
 // directory information and the type of the key. The suffix is typically either
 // a filename or a hash of it.
 class Key {
  public:
+#if defined(DELTAFS) || defined(INDEXFS)
   Key() {}  // Intentionally not initialized for performance.
+#else
+  Key() : rep_(buf_), size_(0), capacity_(sizeof(buf_)) {}
+  Key(const Key& other);
+  Key& operator=(const Key& other);
+  ~Key();
+#endif
   // Initialize a key using a given prefix encoding.
   explicit Key(const Slice& prefix);
 #if defined(DELTAFS_PROTO)
@@ -87,19 +100,11 @@ class Key {
   // Return the final encoding of key.
   Slice Encode() const { return Slice(data(), size()); }
 
-  // Return the raw bytes of a key. Indexfs uses immediate buf spaces.
-#if defined(DELTAFS) || defined(INDEXFS)
+  // Return the raw bytes of a key.
   size_t size() const { return size_; }
   const char* data() const { return rep_; }
   char* data() { return rep_; }
 
-  // Deltafs and tablefs use std::string.
-#else
-  size_t size() const { return rep_.size(); }
-  const char* data() const { return &rep_[0]; }
-  char* data() { return &rep_[0]; }
-#endif
-
  private:
   // Indexfs keys have a small fixed length. So we use an immediate buf space.
 #if defined(DELTAFS) || defined(INDEXFS)
@@ -107,10 +112,15 @@ class Key {
   char rep_[50];
   size_t size_;
 
-  // Deltafs and tablefs store intact filenames in keys.
-  // Filenames can be lengthy. So we use std::string.
+  // Deltafs and tablefs store intact filenames in keys. Most filenames are
+  // short enough for an immediate buf space. Lengthy ones go to the heap.
 #else
-  std::string rep_;
+  void Reset(size_t prefix_size);
+  void Append(const Slice& suff);
+  char* rep_;  // Either buf_ or a heap allocation
+  size_t size_;
+  size_t capacity_;
+  char buf_[FS_KEY_RESERV];
 #endif
 };
 
@@ -25,6 +25,7 @@ struct BlockContents;
 
 class Comparator;
 class Iterator;
+class Slice;
 
 class Block {
  public:
@@ -36,13 +37,29 @@ class Block {
   size_t size() const { return size_; }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Return an iterator positioned for a point lookup of "target", an
+  // internal key.  If the block carries a hash index, the index is used to
+  // jump directly to the restart interval holding the user key of "target".
+  // Otherwise, this is the same as NewIterator() followed by Seek(target).
+  // Unlike Seek(), the result is only guaranteed to be the first entry >=
+  // "target" when that entry has the same user key as "target". The
+  // iterator may be left invalid if no such entry exists.
+  Iterator* NewIteratorForGet(const Comparator* comparator,
+                              const Slice& target);
+
+  // Return true iff the block carries a hash index.
+  bool has_hash_index() const { return num_buckets_ != 0; }
+
  private:
   uint32_t NumRestarts() const;
 
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
-  bool owned_;               // Block owns data_[]
+  uint32_t num_restarts_;
+  uint32_t hash_offset_;  // Offset in data_ of hash buckets
+  uint32_t num_buckets_;  // 0 if there is no hash index
+  bool owned_;            // Block owns data_[]
 
   // No copying allowed
   void operator=(const Block&);
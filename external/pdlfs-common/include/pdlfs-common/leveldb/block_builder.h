@@ -20,6 +20,7 @@
 #include "pdlfs-common/slice.h"
 
 #include <stdint.h>
+#include <utility>
 #include <vector>
 
 namespace pdlfs {
@@ -110,6 +111,12 @@ class BlockBuilder : public AbstractBlockBuilder {
   // Set a new restart interval.
   void ChangeRestartInterval(int interval) { restart_interval_ = interval; }
 
+  // Append a hash index to the next block built so that point lookups
+  // can jump directly to the restart interval holding their key.  Keys
+  // must be internal keys.  Takes effect immediately if the current block is
+  // empty, or after the next Reset() otherwise.
+  void SetHashIndex(bool hash_index);
+
   // Reset the contents as if the BlockBuilder was just constructed.
   void Reset();
 
@@ -129,6 +136,13 @@ class BlockBuilder : public AbstractBlockBuilder {
   int counter_;                     // Number of entries emitted since restart
   std::string last_key_;
 
+  void FinishHashIndex();
+  bool next_hash_index_;
+  bool hash_index_;  // Build a hash index for the current block
+  // Hash of the user portion of each distinct key and the restart
+  // interval holding it, in insertion order
+  std::vector<std::pair<uint32_t, uint8_t> > hashes_;
+
   // No copying allowed
   void operator=(const BlockBuilder&);
   BlockBuilder(const BlockBuilder&);
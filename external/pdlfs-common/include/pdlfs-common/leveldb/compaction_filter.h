@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+namespace pdlfs {
+
+class Slice;
+
+// A database can be configured with a custom CompactionFilter object.
+// This object is consulted during background compactions to remove
+// entries that the application knows to be garbage, such as entries
+// belonging to deleted or migrated directories, without having to
+// write explicit deletion markers for them.
+//
+// Only the newest version of each key that is not newer than the oldest
+// live snapshot is passed to the filter.  A filtered entry disappears
+// from the database and from all live snapshots.  Deletion markers are
+// never passed to the filter.
+class CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // Return true if the entry with the specified user key and value should
+  // be removed from the database.  "level" is the level of the compaction
+  // inputs containing the entry.
+  //
+  // Implementations must be thread-safe and must not call back into the
+  // database.
+  virtual bool Filter(int level, const Slice& key,
+                      const Slice& value) const = 0;
+
+  // Return the name of this filter.  Used for logging only.
+  virtual const char* Name() const = 0;
+};
+
+}  // namespace pdlfs
@@ -33,10 +33,11 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kIdentityFile
 };
 
-static const int kMaxFileType = kInfoLogFile;
+static const int kMaxFileType = kIdentityFile;
 
 // Return the string name of file type.
 extern const char* NameOfType(FileType type);
@@ -81,6 +82,9 @@ extern std::string InfoLogFileName(const std::string& dbname);
 // Return the name of the old info log file for "dbname".
 extern std::string OldInfoLogFileName(const std::string& dbname);
 
+// Return the name of the identity file for "dbname".
+extern std::string IdentityFileName(const std::string& dbname);
+
 // If filename is a db-owned file, store the type of the file in *type.
 // The number encoded in the filename is stored in *number.  If the
 // filename was successfully parsed, returns true.  Else return false.
@@ -92,4 +96,10 @@ extern bool ParseFileName(const Slice& filename, uint64_t* number,
 extern Status SetCurrentFile(Env* env, const std::string& dbname,
                              uint64_t descriptor_number);
 
+// Read the identity of the db named by "dbname" into *identity, creating
+// a new identity if the db does not have one yet. Identities are unique
+// among dbs and among the incarnations of a db at the same location.
+extern Status GetDBIdentity(Env* env, const std::string& dbname,
+                            std::string* identity);
+
 }  // namespace pdlfs
@@ -25,6 +25,7 @@
 namespace pdlfs {
 
 class Block;
+class CompressionDict;
 class RandomAccessFile;
 
 struct ReadOptions;
@@ -95,10 +96,30 @@ struct BlockContents {
   bool heap_allocated;  // True iff caller should delete[] data.data()
 };
 
+// Data blocks may carry an optional hash index that maps the user portion
+// of each key to the restart interval holding it (see block_builder.cc).
+// The presence of the index is marked by the top bit of the num_restarts
+// field at the end of a block.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+// Bucket values: a restart index, or one of the following markers.
+static const uint8_t kBlockHashNoEntry = 255;
+static const uint8_t kBlockHashCollision = 254;
+// Blocks with more restarts than this are not hash indexed.
+static const uint32_t kBlockHashMaxRestarts = 253;
+
+// Return the portion of a block key that is hashed by a block hash index.
+// Block keys are expected to be internal keys, so this strips the 8-byte
+// sequence/type suffix.
+inline Slice BlockHashIndexKey(const Slice& key) {
+  return key.size() >= 8 ? Slice(key.data(), key.size() - 8) : key;
+}
+
 // Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// return non-OK.  On success fill *result and return OK.  "dict", if
+// not NULL, is the dictionary the block was compressed with.
 extern Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                        const BlockHandle& handle, BlockContents* result);
+                        const BlockHandle& handle, BlockContents* result,
+                        const CompressionDict* dict = NULL);
 
 // Implementation details follow.  Clients should ignore,
 inline BlockHandle::BlockHandle()
@@ -20,17 +20,30 @@
 #include "pdlfs-common/leveldb/types.h"
 
 #include <stddef.h>
+#include <vector>
 
 namespace pdlfs {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class PersistentCache;
 class Snapshot;
 class ThreadPool;
 
+// Compaction styles
+enum CompactionStyle {
+  // Keep a single sorted run per level, with each level level_factor times
+  // larger than the one above it
+  kCompactionStyleLevel = 0x0,
+  // Merge level-0 files together with similarly sized sorted runs below
+  // them, keeping at most one sorted run per level
+  kCompactionStyleUniversal = 0x1
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct DBOptions {
   // -------------------
@@ -95,6 +108,34 @@ struct DBOptions {
   // Default: 4MB
   size_t write_buffer_size;
 
+  // If positive, replay write-ahead logs at db open using a pipeline:
+  // one thread reads and verifies log records ahead of the thread inserting
+  // them into memtables, while full memtables are written to Level-0 tables
+  // by up to this many threads in the background.  If zero, logs are
+  // replayed by the opening thread alone.
+  //
+  // Default: 0
+  int recovery_threads;
+
+  // If non-zero, each memtable keeps a bloom filter of this many bytes over
+  // the user keys it holds.  Lookups of keys not in a memtable, such as the
+  // existence checks performed before every file creation, can then skip
+  // the memtable search in most cases.  About 10 bits per key are needed
+  // for a 1% false positive rate.  Not counted against write_buffer_size.
+  //
+  // Default: 0
+  size_t memtable_bloom_bytes;
+
+  // If non-zero, memtables hash entries by the first this many bytes of
+  // their keys into separate skiplists, one per distinct prefix, instead of
+  // keeping all entries in a single skiplist.  Inserts and point lookups
+  // then search a much shorter list.  Iterating over a memtable requires
+  // merging all of its lists and is slower.  Metadata keys in this
+  // library start with an 8-byte parent directory prefix.
+  //
+  // Default: 0
+  size_t memtable_prefix_len;
+
   // Control over open tables (max number of tables that can be opened).
   // You may need to increase this if your database has a large working set (
   // budget one open file per 2MB of working set).
@@ -113,6 +154,14 @@ struct DBOptions {
   // Default: NULL
   Cache* block_cache;
 
+  // If non-NULL, table reads missing the block cache are first looked up
+  // in this cache before they go to the Env.  Data read from the Env is
+  // added to the cache.  Useful when the Env is backed by remote storage
+  // and the cache by local storage.  The cache must not be shared with
+  // other DBs and should be emptied if the DB is destroyed and recreated.
+  // Default: NULL
+  PersistentCache* persistent_cache;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -136,6 +185,15 @@ struct DBOptions {
   // Default: 1
   int index_block_restart_interval;
 
+  // If true, append a compact hash index to each data block that maps keys
+  // to the restart interval holding them.  Point lookups use the index to
+  // skip the binary search over restart points and decode only the keys of
+  // a single restart interval.  Range scans are not affected.  Costs about
+  // one byte per distinct key in each data block.
+  //
+  // Default: false
+  bool data_block_hash_index;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -152,6 +210,25 @@ struct DBOptions {
   // efficiently detect that and will switch to uncompressed mode.
   CompressionType compression;
 
+  // If not empty, overrides "compression" for tables written by memtable
+  // dumps and compactions.  Tables at level L are compressed using
+  // entry min(L, size - 1).  A typical setup is to use a fast compressor
+  // such as kLZ4Compression for the upper levels and kZstdCompression for
+  // the bulk of the data at the last levels.
+  //
+  // Default: empty
+  std::vector<CompressionType> compression_per_level;
+
+  // If non-zero, tables compressed with kZstdCompression train a
+  // dictionary of at most this many bytes from their first entries and
+  // use it to compress all of their data blocks.  The dictionary is stored
+  // in the table.  Helps when blocks are small and many of them share
+  // common content, such as repeated key prefixes and value layouts.
+  // About 100 times this many bytes are buffered per table for training.
+  //
+  // Default: 0
+  size_t compression_dict_bytes;
+
   // If non-NULL, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
@@ -159,6 +236,12 @@ struct DBOptions {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If non-NULL, use the specified filter to drop application-level
+  // garbage during background compactions.  See compaction_filter.h.
+  //
+  // Default: NULL
+  const CompactionFilter* compaction_filter;
+
   // -------------------
   // Dangerous zone - parameters for experts
 
@@ -194,6 +277,16 @@ struct DBOptions {
   // Default: false
   bool disable_write_ahead_log;
 
+  // Compress write-ahead log records of at least "wal_compression_min_size"
+  // bytes using the specified compression algorithm.  Records that do not
+  // compress well are written as is.  Logs written with compression cannot
+  // be replayed by earlier versions of this library.
+  // Default: kNoCompression
+  CompressionType wal_compression;
+
+  // Default: 256
+  size_t wal_compression_min_size;
+
   // If true, no background compaction will be performed except for
   // those triggered by MemTable dumps.
   // All Tables will stay in Level-0 forever.
@@ -253,6 +346,30 @@ struct DBOptions {
   // Default: 12
   int l0_hard_limit;
 
+  // The compaction style to use.  Universal compaction rewrites data far
+  // fewer times than leveled compaction at the cost of more sorted runs to
+  // search on reads and more temporary space.  It suits workloads that
+  // mostly insert new keys and rarely overwrite existing ones.  In
+  // universal mode, seek-triggered compaction is disabled, memtables are
+  // always flushed to Level-0, and a compaction is started once Level-0
+  // reaches l0_compaction_trigger files.  All Level-0 files are then merged,
+  // along with any sorted runs below them of comparable size, into a single
+  // sorted run placed at the deepest level not occupied by older data.
+  // Default: kCompactionStyleLevel
+  CompactionStyle compaction_style;
+
+  // Universal compaction only.  A sorted run is merged with the newer runs
+  // above it if its size is at most (100 + universal_size_ratio) percent of
+  // their combined size.
+  // Default: 1
+  int universal_size_ratio;
+
+  // Universal compaction only.  All sorted runs are merged into one once
+  // the size of all runs other than the oldest one exceeds this percentage
+  // of the size of the oldest run.
+  // Default: 200
+  int universal_max_size_amplification_percent;
+
   DBOptions();
 };
 
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "pdlfs-common/slice.h"
+#include "pdlfs-common/status.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace pdlfs {
+
+class Env;
+
+struct PersistentCacheOptions {
+  PersistentCacheOptions();
+
+  // Env used to store cache files. Should be backed by fast local storage.
+  // Default: Env::Default()
+  Env* env;
+
+  // Max total size of all cache files. Oldest files are removed first when
+  // the cache becomes full.
+  // Default: 1GB
+  uint64_t capacity;
+
+  // Size of each cache file. Each cache file is written sequentially as a
+  // log of records.
+  // Default: 64MB
+  uint64_t file_size;
+
+  // Max total size of inserted data waiting to be written to cache files.
+  // Inserts are dropped when the limit is reached.
+  // Default: 4MB
+  uint64_t write_buffer_size;
+};
+
+// A second cache tier keeping blocks in files on local storage. Cached data
+// is indexed in memory and the index is rebuilt from cache files on open so
+// cached data survives restarts. Each record is checksummed. Torn or
+// corrupted records are ignored. Inserted data is written to cache files
+// in batches by a background thread scheduled through the env.
+//
+// A PersistentCache is safe for concurrent use by multiple threads.
+class PersistentCache {
+ public:
+  PersistentCache() {}
+  virtual ~PersistentCache();
+
+  // Open a cache stored in "dirname", creating the directory if needed.
+  static Status Open(const PersistentCacheOptions& options,
+                     const std::string& dirname, PersistentCache** result);
+
+  // Queue a copy of "data" to be stored under "key" and return without
+  // waiting for it to be written. Errors are not reported since caching is
+  // best-effort.
+  virtual void Insert(const Slice& key, const Slice& data) = 0;
+
+  // Wait until all data queued by earlier Insert() calls has been written
+  // or dropped.
+  virtual void Flush() = 0;
+
+  // If there is data stored under "key", copy it to *data and return true.
+  // Otherwise return false.
+  virtual bool Lookup(const Slice& key, std::string* data) = 0;
+
+  // Total size of all cache files.
+  virtual uint64_t TotalSize() = 0;
+
+ private:
+  // No copying allowed
+  void operator=(const PersistentCache&);
+  PersistentCache(const PersistentCache&);
+};
+
+}  // namespace pdlfs
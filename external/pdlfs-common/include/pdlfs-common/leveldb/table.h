@@ -81,18 +81,24 @@ class Table {
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void* table, const ReadOptions& options,
                                const Slice& block_handle);
+  // Same as BlockReader(), but if "get_target" is not NULL, return an
+  // iterator positioned for a point lookup of *get_target.
+  static Iterator* BlockReader(void* table, const ReadOptions& options,
+                               const Slice& block_handle,
+                               const Slice* get_target);
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key).  May not make such a call if filter policy or the block's
+  // hash index says that key is not present.
   friend class TableCache;
   Status InternalGet(const ReadOptions& options, const Slice& key, void* arg,
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
-  void ReadMeta(const Footer& footer);
+  Status ReadMeta(const Footer& footer);
   void ReadProperties(const Slice& props_handle_value);
   void ReadFilter(const Slice& filter_handle_value);
+  Status ReadDict(const Slice& dict_handle_value);
 
   // No copying allowed
   void operator=(const Table&);
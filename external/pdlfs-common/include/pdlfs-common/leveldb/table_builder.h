@@ -32,6 +32,7 @@ namespace pdlfs {
 
 class BlockBuilder;
 class BlockHandle;
+class CompressionDict;
 class WritableFile;
 class TableProperties;
 
@@ -95,13 +96,16 @@ class TableBuilder {
   uint64_t FileSize() const;
 
  private:
-  void WriteBlock(const Slice& block_contents, BlockHandle* handle);
+  void WriteBlock(const Slice& block_contents, BlockHandle* handle,
+                  const CompressionDict* dict = NULL);
   void WriteRawBlock(const Slice& raw_block_contents, CompressionType,
                      BlockHandle* handle);
 
   bool ok() const { return status().ok(); }
 
   void AddBlock(BlockBuilder* builder, BlockHandle* handle);
+  void AddEntry(const Slice& key, const Slice& value);
+  void MaybeTrainDict();
 
   struct Rep;
   Rep* rep_;
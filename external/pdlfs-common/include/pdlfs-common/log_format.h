@@ -28,9 +28,15 @@ enum RecordType {
   // For fragments
   kFirstType = 2,
   kMiddleType = 3,
-  kLastType = 4
+  kLastType = 4,
+
+  // Same as kFullType and kFirstType, but the logical record they start is
+  // compressed. Its payload is a one-byte CompressionType followed by the
+  // compressed contents. Continuations use kMiddleType and kLastType.
+  kCompressedFullType = 5,
+  kCompressedFirstType = 6
 };
-static const int kMaxRecordType = kLastType;
+static const int kMaxRecordType = kCompressedFirstType;
 
 static const int kBlockSize = 32768;
 
@@ -21,6 +21,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string>
 
 namespace pdlfs {
 
@@ -80,6 +81,9 @@ class Reader {
   Slice buffer_;
   bool eof_;  // Last Read() indicated EOF by returning < kBlockSize
 
+  // Holds the contents of the last compressed record returned by ReadRecord
+  std::string uncompressed_;
+
   // Offset of the last record returned by ReadRecord.
   uint64_t last_record_offset_;
   // Offset of the first location past the end of buffer_.
@@ -112,6 +116,10 @@ class Reader {
   // Return type, or one of the preceding special values
   unsigned int ReadPhysicalRecord(Slice* result);
 
+  // Replace a compressed logical record with its contents. Returns false
+  // and reports a drop if the record cannot be uncompressed.
+  bool Uncompress(Slice* record);
+
   // Reports dropped bytes to the reporter.
   // buffer_ must be updated to remove the dropped bytes prior to invocation.
   void ReportCorruption(uint64_t bytes, const char* reason);
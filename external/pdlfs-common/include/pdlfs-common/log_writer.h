@@ -16,11 +16,13 @@
  */
 #pragma once
 
+#include "pdlfs-common/compression_type.h"
 #include "pdlfs-common/log_format.h"
 #include "pdlfs-common/status.h"
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string>
 
 namespace pdlfs {
 
@@ -45,6 +47,12 @@ class Writer {
   // Return the position of the writing cursor.
   uint64_t CurrentOffset() const { return offset_; }
 
+  // Compress records of at least "min_size" bytes using "type" before
+  // writing them. Records that do not shrink by at least 1/8 are written
+  // as is. Readers must understand compressed record types.
+  // Default: kNoCompression
+  void SetCompression(CompressionType type, size_t min_size);
+
   Status AddRecord(const Slice& slice);
 
   // Call Sync() on the destination file.
@@ -54,6 +62,9 @@ class Writer {
   WritableFile* dest_;
   int block_offset_;  // Offset in the block currently being written
   int offset_;        // Current offset in file
+  CompressionType compression_;
+  size_t min_compression_size_;
+  std::string compressed_;  // Scratch space for compressed records
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
@@ -61,6 +72,7 @@ class Writer {
   uint32_t type_crc_[kMaxRecordType + 1];
 
   Status EmitPhysicalRecord(RecordType type, const char* ptr, size_t length);
+  Status EmitRecord(const Slice& slice, bool compressed);
 
   // No copying allowed
   void operator=(const Writer&);
@@ -24,6 +24,31 @@ class WritableFile;
 
 class Env;
 
+// Options controlling a packed osd (see Osd::OpenPacked()).
+struct PackedOsdOptions {
+  PackedOsdOptions();
+
+  // Env used to store segment files.  If NULL, the result of Env::Default()
+  // will be used.  The "*env" must remain live while the osd is in use.
+  // Default: NULL
+  Env* env;
+
+  // Start a new segment once the active segment has grown beyond this
+  // many bytes.
+  // Default: 64MB
+  uint64_t segment_size;
+
+  // Sync the active segment once this many bytes have been written to it
+  // since the last sync.  Set to 0 to sync after every update.
+  // Default: 1MB
+  uint64_t bytes_per_sync;
+
+  // A sealed segment is rewritten by a background compaction once less
+  // than this percentage of its bytes belongs to live objects.
+  // Default: 50
+  int compaction_threshold;
+};
+
 // OSD is an abstract interface for accessing objects stored in an underlying
 // object store with a flat namespace. This underlying object store can
 // potentially be Ceph RADOS, Amazon S3, LinkedIn Ambry, Openstack Swift, and
@@ -49,6 +74,17 @@ class Osd {
   // remain live while the result is in use.
   static Osd* FromEnv(const char* prefix, Env* env = NULL);
 
+  // Open an Osd instance that packs objects into large append-only segment
+  // files stored under the specified directory prefix, with an in-memory
+  // index locating each object.  Space held by deleted or overwritten objects
+  // is reclaimed by background segment compactions.  Segments written by a
+  // previous instance are recovered.  Best suited for large numbers of small
+  // objects.  On success, stores a pointer to the result in *result and
+  // returns OK.  The caller must delete the result when it is no longer
+  // needed, and after all objects opened through it have been deleted.
+  static Status OpenPacked(const char* prefix, const PackedOsdOptions& options,
+                           Osd** result);
+
   // Create a brand new sequentially-readable object with the specified name.
   // On success, stores a pointer to the new object in *r and returns OK.
   // On failure stores NULL in *r and returns non-OK.  If the object does not
@@ -61,6 +61,13 @@
 #ifdef PDLFS_SNAPPY
 #include <snappy.h>
 #endif
+#ifdef PDLFS_LZ4
+#include <lz4.h>
+#endif
+#ifdef PDLFS_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
 #include "pdlfs-common/atomic_pointer.h"  // Platform-specific atomic pointer
 
 #include <limits.h>
@@ -185,6 +192,157 @@ inline bool Snappy_Uncompress(const char* input, size_t length, char* output) {
 #endif
 }
 
+inline bool LZ4_Compress(const char* input, size_t length,
+                         ::std::string* output) {
+#ifdef PDLFS_LZ4
+  const int bound = LZ4_compressBound(static_cast<int>(length));
+  output->resize(bound);
+  const int outlen = LZ4_compress_default(input, &(*output)[0],
+                                          static_cast<int>(length), bound);
+  output->resize(outlen > 0 ? outlen : 0);
+  return outlen > 0;
+#endif
+
+  return false;
+}
+
+// The uncompressed length is not stored by lz4 and must be known by callers.
+inline bool LZ4_Uncompress(const char* input, size_t length, char* output,
+                           size_t output_length) {
+#ifdef PDLFS_LZ4
+  const int n =
+      LZ4_decompress_safe(input, output, static_cast<int>(length),
+                          static_cast<int>(output_length));
+  return n >= 0 && static_cast<size_t>(n) == output_length;
+#else
+  return false;
+#endif
+}
+
+// Zstd dictionaries are digested once and then shared by all compression
+// (or decompression) calls using them.
+inline void* Zstd_NewCompressionDict(const char* dict, size_t length,
+                                     int level) {
+#ifdef PDLFS_ZSTD
+  return ZSTD_createCDict(dict, length, level);
+#else
+  return NULL;
+#endif
+}
+
+inline void Zstd_DeleteCompressionDict(void* cdict) {
+#ifdef PDLFS_ZSTD
+  ZSTD_freeCDict(static_cast<ZSTD_CDict*>(cdict));
+#endif
+}
+
+inline void* Zstd_NewDecompressionDict(const char* dict, size_t length) {
+#ifdef PDLFS_ZSTD
+  return ZSTD_createDDict(dict, length);
+#else
+  return NULL;
+#endif
+}
+
+inline void Zstd_DeleteDecompressionDict(void* ddict) {
+#ifdef PDLFS_ZSTD
+  ZSTD_freeDDict(static_cast<ZSTD_DDict*>(ddict));
+#endif
+}
+
+#ifdef PDLFS_ZSTD
+// Zstd contexts are large and costly to set up, so each thread keeps one
+// compression and one decompression context for reuse. Return NULL if a
+// context cannot be allocated.
+extern ZSTD_CCtx* Zstd_ThreadCompressionContext();
+extern ZSTD_DCtx* Zstd_ThreadDecompressionContext();
+#endif
+
+// "cdict" may be NULL, in which case no dictionary is used.
+inline bool Zstd_Compress(const char* input, size_t length, int level,
+                          const void* cdict, ::std::string* output) {
+#ifdef PDLFS_ZSTD
+  ZSTD_CCtx* const ctx = Zstd_ThreadCompressionContext();
+  if (ctx == NULL) {
+    return false;
+  }
+  output->resize(ZSTD_compressBound(length));
+  size_t outlen;
+  if (cdict != NULL) {
+    outlen = ZSTD_compress_usingCDict(ctx, &(*output)[0], output->size(),
+                                      input, length,
+                                      static_cast<const ZSTD_CDict*>(cdict));
+  } else {
+    outlen = ZSTD_compressCCtx(ctx, &(*output)[0], output->size(), input,
+                               length, level);
+  }
+  if (ZSTD_isError(outlen)) {
+    output->clear();
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#endif
+
+  return false;
+}
+
+inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result) {
+#ifdef PDLFS_ZSTD
+  const unsigned long long n = ZSTD_getFrameContentSize(input, length);
+  if (n == ZSTD_CONTENTSIZE_UNKNOWN || n == ZSTD_CONTENTSIZE_ERROR) {
+    return false;
+  }
+  *result = static_cast<size_t>(n);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// "ddict" may be NULL, in which case no dictionary is used.
+inline bool Zstd_Uncompress(const char* input, size_t length,
+                            const void* ddict, char* output,
+                            size_t output_length) {
+#ifdef PDLFS_ZSTD
+  ZSTD_DCtx* const ctx = Zstd_ThreadDecompressionContext();
+  if (ctx == NULL) {
+    return false;
+  }
+  size_t n;
+  if (ddict != NULL) {
+    n = ZSTD_decompress_usingDDict(ctx, output, output_length, input, length,
+                                   static_cast<const ZSTD_DDict*>(ddict));
+  } else {
+    n = ZSTD_decompressDCtx(ctx, output, output_length, input, length);
+  }
+  return !ZSTD_isError(n) && n == output_length;
+#else
+  return false;
+#endif
+}
+
+// Train a dictionary of at most "max_length" bytes from "num_samples"
+// samples stored back to back in "samples".
+inline bool Zstd_TrainDict(const char* samples, const size_t* sample_sizes,
+                           unsigned num_samples, size_t max_length,
+                           ::std::string* dict) {
+#ifdef PDLFS_ZSTD
+  dict->resize(max_length);
+  const size_t n = ZDICT_trainFromBuffer(&(*dict)[0], max_length, samples,
+                                         sample_sizes, num_samples);
+  if (ZDICT_isError(n)) {
+    dict->clear();
+    return false;
+  }
+  dict->resize(n);
+  return true;
+#endif
+
+  return false;
+}
+
 inline bool GetHeapProfile(void (*)(void*, const char*, int), void*) {
   return false;
 }
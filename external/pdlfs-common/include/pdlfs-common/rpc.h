@@ -82,7 +82,18 @@ struct RPCOptions {
   // Max number of server addrs that may be cached locally
   size_t addr_cache_size;  //  Default: 128
 
-  // Options specific to the socket rpc engine
+  // Options specific to the socket rpc engine. Uris starting with "udp://" or
+  // "tcp://" select UDP or TCP for all messages. Uris starting with
+  // "hybrid://" select a hybrid transport sending messages over UDP when
+  // they fit in a datagram (see udp_max_unexpected_msgsz and
+  // udp_max_expected_msgsz) and over TCP otherwise. Under the hybrid
+  // transport, lost UDP messages are resent and the server remembers recent
+  // replies so that each call is executed at most once.
+
+  // Time to wait for a reply before resending a request over UDP. Only used
+  // by the hybrid transport.
+  // Default: 200 ms
+  uint64_t udp_retransmit_timeout;  // In microseconds
 
   // Max unexpected message size in bytes for UDP communication.
   // Default: 1432
@@ -210,6 +221,26 @@ class If {
   // Return OK on success, or a non-OK status on errors.
   // Must not throw any exceptions.
   virtual Status Call(Message& in, Message& out) RPCNOEXCEPT = 0;
+
+  // Invoked exactly once for each asynchronous call with the final status
+  // of the call and the "arg" passed to CallAsync().
+  typedef void (*Callback)(const Status& status, void* arg);
+
+  // Start a call without waiting for its reply so that a single thread may
+  // keep many calls outstanding. "in" and "out" must remain valid until
+  // "done" is invoked. "done" is invoked on the calling thread, either from
+  // within CallAsync() if the call finishes immediately or from within a
+  // later Progress() call. The default implementation performs a synchronous
+  // Call() and is used by engines lacking native support for asynchronous
+  // calls. Must not throw any exceptions.
+  virtual void CallAsync(Message& in, Message& out, Callback done,
+                         void* arg) RPCNOEXCEPT;
+
+  // Progress outstanding asynchronous calls, invoking the callbacks of those
+  // that finish. Wait up to "timeout" microseconds for at least one call to
+  // finish. Return the number of calls still outstanding. The default
+  // implementation returns 0 immediately.
+  virtual int Progress(uint64_t timeout) RPCNOEXCEPT;
   virtual ~If();
   If() {}
 
@@ -219,5 +250,32 @@ class If {
   If(const If&);
 };
 
+// A future for the result of an asynchronous call. Example:
+//
+//   rpc::Future f;
+//   stub->CallAsync(in, out, rpc::Future::Done, &f);
+//   ...  // Start more calls
+//   Status s = f.Wait(stub);
+class Future {
+ public:
+  Future() : done_(false) {}
+
+  // Callback to pass to If::CallAsync() along with the future.
+  static void Done(const Status& status, void* arg);
+
+  // Progress calls on "stub" until this call finishes. Return its status.
+  Status Wait(If* stub);
+
+  bool done() const { return done_; }
+  const Status& status() const { return status_; }
+
+ private:
+  // No copying allowed
+  void operator=(const Future&);
+  Future(const Future&);
+  Status status_;
+  bool done_;
+};
+
 }  // namespace rpc
 }  // namespace pdlfs
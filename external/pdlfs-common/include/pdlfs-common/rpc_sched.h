@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "pdlfs-common/hashmap.h"
+#include "pdlfs-common/histogram.h"
+#include "pdlfs-common/port.h"
+#include "pdlfs-common/rpc.h"
+
+#include <deque>
+#include <string>
+
+namespace pdlfs {
+
+// Maps incoming requests to scheduling classes. A class typically combines
+// the id of the client (or job) that sent a request and the type of the
+// operation, both of which are decoded from the request.
+class RPCClassifier {
+ public:
+  RPCClassifier() {}
+  virtual ~RPCClassifier();
+
+  // Return the class of a request.
+  virtual uint64_t Classify(const rpc::If::Message& in) = 0;
+
+  // Return the relative share of a class. When classes compete, each class
+  // gets to execute a number of calls proportional to its weight. Must be
+  // at least 1. The default implementation returns 1 for all classes.
+  virtual int Weight(uint64_t cls);
+
+  // Set the reply to a request rejected or dropped by the scheduler with a
+  // given status. Return true if a reply has been set, in which case the
+  // scheduler returns OK and the reply is sent to the client in place of
+  // the result of the call. Otherwise the call fails with the status, which
+  // only some rpc engines are able to report to the client. The default
+  // implementation returns false.
+  virtual bool EncodeRejection(const Status& status,
+                               const rpc::If::Message& in,
+                               rpc::If::Message& out);
+
+ private:
+  // No copying allowed
+  void operator=(const RPCClassifier&);
+  RPCClassifier(const RPCClassifier&);
+};
+
+struct RPCSchedulerOptions {
+  RPCSchedulerOptions();
+
+  // Max number of calls executed at the same time. Calls beyond this wait
+  // in the queue of their class.
+  // Default: 4
+  int max_outstanding_calls;
+
+  // Max number of calls waiting in the queue of each class. Calls arriving
+  // at a full queue are rejected with Status::BufferFull.
+  // Default: 64
+  size_t max_queue_depth;
+
+  // Calls that have waited longer than this amount of time by the time they
+  // would start are dropped with Status::TryAgain instead of executed.
+  // Set to 0 to never drop calls.
+  // Default: 0
+  uint64_t max_wait_micros;
+
+  // Once more than this number of classes have been seen, classes without
+  // waiting calls are forgotten along with their stats.
+  // Default: 1024
+  size_t max_classes;
+
+  // If NULL, all calls belong to a single class and are executed in
+  // arrival order.
+  // Default: NULL
+  RPCClassifier* classifier;
+};
+
+struct RPCSchedulerStats {
+  RPCSchedulerStats();
+  uint64_t calls;     // Calls executed
+  uint64_t rejected;  // Calls rejected due to a full queue
+  uint64_t expired;   // Calls dropped after waiting too long
+  size_t queue_depth;
+  size_t max_queue_depth;
+  Histogram wait_micros;  // Time spent in queue by executed calls
+};
+
+// Admission control and fair queuing in front of an rpc::If server
+// callback. Install by passing the scheduler instead of the callback as
+// RPCOptions::fs or to RPCServer. Calls of competing classes are executed
+// in weighted deficit round-robin order. The scheduler blocks the threads
+// calling it, so it only reorders calls if the rpc engine hands calls to
+// more threads than max_outstanding_calls, such as through a large
+// RPCOptions::extra_workers pool. Rejected and dropped calls are not
+// executed. They return a non-OK status unless the classifier encodes the
+// rejection in the reply. Thread-safe.
+class RPCScheduler : public rpc::If {
+ public:
+  RPCScheduler(const RPCSchedulerOptions& options, rpc::If* fs);
+  virtual ~RPCScheduler();
+
+  virtual Status Call(Message& in, Message& out) RPCNOEXCEPT;
+
+  // Return the stats of a class. Return false if no call of the class has
+  // been seen or if the class has since been forgotten.
+  bool GetStats(uint64_t cls, RPCSchedulerStats* stats);
+
+  // Return a summary of the stats of all classes.
+  std::string GetUsageInfo();
+
+ private:
+  struct Waiter;
+  struct Class;
+  Class* GetClass(uint64_t cls);
+  // Forget idle classes if there are too many classes.
+  void MaybeForgetClasses();
+  Status Reject(const Status& status, Message& in, Message& out);
+  void Dispatch();
+  const RPCSchedulerOptions options_;
+  rpc::If* const fs_;
+  // State below is protected by mutex_
+  port::Mutex mutex_;
+  HashMap<Class> classes_;
+  size_t num_classes_;
+  size_t next_sweep_;  // Number of classes at which to forget idle classes
+  std::deque<Class*> active_;  // Classes with waiting calls
+  int running_;  // Number of calls being executed
+};
+
+}  // namespace pdlfs
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/compression.h"
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/port.h"
+
+#include <string.h>
+
+namespace pdlfs {
+
+// Compression level used for kZstdCompression.
+static const int kZstdLevel = 3;
+
+CompressionDict::CompressionDict(const Slice& contents, bool for_compression)
+    : contents_(contents.data(), contents.size()), cdict_(NULL), ddict_(NULL) {
+  if (for_compression) {
+    cdict_ = port::Zstd_NewCompressionDict(contents_.data(), contents_.size(),
+                                           kZstdLevel);
+  } else {
+    ddict_ =
+        port::Zstd_NewDecompressionDict(contents_.data(), contents_.size());
+  }
+}
+
+CompressionDict::~CompressionDict() {
+  if (cdict_ != NULL) port::Zstd_DeleteCompressionDict(cdict_);
+  if (ddict_ != NULL) port::Zstd_DeleteDecompressionDict(ddict_);
+}
+
+bool Compress(CompressionType type, const Slice& input, std::string* output,
+              const CompressionDict* dict) {
+  switch (type) {
+    case kNoCompression:
+      output->assign(input.data(), input.size());
+      return true;
+    case kSnappyCompression:
+      return port::Snappy_Compress(input.data(), input.size(), output);
+    case kLZ4Compression: {
+      // lz4 does not record the uncompressed length so we prepend it
+      std::string tmp;
+      if (!port::LZ4_Compress(input.data(), input.size(), &tmp)) {
+        return false;
+      }
+      output->clear();
+      PutVarint32(output, static_cast<uint32_t>(input.size()));
+      output->append(tmp);
+      return true;
+    }
+    case kZstdCompression:
+      return port::Zstd_Compress(input.data(), input.size(), kZstdLevel,
+                                 dict != NULL ? dict->zstd_cdict() : NULL,
+                                 output);
+  }
+  return false;
+}
+
+bool Uncompress(CompressionType type, const Slice& input, char** buf,
+                size_t* size, const CompressionDict* dict) {
+  const char* data = input.data();
+  size_t n = input.size();
+  size_t ulength = 0;
+  switch (type) {
+    case kNoCompression:
+      ulength = n;
+      break;
+    case kSnappyCompression:
+      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+        return false;
+      }
+      break;
+    case kLZ4Compression: {
+      Slice in = input;
+      uint32_t len;
+      if (!GetVarint32(&in, &len)) {
+        return false;
+      }
+      data = in.data();
+      n = in.size();
+      ulength = len;
+      break;
+    }
+    case kZstdCompression:
+      if (!port::Zstd_GetUncompressedLength(data, n, &ulength)) {
+        return false;
+      }
+      break;
+    default:
+      return false;
+  }
+
+  char* const ubuf = new char[ulength > 0 ? ulength : 1];
+  bool ok = false;
+  switch (type) {
+    case kNoCompression:
+      memcpy(ubuf, data, n);
+      ok = true;
+      break;
+    case kSnappyCompression:
+      ok = port::Snappy_Uncompress(data, n, ubuf);
+      break;
+    case kLZ4Compression:
+      ok = port::LZ4_Uncompress(data, n, ubuf, ulength);
+      break;
+    case kZstdCompression:
+      ok = port::Zstd_Uncompress(data, n,
+                                 dict != NULL ? dict->zstd_ddict() : NULL,
+                                 ubuf, ulength);
+      break;
+  }
+  if (!ok) {
+    delete[] ubuf;
+    return false;
+  }
+  *buf = ubuf;
+  *size = ulength;
+  return true;
+}
+
+bool Uncompress(CompressionType type, const Slice& input, std::string* output,
+                const CompressionDict* dict) {
+  char* buf;
+  size_t size;
+  if (!Uncompress(type, input, &buf, &size, dict)) {
+    return false;
+  }
+  output->assign(buf, size);
+  delete[] buf;
+  return true;
+}
+
+bool TrainCompressionDict(const Slice& samples,
+                          const std::vector<size_t>& sample_sizes,
+                          size_t max_size, std::string* dict) {
+  if (sample_sizes.empty()) {
+    return false;
+  }
+  return port::Zstd_TrainDict(samples.data(), &sample_sizes[0],
+                              static_cast<unsigned>(sample_sizes.size()),
+                              max_size, dict);
+}
+
+bool CompressionTypeSupported(CompressionType type) {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  return Compress(type, in, &out);
+}
+
+}  // namespace pdlfs
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/compression.h"
+#include "pdlfs-common/random.h"
+#include "pdlfs-common/testharness.h"
+#include "pdlfs-common/testutil.h"
+
+#include <stdio.h>
+
+namespace pdlfs {
+
+class CompressionTest {
+ public:
+  // Return a small json-like record sharing most of its layout with others.
+  static std::string Record(Random* rnd, int i) {
+    char tmp[200];
+    snprintf(tmp, sizeof(tmp),
+             "{\"id\": %d, \"name\": \"user%d\", \"group\": \"g%d\", "
+             "\"mode\": %o}",
+             i, int(rnd->Uniform(1000)), int(rnd->Uniform(10)),
+             int(rnd->Uniform(0777)));
+    return tmp;
+  }
+};
+
+TEST(CompressionTest, RoundTrip) {
+  const CompressionType types[] = {kNoCompression, kSnappyCompression,
+                                   kLZ4Compression, kZstdCompression};
+  Random rnd(301);
+  std::string input;
+  while (input.size() < 64 << 10) {
+    input += Record(&rnd, static_cast<int>(input.size()));
+  }
+  for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    if (!CompressionTypeSupported(types[i])) {
+      fprintf(stderr, "Skipping compression type %d\n", int(types[i]));
+      continue;
+    }
+    std::string compressed;
+    ASSERT_TRUE(Compress(types[i], input, &compressed));
+    if (types[i] != kNoCompression) {
+      ASSERT_LT(compressed.size(), input.size() / 2);
+    }
+    std::string output;
+    ASSERT_TRUE(Uncompress(types[i], compressed, &output));
+    ASSERT_EQ(output, input);
+    // Corrupted inputs are detected
+    if (types[i] != kNoCompression) {
+      compressed.resize(compressed.size() / 2);
+      ASSERT_TRUE(!Uncompress(types[i], compressed, &output));
+    }
+  }
+}
+
+TEST(CompressionTest, Dictionary) {
+  if (!CompressionTypeSupported(kZstdCompression)) {
+    fprintf(stderr, "Skipping zstd tests\n");
+    return;
+  }
+  Random rnd(301);
+  std::string samples;
+  std::vector<size_t> sizes;
+  for (int i = 0; i < 2000; i++) {
+    std::string r = Record(&rnd, i);
+    samples += r;
+    sizes.push_back(r.size());
+  }
+  std::string contents;
+  ASSERT_TRUE(TrainCompressionDict(samples, sizes, 2048, &contents));
+  ASSERT_TRUE(contents.size() <= 2048);
+  CompressionDict cdict(contents, true);
+  CompressionDict ddict(contents, false);
+  size_t plain = 0;
+  size_t with_dict = 0;
+  for (int i = 0; i < 100; i++) {
+    const std::string input = Record(&rnd, 10000 + i);
+    std::string compressed;
+    std::string output;
+    ASSERT_TRUE(Compress(kZstdCompression, input, &compressed));
+    plain += compressed.size();
+    ASSERT_TRUE(Compress(kZstdCompression, input, &compressed, &cdict));
+    with_dict += compressed.size();
+    ASSERT_TRUE(Uncompress(kZstdCompression, compressed, &output, &ddict));
+    ASSERT_EQ(output, input);
+  }
+  ASSERT_LT(with_dict, plain / 2);
+}
+
+}  // namespace pdlfs
+
+int main(int argc, char** argv) {
+  return ::pdlfs::test::RunAllTests(&argc, &argv);
+}
@@ -10,7 +10,9 @@
  */
 #include "ectrie/bit_vector.h"
 #include "ectrie/trie.h"
+#include "ectrie/twolevel_bucketing.h"
 
+#include "pdlfs-common/coding.h"
 #include "pdlfs-common/ect.h"
 
 #include <vector>
@@ -28,18 +30,20 @@ class ECTCoder {
     return &singleton;
   }
 
+  // Decode the trie starting at bit "iter" of the encoding. The first
+  // "skip_bits" bits of all keys in the trie are assumed to be the same.
   template <typename T>
   size_t Decode(const T& encoding, const uint8_t* key, size_t k_len,
-                size_t num_k) const {
-    size_t iter = 0;
-    size_t rank = trie_.locate(encoding, iter, key, k_len, 0, num_k);
+                size_t num_k, size_t iter = 0, size_t skip_bits = 0) const {
+    size_t rank =
+        trie_.locate(encoding, iter, key, k_len, 0, num_k, 0, 1, skip_bits);
     return rank;
   }
 
   template <typename T>
-  void Encode(T& encoding, size_t k_len, size_t num_k,
-              const uint8_t** keys) const {
-    trie_.encode(encoding, keys, k_len, 0, num_k);
+  void Encode(T& encoding, size_t k_len, size_t num_k, const uint8_t** keys,
+              size_t skip_bits = 0) const {
+    trie_.encode(encoding, keys, k_len, 0, num_k, 0, 1, skip_bits);
   }
 
  private:
@@ -51,6 +55,41 @@ class ECTCoder {
   trie_t trie_;
 };
 
+// Leading byte of serialized indexes.
+enum ECTType { kDefaultECT = 0, kBucketedECT = 1 };
+
+typedef ectrie::bit_vector<> bitvec_t;
+
+void EncodeBits(const bitvec_t& bits, std::string* dst) {
+  PutVarint64(dst, bits.size());
+  size_t i = 0;
+  for (; i + 32 <= bits.size(); i += 32) {
+    PutFixed32(dst, bits.get<uint32_t>(i, 32));
+  }
+  if (i < bits.size()) {
+    PutFixed32(dst, bits.get<uint32_t>(i, bits.size() - i));
+  }
+}
+
+bool DecodeBits(Slice* input, bitvec_t* bits) {
+  uint64_t size;
+  if (!GetVarint64(input, &size) || (size + 31) / 32 > input->size() / 4) {
+    return false;
+  }
+  bits->clear();
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    bits->append(DecodeFixed32(input->data()), 32);
+    input->remove_prefix(4);
+  }
+  if (i < size) {
+    bits->append(DecodeFixed32(input->data()), size - i);
+    input->remove_prefix(4);
+  }
+  bits->compact();
+  return true;
+}
+
 class ECTIndex : public ECT {
  public:
   ECTIndex(size_t k_len) : key_len_(k_len), n_(0) {}
@@ -73,13 +112,167 @@ class ECTIndex : public ECT {
     n_ = n;
   }
 
+  virtual void EncodeTo(std::string* dst) const {
+    dst->push_back(static_cast<char>(kDefaultECT));
+    PutVarint64(dst, key_len_);
+    PutVarint64(dst, n_);
+    EncodeBits(bitvec_, dst);
+  }
+
+  // Restore the state written by EncodeTo() after the key length.
+  bool DecodeFrom(Slice* input) {
+    uint64_t n;
+    if (!GetVarint64(input, &n) || !DecodeBits(input, &bitvec_)) {
+      return false;
+    }
+    n_ = n;
+    return true;
+  }
+
  private:
-  typedef ectrie::bit_vector<> bitvec_t;
   bitvec_t bitvec_;
   size_t key_len_;
   size_t n_;
 };
 
+// Return the first "bits" bits of a key as an integer. Requires bits <= 32.
+inline size_t KeyPrefix(const uint8_t* key, size_t key_len, size_t bits) {
+  if (bits == 0) return 0;
+  uint64_t v = 0;
+  for (size_t i = 0; i < 8; i++) {
+    v = (v << 8) | (i < key_len ? key[i] : 0);
+  }
+  return static_cast<size_t>(v >> (64 - bits));
+}
+
+class BucketedECTIndex : public ECT {
+ public:
+  BucketedECTIndex(size_t k_len, size_t keys_per_bucket)
+      : key_len_(k_len),
+        keys_per_bucket_(keys_per_bucket != 0 ? keys_per_bucket : 1),
+        n_(0),
+        bucket_bits_(0) {}
+  virtual ~BucketedECTIndex() {}
+
+  virtual size_t MemUsage() const {
+    return bitvec_.size() + bucketing_.bit_size();
+  }
+
+  virtual size_t Find(const Slice& key) const {
+    const uint8_t* const k = reinterpret_cast<const uint8_t*>(key.data());
+    const size_t b = KeyPrefix(k, key_len_, bucket_bits_);
+    const size_t base = bucketing_.dest_offset(b);
+    const size_t end =
+        b + 1 < bucketing_.size() ? bucketing_.dest_offset(b + 1) : n_;
+    return base + ECTCoder::Get()->Decode(bitvec_, k, key_len_, end - base,
+                                          bucketing_.index_offset(b),
+                                          bucket_bits_);
+  }
+
+  virtual void InsertKeys(size_t n, const uint8_t** keys) {
+    assert(n_ == 0);
+    n_ = n;
+    size_t bits = 0;
+    while (bits < 32 && bits < key_len_ * 8 &&
+           (static_cast<size_t>(2) << bits) * keys_per_bucket_ <= n) {
+      bits++;
+    }
+    if (!Build(bits, keys)) {
+      // Directory offsets overflowed due to badly skewed keys. Fall back
+      // to a single bucket.
+      Build(0, keys);
+    }
+  }
+
+  virtual void EncodeTo(std::string* dst) const {
+    dst->push_back(static_cast<char>(kBucketedECT));
+    PutVarint64(dst, key_len_);
+    PutVarint64(dst, keys_per_bucket_);
+    PutVarint64(dst, n_);
+    PutVarint32(dst, bucket_bits_);
+    size_t last_index_offset = 0;
+    size_t last_dest_offset = 0;
+    for (size_t b = 0; b < bucketing_.size(); b++) {
+      // Both offsets are non-decreasing so we store them as deltas
+      PutVarint64(dst, bucketing_.index_offset(b) - last_index_offset);
+      PutVarint64(dst, bucketing_.dest_offset(b) - last_dest_offset);
+      last_index_offset = bucketing_.index_offset(b);
+      last_dest_offset = bucketing_.dest_offset(b);
+    }
+    EncodeBits(bitvec_, dst);
+  }
+
+  // Restore the state written by EncodeTo() after the key length and the
+  // bucket size.
+  bool DecodeFrom(Slice* input) {
+    uint64_t n;
+    uint32_t bits;
+    if (!GetVarint64(input, &n) || !GetVarint32(input, &bits) || bits > 32) {
+      return false;
+    }
+    n_ = n;
+    bucket_bits_ = bits;
+    const size_t num_buckets = static_cast<size_t>(1) << bits;
+    // Each bucket takes at least 2 bytes
+    if (num_buckets > input->size() / 2) {
+      return false;
+    }
+    bucketing_.resize(num_buckets, 2 * keys_per_bucket_, 1);
+    uint64_t index_offset = 0;
+    uint64_t dest_offset = 0;
+    for (size_t b = 0; b < num_buckets; b++) {
+      uint64_t delta1, delta2;
+      if (!GetVarint64(input, &delta1) || !GetVarint64(input, &delta2)) {
+        return false;
+      }
+      index_offset += delta1;
+      dest_offset += delta2;
+      if (dest_offset > n_ || !bucketing_.fits(index_offset, dest_offset)) {
+        return false;
+      }
+      bucketing_.insert(index_offset, dest_offset);
+    }
+    return DecodeBits(input, &bitvec_) && index_offset <= bitvec_.size();
+  }
+
+ private:
+  // Return false if the directory cannot represent the buckets.
+  bool Build(size_t bits, const uint8_t** keys) {
+    const size_t num_buckets = static_cast<size_t>(1) << bits;
+    bucket_bits_ = bits;
+    bitvec_.clear();
+    // Pretend buckets are twice as large as they are to leave room for
+    // buckets larger than average within each group of buckets sharing an
+    // upper-level directory entry
+    bucketing_.resize(num_buckets, 2 * keys_per_bucket_, 1);
+    size_t i = 0;
+    for (size_t b = 0; b < num_buckets; b++) {
+      const size_t start = i;
+      while (i < n_ && KeyPrefix(keys[i], key_len_, bits) == b) {
+        i++;
+      }
+      const size_t offset = bitvec_.size();
+      if (!bucketing_.fits(offset, start)) {
+        return false;
+      }
+      bucketing_.insert(offset, start);
+      ECTCoder::Get()->Encode(bitvec_, key_len_, i - start, keys + start,
+                              bits);
+    }
+    assert(i == n_);
+    bitvec_.compact();
+    return true;
+  }
+
+ private:
+  bitvec_t bitvec_;
+  ectrie::twolevel_bucketing<> bucketing_;
+  size_t key_len_;
+  size_t keys_per_bucket_;
+  size_t n_;
+  size_t bucket_bits_;
+};
+
 }  // anonymous namespace
 
 void ECT::InitTrie(ECT* ect, size_t n, const Slice* keys) {
@@ -97,4 +290,41 @@ ECT* ECT::Default(size_t key_len, size_t n, const Slice* keys) {
   return ect;
 }
 
+ECT* ECT::Decode(const Slice& input) {
+  Slice in = input;
+  uint64_t key_len;
+  if (in.empty()) {
+    return NULL;
+  }
+  const unsigned char type = static_cast<unsigned char>(in[0]);
+  in.remove_prefix(1);
+  if (!GetVarint64(&in, &key_len)) {
+    return NULL;
+  }
+  if (type == kDefaultECT) {
+    ECTIndex* ect = new ECTIndex(key_len);
+    if (ect->DecodeFrom(&in)) {
+      return ect;
+    }
+    delete ect;
+  } else if (type == kBucketedECT) {
+    uint64_t keys_per_bucket;
+    if (GetVarint64(&in, &keys_per_bucket)) {
+      BucketedECTIndex* ect = new BucketedECTIndex(key_len, keys_per_bucket);
+      if (ect->DecodeFrom(&in)) {
+        return ect;
+      }
+      delete ect;
+    }
+  }
+  return NULL;
+}
+
+ECT* ECT::Bucketed(size_t key_len, size_t n, const Slice* keys,
+                   size_t keys_per_bucket) {
+  ECT* ect = new BucketedECTIndex(key_len, keys_per_bucket);
+  ECT::InitTrie(ect, n, keys);
+  return ect;
+}
+
 }  // namespace pdlfs
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/ect_partition.h"
+
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/crc32c.h"
+#include "pdlfs-common/ect.h"
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/leveldb/filenames.h"
+#include "pdlfs-common/leveldb/internal_types.h"
+#include "pdlfs-common/leveldb/iterator.h"
+#include "pdlfs-common/leveldb/options.h"
+#include "pdlfs-common/leveldb/table.h"
+#include "pdlfs-common/xxhash.h"
+
+#include <algorithm>
+
+namespace pdlfs {
+
+namespace {
+const uint64_t kECTPartitionMagic = 0x9be6e3b5a7cd1f42ull;
+// 3 x num_entries/offsets_offset/ect_offset + seed + crc + magic
+const size_t kFooterSize = 8 + 8 + 8 + 4 + 4 + 8;
+// Number of seeds to try before giving up on hash collisions
+const uint32_t kMaxSeeds = 16;
+// Records are located through fixed32 offsets
+const uint64_t kMaxRecordBytes = 0xffffffffull;
+
+// ECT keys are hashes in big-endian so that their byte order matches their
+// numeric order.
+inline void EncodeHashKey(char* dst, uint64_t hash) {
+  for (int i = 7; i >= 0; i--) {
+    dst[i] = static_cast<char>(hash & 0xff);
+    hash >>= 8;
+  }
+}
+
+inline uint64_t HashKey(const Slice& key, uint32_t seed) {
+  return xxhash64(key.data(), key.size(), seed);
+}
+}  // namespace
+
+struct ECTPartitionBuilder::RecordCompare {
+  bool operator()(const Record& a, const Record& b) const {
+    return a.hash < b.hash;
+  }
+};
+
+ECTPartitionBuilder::ECTPartitionBuilder(WritableFile* file)
+    : file_(file), offset_(0), finished_(false) {}
+
+ECTPartitionBuilder::~ECTPartitionBuilder() {}
+
+void ECTPartitionBuilder::Add(const Slice& key, const Slice& value) {
+  assert(!finished_);
+  Record r;
+  r.hash = 0;
+  r.off = buf_.size();
+  PutLengthPrefixedSlice(&buf_, key);
+  buf_.append(value.data(), value.size());
+  r.len = buf_.size() - r.off;
+  records_.push_back(r);
+}
+
+bool ECTPartitionBuilder::SortRecords(uint32_t seed) {
+  for (size_t i = 0; i < records_.size(); i++) {
+    Slice input(buf_.data() + records_[i].off, records_[i].len);
+    Slice key;
+    GetLengthPrefixedSlice(&input, &key);
+    records_[i].hash = HashKey(key, seed);
+  }
+  std::sort(records_.begin(), records_.end(), RecordCompare());
+  for (size_t i = 1; i < records_.size(); i++) {
+    if (records_[i].hash == records_[i - 1].hash) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Status ECTPartitionBuilder::Append(const Slice& data) {
+  Status s = file_->Append(data);
+  if (s.ok()) {
+    offset_ += data.size();
+  }
+  return s;
+}
+
+Status ECTPartitionBuilder::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  if (buf_.size() > kMaxRecordBytes) {
+    return Status::NotSupported("Too much data for a single partition");
+  }
+  uint32_t seed = 0;
+  while (!SortRecords(seed)) {
+    // Two keys share a hash. Retry with another seed.
+    if (++seed == kMaxSeeds) {
+      return Status::InvalidArgument("Duplicate keys");
+    }
+  }
+
+  Status s;
+  const size_t n = records_.size();
+  std::string offsets;
+  offsets.reserve(4 * (n + 1));
+  std::string hashes;
+  hashes.resize(8 * n);
+  std::vector<Slice> keys;
+  keys.reserve(n);
+  for (size_t i = 0; s.ok() && i < n; i++) {
+    PutFixed32(&offsets, static_cast<uint32_t>(offset_));
+    EncodeHashKey(&hashes[8 * i], records_[i].hash);
+    keys.push_back(Slice(&hashes[8 * i], 8));
+    s = Append(Slice(buf_.data() + records_[i].off, records_[i].len));
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  PutFixed32(&offsets, static_cast<uint32_t>(offset_));
+  std::string().swap(buf_);
+
+  // Small buckets trade about 0.6 bits per key for twice faster lookups
+  std::string index;
+  ECT* const ect = ECT::Bucketed(8, n, n != 0 ? &keys[0] : NULL, 16);
+  ect->EncodeTo(&index);
+  delete ect;
+
+  const uint64_t offsets_offset = offset_;
+  const uint64_t ect_offset = offsets_offset + offsets.size();
+  uint32_t crc = crc32c::Value(offsets.data(), offsets.size());
+  crc = crc32c::Extend(crc, index.data(), index.size());
+  std::string footer;
+  PutFixed64(&footer, n);
+  PutFixed64(&footer, offsets_offset);
+  PutFixed64(&footer, ect_offset);
+  PutFixed32(&footer, seed);
+  PutFixed32(&footer, crc32c::Mask(crc));
+  PutFixed64(&footer, kECTPartitionMagic);
+  assert(footer.size() == kFooterSize);
+
+  s = Append(offsets);
+  if (s.ok()) {
+    s = Append(index);
+  }
+  if (s.ok()) {
+    s = Append(footer);
+  }
+  return s;
+}
+
+Status ECTPartition::Open(RandomAccessFile* file, uint64_t file_size,
+                          ECTPartition** result) {
+  *result = NULL;
+  if (file_size < kFooterSize) {
+    return Status::Corruption("File too short to be an ECT partition");
+  }
+  Slice input;
+  char footer[kFooterSize];
+  Status s = file->Read(file_size - kFooterSize, kFooterSize, &input, footer);
+  if (!s.ok()) {
+    return s;
+  } else if (input.size() != kFooterSize ||
+             DecodeFixed64(input.data() + 32) != kECTPartitionMagic) {
+    return Status::Corruption("Not an ECT partition");
+  }
+  const uint64_t n = DecodeFixed64(input.data());
+  const uint64_t offsets_offset = DecodeFixed64(input.data() + 8);
+  const uint64_t ect_offset = DecodeFixed64(input.data() + 16);
+  const uint32_t seed = DecodeFixed32(input.data() + 24);
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(input.data() + 28));
+  const uint64_t meta_end = file_size - kFooterSize;
+  if (offsets_offset > ect_offset || ect_offset > meta_end ||
+      ect_offset - offsets_offset != 4 * (n + 1)) {
+    return Status::Corruption("Bad ECT partition footer");
+  }
+
+  // Read the offsets and the index in a single pass. If the file is
+  // memory-mapped the result points into the mapping and is used in place.
+  const size_t meta_size = static_cast<size_t>(meta_end - offsets_offset);
+  std::string scratch;
+  scratch.resize(meta_size);
+  s = file->Read(offsets_offset, meta_size, &input, &scratch[0]);
+  if (!s.ok()) {
+    return s;
+  } else if (input.size() != meta_size) {
+    return Status::Corruption("Truncated ECT partition");
+  } else if (crc32c::Value(input.data(), input.size()) != crc) {
+    return Status::Corruption("ECT partition checksum mismatch");
+  }
+  const size_t offsets_size = static_cast<size_t>(4 * (n + 1));
+  ECT* const ect = ECT::Decode(
+      Slice(input.data() + offsets_size, input.size() - offsets_size));
+  if (ect == NULL) {
+    return Status::Corruption("Bad ECT partition index");
+  }
+
+  ECTPartition* const p = new ECTPartition;
+  p->file_ = file;
+  p->ect_ = ect;
+  p->seed_ = seed;
+  p->num_entries_ = static_cast<size_t>(n);
+  if (input.data() != scratch.data()) {
+    p->offsets_ = Slice(input.data(), offsets_size);
+  } else {
+    p->offsets_buf_.assign(input.data(), offsets_size);
+    p->offsets_ = p->offsets_buf_;
+  }
+  *result = p;
+  return s;
+}
+
+ECTPartition::~ECTPartition() { delete ect_; }
+
+size_t ECTPartition::IndexMemUsage() const { return ect_->MemUsage(); }
+
+Status ECTPartition::Get(const Slice& key, std::string* value) const {
+  if (num_entries_ == 0) {
+    return Status::NotFound(Slice());
+  }
+  char tmp[8];
+  EncodeHashKey(tmp, HashKey(key, seed_));
+  const size_t rank = ect_->Find(Slice(tmp, sizeof(tmp)));
+  if (rank >= num_entries_) {
+    return Status::NotFound(Slice());
+  }
+  const uint32_t off = DecodeFixed32(offsets_.data() + 4 * rank);
+  const uint32_t end = DecodeFixed32(offsets_.data() + 4 * rank + 4);
+  if (end < off) {
+    return Status::Corruption("Bad record offsets");
+  }
+  const size_t len = end - off;
+  char buf[512];
+  std::string scratch;
+  char* dst = buf;
+  if (len > sizeof(buf)) {
+    scratch.resize(len);
+    dst = &scratch[0];
+  }
+  Slice input;
+  Status s = file_->Read(off, len, &input, dst);
+  if (!s.ok()) {
+    return s;
+  } else if (input.size() != len) {
+    return Status::Corruption("Truncated record");
+  }
+  Slice k;
+  if (!GetLengthPrefixedSlice(&input, &k)) {
+    return Status::Corruption("Bad record");
+  } else if (k != key) {
+    // Keys absent from the partition are mapped to arbitrary ranks
+    return Status::NotFound(Slice());
+  }
+  value->assign(input.data(), input.size());
+  return s;
+}
+
+Status BuildECTPartitionFromDump(const DBOptions& options,
+                                 const std::string& dump_dir,
+                                 const std::string& fname,
+                                 size_t* num_entries) {
+  Env* const env = options.env != NULL ? options.env : Env::Default();
+  std::vector<std::string> names;
+  Status s = env->GetChildren(dump_dir.c_str(), &names);
+  if (!s.ok()) {
+    return s;
+  }
+  std::sort(names.begin(), names.end());
+  WritableFile* file;
+  s = env->NewWritableFile(fname.c_str(), &file);
+  if (!s.ok()) {
+    return s;
+  }
+
+  InternalKeyComparator icmp(options.comparator);
+  DBOptions table_options = options;
+  table_options.comparator = &icmp;
+  table_options.filter_policy = NULL;
+  table_options.block_cache = NULL;
+  ECTPartitionBuilder builder(file);
+  for (size_t i = 0; s.ok() && i < names.size(); i++) {
+    uint64_t number;
+    FileType type;
+    if (!ParseFileName(names[i], &number, &type) || type != kTableFile) {
+      continue;
+    }
+    const std::string tname = dump_dir + "/" + names[i];
+    uint64_t file_size;
+    s = env->GetFileSize(tname.c_str(), &file_size);
+    RandomAccessFile* tfile = NULL;
+    if (s.ok()) {
+      s = env->NewRandomAccessFile(tname.c_str(), &tfile);
+    }
+    Table* table = NULL;
+    if (s.ok()) {
+      s = Table::Open(table_options, tfile, file_size, &table);
+    }
+    if (s.ok()) {
+      Iterator* const iter = table->NewIterator(ReadOptions());
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ParsedInternalKey ikey;
+        if (!ParseInternalKey(iter->key(), &ikey)) {
+          s = Status::Corruption("Bad internal key in dump", tname);
+          break;
+        } else if (ikey.type == kTypeValue) {
+          builder.Add(ikey.user_key, iter->value());
+        }
+      }
+      if (s.ok()) {
+        s = iter->status();
+      }
+      delete iter;
+    }
+    delete table;
+    delete tfile;
+  }
+
+  if (s.ok()) {
+    s = builder.Finish();
+  }
+  if (s.ok()) {
+    s = file->Sync();
+  }
+  if (s.ok()) {
+    s = file->Close();
+  }
+  delete file;
+  if (s.ok()) {
+    if (num_entries != NULL) {
+      *num_entries = builder.NumEntries();
+    }
+  } else {
+    env->DeleteFile(fname.c_str());
+  }
+  return s;
+}
+
+}  // namespace pdlfs
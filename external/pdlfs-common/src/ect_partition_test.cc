@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/ect_partition.h"
+
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/leveldb/db.h"
+#include "pdlfs-common/leveldb/options.h"
+#include "pdlfs-common/random.h"
+#include "pdlfs-common/testharness.h"
+#include "pdlfs-common/testutil.h"
+
+#include <map>
+#include <stdio.h>
+#include <string.h>
+
+namespace pdlfs {
+
+class ECTPartitionTest {
+ public:
+  ECTPartitionTest() : env_(Env::Default()), file_(NULL), partition_(NULL) {
+    dir_ = test::PrepareTmpDir("ect_partition_test");
+    fname_ = dir_ + "/partition";
+  }
+
+  ~ECTPartitionTest() { Close(); }
+
+  void Close() {
+    delete partition_;
+    partition_ = NULL;
+    delete file_;
+    file_ = NULL;
+  }
+
+  void Build() {
+    WritableFile* file;
+    ASSERT_OK(env_->NewWritableFile(fname_.c_str(), &file));
+    ECTPartitionBuilder builder(file);
+    std::map<std::string, std::string>::iterator it;
+    for (it = kvs_.begin(); it != kvs_.end(); ++it) {
+      builder.Add(it->first, it->second);
+    }
+    ASSERT_OK(builder.Finish());
+    ASSERT_EQ(builder.NumEntries(), kvs_.size());
+    ASSERT_OK(file->Close());
+    delete file;
+  }
+
+  Status Open() {
+    Close();
+    uint64_t size;
+    Status s = env_->GetFileSize(fname_.c_str(), &size);
+    if (s.ok()) {
+      s = env_->NewRandomAccessFile(fname_.c_str(), &file_);
+    }
+    if (s.ok()) {
+      s = ECTPartition::Open(file_, size, &partition_);
+    }
+    return s;
+  }
+
+  std::string Get(const Slice& key) {
+    std::string value;
+    Status s = partition_->Get(key, &value);
+    if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    } else if (!s.ok()) {
+      return s.ToString();
+    }
+    return value;
+  }
+
+  void CheckAll() {
+    ASSERT_EQ(partition_->NumEntries(), kvs_.size());
+    std::map<std::string, std::string>::iterator it;
+    for (it = kvs_.begin(); it != kvs_.end(); ++it) {
+      ASSERT_EQ(Get(it->first), it->second);
+    }
+  }
+
+  Env* env_;
+  std::string dir_;
+  std::string fname_;
+  std::map<std::string, std::string> kvs_;
+  RandomAccessFile* file_;
+  ECTPartition* partition_;
+};
+
+TEST(ECTPartitionTest, Empty) {
+  Build();
+  ASSERT_OK(Open());
+  CheckAll();
+  ASSERT_EQ(Get("a"), "NOT_FOUND");
+}
+
+TEST(ECTPartitionTest, Small) {
+  kvs_["a"] = "va";
+  kvs_["b"] = "";
+  kvs_["cc"] = "vcc";
+  kvs_[""] = "empty";
+  Build();
+  ASSERT_OK(Open());
+  CheckAll();
+  ASSERT_EQ(Get("c"), "NOT_FOUND");
+  ASSERT_EQ(Get("ccc"), "NOT_FOUND");
+}
+
+TEST(ECTPartitionTest, Random) {
+  Random rnd(301);
+  std::string tmp;
+  while (kvs_.size() < 20000) {
+    const std::string key = test::RandomString(&rnd, 1 + rnd.Uniform(24), &tmp)
+                                .ToString();
+    // Mostly small values with an occasional large one
+    const int len = rnd.OneIn(100) ? 1000 + rnd.Uniform(5000) : rnd.Uniform(64);
+    kvs_[key] = test::RandomString(&rnd, len, &tmp).ToString();
+  }
+  Build();
+  ASSERT_OK(Open());
+  CheckAll();
+  fprintf(stderr, "%.2f index bits per key\n",
+          partition_->IndexMemUsage() / double(kvs_.size()));
+  for (int i = 0; i < 10000; i++) {
+    char key[30];
+    snprintf(key, sizeof(key), "missing-%d", i);
+    ASSERT_EQ(Get(key), "NOT_FOUND");
+  }
+}
+
+TEST(ECTPartitionTest, Corruption) {
+  for (int i = 0; i < 100; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "%d", i);
+    kvs_[key] = key;
+  }
+  Build();
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname_.c_str(), &contents));
+  // Flip a bit in the record offsets, which directly precede the index and
+  // the footer
+  const uint64_t offsets_offset =
+      DecodeFixed64(&contents[contents.size() - 32]);
+  contents[offsets_offset + 5] ^= 1;
+  ASSERT_OK(WriteStringToFile(env_, contents, fname_.c_str()));
+  ASSERT_TRUE(Open().IsCorruption());
+  ASSERT_OK(WriteStringToFile(env_, contents.substr(0, 10), fname_.c_str()));
+  ASSERT_TRUE(Open().IsCorruption());
+}
+
+TEST(ECTPartitionTest, FromDump) {
+  const std::string dbname = test::PrepareTmpDir("ect_partition_test_db");
+  const std::string dump_dir = test::PrepareTmpDir("ect_partition_test_dump");
+  DBOptions options;
+  options.create_if_missing = true;
+  DestroyDB(dbname, options);
+  DB* db;
+  ASSERT_OK(DB::Open(options, dbname, &db));
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    ASSERT_OK(db->Put(WriteOptions(), key, std::string(i % 50, 'v')));
+    if (i % 3 == 0) {
+      ASSERT_OK(db->Delete(WriteOptions(), key));
+    } else {
+      kvs_[key] = std::string(i % 50, 'v');
+    }
+  }
+  ASSERT_OK(db->Put(WriteOptions(), "k000002", "overwritten"));
+  kvs_["k000002"] = "overwritten";
+  ASSERT_OK(db->Dump(DumpOptions(), Range(), dump_dir, NULL, NULL));
+  delete db;
+  DestroyDB(dbname, options);
+  size_t n;
+  ASSERT_OK(BuildECTPartitionFromDump(options, dump_dir, fname_, &n));
+  ASSERT_EQ(n, kvs_.size());
+  ASSERT_OK(Open());
+  CheckAll();
+  ASSERT_EQ(Get("k000000"), "NOT_FOUND");
+}
+
+}  // namespace pdlfs
+
+namespace pdlfs {
+namespace {
+// Compare random point lookups against a partition with those against the
+// db it was dumped from. Keys mimic file names hashed under a directory
+// prefix and values mimic encoded stats followed by names.
+void BM_Get() {
+  const int n = 1000000;
+  const int reads = 1000000;
+  const std::string dbname = test::PrepareTmpDir("ect_partition_bench_db");
+  const std::string dump_dir = test::PrepareTmpDir("ect_partition_bench_dump");
+  const std::string fname =
+      test::PrepareTmpDir("ect_partition_bench") + "/partition";
+  Env* const env = Env::Default();
+  DBOptions options;
+  options.create_if_missing = true;
+  DestroyDB(dbname, options);
+  DB* db;
+  ASSERT_OK(DB::Open(options, dbname, &db));
+  Random rnd(301);
+  std::vector<std::string> keys;
+  std::string tmp;
+  for (int i = 0; i < n; i++) {
+    std::string key;
+    PutFixed64(&key, 1);
+    PutFixed64(&key, (uint64_t(rnd.Next()) << 32) | rnd.Next());
+    keys.push_back(key);
+    ASSERT_OK(db->Put(WriteOptions(), key, test::RandomString(&rnd, 96, &tmp)));
+  }
+  db->CompactRange(NULL, NULL);
+  ASSERT_OK(db->Dump(DumpOptions(), Range(), dump_dir, NULL, NULL));
+  uint64_t start = CurrentMicros();
+  ASSERT_OK(BuildECTPartitionFromDump(options, dump_dir, fname));
+  fprintf(stderr, "build: %.3f s\n", (CurrentMicros() - start) / 1e6);
+
+  uint64_t size;
+  ASSERT_OK(env->GetFileSize(fname.c_str(), &size));
+  RandomAccessFile* file;
+  ASSERT_OK(env->NewRandomAccessFile(fname.c_str(), &file));
+  ECTPartition* partition;
+  ASSERT_OK(ECTPartition::Open(file, size, &partition));
+  fprintf(stderr, "partition: %.2f MB, %.2f index bits per key\n",
+          size / 1048576.0, partition->IndexMemUsage() / double(n));
+
+  std::string value;
+  for (int round = 0; round < 2; round++) {
+    Random r(1);
+    start = CurrentMicros();
+    for (int i = 0; i < reads; i++) {
+      const std::string& key = keys[r.Uniform(n)];
+      Status s = round == 0 ? db->Get(ReadOptions(), key, &value)
+                            : partition->Get(key, &value);
+      ASSERT_OK(s);
+    }
+    fprintf(stderr, "%-9s %.3f us/get\n", round == 0 ? "db:" : "partition:",
+            double(CurrentMicros() - start) / reads);
+  }
+
+  delete partition;
+  delete file;
+  delete db;
+  DestroyDB(dbname, options);
+}
+}  // namespace
+}  // namespace pdlfs
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    ::pdlfs::BM_Get();
+    return 0;
+  }
+  return ::pdlfs::test::RunAllTests(&argc, &argv);
+}
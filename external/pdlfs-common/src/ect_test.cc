@@ -14,26 +14,36 @@
 #include <vector>
 
 #include "pdlfs-common/ect.h"
+#include "pdlfs-common/env.h"
 #include "pdlfs-common/random.h"
 #include "pdlfs-common/slice.h"
 #include "pdlfs-common/testharness.h"
 
-#include "spooky_impl.h"
+#include "ectrie/bit_vector.h"
+#include "ectrie/exp_golomb.h"
+#include "ectrie/huffman.h"
+#include "spooky/SpookyV2.h"
 
 namespace pdlfs {
 
 class ECTTest {};
 
+// Wraps a default index, or a bucketed one if keys_per_bucket is not 0.
 class TrieWrapper {
  private:
   const size_t k_len_;
+  const size_t keys_per_bucket_;
   std::vector<size_t> k_offs_;
   std::string k_buffer_;
   size_t num_k_;
   ECT* ect_;
 
  public:
-  TrieWrapper(size_t key_len) : k_len_(key_len), num_k_(0), ect_(NULL) {}
+  TrieWrapper(size_t key_len, size_t keys_per_bucket = 0)
+      : k_len_(key_len),
+        keys_per_bucket_(keys_per_bucket),
+        num_k_(0),
+        ect_(NULL) {}
 
   ~TrieWrapper() { delete ect_; }
 
@@ -41,6 +51,15 @@ class TrieWrapper {
 
   size_t MemUsage() const { return ect_->MemUsage(); }
 
+  // Replace the index with a copy decoded from its serialized form.
+  void Reload() {
+    std::string encoding;
+    ect_->EncodeTo(&encoding);
+    delete ect_;
+    ect_ = ECT::Decode(encoding);
+    ASSERT_TRUE(ect_ != NULL);
+  }
+
   void Insert(const Slice& key) {
     k_offs_.push_back(k_buffer_.size());
     k_buffer_.append(key.data(), key.size());
@@ -55,7 +74,12 @@ class TrieWrapper {
     for (size_t i = 0; i < num_k_; i++) {
       tmp_keys[i] = Slice(&k_buffer_[k_offs_[i]], k_offs_[i + 1] - k_offs_[i]);
     }
-    ect_ = ECT::Default(k_len_, tmp_keys.size(), &tmp_keys[0]);
+    if (keys_per_bucket_ != 0) {
+      ect_ = ECT::Bucketed(k_len_, tmp_keys.size(), &tmp_keys[0],
+                           keys_per_bucket_);
+    } else {
+      ect_ = ECT::Default(k_len_, tmp_keys.size(), &tmp_keys[0]);
+    }
     k_offs_.clear();
     k_buffer_.clear();
     num_k_ = 0;
@@ -149,6 +173,143 @@ static std::string RandomKey(Random* rnd, int k_len) {
 }
 #endif
 
+// Word-level reads must match bit-by-bit reads, including near the end of
+// the vector where bits past the end read as 0.
+TEST(ECTTest, BitVectorPeek) {
+  Random rnd(301);
+  ectrie::bit_vector<> bits;
+  for (int i = 0; i < 1000; i++) {
+    bits.push_back(rnd.OneIn(2));
+    for (size_t j = 0; j < bits.size(); j += 1 + j / 8) {
+      const uint64_t w = bits.peek(j);
+      for (size_t k = 0; k < 64; k++) {
+        const bool b = j + k < bits.size() && bits[j + k];
+        ASSERT_EQ((w >> (63 - k)) & 1, b);
+      }
+    }
+  }
+}
+
+TEST(ECTTest, Codecs) {
+  Random rnd(301);
+  ectrie::huffman_buffer<> huff;
+  ectrie::bit_vector<> bits;
+  std::vector<size_t> values;
+  for (int i = 0; i < 10000; i++) {
+    const size_t n = 2 + rnd.Uniform(huff.encoding_limit() - 1);
+    const size_t v = rnd.Uniform(n + 1);
+    huff[n - 2]->encode(bits, v);
+    values.push_back(n);
+    values.push_back(v);
+    // Include values whose codes are longer than 64 bits
+    const size_t g = rnd.OneIn(100) ? (size_t(1) << 40) + rnd.Next()
+                                    : rnd.Skewed(20);
+    ectrie::exp_golomb<>::encode<size_t>(bits, g);
+    values.push_back(g);
+  }
+  size_t iter = 0;
+  for (size_t i = 0; i < values.size(); i += 3) {
+    ASSERT_EQ(huff[values[i] - 2]->decode(bits, iter), values[i + 1]);
+    ASSERT_EQ(ectrie::exp_golomb<>::decode<size_t>(bits, iter), values[i + 2]);
+  }
+  ASSERT_EQ(iter, bits.size());
+}
+
+TEST(ECTTest, BucketedEmpty) {
+  TrieWrapper trie(10, 64);
+  trie.Flush();
+}
+
+// Keys sharing leading bits fall into the same few buckets.
+TEST(ECTTest, BucketedSkewedKeys) {
+  const char* keys[6] = {"aaaaa", "fghdc", "fzhdc", "zdfgr", "zzfgr", "zzzgr"};
+  for (size_t kpb = 1; kpb <= 4; kpb++) {
+    TrieWrapper trie(5, kpb);
+    for (int i = 0; i < 6; i++) trie.Insert(keys[i]);
+    trie.Flush();
+    for (int i = 0; i < 6; i++) {
+      ASSERT_EQ(trie.Locate(keys[i]), i);
+    }
+    BETWEEN(trie.Locate("fzbbb"), 1, 2);
+    BETWEEN(trie.Locate("zzzzz"), 5, 6);
+  }
+}
+
+// Check the rank of every "stride"-th key.
+static void CheckRanks(const std::set<std::string>& keys, TrieWrapper* trie,
+                       size_t stride = 1) {
+  std::set<std::string>::const_iterator iter;
+  for (iter = keys.begin(); iter != keys.end(); ++iter) {
+    trie->Insert(*iter);
+  }
+  trie->Flush();
+  size_t rank = 0;
+  for (iter = keys.begin(); iter != keys.end(); ++iter) {
+    if (rank % stride == 0) {
+      ASSERT_EQ(trie->Locate(*iter), rank);
+    }
+    rank++;
+  }
+}
+
+TEST(ECTTest, BucketedRandomKeys) {
+  Random rnd(301);
+  std::set<std::string> keys;
+  while (keys.size() < 100000) keys.insert(RandomKey(&rnd, 8));
+  for (size_t kpb = 16; kpb <= 256; kpb *= 4) {
+    TrieWrapper trie(8, kpb);
+    CheckRanks(keys, &trie);
+    fprintf(stderr, "keys_per_bucket=%d\tbits_per_k=%.2f\n",
+            static_cast<int>(kpb), trie.MemUsage() / double(keys.size()));
+  }
+}
+
+// All keys share their first two bytes so the bucket directory overflows
+// and the index falls back to a single bucket.
+TEST(ECTTest, BucketedOverflow) {
+  Random rnd(301);
+  std::set<std::string> keys;
+  while (keys.size() < 30000) {
+    keys.insert(std::string(2, '\0') + RandomKey(&rnd, 6));
+  }
+  TrieWrapper trie(8, 1);
+  CheckRanks(keys, &trie, 97);
+}
+
+TEST(ECTTest, EncodeDecode) {
+  Random rnd(301);
+  std::set<std::string> keys;
+  while (keys.size() < 5000) keys.insert(RandomKey(&rnd, 8));
+  for (size_t kpb = 0; kpb <= 64; kpb += 64) {
+    TrieWrapper trie(8, kpb);
+    std::set<std::string>::const_iterator iter;
+    for (iter = keys.begin(); iter != keys.end(); ++iter) {
+      trie.Insert(*iter);
+    }
+    trie.Flush();
+    const size_t bits = trie.MemUsage();
+    trie.Reload();
+    ASSERT_EQ(trie.MemUsage(), bits);
+    size_t rank = 0;
+    for (iter = keys.begin(); iter != keys.end(); ++iter) {
+      if (rank % 7 == 0) {
+        ASSERT_EQ(trie.Locate(*iter), rank);
+      }
+      rank++;
+    }
+  }
+  ASSERT_TRUE(ECT::Decode(Slice()) == NULL);
+  ASSERT_TRUE(ECT::Decode("\x07") == NULL);
+  std::string encoding;
+  const Slice key("x");
+  ECT* const ect = ECT::Default(1, 1, &key);
+  ect->EncodeTo(&encoding);
+  delete ect;
+  for (size_t i = 0; i < encoding.size(); i++) {
+    ASSERT_TRUE(ECT::Decode(Slice(encoding.data(), i)) == NULL);
+  }
+}
+
 TEST(ECTTest, ECTBench) {
   for (int k_len = 4; k_len <= 16; k_len += 4) {
     for (int num_k = 16; num_k <= 8192; num_k *= 2) {
@@ -170,6 +331,77 @@ TEST(ECTTest, ECTBench) {
 
 }  // namespace pdlfs
 
+namespace pdlfs {
+namespace {
+// Time Find() over random 8-byte keys for default and bucketed indexes.
+void BM_Find() {
+  for (size_t n = 1 << 14; n <= (1 << 20); n <<= 2) {
+    Random rnd(301);
+    std::set<std::string> key_set;
+    while (key_set.size() < n) key_set.insert(RandomKey(&rnd, 8));
+    std::vector<std::string> keys(key_set.begin(), key_set.end());
+    std::vector<Slice> slices(keys.begin(), keys.end());
+    for (int bucketed = 0; bucketed < 2; bucketed++) {
+      ECT* const ect = bucketed ? ECT::Bucketed(8, n, &slices[0])
+                                : ECT::Default(8, n, &slices[0]);
+      // The default index decodes O(n) bits per lookup
+      const size_t lookups = bucketed ? 1000000 : (1 << 26) / n;
+      const uint64_t start = CurrentMicros();
+      size_t sum = 0;
+      for (size_t i = 0; i < lookups; i++) {
+        sum += ect->Find(slices[rnd.Uniform(n)]);
+      }
+      const uint64_t us = CurrentMicros() - start;
+      fprintf(stderr, "%-8s #k=%-8d %10.3f us/find, %.2f bits/k (%d)\n",
+              bucketed ? "bucketed" : "default", static_cast<int>(n),
+              double(us) / lookups, ect->MemUsage() / double(n),
+              static_cast<int>(sum & 1));
+      delete ect;
+    }
+  }
+}
+
+// Time decoding of the codes that make up tries: huffman codes for small
+// subtrees and exp-golomb codes for larger ones.
+void BM_Decode() {
+  const int n = 1000000;
+  Random rnd(301);
+  ectrie::huffman_buffer<> huff;
+  ectrie::bit_vector<> hbits, gbits;
+  std::vector<size_t> sizes;
+  for (int i = 0; i < n; i++) {
+    const size_t size = 2 + rnd.Uniform(huff.encoding_limit() - 1);
+    size_t left = 0;
+    for (size_t j = 0; j < size; j++) left += rnd.OneIn(2);
+    huff[size - 2]->encode(hbits, left);
+    sizes.push_back(size);
+    ectrie::exp_golomb<>::encode<size_t>(gbits, rnd.Skewed(6));
+  }
+  size_t iter = 0;
+  size_t sum = 0;
+  uint64_t start = CurrentMicros();
+  for (int i = 0; i < n; i++) {
+    sum += huff[sizes[i] - 2]->decode(hbits, iter);
+  }
+  const uint64_t huff_us = CurrentMicros() - start;
+  iter = 0;
+  start = CurrentMicros();
+  for (int i = 0; i < n; i++) {
+    sum += ectrie::exp_golomb<>::decode<size_t>(gbits, iter);
+  }
+  const uint64_t golomb_us = CurrentMicros() - start;
+  fprintf(stderr, "huffman %.2f ns/code, exp-golomb %.2f ns/code (%d)\n",
+          huff_us * 1000.0 / n, golomb_us * 1000.0 / n,
+          static_cast<int>(sum & 1));
+}
+}  // namespace
+}  // namespace pdlfs
+
 int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    ::pdlfs::BM_Decode();
+    ::pdlfs::BM_Find();
+    return 0;
+  }
   return ::pdlfs::test::RunAllTests(&argc, &argv);
 }
@@ -12,6 +12,7 @@
  * found in the LICENSE file. See the AUTHORS file for names of contributors.
  */
 
+#include <assert.h>
 #include <algorithm>
 
 #include "block_info.h"
@@ -72,6 +73,45 @@ class bit_access {
                                  in_block_offset<BlockType>(i)))) != 0;
   }
 
+  // Return the 64 bits starting at bit i as an integer whose most
+  // significant bit is bit i. May read up to 8 bytes past the block holding
+  // bit i, so arrays must be padded accordingly.
+  static uint64_t peek64(const uint32_t* v, size_t i) {
+    v += block_index<uint32_t>(i);
+    const size_t off = in_block_offset<uint32_t>(i);
+    const uint64_t hi = (static_cast<uint64_t>(v[0]) << 32) | v[1];
+    // Shifting the third block by 32 bits when off is 0 yields 0
+    return (hi << off) | (static_cast<uint64_t>(v[2]) >> (32 - off));
+  }
+
+  static uint64_t peek64(const uint64_t* v, size_t i) {
+    v += block_index<uint64_t>(i);
+    const size_t off = in_block_offset<uint64_t>(i);
+    return off == 0 ? v[0] : (v[0] << off) | (v[1] >> (64 - off));
+  }
+
+  template <typename BlockType>
+  static uint64_t peek64(const BlockType* v, size_t i) {
+    uint64_t r = 0;
+    copy_set(&r, 0, v, i, 64);
+    return r;
+  }
+
+  // Return the number of leading zero bits of a non-zero integer.
+  static int clz64(uint64_t v) {
+    assert(v != 0);
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(v);
+#else
+    int n = 0;
+    while ((v & (uint64_t(1) << 63)) == 0) {
+      v <<= 1;
+      n++;
+    }
+    return n;
+#endif
+  }
+
   // multiple bits operations
   template <typename DestBlockType, typename SrcBlockType>
   static void copy_set(DestBlockType* dest, size_t dest_i,
@@ -11,7 +11,9 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 
 #include "bit_vector.h"
 
@@ -57,19 +59,21 @@ void bit_vector<BlockType>::resize() {
   }
 
   block_type* new_buf = reinterpret_cast<block_type*>(
-      realloc(reinterpret_cast<void*>(buf_), new_byte_size));
+      realloc(reinterpret_cast<void*>(buf_), new_byte_size + kPaddingBytes));
 
   if (!new_buf) {
-    new_buf = reinterpret_cast<block_type*>(malloc(new_byte_size));
+    new_buf = reinterpret_cast<block_type*>(
+        malloc(new_byte_size + kPaddingBytes));
     memcpy(new_buf, buf_, old_byte_size);
     free(buf_);
   }
 
   buf_ = new_buf;
 
-  if (new_byte_size > old_byte_size)
-    memset(reinterpret_cast<uint8_t*>(new_buf) + old_byte_size, 0,
-           new_byte_size - old_byte_size);
+  // Clear both the newly added blocks and the padding
+  const size_t used_byte_size = std::min(old_byte_size, new_byte_size);
+  memset(reinterpret_cast<uint8_t*>(new_buf) + used_byte_size, 0,
+         new_byte_size + kPaddingBytes - used_byte_size);
 }
 
 template class bit_vector<uint8_t>;
@@ -15,6 +15,8 @@
 #include "bit_access.h"
 #include "block_info.h"
 
+#include <assert.h>
+
 namespace pdlfs {
 namespace ectrie {
 
@@ -94,6 +96,14 @@ class bit_vector {
     size_ = target_size;
   }
 
+  // Return the 64 bits starting at bit i, most significant bit first. Bits
+  // past the end of the vector read as 0.
+  // REQUIRES: i < size().
+  uint64_t peek(size_t i) const {
+    assert(i < size_);
+    return bit_access::peek64(buf_, i);
+  }
+
   template <typename T>
   T get(size_t i, size_t len) const {
     T v = 0;
@@ -108,6 +118,9 @@ class bit_vector {
   void resize();
 
  private:
+  // Zeroed bytes kept after the last block so that peek() never reads
+  // past the buffer
+  static const size_t kPaddingBytes = 8;
   block_type* buf_;
   size_t size_;
   size_t capacity_;
@@ -51,17 +51,30 @@ class exp_golomb {
 
   template <typename T, typename BufferType>
   static T decode(const BufferType& in_buf, size_t& in_out_buf_iter) {
-    int len = 1;
-    while (true) {
-      if (in_buf[in_out_buf_iter++]) break;
-      len++;
-    }
+    T m;
+    // Codes of up to 64 bits are decoded from a single word: the number of
+    // leading zeros gives the length of the code and the bits that follow
+    // give its value
+    const uint64_t w = in_buf.peek(in_out_buf_iter);
+    const int zeros = w != 0 ? bit_access::clz64(w) : 64;
+    if (2 * zeros + 1 <= 64) {
+      const int code_len = 2 * zeros + 1;
+      m = static_cast<T>(w >> (64 - code_len));
+      in_out_buf_iter += static_cast<size_t>(code_len);
+    } else {
+      int len = 1;
+      while (true) {
+        if (in_buf[in_out_buf_iter++]) break;
+        len++;
+      }
 
-    T m = static_cast<T>(1) << (len - 1);
-    // "template" prefix is used to inform the compiler that in_buf.get is a
-    // member template
-    m |= in_buf.template get<T>(in_out_buf_iter, static_cast<size_t>(len - 1));
-    in_out_buf_iter += static_cast<size_t>(len - 1);
+      m = static_cast<T>(1) << (len - 1);
+      // "template" prefix is used to inform the compiler that in_buf.get is a
+      // member template
+      m |= in_buf.template get<T>(in_out_buf_iter,
+                                  static_cast<size_t>(len - 1));
+      in_out_buf_iter += static_cast<size_t>(len - 1);
+    }
 
     T n;
     if (Order) {
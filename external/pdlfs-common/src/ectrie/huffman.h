@@ -272,7 +272,22 @@ class huffman {
   static const size_t nsymbol = size_t(-1);
 
  public:
-  huffman(const huffman_tree<ref_type>& t) : t_(t), tbl_(t), rev_tbl_(t) {}
+  huffman(const huffman_tree<ref_type>& t) : t_(t), tbl_(t) {
+    // Walk the tree for every possible value of the next kLookupBits bits
+    for (size_t v = 0; v < (1u << kLookupBits); v++) {
+      ref_type p = t_.root();
+      size_t depth = 0;
+      while (!t_.is_symbol(p) && depth < kLookupBits) {
+        if (!(v & (1u << (kLookupBits - 1 - depth))))
+          p = t_.left(p);
+        else
+          p = t_.right(p);
+        depth++;
+      }
+      lookup_refs_[v] = p;
+      lookup_lengths_[v] = static_cast<uint8_t>(depth);
+    }
+  }
 
   template <typename BufferType>
   void encode(BufferType& out_buf, size_t symbol) const {
@@ -286,9 +301,15 @@ class huffman {
   size_t decode(const BufferType& in_buf, size_t& in_out_buf_iter) const {
     if (in_out_buf_iter == in_buf.size()) return nsymbol;
 
-    // simple decoding is ~10% faster than table-based decoding for small
-    // codewords
-    ref_type p = t_.root();
+    // Codewords of up to kLookupBits bits, which are the most frequent
+    // ones, are decoded with a single table lookup. Longer codewords
+    // continue from the tree node reached after kLookupBits bits. The table
+    // is small enough to stay in cache, unlike a table covering the longest
+    // codeword.
+    const size_t v =
+        static_cast<size_t>(in_buf.peek(in_out_buf_iter) >> (64 - kLookupBits));
+    ref_type p = lookup_refs_[v];
+    in_out_buf_iter += lookup_lengths_[v];
     while (!t_.is_symbol(p)) {
       assert(in_out_buf_iter < in_buf.size());
 
@@ -301,9 +322,11 @@ class huffman {
   }
 
  private:
+  static const size_t kLookupBits = 8;
   const huffman_tree<ref_type> t_;
   const huffman_table tbl_;
-  const huffman_rev_table<ref_type> rev_tbl_;
+  ref_type lookup_refs_[1 << kLookupBits];
+  uint8_t lookup_lengths_[1 << kLookupBits];
 };
 
 template <typename RefType = uint8_t>
@@ -65,6 +65,18 @@ void twolevel_bucketing<ValueType, UpperValueType>::insert(size_t index_offset,
   current_i_++;
 }
 
+template <typename ValueType, typename UpperValueType>
+bool twolevel_bucketing<ValueType, UpperValueType>::fits(
+    size_t index_offset, size_t dest_offset) const {
+  assert(current_i_ < size_);
+  const size_t max = static_cast<value_type>(~value_type(0));
+  const size_t upper_max = static_cast<upper_value_type>(~upper_value_type(0));
+  const size_t u = current_i_ / upper_bucket_size_;
+  return index_offset <= upper_max && dest_offset <= upper_max &&
+         index_offset - upper_index_offset(u) <= max &&
+         dest_offset - upper_dest_offset(u) <= max;
+}
+
 template <typename ValueType, typename UpperValueType>
 size_t twolevel_bucketing<ValueType, UpperValueType>::index_offset(
     size_t i) const {
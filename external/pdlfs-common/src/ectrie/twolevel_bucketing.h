@@ -31,6 +31,8 @@ class twolevel_bucketing {
 
   void resize(size_t size, size_t keys_per_bucket, size_t keys_per_block);
   void insert(size_t index_offset, size_t dest_offset);
+  // Return true iff the offsets of the next bucket can be represented.
+  bool fits(size_t index_offset, size_t dest_offset) const;
   void finalize() {}
 
   size_t index_offset(size_t i) const;
@@ -42,6 +42,8 @@ SequentialFile::~SequentialFile() {}
 
 RandomAccessFile::~RandomAccessFile() {}
 
+bool RandomAccessFile::IsMemoryResident() const { return false; }
+
 WritableFile::~WritableFile() {}
 
 WritableFileWrapper::~WritableFileWrapper() {}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/env_faults.h"
+#include "pdlfs-common/mutexlock.h"
+
+#include <algorithm>
+
+namespace pdlfs {
+
+FaultSpec::FaultSpec()
+    : min_micros(0),
+      max_micros(0),
+      tail_one_in(0),
+      tail_micros(0),
+      error_one_in(0) {}
+
+FaultInjectionOptions::FaultInjectionOptions()
+    : read_bytes_per_sec(0),
+      write_bytes_per_sec(0),
+      stall_period_micros(0),
+      stall_micros(0),
+      seed(301) {}
+
+void FaultInjectionStats::Reset() {
+  reads = 0;
+  read_bytes = 0;
+  appends = 0;
+  append_bytes = 0;
+  syncs = 0;
+  errors = 0;
+  delay_micros = 0;
+}
+
+namespace {
+
+class FaultySequentialFile : public SequentialFile {
+ public:
+  FaultySequentialFile(FaultInjectionEnv* env, SequentialFile* base)
+      : env_(env), base_(base) {}
+  virtual ~FaultySequentialFile() { delete base_; }
+
+  virtual Status Read(size_t n, Slice* result, char* scratch) {
+    Status s = env_->Inject(FaultInjectionEnv::kRead, n);
+    if (!s.ok()) {
+      *result = Slice();
+      return s;
+    }
+    return base_->Read(n, result, scratch);
+  }
+
+  virtual Status Skip(uint64_t n) { return base_->Skip(n); }
+
+ private:
+  FaultInjectionEnv* const env_;
+  SequentialFile* const base_;
+};
+
+class FaultyRandomAccessFile : public RandomAccessFile {
+ public:
+  FaultyRandomAccessFile(FaultInjectionEnv* env, RandomAccessFile* base)
+      : env_(env), base_(base) {}
+  virtual ~FaultyRandomAccessFile() { delete base_; }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    Status s = env_->Inject(FaultInjectionEnv::kRead, n);
+    if (!s.ok()) {
+      *result = Slice();
+      return s;
+    }
+    return base_->Read(offset, n, result, scratch);
+  }
+
+ private:
+  FaultInjectionEnv* const env_;
+  RandomAccessFile* const base_;
+};
+
+class FaultyWritableFile : public WritableFile {
+ public:
+  FaultyWritableFile(FaultInjectionEnv* env, WritableFile* base)
+      : env_(env), base_(base) {}
+  virtual ~FaultyWritableFile() { delete base_; }
+
+  virtual Status Append(const Slice& data) {
+    Status s = env_->Inject(FaultInjectionEnv::kAppend, data.size());
+    if (s.ok()) {
+      s = base_->Append(data);
+    }
+    return s;
+  }
+
+  virtual Status Sync() {
+    Status s = env_->Inject(FaultInjectionEnv::kSync, 0);
+    if (s.ok()) {
+      s = base_->Sync();
+    }
+    return s;
+  }
+
+  virtual Status Flush() { return base_->Flush(); }
+  virtual Status Close() { return base_->Close(); }
+
+ private:
+  FaultInjectionEnv* const env_;
+  WritableFile* const base_;
+};
+
+}  // namespace
+
+FaultInjectionEnv::FaultInjectionEnv(Env* base,
+                                     const FaultInjectionOptions& options)
+    : EnvWrapper(base),
+      options_(options),
+      rnd_(options.seed),
+      epoch_(CurrentMicros()),
+      read_ready_(0),
+      write_ready_(0) {}
+
+FaultInjectionEnv::~FaultInjectionEnv() {}
+
+void FaultInjectionEnv::SetOptions(const FaultInjectionOptions& options) {
+  MutexLock ml(&mutex_);
+  if (options.seed != options_.seed) {
+    rnd_ = Random(options.seed);
+  }
+  options_ = options;
+}
+
+FaultInjectionStats FaultInjectionEnv::GetStats() {
+  MutexLock ml(&mutex_);
+  return stats_;
+}
+
+void FaultInjectionEnv::ResetStats() {
+  MutexLock ml(&mutex_);
+  stats_.Reset();
+}
+
+Status FaultInjectionEnv::Inject(OpType type, size_t n) {
+  uint64_t delay = 0;
+  {
+    MutexLock ml(&mutex_);
+    const FaultSpec* spec;
+    uint64_t bytes_per_sec = 0;
+    uint64_t* ready = NULL;
+    switch (type) {
+      case kRead:
+        spec = &options_.read;
+        bytes_per_sec = options_.read_bytes_per_sec;
+        ready = &read_ready_;
+        break;
+      case kAppend:
+        spec = &options_.append;
+        bytes_per_sec = options_.write_bytes_per_sec;
+        ready = &write_ready_;
+        break;
+      default:
+        spec = &options_.sync;
+        break;
+    }
+    if (spec->error_one_in > 0 && rnd_.OneIn(spec->error_one_in)) {
+      stats_.errors++;
+      return Status::IOError("Injected fault");
+    }
+    delay = spec->min_micros;
+    if (spec->max_micros > spec->min_micros) {
+      delay += rnd_.Uniform(spec->max_micros - spec->min_micros + 1);
+    }
+    if (spec->tail_one_in > 0 && rnd_.OneIn(spec->tail_one_in)) {
+      delay += spec->tail_micros;
+    }
+    const uint64_t now = CurrentMicros();
+    if (options_.stall_period_micros != 0) {
+      const uint64_t phase = (now - epoch_) % options_.stall_period_micros;
+      if (phase < options_.stall_micros) {
+        delay += options_.stall_micros - phase;
+      }
+    }
+    // Data transfer starts once the latency has elapsed and all earlier
+    // transfers are done
+    if (bytes_per_sec != 0) {
+      const uint64_t start = std::max(now + delay, *ready);
+      *ready = start + n * 1000000 / bytes_per_sec;
+      delay = *ready - now;
+    }
+    switch (type) {
+      case kRead:
+        stats_.reads++;
+        stats_.read_bytes += n;
+        break;
+      case kAppend:
+        stats_.appends++;
+        stats_.append_bytes += n;
+        break;
+      default:
+        stats_.syncs++;
+        break;
+    }
+    stats_.delay_micros += delay;
+  }
+
+  while (delay != 0) {
+    const int micros = static_cast<int>(std::min<uint64_t>(delay, 1000000));
+    SleepForMicroseconds(micros);
+    delay -= micros;
+  }
+  return Status::OK();
+}
+
+Status FaultInjectionEnv::NewSequentialFile(const char* f,
+                                            SequentialFile** r) {
+  Status s = target()->NewSequentialFile(f, r);
+  if (s.ok()) {
+    *r = new FaultySequentialFile(this, *r);
+  }
+  return s;
+}
+
+Status FaultInjectionEnv::NewRandomAccessFile(const char* f,
+                                              RandomAccessFile** r) {
+  Status s = target()->NewRandomAccessFile(f, r);
+  if (s.ok()) {
+    *r = new FaultyRandomAccessFile(this, *r);
+  }
+  return s;
+}
+
+Status FaultInjectionEnv::NewWritableFile(const char* f, WritableFile** r) {
+  Status s = target()->NewWritableFile(f, r);
+  if (s.ok()) {
+    *r = new FaultyWritableFile(this, *r);
+  }
+  return s;
+}
+
+}  // namespace pdlfs
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/env_faults.h"
+#include "pdlfs-common/testharness.h"
+#include "pdlfs-common/testutil.h"
+
+namespace pdlfs {
+
+class FaultInjectionEnvTest {
+ public:
+  FaultInjectionEnvTest() : env_(Env::Default(), FaultInjectionOptions()) {
+    fname_ = test::TmpDir() + "/fault_injection_env_test";
+  }
+
+  ~FaultInjectionEnvTest() { Env::Default()->DeleteFile(fname_.c_str()); }
+
+  // Append "n" chunks of "size" bytes each, then sync. Return the number of
+  // appends and syncs that failed.
+  int Write(int n, size_t size) {
+    WritableFile* file;
+    ASSERT_OK(env_.NewWritableFile(fname_.c_str(), &file));
+    std::string chunk(size, 'x');
+    int errors = 0;
+    for (int i = 0; i < n; i++) {
+      if (!file->Append(chunk).ok()) errors++;
+    }
+    if (!file->Sync().ok()) errors++;
+    file->Close();
+    delete file;
+    return errors;
+  }
+
+  FaultInjectionEnv env_;
+  std::string fname_;
+};
+
+TEST(FaultInjectionEnvTest, PassThrough) {
+  ASSERT_EQ(Write(10, 100), 0);
+  RandomAccessFile* file;
+  ASSERT_OK(env_.NewRandomAccessFile(fname_.c_str(), &file));
+  char scratch[100];
+  Slice result;
+  ASSERT_OK(file->Read(500, 100, &result, scratch));
+  ASSERT_EQ(result.ToString(), std::string(100, 'x'));
+  delete file;
+  FaultInjectionStats stats = env_.GetStats();
+  ASSERT_EQ(stats.appends, 10);
+  ASSERT_EQ(stats.append_bytes, 1000);
+  ASSERT_EQ(stats.syncs, 1);
+  ASSERT_EQ(stats.reads, 1);
+  ASSERT_EQ(stats.read_bytes, 100);
+  ASSERT_EQ(stats.errors, 0);
+  ASSERT_EQ(stats.delay_micros, 0);
+  env_.ResetStats();
+  ASSERT_EQ(env_.GetStats().appends, 0);
+}
+
+TEST(FaultInjectionEnvTest, Latency) {
+  FaultInjectionOptions options;
+  options.append.min_micros = 1000;
+  options.append.max_micros = 2000;
+  options.sync.min_micros = 10000;
+  env_.SetOptions(options);
+  const uint64_t start = CurrentMicros();
+  ASSERT_EQ(Write(10, 100), 0);
+  const uint64_t elapsed = CurrentMicros() - start;
+  FaultInjectionStats stats = env_.GetStats();
+  ASSERT_GE(stats.delay_micros, 10 * 1000 + 10000);
+  ASSERT_LE(stats.delay_micros, 10 * 2000 + 10000);
+  ASSERT_GE(elapsed, stats.delay_micros);
+}
+
+TEST(FaultInjectionEnvTest, TailLatency) {
+  FaultInjectionOptions options;
+  options.append.tail_one_in = 10;
+  options.append.tail_micros = 100;
+  env_.SetOptions(options);
+  ASSERT_EQ(Write(1000, 1), 0);
+  const uint64_t delay = env_.GetStats().delay_micros;
+  ASSERT_GT(delay, 50 * 100);
+  ASSERT_LT(delay, 150 * 100);
+  // Same seed, same delays
+  env_.ResetStats();
+  options.seed = 302;
+  env_.SetOptions(options);
+  options.seed = 301;
+  env_.SetOptions(options);
+  ASSERT_EQ(Write(1000, 1), 0);
+  ASSERT_EQ(env_.GetStats().delay_micros, delay);
+}
+
+TEST(FaultInjectionEnvTest, Bandwidth) {
+  FaultInjectionOptions options;
+  options.write_bytes_per_sec = 1 << 20;
+  env_.SetOptions(options);
+  const uint64_t start = CurrentMicros();
+  ASSERT_EQ(Write(16, 16 << 10), 0);  // 256KB
+  const uint64_t elapsed = CurrentMicros() - start;
+  ASSERT_GE(elapsed, 250000);
+}
+
+TEST(FaultInjectionEnvTest, Stalls) {
+  FaultInjectionOptions options;
+  options.stall_period_micros = 20000;
+  options.stall_micros = 10000;
+  env_.SetOptions(options);
+  ASSERT_EQ(Write(100, 1), 0);
+  // Each append lands in a stall window at least once in a while
+  ASSERT_GT(env_.GetStats().delay_micros, 0);
+}
+
+TEST(FaultInjectionEnvTest, Errors) {
+  FaultInjectionOptions options;
+  options.append.error_one_in = 4;
+  env_.SetOptions(options);
+  const int errors = Write(1000, 1);
+  ASSERT_GT(errors, 150);
+  ASSERT_LT(errors, 350);
+  FaultInjectionStats stats = env_.GetStats();
+  ASSERT_EQ(stats.errors, errors);
+  ASSERT_EQ(stats.appends, 1000 - errors);
+  options.append.error_one_in = 0;
+  options.sync.error_one_in = 1;
+  env_.SetOptions(options);
+  ASSERT_EQ(Write(10, 1), 1);
+}
+
+}  // namespace pdlfs
+
+int main(int argc, char** argv) {
+  return ::pdlfs::test::RunAllTests(&argc, &argv);
+}
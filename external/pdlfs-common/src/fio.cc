@@ -22,6 +22,43 @@ namespace pdlfs {
 
 Fio::~Fio() {}
 
+Status Fio::Preadv(Request* reqs, size_t n) {
+  Status s;
+  for (size_t i = 0; i < n; i++) {
+    Request* const r = &reqs[i];
+    r->status = Pread(*r->fentry, r->fh, &r->result, r->off, r->size,
+                      r->scratch);
+    if (s.ok()) {
+      s = r->status;
+    }
+  }
+  return s;
+}
+
+Status Fio::Pwritev(Request* reqs, size_t n) {
+  Status s;
+  for (size_t i = 0; i < n; i++) {
+    Request* const r = &reqs[i];
+    r->status = Pwrite(*r->fentry, r->fh, r->data, r->off);
+    if (s.ok()) {
+      s = r->status;
+    }
+  }
+  return s;
+}
+
+void Fio::AsyncPreadv(Request* reqs, size_t n, void (*done)(void*),
+                      void* arg) {
+  Preadv(reqs, n);
+  (*done)(arg);
+}
+
+void Fio::AsyncPwritev(Request* reqs, size_t n, void (*done)(void*),
+                       void* arg) {
+  Pwritev(reqs, n);
+  (*done)(arg);
+}
+
 namespace {
 std::string FetchRoot(const char* input) {
   std::string root = "/tmp/deltafs_data";
@@ -41,6 +78,23 @@ std::string FetchRoot(const char* input) {
 #endif
   return root;
 }
+
+uint64_t FetchNumber(const char* input, const Slice& key) {
+  uint64_t result = 0;
+  std::vector<std::string> confs;
+  SplitString(&confs, input);
+  for (size_t i = 0; i < confs.size(); i++) {
+    Slice input = confs[i];
+    if (input.starts_with(key) && input.size() > key.size() &&
+        input[key.size()] == '=') {
+      input.remove_prefix(key.size() + 1);
+      if (!ParsePrettyNumber(input, &result)) {
+        result = 0;
+      }
+    }
+  }
+  return result;
+}
 }  // namespace
 
 Fio* Fio::Open(const char* name, const char* conf) {
@@ -54,7 +108,17 @@ Fio* Fio::Open(const char* name, const char* conf) {
   if (fio_name == "posix") {
 #if defined(PDLFS_PLATFORM_POSIX)
     std::string root = FetchRoot(fio_conf.c_str());
-    return new PosixFio(root.c_str());
+    int io_threads =
+        static_cast<int>(FetchNumber(fio_conf.c_str(), "io_threads"));
+    Fio* fio = new PosixFio(root.c_str(), io_threads);
+    // A positive "write_back" budget enables write-back caching
+    uint64_t write_back = FetchNumber(fio_conf.c_str(), "write_back");
+    if (write_back != 0) {
+      WriteBackFioOptions options;
+      options.max_buffered_bytes = write_back;
+      fio = Fio::WriteBack(options, fio);
+    }
+    return fio;
 #else
     return NULL;
 #endif
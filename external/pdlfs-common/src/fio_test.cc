@@ -10,8 +10,13 @@
  */
 #include "pdlfs-common/fio.h"
 
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/mutexlock.h"
+#include "pdlfs-common/port.h"
 #include "pdlfs-common/testharness.h"
 
+#include <stdio.h>
+
 namespace pdlfs {
 
 class FioTest {};
@@ -58,6 +63,117 @@ TEST(FioTest, EncodeDecode) {
   ASSERT_EQ(encoding1, encoding2);
 }
 
+class PosixFioTest {
+ public:
+  PosixFioTest() {
+    root_ = test::TmpDir() + "/posix_fio_test";
+    std::string conf = "root=" + root_ + ";io_threads=4";
+    fio_ = Fio::Open("posix", conf.c_str());
+    ASSERT_TRUE(fio_ != NULL);
+    for (int i = 0; i < kNumFiles; i++) {
+      entries_[i].stat.SetInodeNo(100 + i);
+      fio_->Drop(entries_[i]);
+      ASSERT_OK(fio_->Creat(entries_[i], false, &fhs_[i]));
+    }
+  }
+
+  ~PosixFioTest() {
+    for (int i = 0; i < kNumFiles; i++) {
+      fio_->Close(entries_[i], fhs_[i]);
+      fio_->Drop(entries_[i]);
+    }
+    delete fio_;
+  }
+
+  static std::string Data(int i) {
+    char tmp[100];
+    snprintf(tmp, sizeof(tmp), "data-of-file-%d", i);
+    return tmp;
+  }
+
+  static const int kNumFiles = 16;
+  Fentry entries_[kNumFiles];
+  Fio::Handle* fhs_[kNumFiles];
+  std::string root_;
+  Fio* fio_;
+};
+
+TEST(PosixFioTest, VectoredReadWrite) {
+  std::string data[kNumFiles];
+  Fio::Request reqs[kNumFiles];
+  for (int i = 0; i < kNumFiles; i++) {
+    data[i] = Data(i);
+    reqs[i].fentry = &entries_[i];
+    reqs[i].fh = fhs_[i];
+    reqs[i].off = i;
+    reqs[i].data = data[i];
+  }
+  ASSERT_OK(fio_->Pwritev(reqs, kNumFiles));
+  char scratch[kNumFiles][100];
+  for (int i = 0; i < kNumFiles; i++) {
+    reqs[i].size = sizeof(scratch[i]);
+    reqs[i].scratch = scratch[i];
+  }
+  ASSERT_OK(fio_->Preadv(reqs, kNumFiles));
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(reqs[i].status);
+    ASSERT_EQ(reqs[i].result, data[i]);
+  }
+}
+
+namespace {
+struct Completion {
+  Completion() : cv(&mu), done(0) {}
+  port::Mutex mu;
+  port::CondVar cv;
+  int done;
+};
+
+void Complete(void* arg) {
+  Completion* const c = reinterpret_cast<Completion*>(arg);
+  MutexLock ml(&c->mu);
+  c->done++;
+  c->cv.SignalAll();
+}
+
+void WaitFor(Completion* c, int n) {
+  MutexLock ml(&c->mu);
+  while (c->done < n) {
+    c->cv.Wait();
+  }
+}
+}  // namespace
+
+TEST(PosixFioTest, AsyncReadWrite) {
+  std::string data[kNumFiles];
+  Fio::Request reqs[kNumFiles];
+  for (int i = 0; i < kNumFiles; i++) {
+    data[i] = Data(i);
+    reqs[i].fentry = &entries_[i];
+    reqs[i].fh = fhs_[i];
+    reqs[i].data = data[i];
+  }
+  Completion c;
+  // Submit as two independent batches
+  fio_->AsyncPwritev(reqs, kNumFiles / 2, Complete, &c);
+  fio_->AsyncPwritev(reqs + kNumFiles / 2, kNumFiles / 2, Complete, &c);
+  WaitFor(&c, 2);
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(reqs[i].status);
+  }
+  char scratch[kNumFiles][100];
+  for (int i = 0; i < kNumFiles; i++) {
+    reqs[i].size = sizeof(scratch[i]);
+    reqs[i].scratch = scratch[i];
+  }
+  fio_->AsyncPreadv(reqs, kNumFiles, Complete, &c);
+  WaitFor(&c, 3);
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(reqs[i].status);
+    ASSERT_EQ(reqs[i].result, data[i]);
+  }
+}
+
 }  // namespace pdlfs
 
 int main(int argc, char** argv) {
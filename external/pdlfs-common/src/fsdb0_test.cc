@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/fsdb0.h"
+
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/leveldb/db.h"
+#include "pdlfs-common/leveldb/filter_policy.h"
+#include "pdlfs-common/leveldb/iterator.h"
+#include "pdlfs-common/leveldb/options.h"
+#include "pdlfs-common/leveldb/write_batch.h"
+#include "pdlfs-common/testharness.h"
+#include "pdlfs-common/xxhash.h"
+
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <vector>
+
+namespace pdlfs {
+
+namespace {
+struct Tx {
+  const Snapshot* snap;
+  WriteBatch bat;
+};
+
+struct Perf {
+  Perf() : putkeybytes(0), putbytes(0), puts(0), getkeybytes(0), getbytes(0),
+           gets(0) {}
+  uint64_t putkeybytes;
+  uint64_t putbytes;
+  uint64_t puts;
+  uint64_t getkeybytes;
+  uint64_t getbytes;
+  uint64_t gets;
+};
+
+// Hashes of names serving as key suffixes in the kNameInValue format.
+Slice HashName(const Slice& name, char* scratch) {
+  EncodeFixed64(scratch, xxhash64(name.data(), name.size(), 0));
+  return Slice(scratch, 8);
+}
+
+Stat MakeStat(uint64_t ino) {
+  Stat stat;
+#if defined(DELTAFS_PROTO)
+  stat.SetDnodeNo(0);
+#endif
+#if defined(DELTAFS)
+  stat.SetRegId(0);
+  stat.SetSnapId(0);
+#endif
+  stat.SetInodeNo(ino);
+  stat.SetFileSize(ino * 10);
+  stat.SetFileMode(0644);
+#if defined(DELTAFS_PROTO) || defined(DELTAFS) || defined(INDEXFS)
+  stat.SetZerothServer(0);
+#endif
+  stat.SetUserId(1);
+  stat.SetGroupId(1);
+  stat.SetModifyTime(ino);
+  stat.SetChangeTime(ino);
+  return stat;
+}
+
+// Run all fs operations against a fresh db using a given format.
+template <MXDBFormat fmt>
+class MXDBTester {
+ public:
+  typedef MXDB<DB, Slice, Status, fmt> Mx;
+
+  explicit MXDBTester(const std::string& dbname)
+      : dbname_(dbname), filter_(NewBloomFilterPolicy(10)), db_(NULL) {
+    options_.create_if_missing = true;
+    // Spares most lookups of free slots in kNameInValueChained
+    options_.filter_policy = filter_;
+    DestroyDB(dbname_, options_);
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+    mx_ = new Mx(db_);
+  }
+
+  ~MXDBTester() {
+    delete mx_;
+    delete db_;
+    DestroyDB(dbname_, options_);
+    delete filter_;
+  }
+
+  Slice Suffix(const Slice& name, char* scratch) {
+    if (fmt == kNameInKey) {
+      return name;
+    } else if (hashes_.count(name.ToString()) != 0) {
+      EncodeFixed64(scratch, hashes_[name.ToString()]);
+      return Slice(scratch, 8);
+    } else {
+      return HashName(name, scratch);
+    }
+  }
+
+  Status Put(uint64_t dir, const Slice& name, uint64_t ino) {
+    char tmp[8];
+    WriteOptions options;
+    return mx_->template PUT<Key, Tx>(DirId(dir), Suffix(name, tmp),
+                                      MakeStat(ino), name, &options, NULL,
+                                      &perf_);
+  }
+
+  Status Get(uint64_t dir, const Slice& name, Stat* stat, std::string* n) {
+    return Get(dir, name, name, stat, n);
+  }
+
+  // Same as above, but with "fname" passed as the filename of the entry.
+  Status Get(uint64_t dir, const Slice& name, const Slice& fname, Stat* stat,
+             std::string* n) {
+    char tmp[8];
+    ReadOptions options;
+    return mx_->template GET<Key, Tx>(DirId(dir), Suffix(name, tmp), stat, n,
+                                      &options, NULL, &perf_, fname);
+  }
+
+  Status Delete(uint64_t dir, const Slice& name) {
+    return Delete(dir, name, name);
+  }
+
+  // Same as above, but with "fname" passed as the filename of the entry.
+  Status Delete(uint64_t dir, const Slice& name, const Slice& fname) {
+    char tmp[8];
+    WriteOptions options;
+    return mx_->template DELETE<Key, Tx>(DirId(dir), Suffix(name, tmp),
+                                         &options, NULL, fname);
+  }
+
+  Status Exists(uint64_t dir, const Slice& name, const Slice& fname) {
+    char tmp[8];
+    ReadOptions options;
+    return mx_->template EXISTS<Key, Tx>(DirId(dir), Suffix(name, tmp),
+                                         &options, NULL, fname);
+  }
+
+  typedef typename Mx::template Dir<Iterator> Dir;
+
+  Dir* Opendir(uint64_t dir) {
+    ReadOptions options;
+    return mx_->template OPENDIR<Iterator, Key, Tx>(DirId(dir), &options,
+                                                    NULL);
+  }
+
+  // Return names of all entries of a dir in readdir order.
+  std::vector<std::string> Readdir(uint64_t dir, bool with_stats) {
+    std::vector<std::string> names;
+    Dir* const d = Opendir(dir);
+    Stat stat;
+    std::string name;
+    while (mx_->READDIR(d, with_stats ? &stat : NULL, &name).ok()) {
+      if (with_stats) {
+        ASSERT_EQ(stat.InodeNo(), inos_[name]);
+      }
+      names.push_back(name);
+    }
+    mx_->CLOSEDIR(d);
+    return names;
+  }
+
+  size_t List(uint64_t dir, typename Mx::StatList* stats,
+              typename Mx::NameList* names) {
+    ReadOptions options;
+    return mx_->template LIST<Iterator, Key, Tx>(DirId(dir), stats, names,
+                                                 &options, NULL, 1000000);
+  }
+
+  std::string dbname_;
+  const FilterPolicy* filter_;
+  DBOptions options_;
+  DB* db_;
+  Mx* mx_;
+  Perf perf_;
+  std::map<std::string, uint64_t> inos_;
+  // Hashes forced on names. Suffixes are their fixed64 encodings.
+  std::map<std::string, uint64_t> hashes_;
+};
+
+template <MXDBFormat fmt>
+void TestOps(const std::string& dbname) {
+  MXDBTester<fmt> t(dbname);
+  // Names longer than FS_KEY_RESERV go to the heap in kNameInKey
+  const std::string names[] = {"b", "a", "c", "aa", std::string(300, 'x')};
+  for (int i = 0; i < 5; i++) {
+    t.inos_[names[i]] = 100 + i;
+    ASSERT_OK(t.Put(1, names[i], 100 + i));
+  }
+  t.inos_["z"] = 200;
+  ASSERT_OK(t.Put(2, "z", 200));  // Another dir
+  Stat stat;
+  std::string name;
+  for (int i = 0; i < 5; i++) {
+    ASSERT_OK(t.Get(1, names[i], &stat, &name));
+    ASSERT_EQ(stat.InodeNo(), 100 + i);
+    ASSERT_EQ(name, names[i]);
+  }
+  ASSERT_TRUE(t.Get(1, "d", &stat, &name).IsNotFound());
+  ASSERT_EQ(t.perf_.puts, 6);
+  ASSERT_EQ(t.perf_.gets, 6);
+
+  std::vector<std::string> r1 = t.Readdir(1, true);
+  std::vector<std::string> r2 = t.Readdir(1, false);
+  ASSERT_EQ(r1.size(), 5);
+  ASSERT_TRUE(r1 == r2);
+  if (fmt == kNameInKey) {  // Names come out sorted
+    ASSERT_TRUE(std::is_sorted(r1.begin(), r1.end()));
+  }
+  typename MXDBTester<fmt>::Mx::StatList stats;
+  typename MXDBTester<fmt>::Mx::NameList list;
+  ASSERT_EQ(t.List(1, &stats, &list), 5);
+  ASSERT_TRUE(list == r1);
+  ASSERT_EQ(stats.size(), 5);
+  list.clear();
+  ASSERT_EQ(t.List(1, NULL, &list), 5);
+  ASSERT_TRUE(list == r1);
+
+  ASSERT_OK(t.Delete(1, "a"));
+  ASSERT_TRUE(t.Get(1, "a", &stat, &name).IsNotFound());
+  ASSERT_EQ(t.Readdir(1, false).size(), 4);
+  ASSERT_EQ(t.Readdir(2, true).size(), 1);
+  ASSERT_EQ(t.Readdir(3, true).size(), 0);
+}
+}  // namespace
+
+class MXDBTest {
+ public:
+  MXDBTest() { dbname_ = test::PrepareTmpDir("fsdb0_test"); }
+
+  std::string dbname_;
+};
+
+TEST(MXDBTest, NameInValue) { TestOps<kNameInValue>(dbname_); }
+
+TEST(MXDBTest, NameInValueChained) { TestOps<kNameInValueChained>(dbname_); }
+
+TEST(MXDBTest, Collisions) {
+  MXDBTester<kNameInValueChained> t(dbname_);
+  std::vector<std::string> names;
+  for (int i = 0; i < 9; i++) {
+    char tmp[20];
+    snprintf(tmp, sizeof(tmp), "n%d", i);
+    names.push_back(tmp);
+    t.hashes_[tmp] = 12345;
+  }
+  for (int i = 0; i < 8; i++) {
+    t.inos_[names[i]] = 100 + i;
+    ASSERT_OK(t.Put(1, names[i], 100 + i));
+  }
+  ASSERT_TRUE(t.Put(1, names[8], 108).IsBufferFull());
+  Stat stat;
+  std::string name;
+  for (int i = 0; i < 8; i++) {
+    ASSERT_OK(t.Get(1, names[i], &stat, &name));
+    ASSERT_EQ(stat.InodeNo(), 100 + i);
+    ASSERT_EQ(name, names[i]);
+  }
+  ASSERT_TRUE(t.Get(1, names[8], &stat, &name).IsNotFound());
+  // Overwrite an entry in the middle of the chain
+  t.inos_[names[3]] = 203;
+  ASSERT_OK(t.Put(1, names[3], 203));
+  ASSERT_OK(t.Get(1, names[3], &stat, &name));
+  ASSERT_EQ(stat.InodeNo(), 203);
+  ASSERT_EQ(t.Readdir(1, true).size(), 8);
+  // Deleting an entry frees a slot without losing later entries
+  ASSERT_OK(t.Delete(1, names[2]));
+  ASSERT_TRUE(t.Get(1, names[2], &stat, &name).IsNotFound());
+  for (int i = 0; i < 8; i++) {
+    if (i != 2) ASSERT_OK(t.Get(1, names[i], &stat, &name));
+  }
+  t.inos_[names[8]] = 108;
+  ASSERT_OK(t.Put(1, names[8], 108));
+  ASSERT_OK(t.Get(1, names[8], &stat, &name));
+  ASSERT_EQ(t.Readdir(1, true).size(), 8);
+}
+
+// Chains of neighboring hashes may run into each other.
+TEST(MXDBTest, MergedChains) {
+  MXDBTester<kNameInValueChained> t(dbname_);
+  const uint64_t h = 0x0100000000000000ull;  // Big-endian 1
+  t.hashes_["a0"] = h;
+  t.hashes_["a1"] = h;
+  t.hashes_["b0"] = h << 1;  // Big-endian 2
+  ASSERT_OK(t.Put(1, "a0", 1));
+  ASSERT_OK(t.Put(1, "a1", 2));
+  ASSERT_OK(t.Put(1, "b0", 3));  // Overflows to 3
+  Stat stat;
+  std::string name;
+  ASSERT_OK(t.Delete(1, "a0"));  // Moves both a1 and b0 down
+  ASSERT_OK(t.Get(1, "a1", &stat, &name));
+  ASSERT_EQ(stat.InodeNo(), 2);
+  ASSERT_OK(t.Get(1, "b0", &stat, &name));
+  ASSERT_EQ(stat.InodeNo(), 3);
+  ASSERT_OK(t.Delete(1, "a1"));  // b0 cannot move before its hash
+  ASSERT_TRUE(t.Get(1, "a1", &stat, &name).IsNotFound());
+  ASSERT_OK(t.Get(1, "b0", &stat, &name));
+  ASSERT_EQ(stat.InodeNo(), 3);
+  ASSERT_OK(t.Put(1, "a0", 4));
+  ASSERT_OK(t.Get(1, "a0", &stat, &name));
+  ASSERT_EQ(stat.InodeNo(), 4);
+  ASSERT_EQ(t.Readdir(1, false).size(), 2);
+}
+
+// Entries cannot be told apart by their hashes alone.
+TEST(MXDBTest, ChainedNeedsFilename) {
+  MXDBTester<kNameInValueChained> t(dbname_);
+  ASSERT_OK(t.Put(1, "a", 1));
+  ASSERT_OK(t.Exists(1, "a", "a"));
+  ASSERT_TRUE(t.Exists(1, "a", Slice()).IsInvalidArgument());
+  Stat stat;
+  ASSERT_TRUE(t.Get(1, "a", Slice(), &stat, NULL).IsInvalidArgument());
+  ASSERT_TRUE(t.Delete(1, "a", Slice()).IsInvalidArgument());
+  ASSERT_OK(t.Get(1, "a", &stat, NULL));
+  ASSERT_EQ(stat.InodeNo(), 1);
+}
+
+// Indexfs and deltafs keys only have room for name hashes
+#if !defined(DELTAFS) && !defined(INDEXFS)
+TEST(MXDBTest, NameInKey) { TestOps<kNameInKey>(dbname_); }
+#endif
+
+}  // namespace pdlfs
+
+namespace pdlfs {
+namespace {
+// Time creates, stats, and readdirs of a large directory in a given format.
+template <MXDBFormat fmt>
+void BM_Format(const char* label) {
+  const int n = 1000000;
+  MXDBTester<fmt> t(test::PrepareTmpDir("fsdb0_bench"));
+  std::vector<std::string> names;
+  char tmp[30];
+  for (int i = 0; i < n; i++) {
+    snprintf(tmp, sizeof(tmp), "file.%08d.dat",
+             static_cast<int>((uint64_t(i) * 7919) % n));
+    names.push_back(tmp);
+  }
+
+  uint64_t start = CurrentMicros();
+  for (int i = 0; i < n; i++) {
+    ASSERT_OK(t.Put(1, names[i], i));
+  }
+  const double create = double(CurrentMicros() - start) / n;
+  t.db_->CompactRange(NULL, NULL);
+
+  Stat stat;
+  start = CurrentMicros();
+  for (int i = 0; i < n; i++) {
+    ASSERT_OK(t.Get(1, names[(uint64_t(i) * 104729) % n], &stat, NULL));
+  }
+  const double getattr = double(CurrentMicros() - start) / n;
+
+  typename MXDBTester<fmt>::Dir* const d = t.Opendir(1);
+  std::string name;
+  start = CurrentMicros();
+  while (t.mx_->READDIR(d, NULL, &name).ok()) {
+  }
+  const double readdir = double(CurrentMicros() - start) / n;
+  ASSERT_EQ(d->n, n);
+  t.mx_->CLOSEDIR(d);
+
+  fprintf(stderr,
+          "%-21s create: %.3f us/op, stat: %.3f us/op, readdir: %.3f "
+          "us/entry\n",
+          label, create, getattr, readdir);
+}
+}  // namespace
+}  // namespace pdlfs
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    ::pdlfs::BM_Format< ::pdlfs::kNameInValue>("kNameInValue:");
+    ::pdlfs::BM_Format< ::pdlfs::kNameInValueChained>("kNameInValueChained:");
+#if !defined(DELTAFS) && !defined(INDEXFS)
+    ::pdlfs::BM_Format< ::pdlfs::kNameInKey>("kNameInKey:");
+#endif
+    return 0;
+  }
+  return ::pdlfs::test::RunAllTests(&argc, &argv);
+}
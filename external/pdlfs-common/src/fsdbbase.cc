@@ -16,6 +16,8 @@
 #include "pdlfs-common/gigaplus.h"
 #endif
 
+#include <algorithm>
+
 // All fs keys consist of a prefix component and a suffix component. In both
 // tablefs and indexfs, the prefix of a key is a 64-bit integer with the
 // leftmost 56 bits being the parent directory inode no and the rightmost 8 bits
@@ -30,14 +32,12 @@ namespace pdlfs {
     !defined(TABLEFS)
 #define TABLEFS
 #endif
-// Number of bytes reserved for key buffers and key prefix length
+// Number of bytes of key prefixes
 #if defined(DELTAFS_PROTO)
 #define FS_KEY_PREFIX_LENGTH 16
-#define FS_KEY_RESERV 128
 #endif
 #if defined(INDEXFS) || defined(TABLEFS)
 #define FS_KEY_PREFIX_LENGTH 8
-#define FS_KEY_RESERV 128
 #endif
 
 // Indexfs stores hashes of filenames in key suffixes.
@@ -69,15 +69,54 @@ void Key::SetSuffix(const Slice& suff) {  // Reuse SetHash.
 }
 
 #else  // Both deltafs and tablefs use intact base filenames as key suffixes.
+Key::Key(const Key& other) : rep_(buf_), size_(0), capacity_(sizeof(buf_)) {
+  Append(other.Encode());
+}
+
+Key& Key::operator=(const Key& other) {
+  if (this != &other) {
+    size_ = 0;
+    Append(other.Encode());
+  }
+  return *this;
+}
+
+Key::~Key() {
+  if (rep_ != buf_) {
+    delete[] rep_;
+  }
+}
+
+// Reset the key to an uninitialized prefix of a given size.
+void Key::Reset(size_t prefix_size) {
+  assert(prefix_size <= capacity_);
+  size_ = prefix_size;
+}
+
+void Key::Append(const Slice& suff) {
+  if (size_ + suff.size() > capacity_) {
+    const size_t capacity = std::max(size_ + suff.size(), 2 * capacity_);
+    char* const rep = new char[capacity];
+    memcpy(rep, rep_, size_);
+    if (rep_ != buf_) {
+      delete[] rep_;
+    }
+    rep_ = rep;
+    capacity_ = capacity;
+  }
+  memcpy(rep_ + size_, suff.data(), suff.size());
+  size_ += suff.size();
+}
+
 void Key::SetName(const Slice& name) {
-  rep_.resize(FS_KEY_PREFIX_LENGTH);
-  rep_.append(name.data(), name.size());
+  size_ = FS_KEY_PREFIX_LENGTH;
+  Append(name);
 }
 
 void Key::SetOffset(uint64_t off) {
-  rep_.resize(FS_KEY_PREFIX_LENGTH);
+  size_ = FS_KEY_PREFIX_LENGTH;
   off = htobe64(off);
-  rep_.append(reinterpret_cast<char*>(&off), 8);
+  Append(Slice(reinterpret_cast<char*>(&off), 8));
 }
 
 void Key::SetSuffix(const Slice& suff) {  // Reuse SetName.
@@ -134,18 +173,15 @@ size_t PackPrefix(char* dst, uint64_t D, KeyType T) {
 
 // Constructors...
 #if defined(DELTAFS_PROTO)
-Key::Key(uint64_t dno, uint64_t ino, KeyType type) {
-  rep_.reserve(FS_KEY_RESERV);
-  const size_t s = FS_KEY_PREFIX_LENGTH;
-  rep_.resize(s);
-  PackPrefix(&rep_[0], dno, ino, type);
+Key::Key(uint64_t dno, uint64_t ino, KeyType type)
+    : rep_(buf_), capacity_(sizeof(buf_)) {
+  Reset(FS_KEY_PREFIX_LENGTH);
+  PackPrefix(rep_, dno, ino, type);
 }
 
-Key::Key(uint64_t ino, KeyType type) {
-  rep_.reserve(FS_KEY_RESERV);
-  const size_t s = FS_KEY_PREFIX_LENGTH;
-  rep_.resize(s);
-  PackPrefix(&rep_[0], 0, ino, type);
+Key::Key(uint64_t ino, KeyType type) : rep_(buf_), capacity_(sizeof(buf_)) {
+  Reset(FS_KEY_PREFIX_LENGTH);
+  PackPrefix(rep_, 0, ino, type);
 }
 
 #elif defined(INDEXFS)
@@ -156,11 +192,9 @@ Key::Key(uint64_t ino, KeyType type) {
 }
 
 #elif defined(TABLEFS)
-Key::Key(uint64_t ino, KeyType type) {
-  rep_.reserve(FS_KEY_RESERV);
-  const size_t s = FS_KEY_PREFIX_LENGTH;
-  rep_.resize(s);
-  PackPrefix(&rep_[0], ino, type);
+Key::Key(uint64_t ino, KeyType type) : rep_(buf_), capacity_(sizeof(buf_)) {
+  Reset(FS_KEY_PREFIX_LENGTH);
+  PackPrefix(rep_, ino, type);
 }
 
 #else  // Then this is deltafs.
@@ -188,44 +222,47 @@ Key::Key(uint64_t ino, KeyType type) {
 #define PREFIX_INITIALIZER(x, t) x.InodeNo(), t
 #endif
 
+#if defined(DELTAFS) || defined(INDEXFS)
+#define KEY_BUF_INITIALIZER
+#else
+#define KEY_BUF_INITIALIZER : rep_(buf_), capacity_(sizeof(buf_))
+#endif
+
 #if defined(DELTAFS_PROTO) || defined(DELTAFS) || defined(INDEXFS)
-Key::Key(const LookupStat& stat, KeyType type) {
+Key::Key(const LookupStat& stat, KeyType type) KEY_BUF_INITIALIZER {
 #if defined(DELTAFS) || defined(INDEXFS)
   size_t p = PackPrefix(rep_, PREFIX_INITIALIZER(stat, type));
   size_ = p + 8;
 #else
-  rep_.reserve(FS_KEY_RESERV);
-  const size_t s = FS_KEY_PREFIX_LENGTH;
-  rep_.resize(s);
-  PackPrefix(&rep_[0], PREFIX_INITIALIZER(stat, type));
+  Reset(FS_KEY_PREFIX_LENGTH);
+  PackPrefix(rep_, PREFIX_INITIALIZER(stat, type));
 #endif
 }
 #endif
 
-Key::Key(const Stat& stat, KeyType type) {
+Key::Key(const Stat& stat, KeyType type) KEY_BUF_INITIALIZER {
 #if defined(DELTAFS) || defined(INDEXFS)
   size_t p = PackPrefix(rep_, PREFIX_INITIALIZER(stat, type));
   size_ = p + 8;
 #else
-  rep_.reserve(FS_KEY_RESERV);
-  const size_t s = FS_KEY_PREFIX_LENGTH;
-  rep_.resize(s);
-  PackPrefix(&rep_[0], PREFIX_INITIALIZER(stat, type));
+  Reset(FS_KEY_PREFIX_LENGTH);
+  PackPrefix(rep_, PREFIX_INITIALIZER(stat, type));
 #endif
 }
 
-Key::Key(const Slice& prefix) {
+Key::Key(const Slice& prefix) KEY_BUF_INITIALIZER {
 #if defined(DELTAFS) || defined(INDEXFS)
   memcpy(&rep_[0], prefix.data(), prefix.size());
   size_ = prefix.size() + 8;
 #else
-  rep_.reserve(FS_KEY_RESERV);
-  rep_.resize(0);
   assert(prefix.size() == FS_KEY_PREFIX_LENGTH);
-  rep_.append(prefix.data(), prefix.size());
+  Reset(0);
+  Append(prefix);
 #endif
 }
 
+#undef KEY_BUF_INITIALIZER
+
 #if defined(DELTAFS)
 // Return the registry id of the parent directory.
 uint64_t Key::reg_id() const {
@@ -319,7 +356,7 @@ Slice Key::suffix() const {
   Slice r = Slice(rep_ + size_ - 8, 8);
 #else  // suffix = total - prefix
   const size_t s = FS_KEY_PREFIX_LENGTH;
-  Slice r = Slice(&rep_[0] + s, rep_.size() - s);
+  Slice r = Slice(rep_ + s, size_ - s);
 #endif
   return r;
 }
@@ -127,6 +127,27 @@ TEST(KeyTest, KeyEnc6) {
   ASSERT_EQ(k1.prefix(), k3.prefix());
 }
 
+#if !defined(DELTAFS) && !defined(INDEXFS)
+TEST(KeyTest, KeyEnc7) {
+  const std::string long_name(3 * FS_KEY_RESERV, 'L');
+  Key k1(7, kDirEntType);
+  k1.SetName(long_name);
+  ASSERT_EQ(k1.suffix(), long_name);
+  Key k2(k1);
+  ASSERT_EQ(k2.Encode(), k1.Encode());
+  Key k3(7, kDirEntType);
+  k3.SetName(Slice("S"));
+  k2 = k3;
+  ASSERT_EQ(k2.suffix(), Slice("S"));
+  k3 = k1;
+  ASSERT_EQ(k3.Encode(), k1.Encode());
+  k3.SetName(Slice("T"));
+  ASSERT_EQ(k3.suffix(), Slice("T"));
+  ASSERT_EQ(k3.inode(), 7);
+  ASSERT_EQ(k1.suffix(), long_name);
+}
+#endif
+
 class DirIdTest {
   // Empty
 };
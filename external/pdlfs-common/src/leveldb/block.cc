@@ -20,6 +20,7 @@
 #include "pdlfs-common/leveldb/iterator.h"
 
 #include "pdlfs-common/coding.h"
+#include "pdlfs-common/hash.h"
 #include "pdlfs-common/strutil.h"
 
 #include <algorithm>
@@ -36,16 +37,38 @@ inline uint32_t Block::NumRestarts() const {
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      restart_offset_(0),
+      num_restarts_(0),
+      hash_offset_(0),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
   } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
+    size_t limit = size_ - sizeof(uint32_t);
+    num_restarts_ = NumRestarts();
+    if ((num_restarts_ & kBlockHashIndexFlag) != 0) {
+      num_restarts_ &= ~kBlockHashIndexFlag;
+      if (limit < sizeof(uint16_t)) {
+        size_ = 0;
+        return;
+      }
+      limit -= sizeof(uint16_t);
+      num_buckets_ = DecodeFixed16(data_ + limit);
+      if (num_buckets_ == 0 || num_buckets_ > limit) {
+        // The size is too small for the hash index
+        size_ = 0;
+        return;
+      }
+      limit -= num_buckets_;
+      hash_offset_ = limit;
+    }
+    size_t max_restarts_allowed = limit / sizeof(uint32_t);
+    if (num_restarts_ > max_restarts_allowed) {
       // The size is too small for NumRestarts()
       size_ = 0;
     } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      restart_offset_ = limit - num_restarts_ * sizeof(uint32_t);
     }
   }
 }
@@ -212,6 +235,45 @@ class Block::Iter : public Iterator {
     }
   }
 
+  // Use the block's hash index to position the iterator for a point
+  // lookup. See Block::NewIteratorForGet().
+  void SeekForGet(const Slice& target, const uint8_t* buckets,
+                  uint32_t num_buckets) {
+    const Slice user_key = BlockHashIndexKey(target);
+    const uint8_t entry =
+        buckets[Hash(user_key.data(), user_key.size(), 0) % num_buckets];
+    if (entry == kBlockHashCollision) {
+      Seek(target);  // Fall back to a regular binary search
+      return;
+    } else if (entry == kBlockHashNoEntry) {
+      // Key is not in this block
+      current_ = restarts_;
+      restart_index_ = num_restarts_;
+      return;
+    } else if (entry >= num_restarts_) {
+      CorruptionError();
+      return;
+    }
+
+    // Linear search within the restart interval for the first key >= target
+    SeekToRestartPoint(entry);
+    while (true) {
+      if (!ParseNextKey()) {
+        return;
+      }
+      if (restart_index_ != entry) {
+        // All keys of the interval are < target so the block does not
+        // have the key
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        return;
+      }
+      if (Compare(key_, target) >= 0) {
+        return;
+      }
+    }
+  }
+
   virtual void SeekToFirst() {
     SeekToRestartPoint(0);
     ParseNextKey();
@@ -267,12 +329,29 @@ Iterator* Block::NewIterator(const Comparator* cmp) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
+    return NewEmptyIterator();
+  } else {
+    return new Iter(cmp, data_, restart_offset_, num_restarts_);
+  }
+}
+
+Iterator* Block::NewIteratorForGet(const Comparator* cmp, const Slice& target) {
+  if (size_ < sizeof(uint32_t)) {
+    return NewErrorIterator(Status::Corruption("bad block contents"));
+  }
+  if (num_restarts_ == 0) {
     return NewEmptyIterator();
+  }
+  Iter* const iter = new Iter(cmp, data_, restart_offset_, num_restarts_);
+  if (num_buckets_ != 0) {
+    iter->SeekForGet(target,
+                     reinterpret_cast<const uint8_t*>(data_ + hash_offset_),
+                     num_buckets_);
   } else {
-    return new Iter(cmp, data_, restart_offset_, num_restarts);
+    iter->Seek(target);
   }
+  return iter;
 }
 
 }  // namespace pdlfs
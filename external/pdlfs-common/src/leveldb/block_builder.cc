@@ -19,7 +19,9 @@
 #include "pdlfs-common/leveldb/format.h"
 
 #include "pdlfs-common/coding.h"
+#include "pdlfs-common/compression.h"
 #include "pdlfs-common/crc32c.h"
+#include "pdlfs-common/hash.h"
 #include "pdlfs-common/port.h"
 
 #include <assert.h>
@@ -48,6 +50,17 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// Optionally, a hash index may be inserted between the restart array and
+// num_restarts, in which case the top bit of num_restarts is set:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint16
+//     num_restarts | kBlockHashIndexFlag: uint32
+// buckets[hash(user_key) % num_buckets] holds the index of the restart
+// interval in which user_key is stored, kBlockHashNoEntry if no key maps to
+// the bucket, or kBlockHashCollision if keys from different restart
+// intervals map to the same bucket.
 namespace pdlfs {
 
 AbstractBlockBuilder::AbstractBlockBuilder(const Comparator* cmp)
@@ -61,7 +74,9 @@ AbstractBlockBuilder::AbstractBlockBuilder(const Comparator* cmp)
 BlockBuilder::BlockBuilder(int restart_interval)
     : AbstractBlockBuilder(BytewiseComparator()),
       restart_interval_(restart_interval),
-      counter_(0) {
+      counter_(0),
+      next_hash_index_(false),
+      hash_index_(false) {
   restarts_.push_back(0);  // First restart point is at offset 0
   if (restart_interval_ < 1) {
     restart_interval_ = 1;
@@ -73,7 +88,9 @@ BlockBuilder::BlockBuilder(int restart_interval)
 BlockBuilder::BlockBuilder(int restart_interval, const Comparator* cmp)
     : AbstractBlockBuilder(cmp),
       restart_interval_(restart_interval),
-      counter_(0) {
+      counter_(0),
+      next_hash_index_(false),
+      hash_index_(false) {
   restarts_.push_back(0);  // First restart point is at offset 0
   if (restart_interval_ < 1) {
     restart_interval_ = 1;
@@ -106,16 +123,10 @@ Slice AbstractBlockBuilder::Finish(CompressionType compression, bool force) {
 
   const size_t sz = contents.size();
   std::string compressed;
-  switch (compression) {
-    case kNoCompression:
-      break;
-    case kSnappyCompression:
-      if (!port::Snappy_Compress(contents.data(), sz, &compressed) ||
-          (compressed.size() >= (sz - sz / 8u) && !force)) {
-        compression = kNoCompression;
-        compressed.clear();
-      }
-      break;
+  if (!Compress(compression, contents, &compressed) ||
+      (compressed.size() >= (sz - sz / 8u) && !force)) {
+    compression = kNoCompression;
+    compressed.clear();
   }
 
   if (!compressed.empty()) {
@@ -135,13 +146,34 @@ void BlockBuilder::Reset() {
   restarts_.clear();
   restarts_.push_back(0);  // First restart point is at offset 0
   counter_ = 0;
+  hash_index_ = next_hash_index_;
+  hashes_.clear();
+}
+
+void BlockBuilder::SetHashIndex(bool hash_index) {
+  next_hash_index_ = hash_index;
+  if (empty() && !finished_) {
+    hash_index_ = hash_index;
+  }
+}
+
+static uint32_t NumHashBuckets(size_t num_keys) {
+  // Target a bucket utilization of 75%
+  size_t n = num_keys + num_keys / 3 + 1;
+  if (n > 65535) n = 65535;
+  return static_cast<uint32_t>(n | 1);  // Use an odd number of buckets
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
   size_t result = buffer_.size() - buffer_start_;
   if (!finished_) {
     // Plus restart array contents and its length
-    return result + restarts_.size() * sizeof(uint32_t) + sizeof(uint32_t);
+    result += restarts_.size() * sizeof(uint32_t) + sizeof(uint32_t);
+    if (hash_index_) {
+      // Plus hash buckets and their count
+      result += NumHashBuckets(hashes_.size()) + sizeof(uint16_t);
+    }
+    return result;
   } else {
     return result;
   }
@@ -155,11 +187,33 @@ Slice BlockBuilder::Finish(CompressionType compression,
     PutFixed32(&buffer_, restarts_[i]);
   }
   uint32_t num_restarts = static_cast<uint32_t>(restarts_.size());
+  if (hash_index_ && num_restarts <= kBlockHashMaxRestarts) {
+    FinishHashIndex();
+    num_restarts |= kBlockHashIndexFlag;
+  }
   // Remember the array size
   PutFixed32(&buffer_, num_restarts);
   return AbstractBlockBuilder::Finish(compression, force_compression);
 }
 
+void BlockBuilder::FinishHashIndex() {
+  const uint32_t num_buckets = NumHashBuckets(hashes_.size());
+  const size_t start = buffer_.size();
+  buffer_.resize(start + num_buckets, static_cast<char>(kBlockHashNoEntry));
+  uint8_t* const buckets = reinterpret_cast<uint8_t*>(&buffer_[start]);
+  for (size_t i = 0; i < hashes_.size(); i++) {
+    uint8_t* const b = &buckets[hashes_[i].first % num_buckets];
+    if (*b == kBlockHashNoEntry) {
+      *b = hashes_[i].second;
+    } else if (*b != hashes_[i].second) {
+      *b = kBlockHashCollision;
+    }
+  }
+  char buf[2];
+  EncodeFixed16(buf, static_cast<uint16_t>(num_buckets));
+  buffer_.append(buf, sizeof(buf));
+}
+
 Slice AbstractBlockBuilder::Finalize(bool crc32c, uint32_t padding_target,
                                      char padding_char) {
   assert(finished_);
@@ -214,6 +268,17 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   buffer_.append(key.data() + shared, non_shared);
   buffer_.append(value.data(), value.size());
 
+  if (hash_index_ && restarts_.size() <= kBlockHashMaxRestarts) {
+    const Slice user_key = BlockHashIndexKey(key);
+    // Consecutive versions of a user key need only one hash entry
+    // as long as they stay in the same restart interval
+    if (counter_ == 0 || BlockHashIndexKey(last_key_piece) != user_key) {
+      hashes_.push_back(
+          std::make_pair(Hash(user_key.data(), user_key.size(), 0),
+                         static_cast<uint8_t>(restarts_.size() - 1)));
+    }
+  }
+
   // Update state
   last_key_.resize(shared);
   last_key_.append(key.data() + shared, non_shared);
@@ -25,6 +25,7 @@
 #include "../merger.h"
 
 #include "pdlfs-common/leveldb/block.h"
+#include "pdlfs-common/leveldb/compaction_filter.h"
 #include "pdlfs-common/leveldb/db.h"
 #include "pdlfs-common/leveldb/filenames.h"
 #include "pdlfs-common/leveldb/internal_types.h"
@@ -141,7 +142,7 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       bulk_insert_in_progress_(false),
       manual_compaction_(NULL) {
   if (!options_.no_memtable) {
-    mem_ = new MemTable(internal_comparator_);
+    mem_ = NewMemTable();
     mem_->Ref();
   }
   has_imm_.Release_Store(NULL);
@@ -343,6 +344,7 @@ void DBImpl::DeleteObsoleteFiles() {
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
+        case kIdentityFile:
           keep = true;
           break;
       }
@@ -404,6 +406,15 @@ Status DBImpl::Recover(VersionEdit* edit) {
     }
   }
 
+  if (options_.persistent_cache != NULL) {
+    std::string identity;
+    s = GetDBIdentity(env_, dbname_, &identity);
+    if (!s.ok()) {
+      return s;
+    }
+    table_cache_->SetIdentity(identity);
+  }
+
   s = versions_->Recover();
   if (s.ok()) {
     SequenceNumber max_sequence(0);
@@ -511,6 +522,15 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, VersionEdit* edit,
   Log(options_.info_log, 1, "Recovering log into memtable: %s", fname.c_str());
 #endif
 
+  if (options_.recovery_threads > 0) {
+    Status s = ReplayLogFile(&reader, &reporter, &status, edit, max_sequence);
+    if (status.ok()) {
+      status = s;
+    }
+    delete file;
+    return status;
+  }
+
   // Read all the records and add to a memtable
   std::string scratch;
   Slice record;
@@ -525,7 +545,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, VersionEdit* edit,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == NULL) {
-      mem = new MemTable(internal_comparator_);
+      mem = NewMemTable();
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -562,6 +582,207 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, VersionEdit* edit,
   return status;
 }
 
+namespace {
+// Log records read ahead of replay by a background thread.
+struct LogReadahead {
+  LogReadahead(log::Reader* r, log::Reader::Reporter* rep, const Status* s)
+      : reader(r),
+        reporter(rep),
+        read_status(s),
+        cv(&mu),
+        bytes(0),
+        done(false),
+        stop(false) {}
+  log::Reader* const reader;
+  log::Reader::Reporter* const reporter;
+  const Status* const read_status;  // Updated by reporter on corruption
+
+  // State below is protected by mu
+  port::Mutex mu;
+  port::CondVar cv;
+  std::deque<std::string*> records;
+  size_t bytes;  // Total size of records
+  bool done;     // Reader has stopped
+  bool stop;     // Reader should stop
+};
+
+// Stop reading once this many bytes have been read ahead.
+static const size_t kMaxReadaheadBytes = 4 << 20;
+
+void ReadLogRecords(void* arg) {
+  LogReadahead* const ra = reinterpret_cast<LogReadahead*>(arg);
+  std::string scratch;
+  Slice record;
+  while (true) {
+    {
+      MutexLock ml(&ra->mu);
+      while (!ra->stop && ra->bytes >= kMaxReadaheadBytes) {
+        ra->cv.Wait();
+      }
+      if (ra->stop) {
+        break;
+      }
+    }
+    if (!ra->reader->ReadRecord(&record, &scratch) || !ra->read_status->ok()) {
+      break;
+    }
+    if (record.size() < 12) {
+      ra->reporter->Corruption(record.size(),
+                               Status::Corruption("log record too small"));
+      continue;
+    }
+    std::string* const r = new std::string(record.data(), record.size());
+    MutexLock ml(&ra->mu);
+    ra->records.push_back(r);
+    ra->bytes += r->size();
+    ra->cv.SignalAll();
+  }
+  MutexLock ml(&ra->mu);
+  ra->done = true;
+  ra->cv.SignalAll();
+}
+}  // namespace
+
+// A memtable filled during log replay and written to a Level-0 table
+// in the background.
+struct DBImpl::RecoveryDump {
+  DBImpl* db;
+  MemTable* mem;
+  uint64_t file_number;
+  VersionEdit* edit;
+  Status* status;       // First error of all dumps
+  int* pending;         // Number of dumps yet to finish
+  port::CondVar* done;  // Signalled when a dump finishes
+};
+
+void DBImpl::RecoveryDumpWork(void* arg) {
+  RecoveryDump* const d = reinterpret_cast<RecoveryDump*>(arg);
+  DBImpl* const db = d->db;
+  MutexLock ml(&db->mutex_);
+  SequenceNumber ignored_min_seq;
+  SequenceNumber ignored_max_seq;
+  Iterator* const iter = d->mem->NewIterator();
+  Status s = db->WriteLevel0Table(iter, d->edit, NULL, &ignored_min_seq,
+                                  &ignored_max_seq, d->file_number);
+  delete iter;
+  d->mem->Unref();
+  if (!s.ok() && d->status->ok()) {
+    *d->status = s;
+  }
+  --*d->pending;
+  d->done->SignalAll();
+  delete d;
+}
+
+// Replay a log by pipelining record reads, memtable insertion, and
+// memtable dumps across threads. "reporter" is invoked from the reading
+// thread and may update "*read_status", which reading stops on if not ok.
+// REQUIRES: mutex_ has been locked.
+Status DBImpl::ReplayLogFile(log::Reader* reader,
+                             log::Reader::Reporter* reporter,
+                             const Status* read_status, VersionEdit* edit,
+                             SequenceNumber* max_sequence) {
+  mutex_.AssertHeld();
+  LogReadahead ra(reader, reporter, read_status);
+  ThreadPool* const pool = ThreadPool::NewFixed(1 + options_.recovery_threads);
+  Status dump_status;
+  int pending = 0;
+  port::CondVar dump_cv(&mutex_);
+  pool->Schedule(ReadLogRecords, &ra);
+
+  mutex_.Unlock();
+  Status status;
+  WriteBatch batch;
+  MemTable* mem = NULL;
+  while (true) {
+    std::string* record;
+    {
+      MutexLock ml(&ra.mu);
+      while (ra.records.empty() && !ra.done) {
+        ra.cv.Wait();
+      }
+      if (ra.records.empty()) {
+        break;
+      }
+      record = ra.records.front();
+      ra.records.pop_front();
+      ra.bytes -= record->size();
+      ra.cv.SignalAll();
+    }
+    WriteBatchInternal::SetContents(&batch, *record);
+    if (mem == NULL) {
+      mem = NewMemTable();
+      mem->Ref();
+    }
+    status = WriteBatchInternal::InsertInto(&batch, mem);
+    MaybeIgnoreError(&status);
+    if (status.ok()) {
+      const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
+                                      WriteBatchInternal::Count(&batch) - 1;
+      if (last_seq > *max_sequence) {
+        *max_sequence = last_seq;
+      }
+    }
+    delete record;
+    if (!status.ok()) {
+      break;
+    }
+
+    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+      MutexLock ml(&mutex_);
+      // Bound the number of memtables held in memory
+      while (pending >= options_.recovery_threads && dump_status.ok()) {
+        dump_cv.Wait();
+      }
+      status = dump_status;
+      if (!status.ok()) {
+        break;
+      }
+      // Table numbers are allocated in log order so that newer updates
+      // always go to newer Level-0 tables
+      RecoveryDump* const d = new RecoveryDump;
+      d->db = this;
+      d->mem = mem;
+      d->file_number = versions_->NewFileNumber();
+      pending_outputs_.insert(d->file_number);
+      d->edit = edit;
+      d->status = &dump_status;
+      d->pending = &pending;
+      d->done = &dump_cv;
+      pending++;
+      pool->Schedule(RecoveryDumpWork, d);
+      mem = NULL;
+    }
+  }
+
+  {
+    MutexLock ml(&ra.mu);
+    ra.stop = true;
+    ra.cv.SignalAll();
+    while (!ra.done) {
+      ra.cv.Wait();
+    }
+    while (!ra.records.empty()) {
+      delete ra.records.front();
+      ra.records.pop_front();
+    }
+  }
+
+  mutex_.Lock();
+  if (status.ok() && mem != NULL) {
+    status = DumpMemTable(mem, edit, NULL);
+  }
+  while (pending > 0) {
+    dump_cv.Wait();
+  }
+  if (status.ok()) {
+    status = dump_status;
+  }
+  if (mem != NULL) mem->Unref();
+  delete pool;
+  return status;
+}
+
 // REQUIRES: mutex_ has been locked.
 Status DBImpl::DumpMemTable(MemTable* mem, VersionEdit* edit, Version* base) {
   mutex_.AssertHeld();
@@ -575,16 +796,33 @@ Status DBImpl::DumpMemTable(MemTable* mem, VersionEdit* edit, Version* base) {
   return s;
 }
 
+MemTable* DBImpl::NewMemTable() const {
+  return new MemTable(internal_comparator_, options_.memtable_bloom_bytes,
+                      options_.memtable_prefix_len);
+}
+
+// Return the options for building a table at a given level.
+static DBOptions TableOptionsForLevel(const DBOptions& options, int level) {
+  DBOptions result = options;
+  const std::vector<CompressionType>& per_level = options.compression_per_level;
+  if (!per_level.empty()) {
+    result.compression =
+        per_level[std::min(static_cast<size_t>(level), per_level.size() - 1)];
+  }
+  return result;
+}
+
 // REQUIRES: mutex_ has been locked. Will attempt to insert table into deeper
 // levels (limited by options_.max_mem_compact_level) when *base is given.
 // Otherwise, will directly insert table into Level 0.
 Status DBImpl::WriteLevel0Table(Iterator* iter, VersionEdit* edit,
                                 Version* base, SequenceNumber* min_seq,
-                                SequenceNumber* max_seq) {
+                                SequenceNumber* max_seq,
+                                uint64_t file_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = CurrentMicros();
   FileMetaData meta;
-  meta.number = versions_->NewFileNumber();
+  meta.number = file_number != 0 ? file_number : versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
 #if VERBOSE >= 3
   Log(options_.info_log, 3, "Building L0 table ...");
@@ -593,8 +831,8 @@ Status DBImpl::WriteLevel0Table(Iterator* iter, VersionEdit* edit,
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, min_seq,
-                   max_seq, &meta);
+    s = BuildTable(dbname_, env_, TableOptionsForLevel(options_, 0),
+                   table_cache_, iter, min_seq, max_seq, &meta);
     mutex_.Lock();
   }
 #if VERBOSE >= 2
@@ -865,7 +1103,7 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->seq_off,
+    c->edit()->AddFile(c->output_level(), f->number, f->file_size, f->seq_off,
                        f->smallest, f->largest);
     status = versions_->LogAndApply(c->edit(), &mutex_);
     if (!status.ok()) {
@@ -874,7 +1112,7 @@ void DBImpl::BackgroundCompaction() {
 #if VERBOSE >= 3
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, 3, "Moved #%lld to level-%d %lld bytes %s: %s",
-        static_cast<unsigned long long>(f->number), c->level() + 1,
+        static_cast<unsigned long long>(f->number), c->output_level(),
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
 #endif
@@ -936,7 +1174,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   assert(compact->builder == NULL);
 #if VERBOSE >= 3
   Log(options_.info_log, 3, "Building L%d table ...",
-      compact->compaction->level() + 1);
+      compact->compaction->output_level());
 #endif
   uint64_t file_number;
   {
@@ -955,7 +1193,9 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname.c_str(), &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder = new TableBuilder(
+        TableOptionsForLevel(options_, compact->compaction->output_level()),
+        compact->outfile);
   }
   return s;
 }
@@ -1010,7 +1250,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 #if VERBOSE >= 2
     if (s.ok()) {
       Log(options_.info_log, 2, "L%d table #%llu => %llu keys, %llu bytes",
-          compact->compaction->level() + 1,
+          compact->compaction->output_level(),
           static_cast<unsigned long long>(output_number),
           static_cast<unsigned long long>(current_entries),
           static_cast<unsigned long long>(current_bytes));
@@ -1025,16 +1265,17 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
 #if VERBOSE >= 4
   Log(options_.info_log, 4, "Compacted %d@%d + %d@%d files => %lld bytes",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+      compact->compaction->num_input_files(1),
+      compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 #endif
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const SequenceOff off = 0;
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
+    compact->compaction->edit()->AddFile(level, out.number, out.file_size,
                                          off, out.smallest, out.largest);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
@@ -1048,7 +1289,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   Log(options_.info_log, 4, "Compacting %d@%d + %d@%d files ...",
       compact->compaction->num_input_files(0), compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->output_level());
 #endif
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == NULL);
@@ -1069,6 +1310,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  const CompactionFilter* const filter = options_.compaction_filter;
+  std::string filtered_key;  // Deletion marker for a filtered entry
   for (; input->Valid() && !shutting_down_.Acquire_Load();) {
     // Prioritize memtable compactions and bulk insertion work
     if (has_imm_.NoBarrier_Load() != NULL) {
@@ -1096,6 +1339,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     }
 
     Slice key = input->key();
+    Slice value = input->value();
     if (compact->compaction->ShouldStopBefore(key) &&
         compact->builder != NULL) {
       status = FinishCompactionOutputFile(compact, input);
@@ -1135,6 +1379,25 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (filter != NULL && ikey.type == kTypeValue &&
+                 last_sequence_for_key == kMaxSequenceNumber &&
+                 ikey.sequence <= compact->smallest_snapshot &&
+                 filter->Filter(compact->compaction->level(), ikey.user_key,
+                                value)) {
+        // The newest entry for this user key is garbage according to the
+        // application.  Older entries being compacted here will be dropped
+        // by rule (A).  If there may be older entries in higher levels, we
+        // write a deletion marker in place of this entry to shadow them.
+        if (compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+          drop = true;
+        } else {
+          filtered_key.clear();
+          AppendInternalKey(&filtered_key,
+                            ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                              kTypeDeletion));
+          key = filtered_key;
+          value = Slice();
+        }
       }
 
       last_sequence_for_key = ikey.sequence;
@@ -1158,7 +1421,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         }
       }
 
-      compact->builder->Add(key, input->value());
+      compact->builder->Add(key, value);
 
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
@@ -1189,11 +1452,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   stats.micros = CurrentMicros() - start_micros - paused_micros - imm_micros;
   stats.in0 = compact->compaction->num_input_files(0);
   stats.in1 = compact->compaction->num_input_files(1);
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
+  stats.bytes_read = compact->compaction->TotalInputBytes();
   stats.files = compact->outputs.size();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     stats.bytes_written += compact->outputs[i].file_size;
@@ -1201,7 +1460,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   stats.n = 1;
 
   mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+  stats_[compact->compaction->output_level()].Add(stats);
 
   if (status.ok()) {
     status = InstallCompactionResults(compact);
@@ -1212,7 +1471,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 #if VERBOSE >= 1
   VersionSet::LevelSummaryStorage tmp;
   Log(options_.info_log, 1, "Compaction done: L%d->L%d, db => %s",
-      compact->compaction->level(), compact->compaction->level() + 1,
+      compact->compaction->level(), compact->compaction->output_level(),
       versions_->LevelSummary(&tmp));
 #endif
   return status;
@@ -1507,7 +1766,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
         }
 
         bulk_insert_in_progress_ = true;
-        MemTable* const mem = new MemTable(internal_comparator_);
+        MemTable* const mem = NewMemTable();
         mem->Ref();
         status = WriteBatchInternal::InsertInto(final_batch, mem);
         if (status.ok()) {
@@ -1694,13 +1953,15 @@ Status DBImpl::MakeRoomForWrite(bool force) {
         logfile_ = file;
         logfile_number_ = new_log_number;
         log_ = new log::Writer(file);
+        log_->SetCompression(options_.wal_compression,
+                             options_.wal_compression_min_size);
       }
 
       // Attempt to switch to a new memtable and
       // trigger compaction of old
       imm_ = mem_;
       has_imm_.Release_Store(imm_);
-      mem_ = new MemTable(internal_comparator_);
+      mem_ = NewMemTable();
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
@@ -2220,6 +2481,8 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
         impl->logfile_ = file;
         impl->logfile_number_ = new_log_number;
         impl->log_ = new log::Writer(file);
+        impl->log_->SetCompression(options.wal_compression,
+                                   options.wal_compression_min_size);
       }
     }
     if (s.ok()) {
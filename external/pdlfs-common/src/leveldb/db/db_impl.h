@@ -23,6 +23,7 @@
 #include "pdlfs-common/leveldb/snapshot.h"
 
 #include "pdlfs-common/env.h"
+#include "pdlfs-common/log_reader.h"
 #include "pdlfs-common/log_writer.h"
 #include "pdlfs-common/port.h"
 
@@ -131,10 +132,19 @@ class DBImpl : public DB {
   void CompactMemTable();
   Status RecoverLogFile(uint64_t log_number, VersionEdit* edit,
                         SequenceNumber* max_sequence);
+  Status ReplayLogFile(log::Reader* reader, log::Reader::Reporter* reporter,
+                       const Status* read_status, VersionEdit* edit,
+                       SequenceNumber* max_sequence);
+  struct RecoveryDump;
+  static void RecoveryDumpWork(void* arg);
 
+  MemTable* NewMemTable() const;
   Status DumpMemTable(MemTable* mem, VersionEdit* edit, Version* base);
+  // If "file_number" is non-zero, it is used as the number of the new table
+  // instead of a newly allocated one.
   Status WriteLevel0Table(Iterator* iter, VersionEdit* edit, Version* base,
-                          SequenceNumber* min_seq, SequenceNumber* max_seq);
+                          SequenceNumber* min_seq, SequenceNumber* max_seq,
+                          uint64_t file_number = 0);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */);
   WriteBatch* BuildBatchGroup(Writer** last_writer);
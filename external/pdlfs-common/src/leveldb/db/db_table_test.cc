@@ -198,6 +198,7 @@ class BlockConstructor : public Constructor {
     delete block_;
     block_ = NULL;
     BlockBuilder builder(options.block_restart_interval, comparator_);
+    builder.SetHashIndex(options.data_block_hash_index);
 
     for (KVMap::const_iterator it = data.begin(); it != data.end(); ++it) {
       builder.Add(it->first, it->second);
@@ -314,15 +315,15 @@ class KeyConvertingIterator : public Iterator {
 
 class MemTableConstructor : public Constructor {
  public:
-  explicit MemTableConstructor(const Comparator* cmp)
-      : Constructor(cmp), internal_comparator_(cmp) {
-    memtable_ = new MemTable(internal_comparator_);
+  explicit MemTableConstructor(const Comparator* cmp, size_t prefix_len = 0)
+      : Constructor(cmp), internal_comparator_(cmp), prefix_len_(prefix_len) {
+    memtable_ = new MemTable(internal_comparator_, 0, prefix_len_);
     memtable_->Ref();
   }
   ~MemTableConstructor() { memtable_->Unref(); }
   virtual Status FinishImpl(const Options& options, const KVMap& data) {
     memtable_->Unref();
-    memtable_ = new MemTable(internal_comparator_);
+    memtable_ = new MemTable(internal_comparator_, 0, prefix_len_);
     memtable_->Ref();
     int seq = 1;
     for (KVMap::const_iterator it = data.begin(); it != data.end(); ++it) {
@@ -337,6 +338,7 @@ class MemTableConstructor : public Constructor {
 
  private:
   InternalKeyComparator internal_comparator_;
+  size_t prefix_len_;
   MemTable* memtable_;
 };
 
@@ -385,12 +387,19 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+enum TestType {
+  TABLE_TEST,
+  BLOCK_TEST,
+  MEMTABLE_TEST,
+  MEMTABLE_PREFIX_TEST,
+  DB_TEST
+};
 
 struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool hash_index;
 };
 
 static const TestArgs kTestArgList[] = {
@@ -400,6 +409,8 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 16},
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
+    {TABLE_TEST, false, 16, true},
+    {TABLE_TEST, true, 1, true},
 
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
@@ -407,10 +418,14 @@ static const TestArgs kTestArgList[] = {
     {BLOCK_TEST, true, 16},
     {BLOCK_TEST, true, 1},
     {BLOCK_TEST, true, 1024},
+    {BLOCK_TEST, false, 16, true},
+    {BLOCK_TEST, true, 1, true},
 
     // Restart interval does not matter for memtables
     {MEMTABLE_TEST, false, 16},
     {MEMTABLE_TEST, true, 16},
+    {MEMTABLE_PREFIX_TEST, false, 16},
+    {MEMTABLE_PREFIX_TEST, true, 16},
 
     // Do not bother with restart interval variations for DB
     {DB_TEST, false, 16},
@@ -431,6 +446,7 @@ class Harness {
     options_ = Options();
 
     options_.block_restart_interval = args.restart_interval;
+    options_.data_block_hash_index = args.hash_index;
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
@@ -447,6 +463,9 @@ class Harness {
       case MEMTABLE_TEST:
         constructor_ = new MemTableConstructor(options_.comparator);
         break;
+      case MEMTABLE_PREFIX_TEST:
+        constructor_ = new MemTableConstructor(options_.comparator, 1);
+        break;
       case DB_TEST:
         constructor_ = new DBConstructor(options_.comparator);
         break;
@@ -656,6 +675,57 @@ TEST(Harness, ZeroRestartPointsInBlock) {
   delete iter;
 }
 
+TEST(Harness, BlockHashIndex) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  BlockBuilder builder(16, &icmp);
+  builder.SetHashIndex(true);
+  const int kNumKeys = 200;
+  for (int i = 0; i < kNumKeys; i++) {
+    char tmp[20];
+    snprintf(tmp, sizeof(tmp), "k%06d", 2 * i);
+    // Two versions per key
+    for (int j = 0; j < 2; j++) {
+      std::string ikey;
+      AppendInternalKey(&ikey, ParsedInternalKey(tmp, 100 - j, kTypeValue));
+      builder.Add(ikey, tmp);
+    }
+  }
+  std::string data = builder.Finish().ToString();
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  ASSERT_TRUE(block.has_hash_index());
+  for (int i = 0; i < 2 * kNumKeys; i++) {
+    char tmp[20];
+    snprintf(tmp, sizeof(tmp), "k%06d", i);
+    for (SequenceNumber seq = 98; seq <= 101; seq++) {
+      LookupKey lkey(tmp, seq);
+      Iterator* iter = block.NewIteratorForGet(&icmp, lkey.internal_key());
+      ASSERT_OK(iter->status());
+      const bool exists = (i % 2 == 0) && seq >= 99;
+      if (exists) {
+        ASSERT_TRUE(iter->Valid());
+        ParsedInternalKey parsed(Slice(), 0, kTypeValue);
+        ASSERT_TRUE(ParseInternalKey(iter->key(), &parsed));
+        ASSERT_EQ(parsed.user_key, Slice(tmp));
+        ASSERT_EQ(parsed.sequence, std::min<SequenceNumber>(seq, 100));
+      } else if (iter->Valid()) {
+        ASSERT_NE(ExtractUserKey(iter->key()), Slice(tmp));
+      }
+      delete iter;
+    }
+  }
+  // Iteration is not affected by the index
+  Iterator* iter = block.NewIterator(&icmp);
+  int n = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) n++;
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(n, 2 * kNumKeys);
+  delete iter;
+}
+
 // Test the empty key
 TEST(Harness, SimpleEmptyKey) {
   for (int i = 0; i < kNumTestArgs; i++) {
@@ -765,6 +835,85 @@ TEST(MemTableTest, Simple) {
   memtable->Unref();
 }
 
+TEST(MemTableTest, Bloom) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* memtable = new MemTable(cmp, 1024);
+  memtable->Ref();
+  WriteBatch batch;
+  WriteBatchInternal::SetSequence(&batch, 100);
+  for (int i = 0; i < 1000; i += 2) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%d", i);
+    if (i % 10 == 0) {
+      batch.Delete(key);
+    } else {
+      batch.Put(key, std::string("v") + key);
+    }
+  }
+  ASSERT_TRUE(WriteBatchInternal::InsertInto(&batch, memtable).ok());
+
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%d", i);
+    std::string value;
+    db::StringBuf buf(&value);
+    Status s;
+    const bool found =
+        memtable->Get(LookupKey(key, 1000), &buf, size_t(-1), &s);
+    if (i % 2 != 0) {
+      ASSERT_TRUE(!found);
+    } else if (i % 10 == 0) {
+      ASSERT_TRUE(found && s.IsNotFound());
+    } else {
+      ASSERT_TRUE(found && s.ok());
+      ASSERT_EQ(value, std::string("v") + key);
+    }
+  }
+
+  memtable->Unref();
+}
+
+TEST(MemTableTest, PrefixHash) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* memtable = new MemTable(cmp, 0, 4);
+  memtable->Ref();
+  WriteBatch batch;
+  WriteBatchInternal::SetSequence(&batch, 100);
+  batch.Put(std::string("dir2/b"), std::string("v1"));
+  batch.Put(std::string("dir1/a"), std::string("v2"));
+  batch.Put(std::string("dir2/a"), std::string("v3"));
+  batch.Put(std::string("di"), std::string("v4"));  // Shorter than prefix
+  batch.Delete(std::string("dir1/a"));
+  ASSERT_TRUE(WriteBatchInternal::InsertInto(&batch, memtable).ok());
+
+  std::string value;
+  db::StringBuf buf(&value);
+  Status s;
+  ASSERT_TRUE(memtable->Get(LookupKey("dir2/a", 1000), &buf, 100, &s));
+  ASSERT_EQ(value, "v3");
+  ASSERT_TRUE(memtable->Get(LookupKey("di", 1000), &buf, 100, &s));
+  ASSERT_EQ(value, "v4");
+  ASSERT_TRUE(memtable->Get(LookupKey("dir1/a", 1000), &buf, 100, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  s = Status::OK();
+  ASSERT_TRUE(memtable->Get(LookupKey("dir1/a", 101), &buf, 100, &s));
+  ASSERT_EQ(value, "v2");
+  ASSERT_TRUE(!memtable->Get(LookupKey("dir1/b", 1000), &buf, 100, &s));
+  ASSERT_TRUE(!memtable->Get(LookupKey("dir3/a", 1000), &buf, 100, &s));
+
+  Iterator* iter = memtable->NewIterator();
+  std::string result;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey(Slice(), 0, kTypeValue);
+    ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    result += ikey.user_key.ToString() + "@" + NumberToString(ikey.sequence);
+    result += " ";
+  }
+  ASSERT_EQ(result, "di@103 dir1/a@104 dir1/a@101 dir2/a@102 dir2/b@100 ");
+  delete iter;
+  memtable->Unref();
+}
+
 static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   bool result = (val >= low) && (val <= high);
   if (!result) {
@@ -20,6 +20,7 @@
 #include "version_set.h"
 #include "write_batch_internal.h"
 
+#include "pdlfs-common/leveldb/compaction_filter.h"
 #include "pdlfs-common/leveldb/db.h"
 #include "pdlfs-common/leveldb/filenames.h"
 #include "pdlfs-common/leveldb/filter_policy.h"
@@ -27,6 +28,7 @@
 
 #include "pdlfs-common/cache.h"
 #include "pdlfs-common/env.h"
+#include "pdlfs-common/env_faults.h"
 #include "pdlfs-common/hash.h"
 #include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/strutil.h"
@@ -208,7 +210,15 @@ class DBTest {
   const FilterPolicy* filter_policy_;
 
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kFilter,
+    kUncompressed,
+    kHashIndex,
+    kMemTableBloom,
+    kMemTablePrefixHash,
+    kEnd
+  };
   int option_config_;
 
  public:
@@ -255,6 +265,15 @@ class DBTest {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kMemTableBloom:
+        options.memtable_bloom_bytes = 4096;
+        break;
+      case kMemTablePrefixHash:
+        options.memtable_prefix_len = 2;
+        break;
       default:
         break;
     }
@@ -468,6 +487,8 @@ class DBTest {
   // tables that cover a specified range to all levels.
   void FillLevels(const std::string& smallest, const std::string& largest) {
     MakeTables(config::kNumLevels, smallest, largest);
+    // Level-0 compactions triggered above must not run into later steps
+    ASSERT_OK(dbfull()->DrainCompactions());
   }
 
   void DumpFileCounts(const char* label) {
@@ -909,6 +930,88 @@ TEST(DBTest, Recover) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, RecoverCompressedLog) {
+  Options options = CurrentOptions();
+  options.wal_compression = kSnappyCompression;
+  options.wal_compression_min_size = 64;
+  Reopen(&options);
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Put("bar", std::string(1000, 'x')));
+  ASSERT_OK(Put("baz", std::string(100000, 'y')));
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(std::string(1000, 'x'), Get("bar"));
+  ASSERT_EQ(std::string(100000, 'y'), Get("baz"));
+  // Logs are readable regardless of the current setting
+  ASSERT_OK(Put("foo", std::string(1000, 'z')));
+  options.wal_compression = kNoCompression;
+  Reopen(&options);
+  ASSERT_EQ(std::string(1000, 'z'), Get("foo"));
+  ASSERT_EQ(std::string(1000, 'x'), Get("bar"));
+}
+
+TEST(DBTest, PerLevelCompression) {
+  Options options = CurrentOptions();
+  options.compression_per_level.push_back(kNoCompression);
+  options.compression_per_level.push_back(kLZ4Compression);
+  options.compression_per_level.push_back(kZstdCompression);
+  options.compression_dict_bytes = 1024;
+  Reopen(&options);
+  // Unsupported compressors fall back to storing blocks uncompressed
+  Random rnd(301);
+  std::map<std::string, std::string> expected;
+  for (int i = 0; i < 2000; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "key%06d", i);
+    char value[100];
+    snprintf(value, sizeof(value), "{\"id\": %d, \"name\": \"user%d\"}", i,
+             int(rnd.Uniform(100)));
+    ASSERT_OK(Put(key, value));
+    expected[key] = value;
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ(FilesPerLevel(), "0,0,1");
+  for (int i = 0; i < 2; i++) {
+    for (std::map<std::string, std::string>::iterator it = expected.begin();
+         it != expected.end(); ++it) {
+      ASSERT_EQ(it->second, Get(it->first));
+    }
+    Reopen(&options);
+  }
+}
+
+TEST(DBTest, ParallelRecovery) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10 << 20;
+  options.disable_compaction = true;
+  Reopen(&options);
+  // Overwrite keys many times so that newer versions land in later tables
+  Random rnd(301);
+  std::map<std::string, std::string> expected;
+  for (int i = 0; i < 20000; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "key%05d", int(rnd.Uniform(1000)));
+    std::string value = RandomString(&rnd, 50);
+    ASSERT_OK(Put(key, value));
+    expected[key] = value;
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  options.write_buffer_size = 100000;
+  options.recovery_threads = 3;
+  Reopen(&options);
+  ASSERT_GT(NumTableFilesAtLevel(0), 5);
+  for (std::map<std::string, std::string>::iterator it = expected.begin();
+       it != expected.end(); ++it) {
+    ASSERT_EQ(it->second, Get(it->first));
+  }
+  // Replay a log written after a parallel recovery
+  ASSERT_OK(Put("foo", "bar"));
+  Reopen(&options);
+  ASSERT_EQ("bar", Get("foo"));
+}
+
 TEST(DBTest, RecoveryWithEmptyLog) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -1157,6 +1260,38 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, UniversalCompaction) {
+  Options options = CurrentOptions();
+  options.compaction_style = kCompactionStyleUniversal;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  Random rnd(301);
+
+  // Write each key twice so compactions see overwritten values
+  const int kNumKeys = 2000;
+  std::vector<std::string> values(kNumKeys);
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      values[i] = RandomString(&rnd, 500);
+      ASSERT_OK(Put(Key(i), values[i]));
+    }
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+
+  // Sorted runs are placed starting from the last level, with newer runs
+  // at shallower levels
+  Reopen(&options);
+  ASSERT_GT(NumTableFilesAtLevel(config::kNumLevels - 1), 0);
+  ASSERT_LE(NumTableFilesAtLevel(0), options.l0_hard_limit);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1454,6 +1589,64 @@ TEST(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
+namespace {
+// Removes all entries whose value is "garbage"
+class GarbageFilter : public CompactionFilter {
+ public:
+  virtual bool Filter(int level, const Slice& key, const Slice& value) const {
+    return value == "garbage";
+  }
+
+  virtual const char* Name() const { return "test.GarbageFilter"; }
+};
+}  // namespace
+
+TEST(DBTest, CompactionFilter) {
+  GarbageFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  Put("foo", "v1");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  const int last = last_options_.max_mem_compact_level;
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
+
+  // Place a table at level last-1 to prevent merging with preceding mutation
+  Put("a", "begin");
+  Put("z", "end");
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+  ASSERT_EQ(NumTableFilesAtLevel(last - 1), 1);
+
+  Put("foo", "garbage");
+  Put("bar", "garbage");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());  // Moves to level last-2
+  ASSERT_EQ(AllEntriesFor("foo"), "[ garbage, v1 ]");
+  ASSERT_EQ(AllEntriesFor("bar"), "[ garbage ]");
+  dbfull()->TEST_CompactRange(last - 2, NULL, NULL);
+  // foo replaced by a DEL to shadow v1; bar removed since nothing to shadow
+  ASSERT_EQ(AllEntriesFor("foo"), "[ DEL, v1 ]");
+  ASSERT_EQ(AllEntriesFor("bar"), "[ ]");
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("bar"));
+  dbfull()->TEST_CompactRange(last - 1, NULL, NULL);
+  ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
+  ASSERT_EQ("begin", Get("a"));
+  ASSERT_EQ("end", Get("z"));
+
+  // Entries newer than the oldest snapshot are kept
+  Put("foo", "garbage");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  Put("foo", "garbage");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(last - 2, NULL, NULL);
+  ASSERT_EQ(AllEntriesFor("foo"), "[ garbage, garbage ]");
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(last - 1, NULL, NULL);
+  ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
+}
+
 TEST(DBTest, OverlapInLevel0) {
   do {
     ASSERT_EQ(last_options_.max_mem_compact_level, 2)
@@ -1740,6 +1933,41 @@ TEST(DBTest, NonWritableFileSystem) {
   env_->non_writable_.Release_Store(NULL);
 }
 
+// Check that writes and reads against slow and jittery storage complete
+// while compactions and write throttling are active.
+TEST(DBTest, SlowStorage) {
+  FaultInjectionOptions slow_options;
+  slow_options.read.max_micros = 50;
+  slow_options.append.max_micros = 50;
+  slow_options.sync.min_micros = 500;
+  slow_options.sync.tail_one_in = 10;
+  slow_options.sync.tail_micros = 20000;
+  slow_options.write_bytes_per_sec = 64 << 20;
+  slow_options.stall_period_micros = 200000;
+  slow_options.stall_micros = 10000;
+  FaultInjectionEnv slow_env(env_, slow_options);
+  Options options = CurrentOptions();
+  options.env = &slow_env;
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+  Random rnd(301);
+  std::vector<std::string> values;
+  WriteOptions sync;
+  sync.sync = true;
+  for (int i = 0; i < 500; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+    ASSERT_OK(db_->Put(i % 50 == 0 ? sync : WriteOptions(), Key(i), values[i]));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 500; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+  Close();
+  FaultInjectionStats stats = slow_env.GetStats();
+  ASSERT_GT(stats.syncs, 10);
+  ASSERT_GT(stats.delay_micros, 0);
+}
+
 TEST(DBTest, WriteSyncError) {
   // Check that log sync errors cause the DB to disallow future writes.
 
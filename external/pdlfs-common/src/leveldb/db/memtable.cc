@@ -15,11 +15,15 @@
  * found at https://github.com/google/leveldb.
  */
 #include "memtable.h"
+#include "../merger.h"
 
 #include "pdlfs-common/coding.h"
 #include "pdlfs-common/env.h"
+#include "pdlfs-common/hash.h"
 
 #include <algorithm>
+#include <new>
+#include <vector>
 
 namespace pdlfs {
 
@@ -30,13 +34,116 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& cmp)
-    : comparator_(cmp), refs_(0), table_(comparator_, &arena_) {}
+// Number of probes per key.  Optimal for about 10 bits per key.
+static const int kBloomProbes = 6;
 
-MemTable::~MemTable() { assert(refs_ == 0); }
+// Number of hash chains for prefix buckets.
+static const size_t kNumBucketChains = 4096;
+
+MemTable::MemTable(const InternalKeyComparator& cmp, size_t bloom_bytes,
+                   size_t prefix_len)
+    : comparator_(cmp),
+      refs_(0),
+      bloom_(NULL),
+      bloom_bits_(0),
+      table_(comparator_, &arena_),
+      prefix_len_(prefix_len),
+      buckets_(NULL),
+      last_bucket_(NULL) {
+  if (bloom_bytes != 0) {
+    const size_t words = (bloom_bytes + 3) / 4;
+    bloom_ = new std::atomic<uint32_t>[words]();
+    bloom_bits_ = words * 32;
+  }
+  if (prefix_len_ != 0) {
+    char* const mem = arena_.AllocateAligned(sizeof(port::AtomicPointer) *
+                                             kNumBucketChains);
+    buckets_ = reinterpret_cast<port::AtomicPointer*>(mem);
+    for (size_t i = 0; i < kNumBucketChains; i++) {
+      new (&buckets_[i]) port::AtomicPointer(NULL);
+    }
+  }
+}
+
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete[] bloom_;
+}
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
 
+Slice MemTable::KeyPrefix(const Slice& user_key) const {
+  return Slice(user_key.data(), std::min(user_key.size(), prefix_len_));
+}
+
+static uint32_t PrefixHash(const Slice& prefix) {
+  return Hash(prefix.data(), prefix.size(), 0x71b3a2c5);
+}
+
+MemTable::Bucket* MemTable::FindBucket(const Slice& prefix,
+                                       uint32_t hash) const {
+  Bucket* b = reinterpret_cast<Bucket*>(
+      buckets_[hash % kNumBucketChains].Acquire_Load());
+  while (b != NULL && b->prefix != prefix) {
+    b = b->next;
+  }
+  return b;
+}
+
+// Return the skiplist for inserting "user_key", creating it if needed.
+// REQUIRES: prefix_len_ is not zero; only called by the single writer.
+MemTable::Table* MemTable::TableFor(const Slice& user_key) {
+  const Slice prefix = KeyPrefix(user_key);
+  const uint32_t hash = PrefixHash(prefix);
+  Bucket* b = FindBucket(prefix, hash);
+  if (b == NULL) {
+    Slice copy;  // Empty keys have an empty prefix, which needs no space
+    if (!prefix.empty()) {
+      char* const p = arena_.Allocate(prefix.size());
+      memcpy(p, prefix.data(), prefix.size());
+      copy = Slice(p, prefix.size());
+    }
+    char* const mem = arena_.AllocateAligned(sizeof(Bucket));
+    b = new (mem) Bucket(copy, comparator_, &arena_);
+    port::AtomicPointer* const head = &buckets_[hash % kNumBucketChains];
+    b->next = reinterpret_cast<Bucket*>(head->NoBarrier_Load());
+    b->next_created = reinterpret_cast<Bucket*>(last_bucket_.NoBarrier_Load());
+    head->Release_Store(b);
+    last_bucket_.Release_Store(b);
+  }
+  return &b->table;
+}
+
+static uint32_t BloomHash(const Slice& user_key) {
+  return Hash(user_key.data(), user_key.size(), 0x5ba3c1e7);
+}
+
+void MemTable::AddToBloom(const Slice& user_key) {
+  // Use double-hashing to generate a sequence of hash values.
+  uint32_t h = BloomHash(user_key);
+  const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+  for (int j = 0; j < kBloomProbes; j++) {
+    const size_t bitpos = h % bloom_bits_;
+    bloom_[bitpos / 32].fetch_or(1u << (bitpos % 32),
+                                 std::memory_order_relaxed);
+    h += delta;
+  }
+}
+
+bool MemTable::BloomMayMatch(const Slice& user_key) const {
+  uint32_t h = BloomHash(user_key);
+  const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+  for (int j = 0; j < kBloomProbes; j++) {
+    const size_t bitpos = h % bloom_bits_;
+    if ((bloom_[bitpos / 32].load(std::memory_order_relaxed) &
+         (1u << (bitpos % 32))) == 0) {
+      return false;
+    }
+    h += delta;
+  }
+  return true;
+}
+
 int MemTable::KeyComparator::operator()(const char* aptr,
                                         const char* bptr) const {
   // Internal keys are encoded as length-prefixed strings.
@@ -82,7 +189,20 @@ class MemTableIterator : public Iterator {
   void operator=(const MemTableIterator&);
 };
 
-Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
+Iterator* MemTable::NewIterator() {
+  if (prefix_len_ == 0) {
+    return new MemTableIterator(&table_);
+  }
+  // Buckets created after this point only hold newer entries
+  std::vector<Iterator*> list;
+  Bucket* b = reinterpret_cast<Bucket*>(last_bucket_.Acquire_Load());
+  for (; b != NULL; b = b->next_created) {
+    list.push_back(new MemTableIterator(&b->table));
+  }
+  return NewMergingIterator(&comparator_.comparator,
+                            list.empty() ? NULL : &list[0],
+                            static_cast<int>(list.size()));
+}
 
 void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                    const Slice& value) {
@@ -106,12 +226,31 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert((p + val_size) - buf == encoded_len);
-  table_.Insert(buf);
+  if (bloom_ != NULL) {
+    AddToBloom(key);  // Set before the entry becomes visible to readers
+  }
+  if (prefix_len_ != 0) {
+    TableFor(key)->Insert(buf);
+  } else {
+    table_.Insert(buf);
+  }
 }
 
 bool MemTable::Get(const LookupKey& key, Buffer* buf, size_t limit, Status* s) {
+  if (bloom_ != NULL && !BloomMayMatch(key.user_key())) {
+    return false;
+  }
+  const Table* table = &table_;
+  if (prefix_len_ != 0) {
+    const Slice prefix = KeyPrefix(key.user_key());
+    Bucket* const b = FindBucket(prefix, PrefixHash(prefix));
+    if (b == NULL) {
+      return false;
+    }
+    table = &b->table;
+  }
   Slice memkey = key.memtable_key();
-  Table::Iterator iter(&table_);
+  Table::Iterator iter(table);
   iter.Seek(memkey.data());
   if (iter.Valid()) {
     // entry format is:
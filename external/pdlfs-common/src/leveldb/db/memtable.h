@@ -19,9 +19,11 @@
 #include "../skiplist.h"
 
 #include "pdlfs-common/arena.h"
+#include "pdlfs-common/atomic_pointer.h"
 #include "pdlfs-common/leveldb/internal_types.h"
 #include "pdlfs-common/leveldb/iterator.h"
 
+#include <atomic>
 #include <string>
 
 namespace pdlfs {
@@ -32,8 +34,14 @@ class MemTableIterator;
 class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
-  // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  // is zero and the caller must call Ref() at least once.  If
+  // "bloom_bytes" is not zero, a bloom filter of that size is built over
+  // the user keys inserted so that Get() can skip searching the memtable
+  // for most keys not in it.  If "prefix_len" is not zero, entries are
+  // hashed by the first "prefix_len" bytes of their user keys into
+  // separate skiplists instead of going into a single skiplist.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    size_t bloom_bytes = 0, size_t prefix_len = 0);
 
   // Increase reference count.
   void Ref() { ++refs_; }
@@ -86,10 +94,35 @@ class MemTable {
 
   typedef SkipList<const char*, KeyComparator> Table;
 
+  // A skiplist holding all entries whose user keys share a prefix.
+  struct Bucket {
+    Bucket(const Slice& p, const KeyComparator& cmp, Arena* arena)
+        : prefix(p), table(cmp, arena), next(NULL), next_created(NULL) {}
+    Slice prefix;  // Points into the arena
+    Table table;
+    // Links below are set before a bucket is published and never change
+    Bucket* next;          // Next bucket in the same hash chain
+    Bucket* next_created;  // Bucket created before this one
+  };
+
+  Slice KeyPrefix(const Slice& user_key) const;
+  Bucket* FindBucket(const Slice& prefix, uint32_t hash) const;
+  Table* TableFor(const Slice& user_key);
+  void AddToBloom(const Slice& user_key);
+  bool BloomMayMatch(const Slice& user_key) const;
+
   KeyComparator comparator_;
   int refs_;
+  // Bits are only set by the single writer, but may be read concurrently
+  std::atomic<uint32_t>* bloom_;
+  size_t bloom_bits_;
   Arena arena_;
-  Table table_;
+  Table table_;  // Holds all entries unless prefix_len_ is not zero
+  const size_t prefix_len_;
+  // Hash table of buckets.  Chain heads are published by the single
+  // writer using release stores so readers may look up concurrently.
+  port::AtomicPointer* buckets_;
+  port::AtomicPointer last_bucket_;  // Most recently created bucket
 
   // No copying allowed
   MemTable(const MemTable&);
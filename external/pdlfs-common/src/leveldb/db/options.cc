@@ -35,19 +35,28 @@ DBOptions::DBOptions()
       info_log(NULL),
       compaction_pool(NULL),
       write_buffer_size(4 * 1048576),
+      recovery_threads(0),
+      memtable_bloom_bytes(0),
+      memtable_prefix_len(0),
       table_cache(NULL),
       block_cache(NULL),
+      persistent_cache(NULL),
       block_size(4 * 1024),
       block_restart_interval(16),
       index_block_restart_interval(1),
+      data_block_hash_index(false),
       compression(kSnappyCompression),
+      compression_dict_bytes(0),
       filter_policy(NULL),
+      compaction_filter(NULL),
       no_memtable(false),
       gc_skip_deletion(false),
       skip_lock_file(false),
       rotating_manifest(false),
       sync_log_on_close(false),
       disable_write_ahead_log(false),
+      wal_compression(kNoCompression),
+      wal_compression_min_size(256),
       disable_compaction(false),
       disable_seek_compaction(false),
       table_builder_skip_verification(false),
@@ -59,7 +68,10 @@ DBOptions::DBOptions()
       l1_compaction_trigger(5),
       l0_compaction_trigger(4),
       l0_soft_limit(8),
-      l0_hard_limit(12) {}
+      l0_hard_limit(12),
+      compaction_style(kCompactionStyleLevel),
+      universal_size_ratio(1),
+      universal_max_size_amplification_percent(200) {}
 
 ReadOptions::ReadOptions()
     : verify_checksums(false),
@@ -119,7 +131,10 @@ DBOptions SanitizeOptions(const std::string& dbname,
       result.info_log = NULL;
     }
   }
-  if (result.disable_compaction) {
+  ClipToRange(&result.universal_size_ratio, 0, 100);
+  ClipToRange(&result.universal_max_size_amplification_percent, 1, 10000);
+  if (result.disable_compaction ||
+      result.compaction_style == kCompactionStyleUniversal) {
     result.disable_seek_compaction = true;
   }
   if (result.block_cache == NULL) {
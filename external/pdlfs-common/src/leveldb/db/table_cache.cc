@@ -18,6 +18,7 @@
 
 #include "pdlfs-common/leveldb/filenames.h"
 #include "pdlfs-common/leveldb/options.h"
+#include "pdlfs-common/leveldb/persistent_cache.h"
 #include "pdlfs-common/leveldb/table.h"
 
 #include "pdlfs-common/coding.h"
@@ -31,6 +32,54 @@ struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
 };
+
+// Serve reads from a persistent cache when possible. Cache keys consist of
+// the db's identity, the table's file number and size, and the offset and
+// size of each read. The identity keeps dbs sharing a cache, or a db
+// recreated at the same location, from seeing each other's blocks.
+// Data is always returned in the caller's scratch buffer so tables never
+// treat the file as memory resident.
+class PersistentCacheFile : public RandomAccessFile {
+ public:
+  PersistentCacheFile(PersistentCache* cache, RandomAccessFile* base,
+                      const Slice& identity, uint64_t file_number,
+                      uint64_t file_size)
+      : cache_(cache), base_(base) {
+    PutLengthPrefixedSlice(&prefix_, identity);
+    PutFixed64(&prefix_, file_number);
+    PutFixed64(&prefix_, file_size);
+  }
+
+  virtual ~PersistentCacheFile() { delete base_; }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    std::string key = prefix_;
+    PutFixed64(&key, offset);
+    PutFixed64(&key, n);
+    std::string data;
+    if (cache_->Lookup(key, &data) && data.size() == n) {
+      memcpy(scratch, data.data(), n);
+      *result = Slice(scratch, n);
+      return Status::OK();
+    }
+    Status s = base_->Read(offset, n, result, scratch);
+    if (s.ok() && result->data() != scratch) {
+      memcpy(scratch, result->data(), result->size());
+      *result = Slice(scratch, result->size());
+    }
+    if (s.ok() && result->size() == n) {
+      cache_->Insert(key, *result);
+    }
+    return s;
+  }
+
+ private:
+  PersistentCache* const cache_;
+  RandomAccessFile* const base_;
+  std::string prefix_;
+};
+
 }  // namespace
 
 TableCache::TableCache(const std::string& dbname, const Options* options,
@@ -48,6 +97,10 @@ Status TableCache::OpenTable(uint64_t file_number, uint64_t file_size,
   std::string fname = TableFileName(dbname_, file_number);
   if (!prefetch) {
     s = env_->NewRandomAccessFile(fname.c_str(), file);
+    if (s.ok() && options_->persistent_cache != NULL && !identity_.empty()) {
+      *file = new PersistentCacheFile(options_->persistent_cache, *file,
+                                      identity_, file_number, file_size);
+    }
   } else {
     SequentialFile* base;
     s = env_->NewSequentialFile(fname.c_str(), &base);
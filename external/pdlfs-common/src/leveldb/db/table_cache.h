@@ -63,6 +63,11 @@ class TableCache {
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Set the identity of the db whose tables are cached. Reads are only
+  // served from options->persistent_cache once an identity has been set.
+  // REQUIRES: no table has been opened yet.
+  void SetIdentity(const std::string& identity) { identity_ = identity; }
+
  private:
   // Fetch table from storage. By default, only table header and metadata blocks
   // are fetched. If prefetch is true, will read the entire table into memory so
@@ -85,6 +90,7 @@ class TableCache {
   const Options* options_;
   Cache* cache_;
   uint64_t id_;
+  std::string identity_;
 };
 
 }  // namespace pdlfs
@@ -99,8 +99,13 @@ Version::~Version() {
 
 int FindFile(const InternalKeyComparator& icmp,
              const std::vector<FileMetaData*>& files, const Slice& key) {
-  uint32_t left = 0;
-  uint32_t right = files.size();
+  return FindFileInRange(icmp, files, key, 0, files.size());
+}
+
+int FindFileInRange(const InternalKeyComparator& icmp,
+                    const std::vector<FileMetaData*>& files, const Slice& key,
+                    uint32_t left, uint32_t right) {
+  assert(left <= right && right <= files.size());
   while (left < right) {
     uint32_t mid = (left + right) / 2;
     const FileMetaData* f = files[mid];
@@ -117,6 +122,52 @@ int FindFile(const InternalKeyComparator& icmp,
   return right;
 }
 
+void BuildFileIndex(const InternalKeyComparator& icmp,
+                    const std::vector<FileMetaData*>& files,
+                    const std::vector<FileMetaData*>& next_files,
+                    std::vector<FileIndexEntry>* index) {
+  index->resize(files.size());
+  // Both lists are sorted and disjoint so the positions at the next
+  // level are non-decreasing. A single forward sweep finds all of them.
+  uint32_t j = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    const Slice smallest = files[i]->smallest.Encode();
+    while (j < next_files.size() &&
+           icmp.Compare(next_files[j]->largest.Encode(), smallest) < 0) {
+      j++;
+    }
+    (*index)[i].smallest_pos = j;
+    const Slice largest = files[i]->largest.Encode();
+    while (j < next_files.size() &&
+           icmp.Compare(next_files[j]->largest.Encode(), largest) < 0) {
+      j++;
+    }
+    (*index)[i].largest_pos = j;
+  }
+}
+
+void NextLevelSearchRange(const InternalKeyComparator& icmp,
+                          const std::vector<FileMetaData*>& files,
+                          const std::vector<FileIndexEntry>& index,
+                          const Slice& key, uint32_t pos,
+                          uint32_t next_level_files, uint32_t* left,
+                          uint32_t* right) {
+  assert(index.size() == files.size());
+  if (pos >= files.size()) {
+    // Key is after all files at this level
+    *left = index.empty() ? 0 : index.back().largest_pos;
+    *right = next_level_files;
+  } else if (icmp.Compare(key, files[pos]->smallest.Encode()) >= 0) {
+    // Key is within [smallest,largest] of files[pos]
+    *left = index[pos].smallest_pos;
+    *right = index[pos].largest_pos;
+  } else {
+    // Key is in the gap between files[pos-1] and files[pos]
+    *left = (pos == 0) ? 0 : index[pos - 1].largest_pos;
+    *right = index[pos].smallest_pos;
+  }
+}
+
 static bool AfterFile(const Comparator* ucmp, const Slice* user_key,
                       const FileMetaData* f) {
   // NULL user_key occurs before all keys and is therefore never after *f
@@ -333,12 +384,12 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
   }
 
   // Search other levels.
+  uint32_t left = 0;
+  uint32_t right = files_[1].size();
   for (int level = 1; level < config::kNumLevels; level++) {
+    // Find earliest index whose largest key >= internal_key.
+    uint32_t index = LocateFile(level, internal_key, &left, &right);
     size_t num_files = files_[level].size();
-    if (num_files == 0) continue;
-
-    // Binary search to find earliest index whose largest key >= internal_key.
-    uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
     if (index < num_files) {
       FileMetaData* f = files_[level][index];
       if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
@@ -368,8 +419,17 @@ bool Version::Get(const ReadOptions& options, const LookupKey& k, Buffer* buf,
   // in an smaller level, later levels are irrelevant.
   std::vector<FileMetaData*> tmp;
   FileMetaData* tmp2;
+  // Search window at the next level narrowed by fractional cascading.
+  uint32_t left = 0;
+  uint32_t right = files_[1].size();
   for (int level = 0; level < config::kNumLevels; level++) {
     size_t num_files = files_[level].size();
+    uint32_t index = 0;
+    if (level > 0) {
+      // Always go through LocateFile() so that the window handed down
+      // to the next level stays valid even if this level is empty.
+      index = LocateFile(level, ikey, &left, &right);
+    }
     if (num_files == 0) continue;
 
     // Get the list of files to search in this level
@@ -391,8 +451,7 @@ bool Version::Get(const ReadOptions& options, const LookupKey& k, Buffer* buf,
       files = &tmp[0];
       num_files = tmp.size();
     } else {
-      // Binary search to find earliest index whose largest key >= ikey.
-      uint32_t index = FindFile(vset_->icmp_, files_[level], ikey);
+      // Earliest index whose largest key >= ikey was located above.
       if (index >= num_files) {
         files = NULL;
         num_files = 0;
@@ -450,6 +509,24 @@ bool Version::Get(const ReadOptions& options, const LookupKey& k, Buffer* buf,
   return false;
 }
 
+uint32_t Version::LocateFile(int level, const Slice& ikey, uint32_t* left,
+                             uint32_t* right) const {
+  assert(level >= 1);
+  const std::vector<FileMetaData*>& files = files_[level];
+  uint32_t index = FindFileInRange(vset_->icmp_, files, ikey, *left, *right);
+  if (level + 1 < config::kNumLevels) {
+    const uint32_t next_level_files = files_[level + 1].size();
+    if (!file_index_[level].empty()) {
+      NextLevelSearchRange(vset_->icmp_, files, file_index_[level], ikey,
+                           index, next_level_files, left, right);
+    } else {
+      *left = 0;
+      *right = next_level_files;
+    }
+  }
+  return index;
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != NULL) {
@@ -521,7 +598,9 @@ bool Version::OverlapInLevel(int level, const Slice* smallest_user_key,
 int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                         const Slice& largest_user_key) {
   int level = 0;
-  if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+  if (vset_->options_->compaction_style == kCompactionStyleUniversal) {
+    // Sorted runs below level-0 are only created by universal compactions
+  } else if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
@@ -868,7 +947,8 @@ Status VersionSet::ForeighApply(VersionEdit* edit) {
     builder.SaveTo(v);
   }
   // No need to finalize the new version since we are not going to
-  // do any compaction.
+  // do any compaction. Still, lookups need their search index.
+  BuildFileIndex(v);
 
   // Install the new version
   AppendVersion(v);
@@ -1232,8 +1312,30 @@ void VersionSet::Finalize(Version* v) {
     }
   }
 
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    // Universal compactions always start from level-0 and are only
+    // triggered by the number of level-0 files
+    best_level = 0;
+    best_score = v->files_[0].size() /
+                 static_cast<double>(options_->l0_compaction_trigger);
+  }
+
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  BuildFileIndex(v);
+}
+
+void VersionSet::BuildFileIndex(Version* v) {
+  for (int level = 1; level < config::kNumLevels - 1; level++) {
+    std::vector<FileIndexEntry>* const index = &v->file_index_[level];
+    if (!v->files_[level].empty() && !v->files_[level + 1].empty()) {
+      ::pdlfs::BuildFileIndex(icmp_, v->files_[level], v->files_[level + 1],
+                              index);
+    } else {
+      index->clear();
+    }
+  }
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1395,13 +1497,22 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   // Level-0 files have to be merged together. For other levels, we will make a
   // concatenating iterator per level.
   // XXX: use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
+  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2) +
+                    (c->output_level() - c->level() - 1);
   Iterator** list = new Iterator*[space];
   int num = 0;
-  for (int which = 0; which < 2; which++) {
-    if (!c->inputs_[which].empty()) {
-      if (c->level() + which == 0) {
-        const std::vector<FileMetaData*>& files = c->inputs_[which];
+  for (int level = c->level(); level <= c->output_level(); level++) {
+    const std::vector<FileMetaData*>* inputs;
+    if (level == c->level()) {
+      inputs = &c->inputs_[0];
+    } else if (level == c->output_level()) {
+      inputs = &c->inputs_[1];
+    } else {
+      inputs = &c->middle_inputs_[level];
+    }
+    if (!inputs->empty()) {
+      if (level == 0) {
+        const std::vector<FileMetaData*>& files = *inputs;
         for (size_t i = 0; i < files.size(); i++) {
           if (!options_->prefetch_compaction_input) {
             list[num++] = table_cache_->NewIterator(options, files[i]->number,
@@ -1416,11 +1527,11 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       } else {  // Create concatenating iterator for the files from this level
         if (!options_->prefetch_compaction_input) {
           list[num++] = NewTwoLevelIterator(
-              new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+              new Version::LevelFileNumIterator(icmp_, inputs),
               &GetFileIterator, table_cache_, options);
         } else {
           list[num++] = NewTwoLevelIterator(
-              new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+              new Version::LevelFileNumIterator(icmp_, inputs),
               &GetPrefetchedFileIterator, table_cache_, options);
         }
       }
@@ -1433,6 +1544,10 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 }
 
 Compaction* VersionSet::PickCompaction(bool allow_seek_compaction) {
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    return PickUniversalCompaction();
+  }
+
   Compaction* c;
   int level;
 
@@ -1486,6 +1601,90 @@ Compaction* VersionSet::PickCompaction(bool allow_seek_compaction) {
   return c;
 }
 
+// Universal compaction treats each level-0 file and each non-empty level
+// below level-0 as a sorted run.  Runs are ordered by age, with newer runs
+// living at shallower levels.  Each compaction merges all level-0 files
+// together with the runs immediately below them whose sizes are comparable
+// to the total size of the runs above them.  The result is placed at the
+// level of the deepest run merged, or, if no run below level-0 is merged,
+// at the level right above the shallowest run so that runs fill levels
+// bottom-up.  When the newer runs grow too large relative to the oldest run,
+// everything is merged to bound space amplification.
+Compaction* VersionSet::PickUniversalCompaction() {
+  Version* const v = current_;
+  if (v->compaction_score_ < 1 || v->files_[0].empty()) {
+    return NULL;
+  }
+
+  int shallowest = -1;  // Shallowest non-empty level below level-0
+  int oldest = -1;      // Deepest non-empty level
+  int64_t level_bytes[config::kNumLevels];
+  int64_t newer_bytes = 0;  // Total bytes of all runs but the oldest one
+  for (int level = 0; level < config::kNumLevels; level++) {
+    level_bytes[level] = TotalFileSize(v->files_[level]);
+    if (level > 0 && !v->files_[level].empty()) {
+      if (shallowest == -1) shallowest = level;
+      if (oldest != -1) newer_bytes += level_bytes[oldest];
+      oldest = level;
+    }
+  }
+  newer_bytes += level_bytes[0];
+
+  // Deepest level whose run is merged; 0 means only level-0 files
+  int last_input_level = 0;
+  if (oldest == -1) {
+    // Nothing below level-0
+  } else if (newer_bytes * 100 >=
+             level_bytes[oldest] *
+                 options_->universal_max_size_amplification_percent) {
+    last_input_level = oldest;  // Merge all
+  } else {
+    int64_t merged_bytes = level_bytes[0];
+    for (int level = shallowest; level <= oldest; level++) {
+      if (v->files_[level].empty()) continue;
+      if (level_bytes[level] * 100 >
+          merged_bytes * (100 + options_->universal_size_ratio)) {
+        break;
+      }
+      merged_bytes += level_bytes[level];
+      last_input_level = level;
+    }
+    if (last_input_level == 0 && shallowest == 1) {
+      // No free level between level-0 and the shallowest run
+      last_input_level = 1;
+    }
+  }
+
+  int output_level;
+  if (last_input_level != 0) {
+    output_level = last_input_level;
+  } else if (shallowest != -1) {
+    output_level = shallowest - 1;
+  } else {
+    output_level = config::kNumLevels - 1;
+  }
+
+  Compaction* c = new Compaction(options_, 0);
+  c->output_level_ = output_level;
+  c->input_version_ = v;
+  c->input_version_->Ref();
+  c->inputs_[0] = v->files_[0];
+  for (int level = 1; level <= last_input_level; level++) {
+    if (level == output_level) {
+      c->inputs_[1] = v->files_[level];
+    } else {
+      c->middle_inputs_[level] = v->files_[level];
+    }
+  }
+#if VERBOSE >= 4
+  Log(options_->info_log, 4,
+      "Universal compaction: %d level-0 files + runs at levels 1..%d => "
+      "level-%d",
+      int(c->inputs_[0].size()), last_input_level, output_level);
+#endif
+  return c;
+}
+
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
@@ -1584,6 +1783,7 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
+      output_level_(level + 1),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       max_grand_parent_overlap_bytes_(MaxGrandParentOverlapBytes(options)),
       input_version_(NULL),
@@ -1601,7 +1801,20 @@ Compaction::~Compaction() {
   }
 }
 
+int64_t Compaction::TotalInputBytes() const {
+  int64_t sum = TotalFileSize(inputs_[0]) + TotalFileSize(inputs_[1]);
+  for (int level = level_ + 1; level < output_level_; level++) {
+    sum += TotalFileSize(middle_inputs_[level]);
+  }
+  return sum;
+}
+
 bool Compaction::IsTrivialMove() const {
+  for (int level = level_ + 1; level < output_level_; level++) {
+    if (!middle_inputs_[level].empty()) {
+      return false;
+    }
+  }
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
@@ -1610,17 +1823,23 @@ bool Compaction::IsTrivialMove() const {
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
-  for (int which = 0; which < 2; which++) {
-    for (size_t i = 0; i < inputs_[which].size(); i++) {
-      edit->DeleteFile(level_ + which, inputs_[which][i]->number);
+  for (size_t i = 0; i < inputs_[0].size(); i++) {
+    edit->DeleteFile(level_, inputs_[0][i]->number);
+  }
+  for (int level = level_ + 1; level < output_level_; level++) {
+    for (size_t i = 0; i < middle_inputs_[level].size(); i++) {
+      edit->DeleteFile(level, middle_inputs_[level][i]->number);
     }
   }
+  for (size_t i = 0; i < inputs_[1].size(); i++) {
+    edit->DeleteFile(output_level_, inputs_[1][i]->number);
+  }
 }
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
     for (; level_ptrs_[lvl] < files.size();) {
       FileMetaData* f = files[level_ptrs_[lvl]];
@@ -56,6 +56,42 @@ class WritableFile;
 extern int FindFile(const InternalKeyComparator& icmp,
                     const std::vector<FileMetaData*>& files, const Slice& key);
 
+// Same as FindFile(), but only searches files[left,right). The caller
+// guarantees that the result of an unrestricted FindFile() falls within
+// [left,right]. Return right if no file in the range has largest >= key.
+extern int FindFileInRange(const InternalKeyComparator& icmp,
+                           const std::vector<FileMetaData*>& files,
+                           const Slice& key, uint32_t left, uint32_t right);
+
+// Fractional cascading pointers from a file at level L into level L+1.
+// smallest_pos and largest_pos are the results of FindFile() at level L+1
+// for the file's smallest and largest keys. A key that has been located at
+// a file at level L can only land on files within the window bounded by
+// these positions at level L+1.
+struct FileIndexEntry {
+  uint32_t smallest_pos;
+  uint32_t largest_pos;
+};
+
+// Compute the cascading pointers for every file in "files" against
+// "next_files", storing them into *index (one entry per file).
+// REQUIRES: both "files" and "next_files" are sorted and disjoint.
+extern void BuildFileIndex(const InternalKeyComparator& icmp,
+                           const std::vector<FileMetaData*>& files,
+                           const std::vector<FileMetaData*>& next_files,
+                           std::vector<FileIndexEntry>* index);
+
+// Narrow the search window at level L+1 for "key" given that the key
+// has been located at position "pos" of "files" at level L, where "index"
+// holds the cascading pointers of "files". On return, the result of
+// FindFile() at level L+1 is guaranteed to fall within [*left,*right].
+extern void NextLevelSearchRange(const InternalKeyComparator& icmp,
+                                 const std::vector<FileMetaData*>& files,
+                                 const std::vector<FileIndexEntry>& index,
+                                 const Slice& key, uint32_t pos,
+                                 uint32_t next_level_files, uint32_t* left,
+                                 uint32_t* right);
+
 // Returns true iff some file in "files" overlaps the user key range
 // [*smallest,*largest].
 // smallest==NULL represents a key smaller than all keys in the DB.
@@ -140,6 +176,14 @@ class Version {
   void ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
                           bool (*func)(void*, int, FileMetaData*));
 
+  // Return the smallest index i such that files_[level][i]->largest >= ikey,
+  // or the number of files at the level if there is no such file. *left and
+  // *right carry the search window handed down from the level above and are
+  // updated to the window that should be searched at level+1.
+  // REQUIRES: level >= 1.
+  uint32_t LocateFile(int level, const Slice& ikey, uint32_t* left,
+                      uint32_t* right) const;
+
   VersionSet* vset_;  // VersionSet to which this Version belongs
   Version* next_;     // Next version in linked list
   Version* prev_;     // Previous version in linked list
@@ -148,6 +192,11 @@ class Version {
   // List of files per level
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
+  // Cascading pointers from each file at a level into the next level.
+  // Empty for level-0, for the last level, and for levels whose next level
+  // is empty. Initialized by VersionSet::Finalize().
+  std::vector<FileIndexEntry> file_index_[config::kNumLevels];
+
   // Next file to compact based on seek stats.
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
@@ -299,6 +348,9 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Build the per-level cascading pointers for point lookups.
+  void BuildFileIndex(Version* v);
+
   void GetRange(const std::vector<FileMetaData*>& inputs, InternalKey* smallest,
                 InternalKey* largest);
 
@@ -308,6 +360,9 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Pick a universal compaction. See DBOptions::compaction_style.
+  Compaction* PickUniversalCompaction();
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -347,9 +402,16 @@ class Compaction {
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // and "output_level" will be merged to produce a set of "output_level"
+  // files.
   int level() const { return level_; }
 
+  // Return the level at which outputs are placed.  This is always "level+1"
+  // for leveled compactions.  For universal compactions, it may be any
+  // level below "level", in which case all files at levels in between are
+  // also inputs.
+  int output_level() const { return output_level_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -357,22 +419,27 @@ class Compaction {
   // "which" must be either 0 or 1
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at "level()" if "which" is 0, or at
+  // "output_level()" if "which" is 1.
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
+  // Return the total size of all input files, including those at levels
+  // between "level()" and "output_level()".
+  int64_t TotalInputBytes() const;
+
   // Maximum size of files to build during this compaction.
   uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
 
-  // Is this a trivial compaction that can be implemented by just
-  // moving a single input file to the next level (no merging or splitting)
+  // Is this a trivial compaction that can be implemented by just moving a
+  // single input file to the output level (no merging or splitting)
   bool IsTrivialMove() const;
 
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
+  // the compaction is producing data in "output_level" for which no data
+  // exists in levels greater than "output_level".
   bool IsBaseLevelForKey(const Slice& user_key);
 
   // Returns true iff we should stop building the current output
@@ -390,13 +457,16 @@ class Compaction {
   explicit Compaction(const Options* options, int level);
 
   int level_;
+  int output_level_;
   uint64_t max_output_file_size_;
   int64_t max_grand_parent_overlap_bytes_;
   Version* input_version_;
   VersionEdit edit_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
+  // Each compaction reads inputs from "level_" and "output_level_"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
+  // Universal compactions also read all files from levels in between
+  std::vector<FileMetaData*> middle_inputs_[config::kNumLevels];
 
   // State used to check for number of of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
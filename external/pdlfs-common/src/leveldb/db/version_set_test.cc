@@ -184,6 +184,107 @@ TEST(FindFileTest, OverlappingFiles) {
   ASSERT_TRUE(Overlaps("600", "700"));
 }
 
+class FileIndexTest {
+ public:
+  std::vector<FileMetaData*> files_[2];
+  std::vector<FileIndexEntry> index_;
+  InternalKeyComparator cmp_;
+
+  FileIndexTest() : cmp_(BytewiseComparator()) {}
+
+  ~FileIndexTest() {
+    for (int i = 0; i < 2; i++) {
+      for (size_t j = 0; j < files_[i].size(); j++) {
+        delete files_[i][j];
+      }
+    }
+  }
+
+  void Add(int level, int smallest, int largest) {
+    FileMetaData* f = new FileMetaData;
+    f->number = files_[level].size() + 1;
+    f->smallest = InternalKey(Key(smallest), 100, kTypeValue);
+    f->largest = InternalKey(Key(largest), 100, kTypeValue);
+    files_[level].push_back(f);
+  }
+
+  static std::string Key(int i) {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "%06d", i);
+    return buf;
+  }
+
+  // Check that searching the next level within the window derived from
+  // the cascading pointers gives the same answer as a full search.
+  void CheckAll(int max_key) {
+    BuildFileIndex(cmp_, files_[0], files_[1], &index_);
+    ASSERT_EQ(index_.size(), files_[0].size());
+    for (int i = 0; i <= max_key; i++) {
+      for (SequenceNumber seq = 50; seq <= 150; seq += 50) {
+        InternalKey target(Key(i), seq, kTypeValue);
+        const Slice ikey = target.Encode();
+        uint32_t pos = FindFile(cmp_, files_[0], ikey);
+        uint32_t left, right;
+        NextLevelSearchRange(cmp_, files_[0], index_, ikey, pos,
+                             files_[1].size(), &left, &right);
+        ASSERT_LE(left, right);
+        ASSERT_LE(right, files_[1].size());
+        ASSERT_EQ(FindFile(cmp_, files_[1], ikey),
+                  FindFileInRange(cmp_, files_[1], ikey, left, right));
+      }
+    }
+  }
+};
+
+TEST(FileIndexTest, EmptyNextLevel) {
+  Add(0, 10, 20);
+  Add(0, 30, 40);
+  CheckAll(50);
+}
+
+TEST(FileIndexTest, Disjoint) {
+  Add(0, 10, 20);
+  Add(0, 30, 40);
+  Add(1, 0, 5);
+  Add(1, 22, 28);
+  Add(1, 45, 50);
+  CheckAll(60);
+}
+
+TEST(FileIndexTest, Overlapping) {
+  Add(0, 10, 20);
+  Add(0, 25, 25);
+  Add(0, 30, 70);
+  Add(0, 90, 95);
+  for (int i = 0; i < 20; i++) {
+    Add(1, i * 5 + 1, i * 5 + 3);
+  }
+  CheckAll(110);
+}
+
+TEST(FileIndexTest, SharedBoundaries) {
+  Add(0, 10, 20);
+  Add(0, 40, 60);
+  Add(1, 5, 10);
+  Add(1, 20, 40);
+  Add(1, 60, 80);
+  CheckAll(90);
+}
+
+TEST(FileIndexTest, Random) {
+  Random rnd(301);
+  for (int level = 0; level < 2; level++) {
+    int k = 0;
+    for (int i = 0; i < 100; i++) {
+      int smallest = k + rnd.Uniform(10);
+      int largest = smallest + rnd.Uniform(10);
+      Add(level, smallest, largest);
+      k = largest + 1;
+    }
+  }
+  CheckAll(2000);
+}
+
 }  // namespace pdlfs
 
 int main(int argc, char** argv) {
@@ -16,6 +16,7 @@
  */
 #include "pdlfs-common/leveldb/filenames.h"
 #include "pdlfs-common/env.h"
+#include "pdlfs-common/hash.h"
 #include "pdlfs-common/strutil.h"
 
 #include <ctype.h>
@@ -75,8 +76,13 @@ std::string OldInfoLogFileName(const std::string& dbname) {
   return dbname + "/LOG.old";
 }
 
+std::string IdentityFileName(const std::string& dbname) {
+  return dbname + "/IDENTITY";
+}
+
 // Owned filenames have the form:
 //    dbname/CURRENT
+//    dbname/IDENTITY
 //    dbname/LOCK
 //    dbname/LOG
 //    dbname/LOG.old
@@ -90,6 +96,9 @@ bool ParseFileName(const Slice& fname, uint64_t* number, FileType* type) {
   } else if (rest == "LOCK") {
     *number = 0;
     *type = kDBLockFile;
+  } else if (rest == "IDENTITY") {
+    *number = 0;
+    *type = kIdentityFile;
   } else if (rest == "LOG" || rest == "LOG.old") {
     *number = 0;
     *type = kInfoLogFile;
@@ -146,4 +155,35 @@ Status SetCurrentFile(Env* env, const std::string& dbname,
   return s;
 }
 
+Status GetDBIdentity(Env* env, const std::string& dbname,
+                     std::string* identity) {
+  const std::string fname = IdentityFileName(dbname);
+  if (env->FileExists(fname.c_str())) {
+    Status s = ReadFileToString(env, fname.c_str(), identity);
+    if (s.ok()) {
+      Slice input = *identity;
+      while (!input.empty() && isspace(input[input.size() - 1])) {
+        input.remove_suffix(1);
+      }
+      identity->resize(input.size());
+      if (identity->empty()) {
+        s = Status::Corruption(fname, "empty identity");
+      }
+    }
+    return s;
+  }
+  // A new identity combines the creation time with a hash of the db name
+  // and of a stack address, so concurrently created dbs get different ones
+  const uint64_t micros = CurrentMicros();
+  const uintptr_t addr = reinterpret_cast<uintptr_t>(&micros);
+  char tmp[50];
+  snprintf(tmp, sizeof(tmp), "%016llx-%08x-%08x",
+           static_cast<unsigned long long>(micros),
+           Hash(dbname.data(), dbname.size(), static_cast<uint32_t>(micros)),
+           Hash(reinterpret_cast<const char*>(&addr), sizeof(addr),
+                static_cast<uint32_t>(micros >> 32)));
+  *identity = tmp;
+  return WriteStringToFileSync(env, *identity + "\n", fname.c_str());
+}
+
 }  // namespace pdlfs
@@ -40,6 +40,7 @@ TEST(FileNameTest, Parse) {
     { "0.ldb",              0,     kTableFile },
     { "CURRENT",            0,     kCurrentFile },
     { "LOCK",               0,     kDBLockFile },
+    { "IDENTITY",           0,     kIdentityFile },
     { "MANIFEST-2",         2,     kDescriptorFile },
     { "MANIFEST-7",         7,     kDescriptorFile },
     { "LOG",                0,     kInfoLogFile },
@@ -102,6 +103,12 @@ TEST(FileNameTest, Construction) {
   ASSERT_EQ(0, number);
   ASSERT_EQ(kDBLockFile, type);
 
+  fname = IdentityFileName("foo");
+  ASSERT_EQ("foo/", std::string(fname.data(), 4));
+  ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
+  ASSERT_EQ(0, number);
+  ASSERT_EQ(kIdentityFile, type);
+
   fname = LogFileName("foo", 192);
   ASSERT_EQ("foo/", std::string(fname.data(), 4));
   ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
@@ -19,6 +19,7 @@
 #include "pdlfs-common/leveldb/options.h"
 
 #include "pdlfs-common/coding.h"
+#include "pdlfs-common/compression.h"
 #include "pdlfs-common/crc32c.h"
 #include "pdlfs-common/env.h"
 #include "pdlfs-common/port.h"
@@ -76,15 +77,20 @@ Status Footer::DecodeFrom(Slice* input) {
 }
 
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
+                 const BlockHandle& handle, BlockContents* result,
+                 const CompressionDict* dict) {
   result->data = Slice();
   result->cachable = false;
   result->heap_allocated = false;
 
   // Read the block contents as well as the type/crc footer.
   // See table_builder.cc for the code that built this structure.
+  // Memory-resident files need no scratch space.
   size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
+  char* buf = NULL;
+  if (!file->IsMemoryResident()) {
+    buf = new char[n + kBlockTrailerSize];
+  }
   Slice contents;
   Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
   if (!s.ok()) {
@@ -126,16 +132,14 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
 
       // Ok
       break;
-    case kSnappyCompression: {
-      size_t ulength = 0;
-      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
-        delete[] buf;
-        return Status::Corruption("corrupted compressed block contents");
-      }
-      char* ubuf = new char[ulength];
-      if (!port::Snappy_Uncompress(data, n, ubuf)) {
+    case kSnappyCompression:
+    case kLZ4Compression:
+    case kZstdCompression: {
+      char* ubuf;
+      size_t ulength;
+      if (!Uncompress(static_cast<CompressionType>(data[n]), Slice(data, n),
+                      &ubuf, &ulength, dict)) {
         delete[] buf;
-        delete[] ubuf;
         return Status::Corruption("corrupted compressed block contents");
       }
       delete[] buf;
@@ -0,0 +1,505 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/leveldb/persistent_cache.h"
+
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/crc32c.h"
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/hashmap.h"
+#include "pdlfs-common/mutexlock.h"
+#include "pdlfs-common/port.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace pdlfs {
+
+PersistentCacheOptions::PersistentCacheOptions()
+    : env(Env::Default()),
+      capacity(1 << 30),
+      file_size(64 << 20),
+      write_buffer_size(4 << 20) {}
+
+PersistentCache::~PersistentCache() {}
+
+namespace {
+
+// Each record is formatted as:
+//    crc: fixed32 (masked crc of the rest of the record)
+//    key size: fixed32
+//    data size: fixed32
+//    key: char[key size]
+//    data: char[data size]
+static const size_t kHeaderSize = 12;
+
+// A read handle on a cache file. Cache files may be read while being
+// written, so a new handle is opened whenever data is requested beyond
+// what was written when the current handle was opened.
+struct Reader {
+  RandomAccessFile* file;
+  uint64_t readable_size;
+  int refs;
+};
+
+struct Segment {
+  uint64_t number;
+  uint64_t size;
+  Reader* reader;  // NULL until first read
+  // Keys of all records in the segment. A key may since have been indexed
+  // to a newer segment.
+  std::vector<std::string> keys;
+};
+
+struct Location {
+  Segment* segment;
+  uint64_t offset;
+  size_t size;  // Size of the entire record
+};
+
+class PersistentCacheImpl : public PersistentCache {
+ public:
+  PersistentCacheImpl(const PersistentCacheOptions& options,
+                      const std::string& dirname);
+  virtual ~PersistentCacheImpl();
+
+  Status Recover();
+
+  virtual void Insert(const Slice& key, const Slice& data);
+  virtual void Flush();
+  virtual bool Lookup(const Slice& key, std::string* data);
+  virtual uint64_t TotalSize();
+
+ private:
+  std::string FileName(uint64_t number) const;
+  void RecoverFile(uint64_t number);
+  Status NewFile();
+  static void BGWork(void* arg);
+  void BackgroundWrite();
+  void WriteRecords(const std::deque<std::string>& records);
+  void Index(const Slice& key, Segment* seg, uint64_t offset, size_t size);
+  void MaybeDropFiles(std::vector<uint64_t>* dropped);
+  void DeleteFiles(const std::vector<uint64_t>& numbers);
+  void Unref(Reader* r);
+
+  const PersistentCacheOptions options_;
+  Env* const env_;
+  const std::string dirname_;
+
+  // Serializes writers so cache file I/O is done without holding mutex_.
+  // Lock order: write_mutex_ then mutex_.
+  port::Mutex write_mutex_;
+  WritableFile* writer_;  // NULL if writes have failed
+  uint64_t next_number_;
+
+  // State below is protected by mutex_
+  port::Mutex mutex_;
+  port::CondVar bg_cv_;  // Signaled when background writes are done
+  std::deque<Segment*> segments_;  // Oldest first, the last one is written
+  HashMap<Location> index_;
+  uint64_t total_size_;
+  std::deque<std::string> pending_;  // Records waiting to be written
+  uint64_t pending_bytes_;
+  bool bg_scheduled_;
+};
+
+PersistentCacheImpl::PersistentCacheImpl(const PersistentCacheOptions& options,
+                                         const std::string& dirname)
+    : options_(options),
+      env_(options.env),
+      dirname_(dirname),
+      writer_(NULL),
+      next_number_(1),
+      bg_cv_(&mutex_),
+      total_size_(0),
+      pending_bytes_(0),
+      bg_scheduled_(false) {}
+
+PersistentCacheImpl::~PersistentCacheImpl() {
+  Flush();
+  if (writer_ != NULL) {
+    writer_->Close();
+    delete writer_;
+  }
+  struct Deleter : public HashMap<Location>::Visitor {
+    virtual void visit(const Slice& key, Location* loc) { delete loc; }
+  };
+  Deleter deleter;
+  index_.VisitAll(&deleter);
+  for (size_t i = 0; i < segments_.size(); i++) {
+    if (segments_[i]->reader != NULL) {
+      Unref(segments_[i]->reader);
+    }
+    delete segments_[i];
+  }
+}
+
+std::string PersistentCacheImpl::FileName(uint64_t number) const {
+  char tmp[30];
+  snprintf(tmp, sizeof(tmp), "/%06llu.pcache",
+           static_cast<unsigned long long>(number));
+  return dirname_ + tmp;
+}
+
+void PersistentCacheImpl::Unref(Reader* r) {
+  assert(r->refs > 0);
+  if (--r->refs == 0) {
+    delete r->file;
+    delete r;
+  }
+}
+
+void PersistentCacheImpl::Index(const Slice& key, Segment* seg,
+                                uint64_t offset, size_t size) {
+  mutex_.AssertHeld();
+  Location* const loc = new Location;
+  loc->segment = seg;
+  loc->offset = offset;
+  loc->size = size;
+  delete index_.Insert(key, loc);
+  seg->keys.push_back(key.ToString());
+}
+
+Status PersistentCacheImpl::Recover() {
+  MutexLock wl(&write_mutex_);
+  MutexLock ml(&mutex_);
+  env_->CreateDir(dirname_.c_str());  // Ignore error if already exists
+  std::vector<std::string> names;
+  Status s = env_->GetChildren(dirname_.c_str(), &names);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<uint64_t> numbers;
+  for (size_t i = 0; i < names.size(); i++) {
+    unsigned long long number;
+    char suffix[10];
+    if (sscanf(names[i].c_str(), "%llu.%9s", &number, suffix) == 2 &&
+        strcmp(suffix, "pcache") == 0) {
+      numbers.push_back(number);
+    }
+  }
+  std::sort(numbers.begin(), numbers.end());
+  for (size_t i = 0; i < numbers.size(); i++) {
+    RecoverFile(numbers[i]);
+    next_number_ = numbers[i] + 1;
+  }
+  // Always start a new file so that torn writes at the end of the last
+  // file are never followed by new records
+  mutex_.Unlock();
+  s = NewFile();
+  mutex_.Lock();
+  if (s.ok()) {
+    std::vector<uint64_t> dropped;
+    MaybeDropFiles(&dropped);
+    DeleteFiles(dropped);
+  }
+  return s;
+}
+
+// Index all valid records of a cache file, stopping at the first torn or
+// corrupted record.
+void PersistentCacheImpl::RecoverFile(uint64_t number) {
+  mutex_.AssertHeld();
+  const std::string fname = FileName(number);
+  std::string contents;
+  Status s = ReadFileToString(env_, fname.c_str(), &contents);
+  if (!s.ok() || contents.empty()) {
+    env_->DeleteFile(fname.c_str());
+    return;
+  }
+  Segment* const seg = new Segment;
+  seg->number = number;
+  seg->size = contents.size();
+  seg->reader = NULL;
+  segments_.push_back(seg);
+  total_size_ += seg->size;
+  Slice input = contents;
+  while (input.size() >= kHeaderSize) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(input.data()));
+    const uint32_t key_size = DecodeFixed32(input.data() + 4);
+    const uint32_t data_size = DecodeFixed32(input.data() + 8);
+    const uint64_t record_size =
+        kHeaderSize + static_cast<uint64_t>(key_size) + data_size;
+    if (record_size > input.size() ||
+        crc32c::Value(input.data() + 4, record_size - 4) != crc) {
+      break;
+    }
+    Index(Slice(input.data() + kHeaderSize, key_size), seg,
+          input.data() - contents.data(), record_size);
+    input.remove_prefix(record_size);
+  }
+}
+
+// REQUIRES: write_mutex_ is held but mutex_ is not.
+Status PersistentCacheImpl::NewFile() {
+  write_mutex_.AssertHeld();
+  if (writer_ != NULL) {
+    writer_->Close();
+    delete writer_;
+    writer_ = NULL;
+  }
+  const uint64_t number = next_number_++;
+  const std::string fname = FileName(number);
+  Status s = env_->NewWritableFile(fname.c_str(), &writer_);
+  if (s.ok()) {
+    Segment* const seg = new Segment;
+    seg->number = number;
+    seg->size = 0;
+    seg->reader = NULL;
+    MutexLock ml(&mutex_);
+    segments_.push_back(seg);
+  }
+  return s;
+}
+
+// Remove the oldest cache files from the index until the cache is within
+// its capacity. The numbers of the removed files are added to *dropped
+// for the caller to delete them after releasing mutex_.
+void PersistentCacheImpl::MaybeDropFiles(std::vector<uint64_t>* dropped) {
+  mutex_.AssertHeld();
+  while (total_size_ > options_.capacity && segments_.size() > 1) {
+    Segment* const seg = segments_.front();
+    segments_.pop_front();
+    for (size_t i = 0; i < seg->keys.size(); i++) {
+      Location* const loc = index_.Lookup(seg->keys[i]);
+      if (loc != NULL && loc->segment == seg) {
+        delete index_.Erase(seg->keys[i]);
+      }
+    }
+    if (seg->reader != NULL) {
+      Unref(seg->reader);
+    }
+    total_size_ -= seg->size;
+    dropped->push_back(seg->number);
+    delete seg;
+  }
+}
+
+void PersistentCacheImpl::DeleteFiles(const std::vector<uint64_t>& numbers) {
+  for (size_t i = 0; i < numbers.size(); i++) {
+    env_->DeleteFile(FileName(numbers[i]).c_str());
+  }
+}
+
+void PersistentCacheImpl::Insert(const Slice& key, const Slice& data) {
+  std::string record;
+  record.reserve(kHeaderSize + key.size() + data.size());
+  PutFixed32(&record, 0);
+  PutFixed32(&record, static_cast<uint32_t>(key.size()));
+  PutFixed32(&record, static_cast<uint32_t>(data.size()));
+  record.append(key.data(), key.size());
+  record.append(data.data(), data.size());
+  EncodeFixed32(&record[0], crc32c::Mask(crc32c::Value(record.data() + 4,
+                                                       record.size() - 4)));
+  MutexLock ml(&mutex_);
+  if (pending_bytes_ + record.size() > options_.write_buffer_size) {
+    return;  // Writes are falling behind
+  }
+  pending_bytes_ += record.size();
+  pending_.push_back(std::string());
+  pending_.back().swap(record);
+  if (!bg_scheduled_) {
+    bg_scheduled_ = true;
+    env_->Schedule(&PersistentCacheImpl::BGWork, this);
+  }
+}
+
+void PersistentCacheImpl::Flush() {
+  MutexLock ml(&mutex_);
+  while (bg_scheduled_) {
+    bg_cv_.Wait();
+  }
+}
+
+void PersistentCacheImpl::BGWork(void* arg) {
+  reinterpret_cast<PersistentCacheImpl*>(arg)->BackgroundWrite();
+}
+
+// Write queued records until there are none left.
+void PersistentCacheImpl::BackgroundWrite() {
+  write_mutex_.Lock();
+  mutex_.Lock();
+  assert(bg_scheduled_);
+  while (!pending_.empty()) {
+    std::deque<std::string> records;
+    records.swap(pending_);
+    const uint64_t bytes = pending_bytes_;
+    mutex_.Unlock();
+    WriteRecords(records);
+    mutex_.Lock();
+    pending_bytes_ -= bytes;
+  }
+  // Release write_mutex_ first since waiters may delete the cache as soon
+  // as bg_scheduled_ is cleared
+  write_mutex_.Unlock();
+  bg_scheduled_ = false;
+  bg_cv_.SignalAll();
+  mutex_.Unlock();
+}
+
+// Append records to cache files, flushing each file once per batch, and
+// index them after they are flushed. Records are dropped once writes fail.
+// REQUIRES: write_mutex_ is held but mutex_ is not.
+void PersistentCacheImpl::WriteRecords(
+    const std::deque<std::string>& records) {
+  write_mutex_.AssertHeld();
+  std::vector<uint64_t> dropped;
+  size_t i = 0;
+  while (i < records.size() && writer_ != NULL) {
+    Segment* seg;
+    uint64_t offset;
+    {
+      MutexLock ml(&mutex_);
+      seg = segments_.back();
+      offset = seg->size;
+    }
+    if (offset != 0 && offset + records[i].size() > options_.file_size) {
+      if (!NewFile().ok()) {
+        break;
+      }
+      continue;
+    }
+    // The segment being written is never dropped, so seg stays valid
+    const size_t begin = i;
+    uint64_t end = offset;
+    Status s;
+    while (i < records.size() &&
+           (end == 0 || end + records[i].size() <= options_.file_size)) {
+      s = writer_->Append(records[i]);
+      if (!s.ok()) {
+        break;
+      }
+      end += records[i].size();
+      i++;
+    }
+    if (s.ok()) {
+      s = writer_->Flush();  // Make the records visible to readers
+    }
+    if (!s.ok()) {  // Stop caching new data
+      writer_->Close();
+      delete writer_;
+      writer_ = NULL;
+      break;
+    }
+    MutexLock ml(&mutex_);
+    for (size_t j = begin; j < i; j++) {
+      const std::string& r = records[j];
+      const uint32_t key_size = DecodeFixed32(r.data() + 4);
+      Index(Slice(r.data() + kHeaderSize, key_size), seg, offset, r.size());
+      offset += r.size();
+    }
+    total_size_ += end - seg->size;
+    seg->size = end;
+    MaybeDropFiles(&dropped);
+  }
+  DeleteFiles(dropped);
+}
+
+bool PersistentCacheImpl::Lookup(const Slice& key, std::string* data) {
+  Reader* reader = NULL;
+  uint64_t number;
+  uint64_t readable_size;
+  uint64_t offset;
+  size_t size;
+  {
+    MutexLock ml(&mutex_);
+    Location* const loc = index_.Lookup(key);
+    if (loc == NULL) {
+      return false;
+    }
+    Segment* const seg = loc->segment;
+    number = seg->number;
+    readable_size = seg->size;
+    offset = loc->offset;
+    size = loc->size;
+    if (seg->reader != NULL && offset + size <= seg->reader->readable_size) {
+      reader = seg->reader;
+      reader->refs++;
+    }
+  }
+
+  if (reader == NULL) {
+    // Open a new handle without holding mutex_ so other lookups and
+    // background writes are not held up by the open
+    RandomAccessFile* file;
+    const std::string fname = FileName(number);
+    Status s = env_->NewRandomAccessFile(fname.c_str(), &file);
+    if (!s.ok()) {
+      return false;
+    }
+    reader = new Reader;
+    reader->file = file;
+    reader->readable_size = readable_size;
+    reader->refs = 1;
+    // Share the handle with later lookups unless the segment has since
+    // been dropped or given a newer handle
+    MutexLock ml(&mutex_);
+    Location* const loc = index_.Lookup(key);
+    if (loc != NULL && loc->segment->number == number) {
+      Segment* const seg = loc->segment;
+      if (seg->reader == NULL ||
+          seg->reader->readable_size < reader->readable_size) {
+        if (seg->reader != NULL) {
+          Unref(seg->reader);
+        }
+        seg->reader = reader;
+        reader->refs++;
+      }
+    }
+  }
+
+  char* const scratch = new char[size];
+  Slice record;
+  Status s = reader->file->Read(offset, size, &record, scratch);
+  bool ok = s.ok() && record.size() == size;
+  if (ok) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(record.data()));
+    const uint32_t key_size = DecodeFixed32(record.data() + 4);
+    ok = crc32c::Value(record.data() + 4, size - 4) == crc &&
+         key_size <= size - kHeaderSize &&
+         Slice(record.data() + kHeaderSize, key_size) == key;
+    if (ok) {
+      data->assign(record.data() + kHeaderSize + key_size,
+                   size - kHeaderSize - key_size);
+    }
+  }
+  delete[] scratch;
+
+  MutexLock ml(&mutex_);
+  Unref(reader);
+  return ok;
+}
+
+uint64_t PersistentCacheImpl::TotalSize() {
+  MutexLock ml(&mutex_);
+  return total_size_;
+}
+
+}  // namespace
+
+Status PersistentCache::Open(const PersistentCacheOptions& options,
+                             const std::string& dirname,
+                             PersistentCache** result) {
+  *result = NULL;
+  PersistentCacheImpl* const impl = new PersistentCacheImpl(options, dirname);
+  Status s = impl->Recover();
+  if (s.ok()) {
+    *result = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+}  // namespace pdlfs
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/leveldb/persistent_cache.h"
+#include "pdlfs-common/leveldb/db.h"
+#include "pdlfs-common/leveldb/options.h"
+
+#include "pdlfs-common/cache.h"
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/env_faults.h"
+#include "pdlfs-common/random.h"
+#include "pdlfs-common/testharness.h"
+#include "pdlfs-common/testutil.h"
+
+#include <deque>
+#include <stdio.h>
+
+namespace pdlfs {
+
+class PersistentCacheTest {
+ public:
+  PersistentCacheTest() : cache_(NULL) {
+    dirname_ = test::TmpDir() + "/persistent_cache_test";
+    DeleteFiles();
+    options_.file_size = 1000;
+    options_.capacity = 3000;
+    Reopen();
+  }
+
+  ~PersistentCacheTest() {
+    delete cache_;
+    DeleteFiles();
+  }
+
+  void DeleteFiles() {
+    Env* const env = Env::Default();
+    std::vector<std::string> names;
+    env->GetChildren(dirname_.c_str(), &names);
+    for (size_t i = 0; i < names.size(); i++) {
+      env->DeleteFile((dirname_ + "/" + names[i]).c_str());
+    }
+    env->DeleteDir(dirname_.c_str());
+  }
+
+  void Reopen() {
+    delete cache_;
+    cache_ = NULL;
+    ASSERT_OK(PersistentCache::Open(options_, dirname_, &cache_));
+  }
+
+  std::string Lookup(const Slice& key) {
+    std::string data;
+    if (!cache_->Lookup(key, &data)) {
+      return "NOT_FOUND";
+    }
+    return data;
+  }
+
+  PersistentCacheOptions options_;
+  std::string dirname_;
+  PersistentCache* cache_;
+};
+
+TEST(PersistentCacheTest, Empty) {
+  ASSERT_EQ(Lookup("k1"), "NOT_FOUND");
+  ASSERT_EQ(cache_->TotalSize(), 0);
+}
+
+TEST(PersistentCacheTest, InsertAndLookup) {
+  cache_->Insert("k1", "v1");
+  cache_->Insert("k2", "v2");
+  cache_->Flush();
+  ASSERT_EQ(Lookup("k1"), "v1");
+  ASSERT_EQ(Lookup("k2"), "v2");
+  cache_->Insert("k3", "v3");
+  cache_->Insert("k1", "v1'");
+  cache_->Flush();
+  ASSERT_EQ(Lookup("k1"), "v1'");
+  ASSERT_EQ(Lookup("k3"), "v3");
+  ASSERT_EQ(Lookup("k4"), "NOT_FOUND");
+}
+
+TEST(PersistentCacheTest, Recover) {
+  cache_->Insert("k1", "v1");
+  cache_->Insert("k2", std::string(500, 'x'));
+  cache_->Insert("k3", std::string(500, 'y'));
+  Reopen();
+  ASSERT_EQ(Lookup("k1"), "v1");
+  ASSERT_EQ(Lookup("k2"), std::string(500, 'x'));
+  ASSERT_EQ(Lookup("k3"), std::string(500, 'y'));
+  cache_->Insert("k1", "v1'");
+  Reopen();
+  ASSERT_EQ(Lookup("k1"), "v1'");
+}
+
+TEST(PersistentCacheTest, TornWrite) {
+  cache_->Insert("k1", "v1");
+  cache_->Insert("k2", "v2");
+  delete cache_;
+  cache_ = NULL;
+  // Chop off the end of the last record
+  std::vector<std::string> names;
+  Env* const env = Env::Default();
+  ASSERT_OK(env->GetChildren(dirname_.c_str(), &names));
+  for (size_t i = 0; i < names.size(); i++) {
+    const std::string fname = dirname_ + "/" + names[i];
+    std::string contents;
+    if (ReadFileToString(env, fname.c_str(), &contents).ok() &&
+        !contents.empty()) {
+      contents.resize(contents.size() - 1);
+      ASSERT_OK(WriteStringToFile(env, contents, fname.c_str()));
+    }
+  }
+  Reopen();
+  ASSERT_EQ(Lookup("k1"), "v1");
+  ASSERT_EQ(Lookup("k2"), "NOT_FOUND");
+  cache_->Insert("k2", "v2");
+  cache_->Flush();
+  ASSERT_EQ(Lookup("k2"), "v2");
+}
+
+TEST(PersistentCacheTest, Capacity) {
+  for (int i = 0; i < 100; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%03d", i);
+    cache_->Insert(key, std::string(100, 'a' + (i % 26)));
+  }
+  cache_->Flush();
+  ASSERT_LE(cache_->TotalSize(), options_.capacity);
+  ASSERT_EQ(Lookup("k000"), "NOT_FOUND");
+  ASSERT_EQ(Lookup("k099"), std::string(100, 'a' + (99 % 26)));
+  Reopen();
+  ASSERT_LE(cache_->TotalSize(), options_.capacity);
+  ASSERT_EQ(Lookup("k000"), "NOT_FOUND");
+  ASSERT_EQ(Lookup("k099"), std::string(100, 'a' + (99 % 26)));
+}
+
+// An env that runs scheduled work only when asked to.
+class DeferredEnv : public EnvWrapper {
+ public:
+  DeferredEnv() : EnvWrapper(Env::Default()) {}
+
+  virtual void Schedule(void (*function)(void*), void* arg) {
+    work_.push_back(std::make_pair(function, arg));
+  }
+
+  void RunScheduled() {
+    while (!work_.empty()) {
+      std::pair<void (*)(void*), void*> w = work_.front();
+      work_.pop_front();
+      w.first(w.second);
+    }
+  }
+
+ private:
+  std::deque<std::pair<void (*)(void*), void*> > work_;
+};
+
+TEST(PersistentCacheTest, BackgroundWrites) {
+  DeferredEnv env;
+  options_.env = &env;
+  options_.write_buffer_size = 250;
+  Reopen();
+  cache_->Insert("k1", std::string(100, 'x'));
+  cache_->Insert("k2", std::string(100, 'y'));
+  cache_->Insert("k3", std::string(100, 'z'));  // Dropped
+  // Nothing is written by Insert()
+  ASSERT_EQ(Lookup("k1"), "NOT_FOUND");
+  ASSERT_EQ(cache_->TotalSize(), 0);
+  env.RunScheduled();
+  ASSERT_EQ(Lookup("k1"), std::string(100, 'x'));
+  ASSERT_EQ(Lookup("k2"), std::string(100, 'y'));
+  ASSERT_EQ(Lookup("k3"), "NOT_FOUND");
+  cache_->Insert("k3", std::string(100, 'z'));
+  env.RunScheduled();
+  ASSERT_EQ(Lookup("k3"), std::string(100, 'z'));
+  delete cache_;
+  cache_ = NULL;
+  options_.env = Env::Default();
+}
+
+class PersistentCacheDBTest {
+ public:
+  PersistentCacheDBTest()
+      : env_(Env::Default(), FaultInjectionOptions()),
+        block_cache_(NewLRUCache(4096)) {
+    dbname_ = test::TmpDir() + "/persistent_cache_db_test";
+    cachedir_ = test::TmpDir() + "/persistent_cache_db_test_cache";
+    options_.env = &env_;
+    options_.block_cache = block_cache_;
+    options_.create_if_missing = true;
+    DestroyDB(dbname_, options_);
+    DestroyCache();
+  }
+
+  ~PersistentCacheDBTest() {
+    DestroyDB(dbname_, options_);
+    DestroyCache();
+    delete block_cache_;
+  }
+
+  void DestroyCache() {
+    Env* const env = Env::Default();
+    std::vector<std::string> names;
+    env->GetChildren(cachedir_.c_str(), &names);
+    for (size_t i = 0; i < names.size(); i++) {
+      env->DeleteFile((cachedir_ + "/" + names[i]).c_str());
+    }
+    env->DeleteDir(cachedir_.c_str());
+  }
+
+  static std::string Key(int i) {
+    char tmp[20];
+    snprintf(tmp, sizeof(tmp), "key%06d", i);
+    return tmp;
+  }
+
+  void Fill(int n) {
+    DB* db;
+    ASSERT_OK(DB::Open(options_, dbname_, &db));
+    Random rnd(301);
+    for (int i = 0; i < n; i++) {
+      ASSERT_OK(db->Put(WriteOptions(), Key(i), test::RandomString(&rnd, 500,
+                                                                   &scratch_)));
+    }
+    db->CompactRange(NULL, NULL);
+    delete db;
+  }
+
+  // Read all keys and return the number of reads reaching the remote env.
+  int ReadAll(int n, PersistentCache* cache) {
+    options_.persistent_cache = cache;
+    DB* db;
+    ASSERT_OK(DB::Open(options_, dbname_, &db));
+    env_.ResetStats();
+    for (int i = 0; i < n; i++) {
+      std::string value;
+      ASSERT_OK(db->Get(ReadOptions(), Key(i), &value));
+      ASSERT_EQ(value.size(), 500);
+    }
+    const int result = static_cast<int>(env_.GetStats().reads);
+    delete db;
+    if (cache != NULL) {
+      cache->Flush();
+    }
+    options_.persistent_cache = NULL;
+    return result;
+  }
+
+  FaultInjectionEnv env_;  // Stands in for remote storage
+  Cache* block_cache_;
+  std::string scratch_;
+  DBOptions options_;
+  std::string dbname_;
+  std::string cachedir_;
+};
+
+TEST(PersistentCacheDBTest, ReadsSurviveRestarts) {
+  Fill(1000);
+  ASSERT_GT(ReadAll(1000, NULL), 0);
+  PersistentCacheOptions options;
+  PersistentCache* cache;
+  ASSERT_OK(PersistentCache::Open(options, cachedir_, &cache));
+  ASSERT_GT(ReadAll(1000, cache), 0);  // Cold
+  ASSERT_EQ(ReadAll(1000, cache), 0);
+  delete cache;
+  ASSERT_OK(PersistentCache::Open(options, cachedir_, &cache));
+  ASSERT_EQ(ReadAll(1000, cache), 0);
+  delete cache;
+}
+
+TEST(PersistentCacheDBTest, RecreatedDB) {
+  Fill(1000);
+  PersistentCacheOptions options;
+  PersistentCache* cache;
+  ASSERT_OK(PersistentCache::Open(options, cachedir_, &cache));
+  ASSERT_GT(ReadAll(1000, cache), 0);
+  ASSERT_EQ(ReadAll(1000, cache), 0);
+  // The new db has tables with the same numbers and sizes as the old one,
+  // but must not be served the old db's blocks
+  ASSERT_OK(DestroyDB(dbname_, options_));
+  Fill(1000);
+  ASSERT_GT(ReadAll(1000, cache), 0);
+  ASSERT_EQ(ReadAll(1000, cache), 0);
+  delete cache;
+}
+
+// Time random reads against remote storage adding 200us to each read.
+static void BM_RemoteReads(PersistentCacheDBTest* t, bool use_cache) {
+  const int n = 20000;
+  t->Fill(n);
+  PersistentCache* cache = NULL;
+  if (use_cache) {
+    PersistentCacheOptions options;
+    ASSERT_OK(PersistentCache::Open(options, t->cachedir_, &cache));
+  }
+  FaultInjectionOptions remote;
+  remote.read.min_micros = remote.read.max_micros = 200;
+  t->env_.SetOptions(remote);
+  for (int pass = 0; pass < 3; pass++) {
+    const uint64_t start = CurrentMicros();
+    const int reads = t->ReadAll(n, cache);
+    const uint64_t us = CurrentMicros() - start;
+    fprintf(stderr,
+            "BM_RemoteReads/%-8s pass %d: %8d remote reads, %8.3f us/get\n",
+            use_cache ? "pcache" : "none", pass, reads, double(us) / n);
+    if (use_cache && pass == 0) {  // Restart the cache
+      delete cache;
+      PersistentCacheOptions options;
+      ASSERT_OK(PersistentCache::Open(options, t->cachedir_, &cache));
+    }
+  }
+  t->env_.SetOptions(FaultInjectionOptions());
+  delete cache;
+}
+
+}  // namespace pdlfs
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    for (int i = 0; i < 2; i++) {
+      ::pdlfs::PersistentCacheDBTest t;
+      ::pdlfs::BM_RemoteReads(&t, i != 0);
+    }
+    return 0;
+  }
+
+  return ::pdlfs::test::RunAllTests(&argc, &argv);
+}
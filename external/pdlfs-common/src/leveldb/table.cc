@@ -29,6 +29,7 @@
 
 #include "pdlfs-common/cache.h"
 #include "pdlfs-common/coding.h"
+#include "pdlfs-common/compression.h"
 #include "pdlfs-common/env.h"
 
 namespace pdlfs {
@@ -40,6 +41,7 @@ struct Table::Rep {
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  CompressionDict* dict;  // Dictionary for data blocks, or NULL
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   IndexBlockReader* index_block;
@@ -51,6 +53,7 @@ struct Table::Rep {
   ~Rep() {
     delete filter;
     delete[] filter_data;
+    delete dict;
     delete index_block;
   }
 };
@@ -94,16 +97,23 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->index_block = new IndexBlockReader(contents);
     rep->filter_data = NULL;
     rep->filter = NULL;
+    rep->dict = NULL;
     rep->props_valid = false;
 
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = NULL;
+    }
   }
 
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
+// Only a bad compression dictionary fails the table. Without its dictionary,
+// none of the table's data blocks could be read.
+Status Table::ReadMeta(const Footer& footer) {
   Rep* r = rep_;
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
@@ -114,11 +124,18 @@ void Table::ReadMeta(const Footer& footer) {
   BlockContents contents;
   if (!ReadBlock(r->file, opt, footer.metaindex_handle(), &contents).ok()) {
     // Do not propagate errors since meta info is not needed for operation
-    return;
+    return Status::OK();
   }
   Block* meta = new Block(contents);
   Iterator* iter = meta->NewIterator(BytewiseComparator());
 
+  Status s;
+  Slice dict_key("compression.dict");
+  iter->Seek(dict_key);
+  if (iter->Valid() && iter->key() == dict_key) {
+    s = ReadDict(iter->value());
+  }
+
   Slice props_key("table.properties");
   iter->Seek(props_key);
   if (iter->Valid() && iter->key() == props_key) {
@@ -136,6 +153,7 @@ void Table::ReadMeta(const Footer& footer) {
 
   delete iter;
   delete meta;
+  return s;
 }
 
 void Table::ReadFilter(const Slice& handle_value) {
@@ -162,6 +180,34 @@ void Table::ReadFilter(const Slice& handle_value) {
   }
 }
 
+Status Table::ReadDict(const Slice& dict_handle_value) {
+  Rep* r = rep_;
+  Slice v = dict_handle_value;
+  BlockHandle handle;
+  Status s = handle.DecodeFrom(&v);
+  if (!s.ok()) {
+    return s;
+  }
+
+  ReadOptions opt;
+  if (r->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  s = ReadBlock(r->file, opt, handle, &block);
+  if (!s.ok()) {
+    return s;
+  }
+  r->dict = new CompressionDict(block.data, false);
+  if (block.heap_allocated) {
+    delete[] block.data.data();
+  }
+  if (r->dict->zstd_ddict() == NULL) {
+    s = Status::Corruption("cannot load compression dictionary");
+  }
+  return s;
+}
+
 void Table::ReadProperties(const Slice& props_handle_value) {
   Rep* r = rep_;
   Slice v = props_handle_value;
@@ -205,6 +251,12 @@ static void ReleaseBlock(void* arg, void* h) {
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
+  return BlockReader(arg, options, index_value, NULL);
+}
+
+Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
+                             const Slice& index_value,
+                             const Slice* get_target) {
   Table* table = reinterpret_cast<Table*>(arg);
   Cache* block_cache = table->rep_->options.block_cache;
   Block* block = NULL;
@@ -227,7 +279,8 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
       if (cache_handle != NULL) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(table->rep_->file, options, handle, &contents,
+                      table->rep_->dict);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
@@ -237,7 +290,8 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(table->rep_->file, options, handle, &contents,
+                    table->rep_->dict);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -246,7 +300,12 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != NULL) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    const Comparator* const cmp = table->rep_->options.comparator;
+    if (get_target != NULL) {
+      iter = block->NewIteratorForGet(cmp, *get_target);
+    } else {
+      iter = block->NewIterator(cmp);
+    }
     if (cache_handle == NULL) {
       iter->RegisterCleanup(&DeleteBlock, block, NULL);
     } else {
@@ -277,8 +336,7 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
+      Iterator* block_iter = BlockReader(this, options, iiter->value(), &k);
       if (block_iter->Valid()) {
         Slice v = (options.limit != 0) ? block_iter->value() : Slice();
         (*saver)(arg, block_iter->key(), v);
@@ -27,10 +27,12 @@
 #include "pdlfs-common/leveldb/table_properties.h"
 
 #include "pdlfs-common/coding.h"
+#include "pdlfs-common/compression.h"
 #include "pdlfs-common/crc32c.h"
 #include "pdlfs-common/env.h"
 
 #include <assert.h>
+#include <vector>
 
 namespace pdlfs {
 
@@ -62,6 +64,14 @@ struct TableBuilder::Rep {
 
   std::string compressed_output;
 
+  // When a dictionary is to be trained, the first entries are buffered as
+  // training samples and are only added after the dictionary is ready.
+  bool dict_pending;
+  std::string samples;  // Buffered key/value pairs stored back to back
+  std::vector<size_t> key_sizes;
+  std::vector<size_t> sample_sizes;  // Key size plus value size
+  CompressionDict* dict;  // Dictionary for data blocks, or NULL
+
   Rep(const Options& options, WritableFile* f)
       : options(options),
         file(f),
@@ -74,14 +84,20 @@ struct TableBuilder::Rep {
         filter_block(options.filter_policy != NULL
                          ? new FilterBlockBuilder(options.filter_policy)
                          : NULL),
-        pending_index_entry(false) {
+        pending_index_entry(false),
+        dict_pending(options.compression == kZstdCompression &&
+                     options.compression_dict_bytes != 0),
+        dict(NULL) {
     assert(options.comparator != NULL);
+    data_block.SetHashIndex(options.data_block_hash_index);
   }
 };
 
 Status TableBuilder::status() const { return rep_->status; }
 
-uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
+uint64_t TableBuilder::NumEntries() const {
+  return rep_->num_entries + rep_->sample_sizes.size();
+}
 
 uint64_t TableBuilder::NumBlocks() const { return rep_->num_blocks; }
 
@@ -101,6 +117,7 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->dict;
   delete rep_;
 }
 
@@ -114,6 +131,7 @@ Status TableBuilder::ChangeOptions(const Options& options) {
 
   rep_->options = options;
   rep_->data_block.ChangeRestartInterval(rep_->options.block_restart_interval);
+  rep_->data_block.SetHashIndex(rep_->options.data_block_hash_index);
   rep_->index_block.ChangeRestartInterval(
       rep_->options.index_block_restart_interval);
   return Status::OK();
@@ -123,6 +141,46 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
+  if (r->dict_pending) {
+    r->samples.append(key.data(), key.size());
+    r->samples.append(value.data(), value.size());
+    r->key_sizes.push_back(key.size());
+    r->sample_sizes.push_back(key.size() + value.size());
+    if (r->samples.size() >= 100 * r->options.compression_dict_bytes) {
+      MaybeTrainDict();
+    }
+    return;
+  }
+
+  AddEntry(key, value);
+}
+
+// Train a dictionary from all buffered entries and then add these entries
+// to the table. Entries are stored without a dictionary if training fails.
+void TableBuilder::MaybeTrainDict() {
+  Rep* r = rep_;
+  if (!r->dict_pending) return;
+  r->dict_pending = false;
+  std::string dict;
+  if (TrainCompressionDict(r->samples, r->sample_sizes,
+                           r->options.compression_dict_bytes, &dict)) {
+    r->dict = new CompressionDict(dict, true);
+  }
+  const char* p = r->samples.data();
+  for (size_t i = 0; i < r->sample_sizes.size(); i++) {
+    const size_t key_size = r->key_sizes[i];
+    AddEntry(Slice(p, key_size),
+             Slice(p + key_size, r->sample_sizes[i] - key_size));
+    p += r->sample_sizes[i];
+  }
+  std::string().swap(r->samples);
+  std::vector<size_t>().swap(r->key_sizes);
+  std::vector<size_t>().swap(r->sample_sizes);
+}
+
+void TableBuilder::AddEntry(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  if (!ok()) return;
   if (r->num_entries > 0) {
     assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
   } else {
@@ -160,6 +218,7 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
+  MaybeTrainDict();
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
@@ -177,12 +236,13 @@ void TableBuilder::Flush() {
 }
 
 void TableBuilder::AddBlock(BlockBuilder* builder, BlockHandle* handle) {
-  WriteBlock(builder->Finish(), handle);
+  WriteBlock(builder->Finish(), handle, rep_->dict);
   builder->Reset();
 }
 
 void TableBuilder::WriteBlock(const Slice& block_contents,
-                              BlockHandle* handle) {
+                              BlockHandle* handle,
+                              const CompressionDict* dict) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
@@ -191,25 +251,19 @@ void TableBuilder::WriteBlock(const Slice& block_contents,
   Rep* r = rep_;
   Slice raw_block_contents;
   CompressionType type = r->options.compression;
-  switch (type) {
-    case kNoCompression:
+  if (type == kNoCompression) {
+    raw_block_contents = block_contents;
+  } else {
+    std::string* compressed = &r->compressed_output;
+    if (Compress(type, block_contents, compressed, dict) &&
+        compressed->size() <
+            block_contents.size() - (block_contents.size() / 8u)) {
+      raw_block_contents = *compressed;
+    } else {
+      // Compression not supported, or compressed less than 12.5%, so just
+      // store uncompressed form
       raw_block_contents = block_contents;
-      break;
-
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(block_contents.data(), block_contents.size(),
-                                compressed) &&
-          compressed->size() <
-              block_contents.size() - (block_contents.size() / 8u)) {
-        raw_block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        raw_block_contents = block_contents;
-        type = kNoCompression;
-      }
-      break;
+      type = kNoCompression;
     }
   }
   WriteRawBlock(raw_block_contents, type, handle);
@@ -242,6 +296,7 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
   BlockHandle filter_block_handle;
+  BlockHandle dict_block_handle;
   BlockHandle props_block_handle;
   BlockHandle metaindex_block_handle;
   BlockHandle index_block_handle;
@@ -254,6 +309,13 @@ Status TableBuilder::Finish() {
     }
   }
 
+  // Write compression dictionary
+  if (ok()) {
+    if (r->dict != NULL) {
+      WriteRawBlock(r->dict->contents(), kNoCompression, &dict_block_handle);
+    }
+  }
+
   // Write stats
   if (ok()) {
     r->props_.SetLastKey(r->last_key);
@@ -266,6 +328,13 @@ Status TableBuilder::Finish() {
   if (ok()) {
     BlockBuilder meta_index_block(1);
 
+    if (r->dict != NULL) {
+      // Add mapping from "compression.dict" to location of the dictionary
+      std::string handle_encoding;
+      dict_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("compression.dict", handle_encoding);
+    }
+
     if (r->filter_block != NULL) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
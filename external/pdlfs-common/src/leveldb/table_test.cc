@@ -9,16 +9,23 @@
  * found in the LICENSE file. See the AUTHORS file for names of contributors.
  */
 #include "pdlfs-common/leveldb/table.h"
+#include "pdlfs-common/leveldb/block.h"
 #include "pdlfs-common/leveldb/comparator.h"
+#include "pdlfs-common/leveldb/format.h"
 #include "pdlfs-common/leveldb/internal_types.h"
+#include "pdlfs-common/leveldb/iterator.h"
 #include "pdlfs-common/leveldb/options.h"
 #include "pdlfs-common/leveldb/table_builder.h"
 #include "pdlfs-common/leveldb/table_properties.h"
+#include "pdlfs-common/cache.h"
+#include "pdlfs-common/compression.h"
+#include "pdlfs-common/env.h"
 #include "pdlfs-common/testharness.h"
 #include "pdlfs-common/testutil.h"
 
 #include <map>
 #include <string>
+#include <vector>
 
 namespace pdlfs {
 
@@ -80,6 +87,42 @@ class StringSource : public RandomAccessFile {
   std::string contents_;
 };
 
+// A source that serves reads directly from its memory without copying,
+// much like an mmapped file.
+class InMemorySource : public RandomAccessFile {
+ public:
+  InMemorySource(const Slice& contents)
+      : contents_(contents.data(), contents.size()), scratch_reads_(0) {}
+
+  virtual ~InMemorySource() {}
+
+  uint64_t Size() const { return contents_.size(); }
+
+  // Total number of reads given a scratch buffer
+  int scratch_reads() const { return scratch_reads_; }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    if (scratch != NULL) {
+      ++scratch_reads_;
+    }
+    if (offset > contents_.size()) {
+      return Status::InvalidArgument(Slice());
+    }
+    if (offset + n > contents_.size()) {
+      n = contents_.size() - offset;
+    }
+    *result = Slice(&contents_[offset], n);
+    return Status::OK();
+  }
+
+  virtual bool IsMemoryResident() const { return true; }
+
+ private:
+  std::string contents_;
+  mutable int scratch_reads_;
+};
+
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
 
 class TableWriter {
@@ -213,8 +256,163 @@ TEST(TableTest, ReadWrite) {
   ASSERT_EQ(reader.MaxSeq(), kMinSequenceNumber + kNumEntries - 1);
 }
 
+// Blocks of memory-resident files are read without scratch space.
+// Uncompressed blocks are used in place; compressed blocks are
+// uncompressed directly from the file's memory.
+static void TestInPlaceReads(CompressionType type) {
+  typedef DBOptions Options;
+  Options options;
+  options.block_size = 256;
+  options.compression = type;
+  TableWriter writer(options);
+  std::string contents = CreateTable(&writer);
+  InMemorySource file(contents);
+  Table* table;
+  ASSERT_OK(Table::Open(options, &file, file.Size(), &table));
+  const int scratch_reads = file.scratch_reads();
+  Iterator* iter = table->NewIterator(ReadOptions());
+  int n = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(iter->value().ToString(), "abcdfeg");
+    n++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(n, kNumEntries);
+  ASSERT_EQ(file.scratch_reads(), scratch_reads);
+  delete iter;
+  delete table;
+}
+
+TEST(TableTest, InPlaceReads) { TestInPlaceReads(kNoCompression); }
+
+TEST(TableTest, InPlaceCompressedReads) {
+  const CompressionType types[] = {kSnappyCompression, kLZ4Compression,
+                                   kZstdCompression};
+  for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    if (CompressionTypeSupported(types[i])) {
+      TestInPlaceReads(types[i]);
+    }
+  }
+}
+
+// A table whose dictionary cannot be read must fail to open rather than
+// fail each of its data block reads later.
+TEST(TableTest, BadCompressionDict) {
+  if (!CompressionTypeSupported(kZstdCompression)) {
+    fprintf(stderr, "zstd not supported, skipping test\n");
+    return;
+  }
+  Options options;
+  options.compression = kZstdCompression;
+  options.compression_dict_bytes = 1024;
+  options.paranoid_checks = true;
+  TableWriter writer(options);
+  std::string contents = CreateTable(&writer);
+  {
+    TableReader reader(options, contents);  // Opens fine
+  }
+  // Locate the dictionary through the footer and the metaindex block
+  Footer footer;
+  Slice input(contents.data() + contents.size() - Footer::kEncodedLength,
+              Footer::kEncodedLength);
+  ASSERT_OK(footer.DecodeFrom(&input));
+  StringSource source(contents);
+  BlockContents meta_contents;
+  ASSERT_OK(ReadBlock(&source, ReadOptions(), footer.metaindex_handle(),
+                      &meta_contents));
+  Block meta(meta_contents);
+  Iterator* iter = meta.NewIterator(BytewiseComparator());
+  iter->Seek("compression.dict");
+  ASSERT_TRUE(iter->Valid() && iter->key() == Slice("compression.dict"));
+  Slice v = iter->value();
+  BlockHandle handle;
+  ASSERT_OK(handle.DecodeFrom(&v));
+  delete iter;
+  contents[handle.offset()] ^= 1;
+  StringSource file(contents);
+  Table* table;
+  ASSERT_TRUE(Table::Open(options, &file, file.Size(), &table).IsCorruption());
+  ASSERT_TRUE(table == NULL);
+}
+
+// Compare point lookups against a table that is read through mmap with
+// those against a table that is read through pread and cached in a block
+// cache.  The table is fully cached in both cases.
+static void BM_TableRead(int num_entries, int num_reads) {
+  typedef DBOptions Options;
+  Env* const env = Env::Default();
+  std::string fname = test::TmpDir() + "/table_test_benchmark";
+  Options options;
+  options.compression = kNoCompression;
+  Random rnd(301);
+  std::vector<std::string> keys;
+  {
+    WritableFile* file;
+    ASSERT_OK(env->NewWritableFile(fname.c_str(), &file));
+    TableBuilder builder(options, file);
+    std::string value;
+    for (int i = 0; i < num_entries; i++) {
+      char tmp[20];
+      snprintf(tmp, sizeof(tmp), "%016d", i);
+      std::string key;
+      AppendInternalKey(&key, ParsedInternalKey(tmp, i + 1, kTypeValue));
+      builder.Add(key, test::RandomString(&rnd, 100, &value));
+      keys.push_back(key);
+    }
+    ASSERT_OK(builder.Finish());
+    ASSERT_OK(file->Close());
+    delete file;
+  }
+  uint64_t size;
+  ASSERT_OK(env->GetFileSize(fname.c_str(), &size));
+
+  for (int mmapped = 1; mmapped >= 0; mmapped--) {
+    Cache* cache = NULL;
+    RandomAccessFile* file;
+    if (mmapped) {
+      ASSERT_OK(env->NewRandomAccessFile(fname.c_str(), &file));
+    } else {
+      cache = NewLRUCache(2 * size);
+      options.block_cache = cache;
+      ASSERT_OK(Env::GetUnBufferedIoEnv()->NewRandomAccessFile(fname.c_str(),
+                                                               &file));
+    }
+    Table* table;
+    ASSERT_OK(Table::Open(options, file, size, &table));
+    // Warm up
+    Iterator* iter = table->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    }
+    delete iter;
+    const uint64_t start = CurrentMicros();
+    for (int i = 0; i < num_reads; i++) {
+      iter = table->NewIterator(ReadOptions());
+      iter->Seek(keys[rnd.Uniform(num_entries)]);
+      ASSERT_TRUE(iter->Valid());
+      delete iter;
+    }
+    const uint64_t us = CurrentMicros() - start;
+    fprintf(stderr,
+            "BM_TableRead/%-12s %8d reads : %9llu us (%7.3f us / read)\n",
+            mmapped ? "mmap" : "pread+cache", num_reads,
+            static_cast<unsigned long long>(us), double(us) / num_reads);
+    delete table;
+    delete file;
+    options.block_cache = NULL;
+    delete cache;
+  }
+
+  env->DeleteFile(fname.c_str());
+}
+
 }  // namespace pdlfs
 
 int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    ::pdlfs::BM_TableRead(100000, 1000000);
+    ::pdlfs::BM_TableRead(1000000, 1000000);
+    return 0;
+  }
+
   return ::pdlfs::test::RunAllTests(&argc, &argv);
 }
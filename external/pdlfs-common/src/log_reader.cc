@@ -17,7 +17,9 @@
 #include "pdlfs-common/log_reader.h"
 #include "pdlfs-common/coding.h"
 #include "pdlfs-common/crc32c.h"
+#include "pdlfs-common/compression.h"
 #include "pdlfs-common/env.h"
+#include "pdlfs-common/port.h"
 
 #include <stdio.h>
 
@@ -78,6 +80,7 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch, bool clean_eof) {
   scratch->clear();
   record->clear();
   bool in_fragmented_record = false;
+  bool compressed = false;  // If the current logical record is compressed
   // Record offset of the logical record that we're reading
   // 0 is a dummy value to make compilers happy
   uint64_t prospective_record_offset = 0;
@@ -105,6 +108,7 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch, bool clean_eof) {
 
     switch (record_type) {
       case kFullType:
+      case kCompressedFullType:
         if (in_fragmented_record) {
           // Handle bug in earlier versions of log::Writer where
           // it could emit an empty kFirstType record at the tail end
@@ -119,10 +123,14 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch, bool clean_eof) {
         prospective_record_offset = physical_record_offset;
         scratch->clear();
         *record = fragment;
+        if (record_type == kCompressedFullType && !Uncompress(record)) {
+          break;
+        }
         last_record_offset_ = prospective_record_offset;
         return true;
 
       case kFirstType:
+      case kCompressedFirstType:
         if (in_fragmented_record) {
           // Handle bug in earlier versions of log::Writer where
           // it could emit an empty kFirstType record at the tail end
@@ -136,6 +144,7 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch, bool clean_eof) {
         }
         prospective_record_offset = physical_record_offset;
         scratch->assign(fragment.data(), fragment.size());
+        compressed = (record_type == kCompressedFirstType);
         in_fragmented_record = true;
         break;
 
@@ -155,6 +164,11 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch, bool clean_eof) {
         } else {
           scratch->append(fragment.data(), fragment.size());
           *record = Slice(*scratch);
+          in_fragmented_record = false;
+          if (compressed && !Uncompress(record)) {
+            scratch->clear();
+            break;
+          }
           last_record_offset_ = prospective_record_offset;
           return true;
         }
@@ -192,6 +206,24 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch, bool clean_eof) {
   return false;
 }
 
+bool Reader::Uncompress(Slice* record) {
+  bool ok = false;
+  if (!record->empty()) {
+    const CompressionType type = static_cast<CompressionType>((*record)[0]);
+    if (type != kNoCompression) {
+      ok = pdlfs::Uncompress(
+          type, Slice(record->data() + 1, record->size() - 1), &uncompressed_);
+    }
+  }
+  if (!ok) {
+    ReportCorruption(record->size(), "corrupted compressed record");
+    record->clear();
+    return false;
+  }
+  *record = uncompressed_;
+  return true;
+}
+
 void Reader::SetReporter(Reporter* reporter) { reporter_ = reporter; }
 
 uint64_t Reader::LastRecordOffset() { return last_record_offset_; }
@@ -19,6 +19,7 @@
 #include "pdlfs-common/env.h"
 #include "pdlfs-common/log_reader.h"
 #include "pdlfs-common/log_writer.h"
+#include "pdlfs-common/port.h"
 #include "pdlfs-common/random.h"
 #include "pdlfs-common/testharness.h"
 
@@ -143,6 +144,10 @@ class LogTest {
     writer_ = new Writer(&dest_, dest_.contents_.size());
   }
 
+  void SetCompression(CompressionType type, size_t min_size) {
+    writer_->SetCompression(type, min_size);
+  }
+
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
     writer_->AddRecord(Slice(msg));
@@ -597,11 +602,122 @@ TEST(LogTest, ReadPastEnd) {
   CheckOffsetPastEndReturnsNoRecords(5);
 }
 
+static bool SnappyCompressionSupported() {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  return port::Snappy_Compress(in.data(), in.size(), &out);
+}
+
+TEST(LogTest, CompressedRecords) {
+  SetCompression(kSnappyCompression, 100);
+  std::string compressible;
+  while (compressible.size() < 3 * kBlockSize) {
+    compressible.append(NumberString(compressible.size()));
+  }
+  Write("foo");
+  Write(BigString("bar", 1000));
+  Write(compressible);
+  Write("small");
+  Write("");
+  const size_t raw = 3 + 1000 + compressible.size() + 5;
+  if (SnappyCompressionSupported()) {
+    ASSERT_LT(WrittenBytes(), raw / 2);
+  } else {
+    fprintf(stderr, "skipping compression checks: snappy not supported\n");
+    ASSERT_GT(WrittenBytes(), raw);
+  }
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ(BigString("bar", 1000), Read());
+  ASSERT_EQ(compressible, Read());
+  ASSERT_EQ("small", Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, BadCompressedRecord) {
+  Write("foo");
+  Write("bar");
+  // Mark the first record compressed with an unknown compression type
+  SetByte(6, kCompressedFullType);
+  FixChecksum(0, 3);
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(3, DroppedBytes());
+  ASSERT_EQ("OK", MatchError("corrupted compressed record"));
+}
+
 }  // namespace log
-}  // namespace pdlfs
 
 /* clang-format on */
 
+namespace {
+class NullFile : public WritableFile {
+ public:
+  NullFile() : size_(0) {}
+  virtual ~NullFile() {}
+  virtual Status Append(const Slice& data) {
+    size_ += data.size();
+    return Status::OK();
+  }
+  virtual Status Close() { return Status::OK(); }
+  virtual Status Flush() { return Status::OK(); }
+  virtual Status Sync() { return Status::OK(); }
+
+  uint64_t size_;
+};
+}  // namespace
+
+// Write log records resembling write batches of "batch_size" bytes full of
+// encoded keys and file stats, and report bytes written and throughput.
+static void BM_LogWrite(CompressionType compression, size_t batch_size) {
+  const uint64_t total = 256 << 20;
+  std::vector<std::string> batches;
+  Random rnd(301);
+  for (int i = 0; i < 64; i++) {
+    std::string batch;
+    while (batch.size() < batch_size) {
+      PutFixed64(&batch, 1000 + rnd.Uniform(64));  // Dir id
+      PutFixed32(&batch, rnd.Next());              // Name hash
+      PutFixed32(&batch, rnd.Next());
+      PutFixed32(&batch, 0x81a4);                  // Mode
+      PutFixed32(&batch, 1000);                    // Uid
+      PutFixed32(&batch, 1000);                    // Gid
+      PutFixed64(&batch, 0);                       // Size
+      PutFixed64(&batch, 1500000000000000ULL + i); // Mtime
+    }
+    batch.resize(batch_size);
+    batches.push_back(batch);
+  }
+  NullFile file;
+  log::Writer writer(&file);
+  writer.SetCompression(compression, 0);
+  uint64_t written = 0;
+  const uint64_t start = CurrentMicros();
+  for (int i = 0; written < total; i++) {
+    writer.AddRecord(batches[i % batches.size()]);
+    written += batch_size;
+  }
+  const uint64_t us = CurrentMicros() - start;
+  fprintf(stderr,
+          "BM_LogWrite/%-6s %6d-byte batches: %6.1f MB logged for %6.1f MB "
+          "written, %8.1f MB/s\n",
+          compression == kNoCompression ? "raw" : "snappy",
+          static_cast<int>(batch_size), file.size_ / 1048576.0,
+          written / 1048576.0, written / 1048576.0 / (us / 1e6));
+}
+
+}  // namespace pdlfs
+
 int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    const size_t sizes[] = {128, 512, 4096, 32768, 262144};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      ::pdlfs::BM_LogWrite(::pdlfs::kNoCompression, sizes[i]);
+      ::pdlfs::BM_LogWrite(::pdlfs::kSnappyCompression, sizes[i]);
+    }
+    return 0;
+  }
+
   return ::pdlfs::test::RunAllTests(&argc, &argv);
 }
@@ -16,8 +16,10 @@
  */
 #include "pdlfs-common/log_writer.h"
 #include "pdlfs-common/coding.h"
+#include "pdlfs-common/compression.h"
 #include "pdlfs-common/crc32c.h"
 #include "pdlfs-common/env.h"
+#include "pdlfs-common/port.h"
 
 namespace pdlfs {
 namespace log {
@@ -29,20 +31,48 @@ static void InitTypeCrc(uint32_t* type_crc) {
   }
 }
 
-Writer::Writer(WritableFile* dest) : dest_(dest), block_offset_(0) {
+Writer::Writer(WritableFile* dest)
+    : dest_(dest),
+      block_offset_(0),
+      offset_(0),
+      compression_(kNoCompression),
+      min_compression_size_(0) {
   InitTypeCrc(type_crc_);
 }
 
 Writer::Writer(WritableFile* dest, uint64_t dest_length)
     : dest_(dest),
       block_offset_(dest_length % kBlockSize),
-      offset_(dest_length) {
+      offset_(dest_length),
+      compression_(kNoCompression),
+      min_compression_size_(0) {
   InitTypeCrc(type_crc_);
 }
 
 Writer::~Writer() {}
 
+void Writer::SetCompression(CompressionType type, size_t min_size) {
+  compression_ = type;
+  min_compression_size_ = min_size;
+}
+
 Status Writer::AddRecord(const Slice& slice) {
+  const size_t sz = slice.size();
+  if (compression_ != kNoCompression && sz != 0 &&
+      sz >= min_compression_size_) {
+    compressed_.resize(1);
+    compressed_[0] = static_cast<char>(compression_);
+    std::string output;
+    const bool ok = Compress(compression_, slice, &output);
+    if (ok && 1 + output.size() < sz - sz / 8u) {
+      compressed_.append(output);
+      return EmitRecord(compressed_, true);
+    }
+  }
+  return EmitRecord(slice, false);
+}
+
+Status Writer::EmitRecord(const Slice& slice, bool compressed) {
   const char* ptr = slice.data();
   size_t left = slice.size();
 
@@ -75,9 +105,9 @@ Status Writer::AddRecord(const Slice& slice) {
       RecordType type;
       const bool end = (left == fragment_length);
       if (begin && end) {
-        type = kFullType;
+        type = compressed ? kCompressedFullType : kFullType;
       } else if (begin) {
-        type = kFirstType;
+        type = compressed ? kCompressedFirstType : kFirstType;
       } else if (end) {
         type = kLastType;
       } else {
@@ -58,9 +58,8 @@ hg_return_t MercuryRPC::RPCMessageCoder(hg_proc_t proc, void* data) {
               if (len <= sizeof(msg->buf)) {
                 p = &msg->buf[0];
               } else {
-                // XXX: Avoid an extra copy of data
-                msg->extra_buf.reserve(len);
-                msg->extra_buf.resize(1);
+                // Decode straight into the message's own buffer
+                msg->extra_buf.resize(len);
                 p = &msg->extra_buf[0];
               }
               ret = hg_proc_memcpy(proc, p, len);
@@ -9,12 +9,17 @@
  * found in the LICENSE file. See the AUTHORS file for names of contributors.
  */
 
+#include "packed_osd.h"
+
 #include "pdlfs-common/testharness.h"
 #include "pdlfs-common/testutil.h"
 
 #include "pdlfs-common/env.h"
 #include "pdlfs-common/ofs.h"
 #include "pdlfs-common/osd.h"
+#include "pdlfs-common/strutil.h"
+
+#include <stdio.h>
 
 namespace pdlfs {
 
@@ -79,8 +84,221 @@ TEST(OSD, Copy) {
   ASSERT_EQ(tmp, rnddata);
 }
 
+class PackedOSD {
+ public:
+  PackedOSD() : rnd_(test::RandomSeed()), osd_(NULL) {
+    root_ = test::PrepareTmpDir("packed_osd_test");
+    options_.segment_size = 4096;
+    Open();
+  }
+
+  ~PackedOSD() { delete osd_; }
+
+  void Open() {
+    delete osd_;
+    osd_ = NULL;
+    ASSERT_OK(Osd::OpenPacked(root_.c_str(), options_, &osd_));
+  }
+
+  void WaitForCompactions() {
+    static_cast<PackedOsd*>(osd_)->TEST_WaitForCompactions();
+  }
+
+  int NumSegments() {
+    std::vector<std::string> names;
+    ASSERT_OK(Env::Default()->GetChildren(root_.c_str(), &names));
+    int result = 0;
+    for (size_t i = 0; i < names.size(); i++) {
+      if (Slice(names[i]).ends_with(".seg")) {
+        result++;
+      }
+    }
+    return result;
+  }
+
+  std::string Get(const char* name) {
+    std::string tmp;
+    Status s = osd_->Get(name, &tmp);
+    if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    } else if (!s.ok()) {
+      return s.ToString();
+    } else {
+      return tmp;
+    }
+  }
+
+  Random rnd_;
+  std::string root_;
+  PackedOsdOptions options_;
+  Osd* osd_;
+};
+
+TEST(PackedOSD, PutGetDelete) {
+  std::string rnddatastor;
+  Slice rnddata = test::RandomString(&rnd_, 16, &rnddatastor);
+  ASSERT_OK(osd_->Put("name1", rnddata));
+  ASSERT_TRUE(osd_->Exists("name1"));
+  uint64_t size = 0;
+  ASSERT_OK(osd_->Size("name1", &size));
+  ASSERT_EQ(size, rnddata.size());
+  ASSERT_EQ(Get("name1"), rnddata);
+  ASSERT_OK(osd_->Put("name1", "v2"));
+  ASSERT_EQ(Get("name1"), "v2");
+  ASSERT_OK(osd_->Copy("name1", "name2"));
+  ASSERT_EQ(Get("name2"), "v2");
+  ASSERT_OK(osd_->Delete("name1"));
+  ASSERT_FALSE(osd_->Exists("name1"));
+  ASSERT_EQ(Get("name1"), "NOT_FOUND");
+  ASSERT_TRUE(osd_->Delete("name1").IsNotFound());
+  ASSERT_OK(osd_->Put("empty", Slice()));
+  ASSERT_EQ(Get("empty"), "");
+}
+
+TEST(PackedOSD, ReadWriteObjects) {
+  std::string rnddatastor;
+  Slice rnddata = test::RandomString(&rnd_, 1000, &rnddatastor);
+  WritableFile* wfile;
+  ASSERT_OK(osd_->NewWritableObj("name1", &wfile));
+  ASSERT_TRUE(osd_->Exists("name1"));
+  ASSERT_OK(wfile->Append(Slice(rnddata.data(), 500)));
+  ASSERT_OK(wfile->Append(Slice(rnddata.data() + 500, 500)));
+  ASSERT_OK(wfile->Close());
+  delete wfile;
+  std::string tmp;
+  ASSERT_OK(ReadFileToString(osd_, "name1", &tmp));
+  ASSERT_EQ(tmp, rnddata);
+  RandomAccessFile* rfile;
+  ASSERT_OK(osd_->NewRandomAccessObj("name1", &rfile));
+  char scratch[100];
+  Slice result;
+  ASSERT_OK(rfile->Read(900, 100, &result, scratch));
+  ASSERT_EQ(result, Slice(rnddata.data() + 900, 100));
+  ASSERT_OK(rfile->Read(950, 100, &result, scratch));
+  ASSERT_EQ(result, Slice(rnddata.data() + 950, 50));
+  // Object contents stay readable after an overwrite
+  ASSERT_OK(osd_->Put("name1", "v2"));
+  ASSERT_OK(rfile->Read(0, 100, &result, scratch));
+  ASSERT_EQ(result, Slice(rnddata.data(), 100));
+  delete rfile;
+  ASSERT_EQ(Get("name1"), "v2");
+}
+
+TEST(PackedOSD, InterleavedPutGet) {
+  RandomAccessFile* rfile = NULL;
+  std::string value;
+  for (int i = 0; i < 200; i++) {
+    test::RandomString(&rnd_, 10, &value);
+    ASSERT_OK(osd_->Put(NumberToString(i).c_str(), value));
+    ASSERT_EQ(Get(NumberToString(i).c_str()), value);
+    if (i == 0) {
+      ASSERT_OK(osd_->NewRandomAccessObj("0", &rfile));
+    }
+  }
+  // Handles pinned by earlier readers remain usable
+  char scratch[10];
+  Slice result;
+  ASSERT_OK(rfile->Read(0, 10, &result, scratch));
+  ASSERT_EQ(result.size(), 10);
+  delete rfile;
+}
+
+TEST(PackedOSD, Recovery) {
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(osd_->Put(NumberToString(i).c_str(), NumberToString(i * 2)));
+  }
+  for (int i = 0; i < 100; i += 2) {
+    ASSERT_OK(osd_->Delete(NumberToString(i).c_str()));
+  }
+  ASSERT_OK(osd_->Put("1", "one"));
+  Open();
+  ASSERT_EQ(Get("0"), "NOT_FOUND");
+  ASSERT_EQ(Get("1"), "one");
+  for (int i = 2; i < 100; i++) {
+    const std::string expected =
+        (i % 2 == 0) ? "NOT_FOUND" : NumberToString(i * 2);
+    ASSERT_EQ(Get(NumberToString(i).c_str()), expected);
+  }
+}
+
+TEST(PackedOSD, Compaction) {
+  std::string value;
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < 20; i++) {
+      test::RandomString(&rnd_, 100, &value);
+      ASSERT_OK(osd_->Put(NumberToString(i).c_str(), value));
+    }
+  }
+  // Each round writes about half a segment worth of data so all
+  // live objects would fit in a couple of segments
+  WaitForCompactions();
+  ASSERT_LT(NumSegments(), 6);
+  Open();
+  WaitForCompactions();
+  ASSERT_LT(NumSegments(), 6);
+  ASSERT_EQ(Get("19"), value);
+  for (int i = 0; i < 20; i++) {
+    ASSERT_TRUE(osd_->Exists(NumberToString(i).c_str()));
+  }
+  for (int i = 0; i < 20; i++) {
+    ASSERT_OK(osd_->Delete(NumberToString(i).c_str()));
+  }
+  Open();
+  for (int i = 0; i < 20; i++) {
+    ASSERT_FALSE(osd_->Exists(NumberToString(i).c_str()));
+  }
+}
+
+// Compare small-object put/get rates of one-file-per-object
+// with those of packed segments.
+static void BM_SmallObjects(int num_objects, int obj_size) {
+  std::string value(obj_size, 'x');
+  for (int packed = 0; packed < 2; packed++) {
+    std::string root = test::PrepareTmpDir("osd_bench");
+    Osd* osd;
+    if (packed) {
+      ASSERT_OK(Osd::OpenPacked(root.c_str(), PackedOsdOptions(), &osd));
+    } else {
+      osd = Osd::FromEnv(root.c_str());
+    }
+    char name[20];
+    uint64_t start = CurrentMicros();
+    for (int i = 0; i < num_objects; i++) {
+      snprintf(name, sizeof(name), "obj%d", i);
+      ASSERT_OK(osd->Put(name, value));
+    }
+    const uint64_t put_us = CurrentMicros() - start;
+    start = CurrentMicros();
+    std::string tmp;
+    for (int i = 0; i < num_objects; i++) {
+      snprintf(name, sizeof(name), "obj%d", i);
+      ASSERT_OK(osd->Get(name, &tmp));
+    }
+    const uint64_t get_us = CurrentMicros() - start;
+    start = CurrentMicros();
+    for (int i = 0; i < num_objects; i++) {
+      snprintf(name, sizeof(name), "obj%d", i);
+      ASSERT_OK(osd->Delete(name));
+    }
+    const uint64_t del_us = CurrentMicros() - start;
+    delete osd;
+    fprintf(stderr,
+            "BM_SmallObjects/%-6s %8d x %dB : put %8.0f ops/s, get %8.0f "
+            "ops/s, delete %8.0f ops/s\n",
+            packed ? "packed" : "files", num_objects, obj_size,
+            num_objects * 1e6 / put_us, num_objects * 1e6 / get_us,
+            num_objects * 1e6 / del_us);
+  }
+}
+
 }  // namespace pdlfs
 
 int main(int argc, char* argv[]) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    ::pdlfs::BM_SmallObjects(100000, 100);
+    ::pdlfs::BM_SmallObjects(100000, 4000);
+    return 0;
+  }
+
   return ::pdlfs::test::RunAllTests(&argc, &argv);
 }
@@ -0,0 +1,786 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "packed_osd.h"
+
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/crc32c.h"
+#include "pdlfs-common/mutexlock.h"
+#include "pdlfs-common/strutil.h"
+
+#include <stdio.h>
+
+namespace pdlfs {
+
+PackedOsdOptions::PackedOsdOptions()
+    : env(NULL),
+      segment_size(64 << 20),
+      bytes_per_sync(1 << 20),
+      compaction_threshold(50) {}
+
+// A read handle of a segment file. Handles are shared by all readers of a
+// segment and are replaced when records beyond the readable portion are
+// requested. A replaced handle is deleted once its last reader is gone.
+struct PackedOsd::SegmentFile {
+  SegmentFile(RandomAccessFile* file, uint64_t readable)
+      : file(file), readable(readable), refs(1) {}
+  ~SegmentFile() { delete file; }
+
+  RandomAccessFile* const file;
+  const uint64_t readable;  // Bytes visible through file
+  int refs;
+
+ private:
+  // No copying allowed
+  void operator=(const SegmentFile& f);
+  SegmentFile(const SegmentFile&);
+};
+
+struct PackedOsd::Segment {
+  explicit Segment(uint64_t number)
+      : number(number),
+        size(0),
+        live(0),
+        file(NULL),
+        refs(1),
+        compacting(false),
+        obsolete(false) {}
+
+  uint64_t number;
+  uint64_t size;      // Total bytes of records written
+  uint64_t live;      // Bytes of records referenced by the index
+  SegmentFile* file;  // Latest read handle. NULL until first read
+  int refs;
+  bool compacting;  // True iff segment is queued for compaction
+  bool obsolete;    // True iff the segment file should be deleted
+};
+
+struct PackedOsd::ObjLoc {
+  ObjLoc(Segment* seg, uint64_t offset, uint64_t size, uint64_t record_size)
+      : seg(seg), offset(offset), size(size), record_size(record_size) {}
+
+  Segment* seg;
+  uint64_t offset;  // Offset of object data within seg
+  uint64_t size;    // Size of object data
+  uint64_t record_size;
+};
+
+namespace {
+// Objects are backed by a record in a segment. The record data is
+// immutable and each object pins a segment file handle through which the
+// entire record is visible, so reads require no synchronization.
+class PackedRandomAccessObj : public RandomAccessFile {
+ public:
+  PackedRandomAccessObj(PackedOsd* osd, PackedOsd::Segment* seg,
+                        PackedOsd::SegmentFile* file, uint64_t offset,
+                        uint64_t size)
+      : osd_(osd), seg_(seg), file_(file), offset_(offset), size_(size) {}
+
+  virtual ~PackedRandomAccessObj() { osd_->Release(seg_, file_); }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    if (offset >= size_) {
+      *result = Slice();
+      return Status::OK();
+    }
+    if (offset + n > size_) {
+      n = static_cast<size_t>(size_ - offset);
+    }
+    return file_->file->Read(offset_ + offset, n, result, scratch);
+  }
+
+ private:
+  PackedOsd* const osd_;
+  PackedOsd::Segment* const seg_;
+  PackedOsd::SegmentFile* const file_;
+  const uint64_t offset_;
+  const uint64_t size_;
+};
+
+class PackedSequentialObj : public SequentialFile {
+ public:
+  PackedSequentialObj(PackedOsd* osd, PackedOsd::Segment* seg,
+                      PackedOsd::SegmentFile* file, uint64_t offset,
+                      uint64_t size)
+      : osd_(osd),
+        seg_(seg),
+        file_(file),
+        offset_(offset),
+        size_(size),
+        pos_(0) {}
+
+  virtual ~PackedSequentialObj() { osd_->Release(seg_, file_); }
+
+  virtual Status Read(size_t n, Slice* result, char* scratch) {
+    if (pos_ + n > size_) {
+      n = static_cast<size_t>(size_ - pos_);
+    }
+    Status s;
+    if (n == 0) {
+      *result = Slice();
+    } else {
+      s = file_->file->Read(offset_ + pos_, n, result, scratch);
+      if (s.ok()) {
+        pos_ += result->size();
+      }
+    }
+    return s;
+  }
+
+  virtual Status Skip(uint64_t n) {
+    if (pos_ + n > size_) {
+      pos_ = size_;
+    } else {
+      pos_ += n;
+    }
+    return Status::OK();
+  }
+
+ private:
+  PackedOsd* const osd_;
+  PackedOsd::Segment* const seg_;
+  PackedOsd::SegmentFile* const file_;
+  const uint64_t offset_;
+  const uint64_t size_;
+  uint64_t pos_;
+};
+
+// Object contents are buffered in memory and stored as
+// a single record when the object is closed.
+class PackedWritableObj : public WritableFile {
+ public:
+  PackedWritableObj(PackedOsd* osd, const char* name)
+      : osd_(osd), name_(name), closed_(false) {}
+
+  virtual ~PackedWritableObj() {
+    if (!closed_) {
+      Close();
+    }
+  }
+
+  virtual Status Append(const Slice& data) {
+    if (closed_) {
+      return Status::AssertionFailed("Object already closed", name_);
+    }
+    buf_.append(data.data(), data.size());
+    return Status::OK();
+  }
+
+  virtual Status Flush() { return Status::OK(); }
+  virtual Status Sync() { return Status::OK(); }
+
+  virtual Status Close() {
+    if (closed_) {
+      return Status::OK();
+    }
+    closed_ = true;
+    return osd_->Put(name_.c_str(), buf_);
+  }
+
+ private:
+  PackedOsd* const osd_;
+  std::string name_;
+  std::string buf_;
+  bool closed_;
+};
+
+const char kSegmentSuffix[] = ".seg";
+
+// Return true and set *number if fname names a segment file.
+bool ParseSegmentFileName(const std::string& fname, uint64_t* number) {
+  Slice input(fname);
+  if (!input.ends_with(kSegmentSuffix)) {
+    return false;
+  }
+  input.remove_suffix(sizeof(kSegmentSuffix) - 1);
+  return !input.empty() && ConsumeDecimalNumber(&input, number) &&
+         input.empty();
+}
+}  // namespace
+
+PackedOsd::PackedOsd(const PackedOsdOptions& options, const char* prefix)
+    : options_(options),
+      env_(options.env != NULL ? options.env : Env::Default()),
+      prefix_(prefix),
+      bg_cv_(&mutex_),
+      bg_scheduled_(false),
+      shutting_down_(false),
+      syncing_(false),
+      next_segment_number_(1),
+      active_(NULL),
+      active_file_(NULL),
+      flushed_(0),
+      unsynced_(0) {}
+
+PackedOsd::~PackedOsd() {
+  MutexLock ml(&mutex_);
+  shutting_down_ = true;
+  while (bg_scheduled_ || syncing_) {
+    bg_cv_.Wait();
+  }
+  while (!compaction_queue_.empty()) {
+    Segment* const seg = compaction_queue_.front();
+    compaction_queue_.pop_front();
+    seg->compacting = false;
+    Unref(seg);
+  }
+  if (active_file_ != NULL) {
+    active_file_->Sync();
+    active_file_->Close();
+    delete active_file_;
+  }
+  struct Visitor : public HashMap<ObjLoc>::Visitor {
+    virtual void visit(const Slice& k, ObjLoc* loc) { delete loc; }
+  };
+  Visitor v;
+  index_.VisitAll(&v);
+  std::map<uint64_t, Segment*>::iterator it = segments_.begin();
+  for (; it != segments_.end(); ++it) {
+    Unref(it->second);
+  }
+}
+
+std::string PackedOsd::SegmentFileName(uint64_t number) const {
+  char tmp[30];
+  snprintf(tmp, sizeof(tmp), "/%08llu%s",
+           static_cast<unsigned long long>(number), kSegmentSuffix);
+  return prefix_ + tmp;
+}
+
+void PackedOsd::Release(Segment* seg, SegmentFile* file) {
+  MutexLock ml(&mutex_);
+  Unref(file);
+  Unref(seg);
+}
+
+void PackedOsd::TEST_WaitForCompactions() {
+  MutexLock ml(&mutex_);
+  while (bg_scheduled_) {
+    bg_cv_.Wait();
+  }
+}
+
+void PackedOsd::Unref(SegmentFile* file) {
+  mutex_.AssertHeld();
+  assert(file->refs > 0);
+  if (--file->refs == 0) {
+    delete file;
+  }
+}
+
+void PackedOsd::Unref(Segment* seg) {
+  mutex_.AssertHeld();
+  assert(seg->refs > 0);
+  if (--seg->refs == 0) {
+    if (seg->file != NULL) {
+      Unref(seg->file);
+    }
+    if (seg->obsolete) {
+      env_->DeleteFile(SegmentFileName(seg->number).c_str());
+    }
+    delete seg;
+  }
+}
+
+Status PackedOsd::Recover() {
+  MutexLock ml(&mutex_);
+  env_->CreateDir(prefix_.c_str());  // Ignore error. Dir may exist.
+  std::vector<std::string> names;
+  Status s = env_->GetChildren(prefix_.c_str(), &names);
+  if (!s.ok()) {
+    return s;
+  }
+  for (size_t i = 0; i < names.size(); i++) {
+    uint64_t number;
+    if (ParseSegmentFileName(names[i], &number)) {
+      segments_[number] = new Segment(number);
+      if (number >= next_segment_number_) {
+        next_segment_number_ = number + 1;
+      }
+    }
+  }
+  std::map<uint64_t, Segment*>::iterator it = segments_.begin();
+  for (; s.ok() && it != segments_.end(); ++it) {
+    s = ReplaySegment(it->second);
+  }
+  if (s.ok()) {
+    for (it = segments_.begin(); it != segments_.end(); ++it) {
+      MaybeScheduleCompaction(it->second);
+    }
+  }
+  return s;
+}
+
+// Records are replayed until the end of the segment or the first
+// truncated or corrupted record, whichever comes first. New records
+// are never appended to a segment written by a previous instance.
+Status PackedOsd::ReplaySegment(Segment* seg) {
+  mutex_.AssertHeld();
+  SequentialFile* file;
+  Status s = env_->NewSequentialFile(SegmentFileName(seg->number).c_str(),
+                                     &file);
+  if (!s.ok()) {
+    return s;
+  }
+  char header[kHeaderSize];
+  std::string buf;
+  while (true) {
+    Slice input;
+    s = file->Read(kHeaderSize, &input, header);
+    if (!s.ok() || input.size() != kHeaderSize) {
+      break;
+    }
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(input.data()));
+    const RecordType type = static_cast<RecordType>(input[4]);
+    const uint32_t name_len = DecodeFixed32(input.data() + 5);
+    const uint64_t data_len = DecodeFixed64(input.data() + 9);
+    if (type != kPutRecord && type != kDeleteRecord) {
+      break;
+    }
+    uint32_t actual = crc32c::Value(input.data() + 4, kHeaderSize - 4);
+    const size_t n = name_len + static_cast<size_t>(data_len);
+    buf.resize(n);
+    Slice payload;
+    s = file->Read(n, &payload, &buf[0]);
+    if (!s.ok() || payload.size() != n) {
+      break;
+    }
+    actual = crc32c::Extend(actual, payload.data(), n);
+    if (actual != crc) {
+      break;
+    }
+    const Slice name(payload.data(), name_len);
+    const uint64_t record_size = kHeaderSize + n;
+    if (type == kPutRecord) {
+      ObjLoc* const loc = new ObjLoc(seg, seg->size + kHeaderSize + name_len,
+                                     data_len, record_size);
+      Unlive(index_.Insert(name, loc));
+      seg->live += record_size;
+    } else {
+      Unlive(index_.Erase(name));
+    }
+    seg->size += record_size;
+  }
+  delete file;
+  return s;
+}
+
+// Return a referenced handle through which the first "end" bytes of a
+// segment are visible. The caller must hold a reference to the segment.
+Status PackedOsd::PrepareRead(Segment* seg, uint64_t end, SegmentFile** file) {
+  mutex_.AssertHeld();
+  Status s;
+  while (seg == active_ && syncing_) {
+    bg_cv_.Wait();
+  }
+  if (seg == active_ && flushed_ < end) {
+    s = active_file_->Flush();
+    if (s.ok()) {
+      flushed_ = seg->size;
+    }
+  }
+  if (s.ok() && (seg->file == NULL || seg->file->readable < end)) {
+    // Reopen the segment so that recently written data becomes visible
+    RandomAccessFile* f;
+    s = env_->NewRandomAccessFile(SegmentFileName(seg->number).c_str(), &f);
+    if (s.ok()) {
+      if (seg->file != NULL) {
+        Unref(seg->file);
+      }
+      seg->file = new SegmentFile(f, (seg == active_) ? flushed_ : seg->size);
+    }
+  }
+  if (s.ok()) {
+    seg->file->refs++;
+    *file = seg->file;
+  }
+  return s;
+}
+
+// Sync the active segment file without holding mutex_. Appends and flushes
+// of the active segment wait while a sync is in progress.
+Status PackedOsd::SyncActive() {
+  mutex_.AssertHeld();
+  while (syncing_) {
+    bg_cv_.Wait();
+  }
+  if (active_file_ == NULL) {
+    return Status::OK();
+  }
+  WritableFile* const file = active_file_;
+  const uint64_t size = active_->size;
+  syncing_ = true;
+  mutex_.Unlock();
+  Status s = file->Sync();
+  mutex_.Lock();
+  syncing_ = false;
+  bg_cv_.SignalAll();
+  if (s.ok()) {
+    flushed_ = size;
+    unsynced_ = 0;
+  }
+  return s;
+}
+
+Status PackedOsd::NewSegment() {
+  mutex_.AssertHeld();
+  Status s;
+  if (active_file_ != NULL) {
+    s = SyncActive();
+    if (s.ok()) {
+      s = active_file_->Close();
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    delete active_file_;
+    active_file_ = NULL;
+    Segment* const sealed = active_;
+    active_ = NULL;
+    MaybeScheduleCompaction(sealed);
+  }
+  const uint64_t number = next_segment_number_++;
+  WritableFile* file;
+  s = env_->NewWritableFile(SegmentFileName(number).c_str(), &file);
+  if (s.ok()) {
+    active_ = new Segment(number);
+    segments_[number] = active_;
+    active_file_ = file;
+    flushed_ = 0;
+    unsynced_ = 0;
+  }
+  return s;
+}
+
+Status PackedOsd::AppendRecord(RecordType type, const Slice& name,
+                               const Slice& data) {
+  mutex_.AssertHeld();
+  while (syncing_) {
+    bg_cv_.Wait();
+  }
+  Status s;
+  if (active_ == NULL || active_->size >= options_.segment_size) {
+    s = NewSegment();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  char header[kHeaderSize];
+  header[4] = static_cast<char>(type);
+  EncodeFixed32(header + 5, static_cast<uint32_t>(name.size()));
+  EncodeFixed64(header + 9, data.size());
+  uint32_t crc = crc32c::Value(header + 4, kHeaderSize - 4);
+  crc = crc32c::Extend(crc, name.data(), name.size());
+  crc = crc32c::Extend(crc, data.data(), data.size());
+  EncodeFixed32(header, crc32c::Mask(crc));
+  s = active_file_->Append(Slice(header, kHeaderSize));
+  if (s.ok()) {
+    s = active_file_->Append(name);
+  }
+  if (s.ok() && !data.empty()) {
+    s = active_file_->Append(data);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  const uint64_t record_size = kHeaderSize + name.size() + data.size();
+  const uint64_t offset = active_->size;
+  active_->size += record_size;
+  unsynced_ += record_size;
+
+  if (type == kPutRecord) {
+    ObjLoc* const loc = new ObjLoc(active_, offset + kHeaderSize + name.size(),
+                                   data.size(), record_size);
+    active_->live += record_size;
+    Unlive(index_.Insert(name, loc));
+  } else {
+    Unlive(index_.Erase(name));
+  }
+
+  if (unsynced_ >= options_.bytes_per_sync) {
+    s = SyncActive();
+  }
+  return s;
+}
+
+void PackedOsd::Unlive(ObjLoc* loc) {
+  mutex_.AssertHeld();
+  if (loc != NULL) {
+    Segment* const seg = loc->seg;
+    assert(seg->live >= loc->record_size);
+    seg->live -= loc->record_size;
+    delete loc;
+    MaybeScheduleCompaction(seg);
+  }
+}
+
+void PackedOsd::MaybeScheduleCompaction(Segment* seg) {
+  mutex_.AssertHeld();
+  if (seg == active_ || seg->compacting || seg->obsolete) {
+    // Skip
+  } else if (seg->live * 100 >=
+             seg->size * static_cast<uint64_t>(options_.compaction_threshold)) {
+    // Skip
+  } else if (shutting_down_) {
+    // Skip
+  } else {
+    seg->compacting = true;
+    seg->refs++;
+    compaction_queue_.push_back(seg);
+    if (!bg_scheduled_) {
+      bg_scheduled_ = true;
+      env_->Schedule(&PackedOsd::BGWork, this);
+    }
+  }
+}
+
+void PackedOsd::BGWork(void* arg) {
+  reinterpret_cast<PackedOsd*>(arg)->BackgroundCall();
+}
+
+void PackedOsd::BackgroundCall() {
+  MutexLock ml(&mutex_);
+  assert(bg_scheduled_);
+  while (!compaction_queue_.empty() && !shutting_down_) {
+    Segment* const seg = compaction_queue_.front();
+    compaction_queue_.pop_front();
+    Status s = CompactSegment(seg);
+    seg->compacting = false;
+    if (s.ok()) {
+      segments_.erase(seg->number);
+      seg->obsolete = true;
+      Unref(seg);  // Drop the reference held by segments_
+    }
+    Unref(seg);
+  }
+  bg_scheduled_ = false;
+  bg_cv_.SignalAll();
+}
+
+// Copy all live records of a sealed segment to the active segment. A
+// deletion record is copied only if no newer put exists for the same name
+// and older segments may still hold a put for it.
+Status PackedOsd::CompactSegment(Segment* seg) {
+  mutex_.AssertHeld();
+  mutex_.Unlock();
+  SequentialFile* file;
+  Status s = env_->NewSequentialFile(SegmentFileName(seg->number).c_str(),
+                                     &file);
+  mutex_.Lock();
+  if (!s.ok()) {
+    return s;
+  }
+
+  char header[kHeaderSize];
+  std::string buf;
+  uint64_t offset = 0;
+  while (s.ok() && offset < seg->size && !shutting_down_) {
+    mutex_.Unlock();
+    Slice input;
+    Slice payload;
+    s = file->Read(kHeaderSize, &input, header);
+    if (s.ok() && input.size() != kHeaderSize) {
+      s = Status::Corruption("Truncated segment record header");
+    }
+    uint32_t name_len = 0;
+    RecordType type = kPutRecord;
+    if (s.ok()) {
+      type = static_cast<RecordType>(input[4]);
+      name_len = DecodeFixed32(input.data() + 5);
+      const size_t n =
+          name_len + static_cast<size_t>(DecodeFixed64(input.data() + 9));
+      buf.resize(n);
+      s = file->Read(n, &payload, &buf[0]);
+      if (s.ok() && payload.size() != n) {
+        s = Status::Corruption("Truncated segment record");
+      }
+    }
+    mutex_.Lock();
+    if (!s.ok()) {
+      break;
+    }
+
+    const Slice name(payload.data(), name_len);
+    const Slice data(payload.data() + name_len, payload.size() - name_len);
+    if (type == kPutRecord) {
+      ObjLoc* const loc = index_.Lookup(name);
+      if (loc != NULL && loc->seg == seg &&
+          loc->offset == offset + kHeaderSize + name_len) {
+        s = AppendRecord(kPutRecord, name, data);
+      }
+    } else if (!index_.Contains(name) &&
+               segments_.begin()->first < seg->number) {
+      s = AppendRecord(kDeleteRecord, name, Slice());
+    }
+    offset += kHeaderSize + payload.size();
+  }
+  delete file;
+
+  if (s.ok() && shutting_down_) {
+    s = Status::IOError("Osd is shutting down");
+  }
+  // Copied records must be durable before the segment can be removed
+  if (s.ok()) {
+    s = SyncActive();
+  }
+  return s;
+}
+
+Status PackedOsd::NewSequentialObj(const char* name, SequentialFile** r) {
+  MutexLock ml(&mutex_);
+  *r = NULL;
+  ObjLoc* const loc = index_.Lookup(name);
+  if (loc == NULL) {
+    return Status::NotFound(name);
+  }
+  Segment* const seg = loc->seg;
+  const uint64_t offset = loc->offset;
+  const uint64_t size = loc->size;
+  seg->refs++;
+  SegmentFile* file;
+  // May temporarily release mutex_, after which loc may be gone
+  Status s = PrepareRead(seg, offset + size, &file);
+  if (s.ok()) {
+    *r = new PackedSequentialObj(this, seg, file, offset, size);
+  } else {
+    Unref(seg);
+  }
+  return s;
+}
+
+Status PackedOsd::NewRandomAccessObj(const char* name, RandomAccessFile** r) {
+  MutexLock ml(&mutex_);
+  *r = NULL;
+  ObjLoc* const loc = index_.Lookup(name);
+  if (loc == NULL) {
+    return Status::NotFound(name);
+  }
+  Segment* const seg = loc->seg;
+  const uint64_t offset = loc->offset;
+  const uint64_t size = loc->size;
+  seg->refs++;
+  SegmentFile* file;
+  // May temporarily release mutex_, after which loc may be gone
+  Status s = PrepareRead(seg, offset + size, &file);
+  if (s.ok()) {
+    *r = new PackedRandomAccessObj(this, seg, file, offset, size);
+  } else {
+    Unref(seg);
+  }
+  return s;
+}
+
+// The new object is created empty right away, and its contents
+// are written when it is closed.
+Status PackedOsd::NewWritableObj(const char* name, WritableFile** r) {
+  Status s = Put(name, Slice());
+  if (s.ok()) {
+    *r = new PackedWritableObj(this, name);
+  } else {
+    *r = NULL;
+  }
+  return s;
+}
+
+bool PackedOsd::Exists(const char* name) {
+  MutexLock ml(&mutex_);
+  return index_.Contains(name);
+}
+
+Status PackedOsd::Size(const char* name, uint64_t* obj_size) {
+  MutexLock ml(&mutex_);
+  ObjLoc* const loc = index_.Lookup(name);
+  if (loc == NULL) {
+    return Status::NotFound(name);
+  } else {
+    *obj_size = loc->size;
+    return Status::OK();
+  }
+}
+
+Status PackedOsd::Delete(const char* name) {
+  MutexLock ml(&mutex_);
+  if (!index_.Contains(name)) {
+    return Status::NotFound(name);
+  } else {
+    return AppendRecord(kDeleteRecord, name, Slice());
+  }
+}
+
+Status PackedOsd::Put(const char* name, const Slice& data) {
+  MutexLock ml(&mutex_);
+  return AppendRecord(kPutRecord, name, data);
+}
+
+Status PackedOsd::Get(const char* name, std::string* data) {
+  Segment* seg;
+  SegmentFile* file;
+  uint64_t offset;
+  size_t n;
+  {
+    MutexLock ml(&mutex_);
+    ObjLoc* const loc = index_.Lookup(name);
+    if (loc == NULL) {
+      return Status::NotFound(name);
+    }
+    seg = loc->seg;
+    offset = loc->offset;
+    n = static_cast<size_t>(loc->size);
+    seg->refs++;
+    Status s = PrepareRead(seg, offset + n, &file);
+    if (!s.ok()) {
+      Unref(seg);
+      return s;
+    }
+  }
+  data->resize(n);
+  Slice result;
+  Status s;
+  if (n != 0) {
+    s = file->file->Read(offset, n, &result, &(*data)[0]);
+  }
+  if (s.ok() && result.size() != n) {
+    s = Status::Corruption("Truncated object", name);
+  }
+  if (s.ok() && result.data() != data->data()) {
+    data->assign(result.data(), result.size());
+  }
+  if (!s.ok()) {
+    data->clear();
+  }
+  Release(seg, file);
+  return s;
+}
+
+Status PackedOsd::Copy(const char* src, const char* dst) {
+  std::string data;
+  Status s = Get(src, &data);
+  if (s.ok()) {
+    s = Put(dst, data);
+  }
+  return s;
+}
+
+Status Osd::OpenPacked(const char* prefix, const PackedOsdOptions& options,
+                       Osd** result) {
+  *result = NULL;
+  PackedOsd* const osd = new PackedOsd(options, prefix);
+  Status s = osd->Recover();
+  if (s.ok()) {
+    *result = osd;
+  } else {
+    delete osd;
+  }
+  return s;
+}
+
+}  // namespace pdlfs
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/hashmap.h"
+#include "pdlfs-common/osd.h"
+#include "pdlfs-common/port.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pdlfs {
+
+// An Osd implementation storing objects in large append-only segment files.
+// Each object update is written as a record to the end of the active
+// segment:
+//
+//   checksum: fixed32     // Masked crc32c of type, lengths, name, and data
+//   type: uint8           // kPutRecord or kDeleteRecord
+//   name_length: fixed32
+//   data_length: fixed64
+//   name: char[name_length]
+//   data: char[data_length]
+//
+// An in-memory index maps each live object to its latest record, and is
+// rebuilt by replaying all segments in order when the osd is opened.
+// Sealed segments whose live bytes drop below a threshold are compacted
+// in the background by copying their live records to the active segment.
+class PackedOsd : public Osd {
+ public:
+  PackedOsd(const PackedOsdOptions& options, const char* prefix);
+  virtual ~PackedOsd();
+
+  // Replay all existing segments to rebuild the index.
+  Status Recover();
+
+  virtual Status NewSequentialObj(const char* name, SequentialFile** r);
+  virtual Status NewRandomAccessObj(const char* name, RandomAccessFile** r);
+  virtual Status NewWritableObj(const char* name, WritableFile** r);
+  virtual bool Exists(const char* name);
+  virtual Status Size(const char* name, uint64_t* obj_size);
+  virtual Status Delete(const char* name);
+  virtual Status Put(const char* name, const Slice& data);
+  virtual Status Get(const char* name, std::string* data);
+  virtual Status Copy(const char* src, const char* dst);
+
+  // Values are unsigned
+  enum RecordType { kPutRecord = 0x01, kDeleteRecord = 0x02 };
+  static const size_t kHeaderSize = 4 + 1 + 4 + 8;
+
+  struct Segment;
+  struct SegmentFile;
+  // Drop a reference to a segment and one to a file handle of it held by
+  // the caller.
+  void Release(Segment* seg, SegmentFile* file);
+
+  // Wait until all queued compactions are done.
+  void TEST_WaitForCompactions();
+
+ private:
+  struct ObjLoc;
+  void Unref(Segment* seg);
+  void Unref(SegmentFile* file);
+  std::string SegmentFileName(uint64_t number) const;
+  Status ReplaySegment(Segment* seg);
+  Status PrepareRead(Segment* seg, uint64_t end, SegmentFile** file);
+  Status AppendRecord(RecordType type, const Slice& name, const Slice& data);
+  Status SyncActive();
+  Status NewSegment();
+  void Unlive(ObjLoc* loc);
+  void MaybeScheduleCompaction(Segment* seg);
+  static void BGWork(void* arg);
+  void BackgroundCall();
+  Status CompactSegment(Segment* seg);
+
+  // No copying allowed
+  void operator=(const PackedOsd&);
+  PackedOsd(const PackedOsd&);
+
+  // Constant after construction
+  const PackedOsdOptions options_;
+  Env* const env_;
+  std::string prefix_;
+
+  // State below is protected by mutex_
+  port::Mutex mutex_;
+  port::CondVar bg_cv_;  // Signalled when background work finishes
+  bool bg_scheduled_;
+  bool shutting_down_;
+  bool syncing_;  // True iff active_file_ is being synced without mutex_
+  HashMap<ObjLoc> index_;
+  std::map<uint64_t, Segment*> segments_;  // All segments by number
+  std::deque<Segment*> compaction_queue_;
+  uint64_t next_segment_number_;
+  Segment* active_;  // NULL until the first update
+  WritableFile* active_file_;
+  uint64_t flushed_;   // Bytes of active_ passed to the os
+  uint64_t unsynced_;  // Bytes written to active_ since the last sync
+};
+
+}  // namespace pdlfs
@@ -132,6 +132,51 @@ void InitOnce(OnceType* once, void (*initializer)()) {
   PthreadCall("pthread_once", pthread_once(once, initializer));
 }
 
+#ifdef PDLFS_ZSTD
+namespace {
+pthread_key_t zstd_cctx_key;
+pthread_key_t zstd_dctx_key;
+OnceType zstd_once = PDLFS_ONCE_INIT;
+
+void FreeZstdCCtx(void* ctx) { ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(ctx)); }
+
+void FreeZstdDCtx(void* ctx) { ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(ctx)); }
+
+void InitZstdKeys() {
+  PthreadCall("pthread_key_create",
+              pthread_key_create(&zstd_cctx_key, FreeZstdCCtx));
+  PthreadCall("pthread_key_create",
+              pthread_key_create(&zstd_dctx_key, FreeZstdDCtx));
+}
+}  // namespace
+
+ZSTD_CCtx* Zstd_ThreadCompressionContext() {
+  InitOnce(&zstd_once, InitZstdKeys);
+  ZSTD_CCtx* ctx = static_cast<ZSTD_CCtx*>(pthread_getspecific(zstd_cctx_key));
+  if (ctx == NULL) {
+    ctx = ZSTD_createCCtx();
+    if (ctx != NULL && pthread_setspecific(zstd_cctx_key, ctx) != 0) {
+      ZSTD_freeCCtx(ctx);
+      ctx = NULL;
+    }
+  }
+  return ctx;
+}
+
+ZSTD_DCtx* Zstd_ThreadDecompressionContext() {
+  InitOnce(&zstd_once, InitZstdKeys);
+  ZSTD_DCtx* ctx = static_cast<ZSTD_DCtx*>(pthread_getspecific(zstd_dctx_key));
+  if (ctx == NULL) {
+    ctx = ZSTD_createDCtx();
+    if (ctx != NULL && pthread_setspecific(zstd_dctx_key, ctx) != 0) {
+      ZSTD_freeDCtx(ctx);
+      ctx = NULL;
+    }
+  }
+  return ctx;
+}
+#endif
+
 uint64_t PthreadId() {
   pthread_t tid = pthread_self();
   uint64_t thread_id = 0;
@@ -11,6 +11,8 @@
 
 #include "posix_fio.h"
 
+#include "pdlfs-common/mutexlock.h"
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -19,6 +21,8 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 namespace pdlfs {
 
 static std::string PosixName(const Fentry& fentry) {
@@ -209,4 +213,135 @@ Status PosixFio::Drop(const Fentry& fentry) {
   return s;
 }
 
+// A set of requests shared by the threads working on them. Each thread
+// repeatedly claims the next pending request until none is left. The last
+// thread to finish deletes the batch and runs the completion callback.
+struct PosixFio::Batch {
+  PosixFio* fio;
+  Fio::Request* reqs;
+  size_t n;
+  bool write;
+  void (*done)(void*);
+  void* arg;
+
+  port::Mutex mu;
+  size_t next;  // Index of the next request to claim
+  int workers;  // Number of threads yet to finish
+};
+
+void PosixFio::BGWork(void* arg) { RunBatch(reinterpret_cast<Batch*>(arg)); }
+
+void PosixFio::RunBatch(Batch* b) {
+  while (true) {
+    b->mu.Lock();
+    const size_t i = b->next;
+    if (i < b->n) b->next++;
+    b->mu.Unlock();
+    if (i >= b->n) {
+      break;
+    }
+    Fio::Request* const r = &b->reqs[i];
+    if (b->write) {
+      r->status = b->fio->Pwrite(*r->fentry, r->fh, r->data, r->off);
+    } else {
+      r->status = b->fio->Pread(*r->fentry, r->fh, &r->result, r->off,
+                                r->size, r->scratch);
+    }
+  }
+
+  b->mu.Lock();
+  const bool last = --b->workers == 0;
+  b->mu.Unlock();
+  if (last) {
+    void (*done)(void*) = b->done;
+    void* const arg = b->arg;
+    delete b;
+    (*done)(arg);
+  }
+}
+
+// Dispatch a batch to the io pool, optionally letting the calling thread
+// take part. (*done)(arg) is called once all requests are done.
+void PosixFio::Submit(Request* reqs, size_t n, bool write, bool run_inline,
+                      void (*done)(void*), void* arg) {
+  Batch* const b = new Batch;
+  b->fio = this;
+  b->reqs = reqs;
+  b->n = n;
+  b->write = write;
+  b->done = done;
+  b->arg = arg;
+  b->next = 0;
+  int bg = static_cast<int>(std::min<size_t>(n, io_threads_));
+  if (run_inline && static_cast<size_t>(bg) == n) bg--;
+  b->workers = bg + (run_inline ? 1 : 0);
+  for (int i = 0; i < bg; i++) {
+    pool_->Schedule(BGWork, b);
+  }
+  if (run_inline) {
+    RunBatch(b);
+  }
+}
+
+namespace {
+struct SyncDone {
+  SyncDone() : cv(&mu), done(false) {}
+  port::Mutex mu;
+  port::CondVar cv;
+  bool done;
+};
+
+void SignalDone(void* arg) {
+  SyncDone* const d = reinterpret_cast<SyncDone*>(arg);
+  MutexLock ml(&d->mu);
+  d->done = true;
+  d->cv.SignalAll();
+}
+}  // namespace
+
+Status PosixFio::Wait(Request* reqs, size_t n, bool write) {
+  SyncDone d;
+  Submit(reqs, n, write, true, SignalDone, &d);
+  {
+    MutexLock ml(&d.mu);
+    while (!d.done) {
+      d.cv.Wait();
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (!reqs[i].status.ok()) {
+      return reqs[i].status;
+    }
+  }
+  return Status::OK();
+}
+
+Status PosixFio::Preadv(Request* reqs, size_t n) {
+  if (pool_ == NULL || n < 2) return Fio::Preadv(reqs, n);
+  return Wait(reqs, n, false);
+}
+
+Status PosixFio::Pwritev(Request* reqs, size_t n) {
+  if (pool_ == NULL || n < 2) return Fio::Pwritev(reqs, n);
+  return Wait(reqs, n, true);
+}
+
+void PosixFio::AsyncPreadv(Request* reqs, size_t n, void (*done)(void*),
+                           void* arg) {
+  if (pool_ == NULL || n == 0) {
+    Fio::AsyncPreadv(reqs, n, done, arg);
+  } else {
+    Submit(reqs, n, false, false, done, arg);
+  }
+}
+
+void PosixFio::AsyncPwritev(Request* reqs, size_t n, void (*done)(void*),
+                            void* arg) {
+  if (pool_ == NULL || n == 0) {
+    Fio::AsyncPwritev(reqs, n, done, arg);
+  } else {
+    Submit(reqs, n, true, false, done, arg);
+  }
+}
+
 }  // namespace pdlfs
@@ -18,13 +18,16 @@ namespace pdlfs {
 
 class PosixFio : public Fio {
  public:
-  explicit PosixFio(const char* root) : root_(root) {
+  // If "io_threads" is positive, vectored and asynchronous requests are
+  // spread over a private pool of that many threads.
+  explicit PosixFio(const char* root, int io_threads = 0)
+      : root_(root), io_threads_(io_threads), pool_(NULL) {
+    if (io_threads_ > 0) pool_ = ThreadPool::NewFixed(io_threads_);
     Env::Default()->CreateDir(root);
   }
 
-  virtual ~PosixFio() {
-    // Do nothing
-  }
+  // REQUIRES: all asynchronous requests have completed.
+  virtual ~PosixFio() { delete pool_; }
 
   virtual Status Creat(const Fentry& fentry, bool append_only, Handle** fh);
   virtual Status Open(const Fentry& fentry, bool create_if_missing,
@@ -47,9 +50,25 @@ class PosixFio : public Fio {
   virtual Status Stat(const Fentry& fentry, uint64_t* mtime, uint64_t* size);
   virtual Status Drop(const Fentry& fentry);
 
+  virtual Status Preadv(Request* reqs, size_t n);
+  virtual Status Pwritev(Request* reqs, size_t n);
+  virtual void AsyncPreadv(Request* reqs, size_t n, void (*done)(void*),
+                           void* arg);
+  virtual void AsyncPwritev(Request* reqs, size_t n, void (*done)(void*),
+                            void* arg);
+
  private:
+  struct Batch;
+  static void BGWork(void* arg);
+  static void RunBatch(Batch* b);
+  void Submit(Request* reqs, size_t n, bool write, bool run_inline,
+              void (*done)(void*), void* arg);
+  Status Wait(Request* reqs, size_t n, bool write);
+
   std::string FileName(const Fentry &fentry);
   std::string root_;
+  int io_threads_;
+  ThreadPool* pool_;
 };
 
 }  // namespace pdlfs
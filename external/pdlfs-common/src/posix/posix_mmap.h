@@ -101,6 +101,8 @@ class PosixMmapReadableFile : public RandomAccessFile {
     return s;
   }
 
+  virtual bool IsMemoryResident() const { return true; }
+
   virtual ~PosixMmapReadableFile() {
     munmap(mmapped_region_, length_);
     limiter_->Release();
@@ -10,6 +10,7 @@
  */
 #include "posix_rpc.h"
 
+#include "posix_rpc_hybrid.h"
 #include "posix_rpc_tcp.h"
 #include "posix_rpc_udp.h"
 
@@ -159,17 +160,20 @@ PosixSocketServer::~PosixSocketServer() {
 }
 
 namespace {
-inline PosixSocketServer* CreateServer(const RPCOptions& options, int tcp) {
+inline PosixSocketServer* CreateServer(const RPCOptions& options, int tcp,
+                                       int hybrid) {
+  if (hybrid) return new PosixHybridServer(options);
   if (tcp) return new PosixTCPServer(options, options.rpc_timeout);
   return new PosixUDPServer(options);
 }
 }  // namespace
 
 PosixRPC::PosixRPC(const RPCOptions& options)
-    : srv_(NULL), options_(options), tcp_(0) {
+    : srv_(NULL), options_(options), tcp_(0), hybrid_(0) {
   tcp_ = Slice(options_.uri).starts_with("tcp://");
+  hybrid_ = Slice(options_.uri).starts_with("hybrid://");
   if (options_.mode == rpc::kServerClient) {
-    srv_ = CreateServer(options_, tcp_);
+    srv_ = CreateServer(options_, tcp_, hybrid_);
   }
 }
 
@@ -211,7 +215,11 @@ Status PosixRPC::status() {
 }
 
 rpc::If* PosixRPC::OpenStubFor(const std::string& uri) {
-  if (!tcp_) {
+  if (hybrid_) {
+    PosixHybridCli* const cli = new PosixHybridCli(options_);
+    cli->Open(uri);
+    return cli;
+  } else if (!tcp_) {
     PosixUDPCli* const cli =
         new PosixUDPCli(options_.rpc_timeout, options_.udp_max_expected_msgsz);
     cli->Open(uri);
@@ -31,15 +31,15 @@ class PosixSocketServer {
 
   virtual std::string GetUri() = 0;
   virtual Status OpenAndBind(const std::string& uri) = 0;
-  Status BGStart(Env* env, int num_threads);
-  Status BGStop();
+  virtual Status BGStart(Env* env, int num_threads);
+  virtual Status BGStop();
 
-  int GetPort();  // Return server port.
+  virtual int GetPort();  // Return server port.
   // Return base uri of the server. Unlike a full uri, a base uri is not coupled
   // with a protocol (tcp, udp).
-  std::string GetBaseUri();
-  std::string GetUsageInfo();
-  Status status();
+  virtual std::string GetBaseUri();
+  virtual std::string GetUsageInfo();
+  virtual Status status();
 
  protected:
   // No copying allowed
@@ -92,7 +92,8 @@ class PosixRPC : public RPC {
   PosixRPC(const PosixRPC&);
   PosixSocketServer* srv_;  // NULL for client only mode
   RPCOptions options_;
-  int tcp_;  // O for UDP, non-0 for TCP
+  int tcp_;     // O for UDP, non-0 for TCP
+  int hybrid_;  // Non-0 for UDP with TCP fallback for large messages
 };
 
 }  // namespace pdlfs
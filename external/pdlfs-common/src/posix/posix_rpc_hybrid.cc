@@ -0,0 +1,574 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "posix_rpc_hybrid.h"
+
+#include "posix_rpc_udp.h"
+
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/mutexlock.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace pdlfs {
+
+namespace {
+// Each request is formatted as:
+//    type: uint8
+//    nonce: fixed64 (chosen at random by each client)
+//    id: fixed64
+//    max reply size: fixed32 (largest reply the client can receive by UDP)
+//    payload: char[]
+// Each reply sent over UDP is formatted as:
+//    type: uint8
+//    id: fixed64
+//    payload: char[]
+// Replies sent over TCP carry the same fields as a trailer:
+//    payload: char[]
+//    type: uint8
+//    id: fixed64
+// so that a large payload built by the server's handler is sent from where
+// it is without being moved to make room for a header. Requests sent over
+// TCP are likewise sent from the caller's memory through a gathering write.
+const size_t kRequestHeader = 21;
+const size_t kReplyHeader = 9;
+const size_t kReplyTrailer = kReplyHeader;
+
+enum RequestType {
+  kCall = 1,   // Execute the call and reply
+  kFetch = 2,  // Send a reply previously kept for the client
+};
+
+enum ReplyType {
+  kOk = 1,
+  kTooLarge = 2,    // Reply to be fetched over TCP
+  kInProgress = 3,  // Request is already being executed
+  kLost = 4,        // Reply is no longer available
+  kError = 5,       // Call failed, payload is the error message
+};
+
+// Max number of recent replies remembered by a server, and max total size
+// of their contents.
+const size_t kMaxReplies = 4096;
+const size_t kMaxReplyBytes = 64 << 20;
+
+// Requests are known to the server by the client's nonce and the request id.
+const size_t kRequestKey = 16;
+
+void EncodeReply(std::string* dst, int type, uint64_t id,
+                 const Slice& payload) {
+  dst->resize(kReplyHeader);
+  (*dst)[0] = static_cast<char>(type);
+  EncodeFixed64(&(*dst)[1], id);
+  dst->append(payload.data(), payload.size());
+}
+
+void EncodeRequestHeader(char* dst, int type, uint64_t nonce, uint64_t id,
+                         uint32_t max_reply) {
+  dst[0] = static_cast<char>(type);
+  EncodeFixed64(dst + 1, nonce);
+  EncodeFixed64(dst + 9, id);
+  EncodeFixed32(dst + 17, max_reply);
+}
+
+void EncodeRequest(std::string* dst, int type, uint64_t nonce, uint64_t id,
+                   uint32_t max_reply, const Slice& payload) {
+  dst->resize(kRequestHeader);
+  EncodeRequestHeader(&(*dst)[0], type, nonce, id, max_reply);
+  dst->append(payload.data(), payload.size());
+}
+
+inline void SetReply(rpc::If::Message& out, int type, uint64_t id,
+                     const Slice& payload) {
+  EncodeReply(&out.extra_buf, type, id, payload);
+  out.contents = out.extra_buf;
+}
+
+// Turn out.contents into a TCP reply. The payload is not copied when it
+// already fills out.extra_buf, which is the case for replies built there by
+// the handler as well as for replies fetched from the stash.
+void SetTCPReply(rpc::If::Message& out, int type, uint64_t id) {
+  std::string& buf = out.extra_buf;
+  if (out.contents.data() != buf.data() || out.contents.size() != buf.size()) {
+    std::string tmp;
+    tmp.reserve(out.contents.size() + kReplyTrailer);
+    tmp.append(out.contents.data(), out.contents.size());
+    buf.swap(tmp);
+  }
+  char trailer[kReplyTrailer];
+  trailer[0] = static_cast<char>(type);
+  EncodeFixed64(trailer + 1, id);
+  buf.append(trailer, sizeof(trailer));
+  out.contents = buf;
+}
+
+// Same as above, but with the given payload.
+inline void SetTCPReply(rpc::If::Message& out, int type, uint64_t id,
+                        const Slice& payload) {
+  out.contents = payload;
+  SetTCPReply(out, type, id);
+}
+}  // namespace
+
+// Adapts incoming UDP or TCP calls to the hybrid protocol.
+class PosixHybridServer::Handler : public rpc::If {
+ public:
+  Handler(PosixHybridServer* srv, bool udp) : srv_(srv), udp_(udp) {}
+
+  virtual Status Call(Message& in, Message& out) RPCNOEXCEPT {
+    if (in.contents.size() < kRequestHeader) {
+      return Status::InvalidArgument("Bad request");
+    }
+    if (udp_) {
+      srv_->HandleUDPCall(in, out);
+    } else {
+      srv_->HandleTCPCall(in, out);
+    }
+    return Status::OK();
+  }
+
+ private:
+  PosixHybridServer* const srv_;
+  const bool udp_;
+};
+
+PosixHybridServer::PosixHybridServer(const RPCOptions& options)
+    : PosixSocketServer(options),
+      udp_options_(options),
+      tcp_options_(options),
+      reply_bytes_(0) {
+  udp_handler_ = new Handler(this, true);
+  tcp_handler_ = new Handler(this, false);
+  udp_options_.fs = udp_handler_;
+  tcp_options_.fs = tcp_handler_;
+  udp_ = new PosixUDPServer(udp_options_);
+  tcp_ = new PosixTCPServer(tcp_options_, options.rpc_timeout);
+}
+
+PosixHybridServer::~PosixHybridServer() {
+  delete udp_;
+  delete tcp_;
+  delete udp_handler_;
+  delete tcp_handler_;
+  struct Deleter : public HashMap<Reply>::Visitor {
+    virtual void visit(const Slice& key, Reply* r) { delete r; }
+  };
+  Deleter deleter;
+  replies_.VisitAll(&deleter);
+}
+
+// The TCP server is opened first so that the OS may pick a port for us. The
+// UDP server then binds to the same port number.
+Status PosixHybridServer::OpenAndBind(const std::string& uri) {
+  Status status = tcp_->OpenAndBind(uri);
+  if (status.ok()) {
+    status = udp_->OpenAndBind(tcp_->GetBaseUri());
+  }
+  return status;
+}
+
+std::string PosixHybridServer::GetUri() {
+  return std::string("hybrid://") + GetBaseUri();
+}
+
+Status PosixHybridServer::BGStart(Env* env, int num_threads) {
+  Status status = udp_->BGStart(env, num_threads);
+  if (status.ok()) {
+    status = tcp_->BGStart(env, num_threads);
+  }
+  return status;
+}
+
+Status PosixHybridServer::BGStop() {
+  Status status = udp_->BGStop();
+  Status s = tcp_->BGStop();
+  if (status.ok()) {
+    status = s;
+  }
+  return status;
+}
+
+int PosixHybridServer::GetPort() { return tcp_->GetPort(); }
+
+std::string PosixHybridServer::GetBaseUri() { return tcp_->GetBaseUri(); }
+
+std::string PosixHybridServer::GetUsageInfo() {
+  return "UDP:\n" + udp_->GetUsageInfo() + "TCP:\n" + tcp_->GetUsageInfo();
+}
+
+Status PosixHybridServer::status() {
+  Status status = udp_->status();
+  if (status.ok()) {
+    status = tcp_->status();
+  }
+  return status;
+}
+
+Status PosixHybridServer::BGLoop(int myid) {
+  return Status::OK();  // All work is done by the UDP and TCP servers
+}
+
+Status PosixHybridServer::Execute(const Slice& input, rpc::If::Message* out) {
+  rpc::If::Message in;
+  in.contents = input;
+  return options_.fs->Call(in, *out);
+}
+
+void PosixHybridServer::HandleUDPCall(rpc::If::Message& in,
+                                      rpc::If::Message& out) {
+  const uint64_t id = DecodeFixed64(in.contents.data() + 9);
+  const size_t max_reply = DecodeFixed32(in.contents.data() + 17);
+  const Slice key(in.contents.data() + 1, kRequestKey);
+  {
+    MutexLock ml(&reply_mutex_);
+    Reply* r = replies_.Lookup(key);
+    if (r != NULL) {  // A resent request
+      if (!r->done) {
+        SetReply(out, kInProgress, id, Slice());
+      } else if (r->stashed) {
+        SetReply(out, kTooLarge, id, Slice());
+      } else {
+        out.extra_buf = r->data;
+        out.contents = out.extra_buf;
+      }
+      return;
+    }
+    r = new Reply;
+    r->done = false;
+    r->stashed = false;
+    replies_.Insert(key, r);
+    reply_keys_.push_back(key.ToString());
+    EvictReplies();
+  }
+
+  rpc::If::Message result;
+  Status s = Execute(Slice(in.contents.data() + kRequestHeader,
+                           in.contents.size() - kRequestHeader),
+                     &result);
+  bool stash = false;
+  if (!s.ok()) {
+    SetReply(out, kError, id, s.ToString());
+  } else if (kReplyHeader + result.contents.size() > max_reply) {
+    SetReply(out, kTooLarge, id, Slice());
+    stash = true;
+  } else {
+    SetReply(out, kOk, id, result.contents);
+  }
+
+  MutexLock ml(&reply_mutex_);
+  Reply* const r = replies_.Lookup(key);
+  // Skip entries evicted while we were executing the call, and entries
+  // already completed by another execution of the same request that began
+  // after ours was evicted.
+  if (r != NULL && !r->done) {
+    r->done = true;
+    r->stashed = stash;
+    if (stash) {  // Take the reply without copying it if possible
+      if (result.contents.data() == result.extra_buf.data() &&
+          result.contents.size() == result.extra_buf.size()) {
+        r->data.swap(result.extra_buf);
+      } else {
+        r->data.assign(result.contents.data(), result.contents.size());
+      }
+    } else {
+      r->data = out.extra_buf;
+    }
+    reply_bytes_ += r->data.size();
+    EvictReplies();
+  }
+}
+
+void PosixHybridServer::EvictReplies() {
+  reply_mutex_.AssertHeld();
+  while (reply_keys_.size() > kMaxReplies ||
+         (reply_bytes_ > kMaxReplyBytes && !reply_keys_.empty())) {
+    Reply* const r = replies_.Erase(reply_keys_.front());
+    reply_keys_.pop_front();
+    if (r != NULL) {
+      reply_bytes_ -= r->data.size();
+      delete r;
+    }
+  }
+}
+
+void PosixHybridServer::HandleTCPCall(rpc::If::Message& in,
+                                      rpc::If::Message& out) {
+  const uint64_t id = DecodeFixed64(in.contents.data() + 9);
+  if (in.contents[0] == kFetch) {
+    const Slice key(in.contents.data() + 1, kRequestKey);
+    MutexLock ml(&reply_mutex_);
+    Reply* const r = replies_.Lookup(key);
+    if (r != NULL && r->done && r->stashed) {
+      reply_bytes_ -= r->data.size();
+      out.extra_buf.swap(r->data);
+      out.contents = out.extra_buf;
+      SetTCPReply(out, kOk, id);
+      delete replies_.Erase(key);
+    } else {
+      SetTCPReply(out, kLost, id, Slice());
+    }
+    return;
+  }
+
+  // The handler writes its reply directly into out
+  Status s = Execute(Slice(in.contents.data() + kRequestHeader,
+                           in.contents.size() - kRequestHeader),
+                     &out);
+  if (!s.ok()) {
+    const std::string msg = s.ToString();
+    SetTCPReply(out, kError, id, msg);
+  } else {
+    SetTCPReply(out, kOk, id);
+  }
+}
+
+PosixHybridCli::PosixHybridCli(const RPCOptions& options)
+    : rpc_timeout_(options.rpc_timeout),
+      retransmit_timeout_(options.udp_retransmit_timeout),
+      max_unexpected_msgsz_(options.udp_max_unexpected_msgsz),
+      max_expected_msgsz_(options.udp_max_expected_msgsz),
+      tcp_(options.rpc_timeout),
+      next_id_(1),
+      fd_(-1) {
+  // The nonce keeps our requests apart from those of other clients talking
+  // to the same server. Fall back to a weaker mix of local state if the
+  // system cannot give us random bytes.
+  char buf[8];
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd != -1 && read(fd, buf, sizeof(buf)) == sizeof(buf)) {
+    nonce_ = DecodeFixed64(buf);
+  } else {
+    nonce_ = (CurrentMicros() << 20) ^
+             (static_cast<uint64_t>(getpid()) << 44) ^
+             reinterpret_cast<uintptr_t>(this);
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+PosixHybridCli::~PosixHybridCli() {
+  while (!calls_.empty()) {
+    Finish(calls_.begin(), Status::Disconnected("Client closed"));
+  }
+  for (size_t i = 0; i < finished_.size(); i++) {
+    finished_[i].first->done(finished_[i].second, finished_[i].first->arg);
+    delete finished_[i].first;
+  }
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+void PosixHybridCli::Open(const std::string& uri) {
+  PosixSocketAddr addr;
+  status_ = addr.ResolvUri(uri);
+  if (!status_.ok()) {
+    return;
+  }
+  tcp_.SetTarget(uri);
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ == -1) {
+    status_ = Status::IOError("Cannot create UDP socket", strerror(errno));
+    return;
+  }
+  int rv = connect(fd_, reinterpret_cast<struct sockaddr*>(addr.rep()),
+                   sizeof(struct sockaddr_in));
+  if (rv == -1) {
+    status_ = Status::IOError("UDP connect", strerror(errno));
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+Status PosixHybridCli::TCPCall(int type, uint64_t id, const Slice& input,
+                               Message& out) {
+  char header[kRequestHeader];
+  EncodeRequestHeader(header, type, nonce_, id, 0);
+  struct iovec iov[2];
+  iov[0].iov_base = header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = const_cast<char*>(input.data());
+  iov[1].iov_len = input.size();
+  Message reply;
+  Status status = tcp_.Call(iov, 2, reply);
+  if (!status.ok()) {
+    return status;
+  }
+  if (reply.contents.size() < kReplyTrailer) {
+    return Status::Corruption("Bad reply");
+  }
+  const size_t n = reply.contents.size() - kReplyTrailer;
+  const char* const trailer = reply.contents.data() + n;
+  if (DecodeFixed64(trailer + 1) != id) {
+    return Status::Corruption("Bad reply");
+  }
+  const int rtype = trailer[0];
+  if (rtype == kOk) {  // Hand over the reply buffer without copying
+    const size_t off = reply.contents.data() - reply.extra_buf.data();
+    out.extra_buf.swap(reply.extra_buf);
+    out.contents = Slice(out.extra_buf.data() + off, n);
+    return status;
+  } else if (rtype == kError) {
+    return Status::IOError("Remote call failed",
+                           Slice(reply.contents.data(), n));
+  } else if (rtype == kLost) {
+    return Status::IOError("Reply lost");
+  } else {
+    return Status::Corruption("Bad reply");
+  }
+}
+
+Status PosixHybridCli::Call(Message& in, Message& out) RPCNOEXCEPT {
+  rpc::Future f;
+  CallAsync(in, out, rpc::Future::Done, &f);
+  return f.Wait(this);
+}
+
+void PosixHybridCli::CallAsync(Message& in, Message& out, Callback done,
+                               void* arg) RPCNOEXCEPT {
+  if (!status_.ok()) {
+    done(status_, arg);
+    return;
+  }
+  const uint64_t id = next_id_++;
+  if (kRequestHeader + in.contents.size() > max_unexpected_msgsz_) {
+    done(TCPCall(kCall, id, in.contents, out), arg);
+    return;
+  }
+  AsyncCall* const call = new AsyncCall;
+  call->out = &out;
+  call->done = done;
+  call->arg = arg;
+  EncodeRequest(&call->request, kCall, nonce_, id,
+                static_cast<uint32_t>(max_expected_msgsz_), in.contents);
+  ssize_t rv = send(fd_, call->request.data(), call->request.size(), 0);
+  if (rv != static_cast<ssize_t>(call->request.size())) {
+    Status status = Status::IOError("UDP send", strerror(errno));
+    delete call;
+    done(status, arg);
+    return;
+  }
+  call->start = call->sent = CurrentMicros();
+  calls_.insert(std::make_pair(id, call));
+}
+
+void PosixHybridCli::Finish(CallMap::iterator it, const Status& status) {
+  finished_.push_back(std::make_pair(it->second, status));
+  calls_.erase(it);
+}
+
+void PosixHybridCli::HandleReply(size_t size) {
+  if (size < kReplyHeader) {
+    return;
+  }
+  const uint64_t id = DecodeFixed64(&recv_buf_[1]);
+  CallMap::iterator it = calls_.find(id);
+  if (it == calls_.end()) {
+    return;  // Late reply to a finished call
+  }
+  AsyncCall* const call = it->second;
+  Message* const out = call->out;
+  switch (recv_buf_[0]) {
+    case kOk:  // Hand over the receive buffer without copying
+      out->extra_buf.swap(recv_buf_);
+      out->contents =
+          Slice(out->extra_buf.data() + kReplyHeader, size - kReplyHeader);
+      Finish(it, Status::OK());
+      break;
+    case kInProgress:
+      call->sent = CurrentMicros();  // Wait longer before resending
+      break;
+    case kTooLarge:
+      Finish(it, TCPCall(kFetch, id, Slice(), *out));
+      break;
+    case kError:
+      Finish(it, Status::IOError("Remote call failed",
+                                 Slice(&recv_buf_[kReplyHeader],
+                                       size - kReplyHeader)));
+      break;
+    default:
+      Finish(it, Status::Corruption("Bad reply"));
+      break;
+  }
+}
+
+// Each round receives all replies available, then resends requests whose
+// replies are overdue and expires calls that have timed out. Replies to
+// earlier requests that arrive late are discarded.
+int PosixHybridCli::Progress(uint64_t timeout) RPCNOEXCEPT {
+  const uint64_t begin = CurrentMicros();
+  struct pollfd po;
+  memset(&po, 0, sizeof(struct pollfd));
+  po.events = POLLIN;
+  po.fd = fd_;
+  while (!calls_.empty()) {
+    while (true) {
+      recv_buf_.resize(max_expected_msgsz_);
+      ssize_t rv = recv(fd_, &recv_buf_[0], recv_buf_.size(), MSG_DONTWAIT);
+      if (rv >= 0) {
+        HandleReply(rv);
+      } else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+        break;
+      } else if (errno != EINTR) {
+        Status status = Status::IOError("UDP recv", strerror(errno));
+        while (!calls_.empty()) {
+          Finish(calls_.begin(), status);
+        }
+        break;
+      }
+    }
+    const uint64_t now = CurrentMicros();
+    uint64_t wait = timeout > now - begin ? timeout - (now - begin) : 0;
+    CallMap::iterator it = calls_.begin();
+    while (it != calls_.end()) {
+      AsyncCall* const call = it->second;
+      if (now - call->start >= rpc_timeout_) {
+        Finish(it++, Status::Disconnected("timeout"));
+        continue;
+      }
+      if (now - call->sent >= retransmit_timeout_) {
+        ssize_t rv = send(fd_, call->request.data(), call->request.size(), 0);
+        if (rv != static_cast<ssize_t>(call->request.size())) {
+          Finish(it++, Status::IOError("UDP send", strerror(errno)));
+          continue;
+        }
+        call->sent = now;
+      }
+      wait = std::min(wait, call->sent + retransmit_timeout_ - now);
+      wait = std::min(wait, call->start + rpc_timeout_ - now);
+      ++it;
+    }
+    if (!finished_.empty() || now - begin >= timeout) {
+      break;
+    }
+    int rv = poll(&po, 1, static_cast<int>((wait + 999) / 1000));
+    if (rv == -1 && errno != EINTR) {
+      break;
+    }
+  }
+  // Callbacks may start new calls so they are invoked last
+  std::vector<std::pair<AsyncCall*, Status> > finished;
+  finished.swap(finished_);
+  for (size_t i = 0; i < finished.size(); i++) {
+    finished[i].first->done(finished[i].second, finished[i].first->arg);
+    delete finished[i].first;
+  }
+  return static_cast<int>(calls_.size());
+}
+
+}  // namespace pdlfs
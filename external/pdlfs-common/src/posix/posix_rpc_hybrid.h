@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "posix_rpc.h"
+#include "posix_rpc_tcp.h"
+
+#include "pdlfs-common/hashmap.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pdlfs {
+// RPC srv impl sending small messages over UDP and large ones over TCP. A
+// UDP server and a TCP server listen on the same port number. Each request
+// carries a random nonce chosen once by its client and a request id. Replies
+// to recent requests received over UDP are remembered under both so that
+// resent requests are answered without executing the call again. Replies
+// too large for a datagram are kept until fetched by the client over TCP.
+// Remembered replies are bounded in both number and total size.
+class PosixHybridServer : public PosixSocketServer {
+ public:
+  explicit PosixHybridServer(const RPCOptions& options);
+  virtual ~PosixHybridServer();
+
+  virtual Status OpenAndBind(const std::string& uri);
+  virtual std::string GetUri();
+  virtual Status BGStart(Env* env, int num_threads);
+  virtual Status BGStop();
+
+  virtual int GetPort();
+  virtual std::string GetBaseUri();
+  virtual std::string GetUsageInfo();
+  virtual Status status();
+
+ private:
+  class Handler;
+  struct Reply {
+    bool done;     // False if the call is still being executed
+    bool stashed;  // True if the reply is to be fetched over TCP
+    std::string data;
+  };
+  void HandleUDPCall(rpc::If::Message& in, rpc::If::Message& out);
+  void HandleTCPCall(rpc::If::Message& in, rpc::If::Message& out);
+  Status Execute(const Slice& input, rpc::If::Message* out);
+  // Forget the oldest replies until we are within limits.
+  // REQUIRES: reply_mutex_ has been locked.
+  void EvictReplies();
+  virtual Status BGLoop(int myid);
+  RPCOptions udp_options_;
+  RPCOptions tcp_options_;
+  Handler* udp_handler_;
+  Handler* tcp_handler_;
+  PosixSocketServer* udp_;
+  PosixSocketServer* tcp_;
+  // State below is protected by reply_mutex_
+  port::Mutex reply_mutex_;
+  HashMap<Reply> replies_;  // Keyed by client nonce and request id
+  std::deque<std::string> reply_keys_;  // Oldest first
+  size_t reply_bytes_;  // Total size of remembered replies
+};
+
+// Hybrid client.
+class PosixHybridCli : public rpc::If {
+ public:
+  explicit PosixHybridCli(const RPCOptions& options);
+  virtual ~PosixHybridCli();
+
+  // Requests fitting in a datagram are sent over UDP and resent until a
+  // reply is received or the call times out. Larger requests, and requests
+  // whose replies do not fit in a datagram, go through TCP.
+  virtual Status Call(Message& in, Message& out) RPCNOEXCEPT;
+
+  // Many calls may be outstanding over UDP at the same time. Replies are
+  // matched to calls by request id. Calls going through TCP are performed
+  // synchronously inside CallAsync() or Progress().
+  virtual void CallAsync(Message& in, Message& out, Callback done,
+                         void* arg) RPCNOEXCEPT;
+  virtual int Progress(uint64_t timeout) RPCNOEXCEPT;
+  // If we fail to open, error status will be set and the next Call()
+  // operation will return it.
+  void Open(const std::string& uri);
+
+ private:
+  // No copying allowed
+  void operator=(const PosixHybridCli&);
+  PosixHybridCli(const PosixHybridCli& other);
+  Status TCPCall(int type, uint64_t id, const Slice& input, Message& out);
+  struct AsyncCall {
+    Message* out;
+    Callback done;
+    void* arg;
+    std::string request;  // Encoded request for resending
+    uint64_t start;
+    uint64_t sent;  // Time the request was last sent
+  };
+  typedef std::map<uint64_t, AsyncCall*> CallMap;
+  // Remove a call from calls_ and queue it for its callback.
+  void Finish(CallMap::iterator it, const Status& status);
+  // Match a reply just received into recv_buf_ to its call.
+  void HandleReply(size_t size);
+  const uint64_t rpc_timeout_;         // In microseconds
+  const uint64_t retransmit_timeout_;  // In microseconds
+  const size_t max_unexpected_msgsz_;
+  const size_t max_expected_msgsz_;
+  PosixTCPCli tcp_;
+  uint64_t nonce_;
+  uint64_t next_id_;
+  CallMap calls_;  // Outstanding calls keyed by request id
+  std::vector<std::pair<AsyncCall*, Status> > finished_;
+  std::string recv_buf_;  // Buffer for receiving replies
+  Status status_;
+  int fd_;
+};
+
+}  // namespace pdlfs
@@ -12,15 +12,29 @@
 
 #include "pdlfs-common/mutexlock.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <string.h>
 #include <unistd.h>
+#include <vector>
+#if defined(PDLFS_OS_LINUX)
+#include <sys/epoll.h>
+#endif
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
 
 namespace pdlfs {
 PosixTCPServer::PosixTCPServer(const RPCOptions& opts, uint64_t t, size_t s)
-    : PosixSocketServer(opts), rpc_timeout_(t), buf_sz_(s) {}
+    : PosixSocketServer(opts),
+#if defined(PDLFS_OS_LINUX)
+      bg_count_(0),
+#endif
+      rpc_timeout_(t),
+      buf_sz_(s) {
+}
 
 Status PosixTCPServer::OpenAndBind(const std::string& uri) {
   MutexLock ml(&mutex_);
@@ -68,8 +82,293 @@ inline void SET_O_NONBLOCK(int fd, bool non_blocking) {
   flags = non_blocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
   fcntl(fd, F_SETFL, flags);
 }
+
+// Receive into *buf right after the *received bytes already there. The
+// buffer grows geometrically and is never copied from a bounce buffer, so a
+// large message lands in its final place as it arrives. Callers resize the
+// buffer to *received once the entire message is in.
+ssize_t RecvInPlace(int fd, std::string* const buf, size_t* const received,
+                    size_t min_room, int flags) {
+  if (buf->size() - *received < min_room) {
+    buf->resize(std::max(2 * buf->size(), *received + min_room));
+  }
+  ssize_t rv = recv(fd, &(*buf)[*received], buf->size() - *received, flags);
+  if (rv > 0) {
+    *received += rv;
+  }
+  return rv;
+}
+
+// Make the next close() reset the connection. Peers waiting for a reply see
+// an error instead of an empty reply.
+void SetResetOnClose(int fd) {
+  struct linger lg;
+  lg.l_onoff = 1;
+  lg.l_linger = 0;
+  setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+}
 }  // namespace
 
+#if defined(PDLFS_OS_LINUX)
+struct PosixTCPServer::Reactor {
+  PosixTCPServer* srv;
+  int epfd;
+  int listen_fd;
+  Connection head;  // Dummy head of the list of open connections
+  std::vector<Connection*> free_list;  // Closed connections for reuse
+};
+
+namespace {
+// Max number of events processed per epoll_wait().
+const int kMaxEvents = 64;
+// Max number of closed connections kept for reuse by each reactor.
+const size_t kMaxFreeConnections = 64;
+}  // namespace
+
+// Set up a reactor. All reactors accept from the socket opened by
+// OpenAndBind().
+Status PosixTCPServer::OpenReactor(Reactor* const r) {
+  r->srv = this;
+  r->epfd = -1;
+  r->listen_fd = fd_;
+  r->head.next = r->head.prev = &r->head;
+  SET_O_NONBLOCK(r->listen_fd, true);
+  r->epfd = epoll_create1(0);
+  if (r->epfd == -1) {
+    return Status::IOError("epoll_create", strerror(errno));
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+#if defined(EPOLLEXCLUSIVE)
+  ev.events |= EPOLLEXCLUSIVE;  // Wake up one reactor per new connection
+#endif
+  ev.data.ptr = NULL;  // Identifies the listening socket
+  if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->listen_fd, &ev) == -1) {
+    return Status::IOError("epoll_ctl", strerror(errno));
+  }
+  return Status::OK();
+}
+
+void PosixTCPServer::CloseReactor(Reactor* const r) {
+  {
+    // Wait for calls handed to bg workers. Their connections are closed
+    // below along with all others.
+    MutexLock ml(&mutex_);
+    while (bg_count_ != 0) {
+      bg_cv_.Wait();
+    }
+  }
+  while (r->head.next != &r->head) {
+    Close(r->head.next);
+  }
+  for (size_t i = 0; i < r->free_list.size(); i++) {
+    delete r->free_list[i];
+  }
+  r->free_list.clear();
+  if (r->epfd != -1) {
+    close(r->epfd);
+  }
+}
+
+Status PosixTCPServer::BGLoop(int myid) {
+  Reactor r;
+  Status status = OpenReactor(&r);
+  struct epoll_event events[kMaxEvents];
+  uint64_t last_sweep = CurrentMicros();
+  while (status.ok() && !shutting_down_.Acquire_Load()) {
+    // Wake up every 0.2 second to check for shutdown and timeouts
+    int n = epoll_wait(r.epfd, events, kMaxEvents, 200);
+    if (n == -1) {
+      if (errno != EINTR) {
+        status = Status::IOError("epoll_wait", strerror(errno));
+      }
+      continue;
+    }
+    for (int i = 0; i < n; i++) {
+      Connection* const c = static_cast<Connection*>(events[i].data.ptr);
+      if (c == NULL) {
+        Accept(&r);
+      } else if (c->state == Connection::kReading) {
+        HandleRead(c);
+      } else {
+        if (c->state == Connection::kCalling) {  // Back from a bg worker
+          c->state = Connection::kWriting;
+          c->start = CurrentMicros();
+        }
+        HandleWrite(c);
+      }
+    }
+    const uint64_t now = CurrentMicros();
+    if (now - last_sweep >= 200000) {
+      last_sweep = now;
+      Connection* c = r.head.next;
+      while (c != &r.head) {
+        Connection* const next = c->next;
+        if (c->state != Connection::kCalling &&
+            now - c->start >= rpc_timeout_) {
+          Close(c);
+        }
+        c = next;
+      }
+    }
+  }
+
+  CloseReactor(&r);
+  return status;
+}
+
+void PosixTCPServer::Accept(Reactor* const r) {
+  while (true) {
+    int fd = accept4(r->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+    if (fd == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        // Such as running out of fds. Keep serving existing connections.
+        Log(options_.info_log, 0, "Error accepting connections: %s",
+            strerror(errno));
+      }
+      return;
+    }
+    Connection* c;
+    if (!r->free_list.empty()) {
+      c = r->free_list.back();
+      r->free_list.pop_back();
+    } else {
+      c = new Connection;
+    }
+    c->reactor = r;
+    c->fd = fd;
+    c->state = Connection::kReading;
+    c->start = CurrentMicros();
+    c->in.contents = Slice();
+    c->in.extra_buf.clear();
+    c->out.contents = Slice();
+    c->out.extra_buf.clear();
+    c->received = 0;
+    c->sent = 0;
+    c->failed = false;
+    c->next = &r->head;
+    c->prev = r->head.prev;
+    c->prev->next = c;
+    c->next->prev = c;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = c;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+      Log(options_.info_log, 0, "epoll_ctl: %s", strerror(errno));
+      Close(c);
+    }
+  }
+}
+
+// Connections are registered with EPOLLONESHOT so that only one thread
+// works on a connection at a time. Rearm() waits for the next event.
+void PosixTCPServer::Rearm(Connection* const c, uint32_t events) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events | EPOLLONESHOT;
+  ev.data.ptr = c;
+  epoll_ctl(c->reactor->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+void PosixTCPServer::Close(Connection* const c) {
+  Reactor* const r = c->reactor;
+  close(c->fd);  // Also removes the fd from epoll
+  c->prev->next = c->next;
+  c->next->prev = c->prev;
+  if (r->free_list.size() < kMaxFreeConnections) {
+    r->free_list.push_back(c);
+  } else {
+    delete c;
+  }
+}
+
+void PosixTCPServer::HandleRead(Connection* const c) {
+  std::string* const buf = &c->in.extra_buf;
+  while (true) {
+    ssize_t rv = RecvInPlace(c->fd, buf, &c->received, buf_sz_, 0);
+    if (rv > 0) {
+      continue;
+    } else if (rv == 0) {  // End of message
+      buf->resize(c->received);
+      c->in.contents = *buf;
+      Dispatch(c);
+      return;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      Rearm(c, EPOLLIN);
+      return;
+    } else if (errno != EINTR) {
+      Close(c);
+      return;
+    }
+  }
+}
+
+void PosixTCPServer::Dispatch(Connection* const c) {
+  if (options_.extra_workers) {
+    // The reactor leaves the connection alone until the worker is done
+    c->state = Connection::kCalling;
+    MutexLock ml(&mutex_);
+    ++bg_count_;
+    options_.extra_workers->Schedule(ProcessCallWrapper, c);
+  } else {
+    ProcessCall(c);
+    c->state = Connection::kWriting;
+    c->start = CurrentMicros();
+    HandleWrite(c);
+  }
+}
+
+void PosixTCPServer::ProcessCallWrapper(void* arg) {
+  Connection* const c = reinterpret_cast<Connection*>(arg);
+  PosixTCPServer* const srv = c->reactor->srv;
+  srv->ProcessCall(c);
+  // Hand the connection back to its reactor for sending the reply. The
+  // connection must no longer be touched after this.
+  srv->Rearm(c, EPOLLOUT);
+  MutexLock ml(&srv->mutex_);
+  assert(srv->bg_count_ > 0);
+  --srv->bg_count_;
+  if (!srv->bg_count_) {
+    srv->bg_cv_.SignalAll();
+  }
+}
+
+void PosixTCPServer::ProcessCall(Connection* const c) {
+  Status s = options_.fs->Call(c->in, c->out);
+  if (!s.ok()) {
+    Log(options_.info_log, 0, "Fail to handle incoming call: %s",
+        s.ToString().c_str());
+    c->failed = true;
+  }
+}
+
+void PosixTCPServer::HandleWrite(Connection* const c) {
+  if (c->failed) {
+    SetResetOnClose(c->fd);
+    Close(c);
+    return;
+  }
+  const Slice& reply = c->out.contents;
+  while (c->sent < reply.size()) {
+    ssize_t nbytes = send(c->fd, reply.data() + c->sent,
+                          reply.size() - c->sent, MSG_NOSIGNAL);
+    if (nbytes > 0) {
+      c->sent += nbytes;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      Rearm(c, EPOLLOUT);
+      return;
+    } else if (errno != EINTR) {
+      Close(c);
+      return;
+    }
+  }
+  shutdown(c->fd, SHUT_WR);
+  Close(c);
+}
+
+#else
 Status PosixTCPServer::BGLoop(int myid) {
   SET_O_NONBLOCK(fd_, true);
   struct pollfd po;
@@ -112,13 +411,14 @@ void PosixTCPServer::HandleIncomingCall(CallState* const call) {
   memset(&po, 0, sizeof(struct pollfd));
   po.events = POLLIN;
   po.fd = call->fd;
-  char* const buf = new char[buf_sz_];
+  size_t received = 0;
   while (true) {
-    ssize_t rv = recv(call->fd, buf, buf_sz_, MSG_DONTWAIT);
+    ssize_t rv = RecvInPlace(call->fd, &in.extra_buf, &received, buf_sz_,
+                             MSG_DONTWAIT);
     if (rv > 0) {
-      in.extra_buf.append(buf, rv);
       continue;
     } else if (rv == 0) {  // End of message
+      in.extra_buf.resize(received);
       in.contents = in.extra_buf;
       break;
     } else if (errno == EWOULDBLOCK) {
@@ -139,13 +439,18 @@ void PosixTCPServer::HandleIncomingCall(CallState* const call) {
     }
   }
 
-  delete[] buf;
   if (err) {
     //
     return;
   }
 
-  options_.fs->Call(in, out);
+  Status s = options_.fs->Call(in, out);
+  if (!s.ok()) {
+    Log(options_.info_log, 0, "Fail to handle incoming call: %s",
+        s.ToString().c_str());
+    SetResetOnClose(call->fd);
+    return;
+  }
   Slice remaining_out = out.contents;
   SET_O_NONBLOCK(call->fd, false);  // Force blocking semantics
   while (!remaining_out.empty()) {
@@ -162,6 +467,8 @@ void PosixTCPServer::HandleIncomingCall(CallState* const call) {
   shutdown(call->fd, SHUT_WR);
 }
 
+#endif
+
 std::string PosixTCPServer::GetUri() {
   return std::string("tcp://") + GetBaseUri();
 }
@@ -169,6 +476,28 @@ std::string PosixTCPServer::GetUri() {
 PosixTCPCli::PosixTCPCli(uint64_t timeout, size_t buf_sz)
     : rpc_timeout_(timeout), buf_sz_(buf_sz) {}
 
+struct PosixTCPCli::AsyncCall {
+  Message* out;
+  Callback done;
+  void* arg;
+  int fd;
+  bool connected;
+  bool sending;      // False once the entire request is sent
+  Slice remaining;   // Request bytes yet to be sent
+  size_t received;   // Number of reply bytes received
+  uint64_t start;
+};
+
+PosixTCPCli::~PosixTCPCli() {
+  std::vector<AsyncCall*> calls;
+  calls.swap(calls_);
+  for (size_t i = 0; i < calls.size(); i++) {
+    close(calls[i]->fd);
+    calls[i]->done(Status::Disconnected("Client closed"), calls[i]->arg);
+    delete calls[i];
+  }
+}
+
 void PosixTCPCli::SetTarget(const std::string& uri) {
   status_ = addr_.ResolvUri(uri);
 }
@@ -189,6 +518,14 @@ Status PosixTCPCli::OpenAndConnect(int* result) {
 }
 
 Status PosixTCPCli::Call(Message& in, Message& out) RPCNOEXCEPT {
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(in.contents.data());
+  iov.iov_len = in.contents.size();
+  return Call(&iov, 1, out);
+}
+
+Status PosixTCPCli::Call(struct iovec* iov, int iovcnt,
+                         Message& out) RPCNOEXCEPT {
   if (!status_.ok()) {
     return status_;
   }
@@ -197,13 +534,34 @@ Status PosixTCPCli::Call(Message& in, Message& out) RPCNOEXCEPT {
   if (!status.ok()) {
     return status;
   }
-  Slice remaining_in = in.contents;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iovcnt;
   SET_O_NONBLOCK(fd, false);  // Force blocking semantics
-  while (!remaining_in.empty()) {
-    ssize_t nbytes = send(fd, remaining_in.data(), remaining_in.size(), 0);
+  while (true) {
+    // Skip pieces that have been fully sent
+    while (msg.msg_iovlen != 0 && msg.msg_iov->iov_len == 0) {
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (msg.msg_iovlen == 0) {
+      break;
+    }
+    ssize_t nbytes = sendmsg(fd, &msg, MSG_NOSIGNAL);
     if (nbytes > 0) {
-      remaining_in.remove_prefix(nbytes);
-    } else {
+      size_t n = nbytes;
+      while (n != 0) {
+        const size_t m = std::min(n, msg.msg_iov->iov_len);
+        msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + m;
+        msg.msg_iov->iov_len -= m;
+        n -= m;
+        if (n != 0) {
+          msg.msg_iov++;
+          msg.msg_iovlen--;
+        }
+      }
+    } else if (errno != EINTR) {
       status = Status::IOError(strerror(errno));
       close(fd);
       return status;
@@ -215,13 +573,15 @@ Status PosixTCPCli::Call(Message& in, Message& out) RPCNOEXCEPT {
   memset(&po, 0, sizeof(struct pollfd));
   po.events = POLLIN;
   po.fd = fd;
-  char* const buf = new char[buf_sz_];
+  out.extra_buf.clear();
+  size_t received = 0;
   while (true) {
-    ssize_t rv = recv(fd, buf, buf_sz_, MSG_DONTWAIT);
+    ssize_t rv = RecvInPlace(fd, &out.extra_buf, &received, buf_sz_,
+                             MSG_DONTWAIT);
     if (rv > 0) {
-      out.extra_buf.append(buf, rv);
       continue;
     } else if (rv == 0) {  // End of message
+      out.extra_buf.resize(received);
       out.contents = out.extra_buf;
       break;
     } else if (errno == EWOULDBLOCK) {
@@ -242,9 +602,145 @@ Status PosixTCPCli::Call(Message& in, Message& out) RPCNOEXCEPT {
     }
   }
 
-  delete[] buf;
   close(fd);
   return status;
 }
 
+void PosixTCPCli::CallAsync(Message& in, Message& out, Callback done,
+                            void* arg) RPCNOEXCEPT {
+  if (!status_.ok()) {
+    done(status_, arg);
+    return;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    done(Status::IOError(strerror(errno)), arg);
+    return;
+  }
+  SET_O_NONBLOCK(fd, true);
+  int rv = connect(fd, reinterpret_cast<struct sockaddr*>(addr_.rep()),
+                   sizeof(struct sockaddr_in));
+  if (rv == -1 && errno != EINPROGRESS) {
+    Status status = Status::IOError(strerror(errno));
+    close(fd);
+    done(status, arg);
+    return;
+  }
+  AsyncCall* const call = new AsyncCall;
+  call->out = &out;
+  call->done = done;
+  call->arg = arg;
+  call->fd = fd;
+  call->connected = (rv == 0);
+  call->sending = true;
+  call->remaining = in.contents;
+  call->received = 0;
+  call->start = CurrentMicros();
+  out.extra_buf.clear();
+  calls_.push_back(call);
+}
+
+bool PosixTCPCli::Advance(AsyncCall* const call, Status* const status) {
+  if (!call->connected) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(call->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+      *status = Status::IOError(strerror(err));
+      return true;
+    }
+    call->connected = true;
+  }
+  while (call->sending) {
+    if (call->remaining.empty()) {
+      shutdown(call->fd, SHUT_WR);
+      call->sending = false;
+      return false;  // Wait for the reply
+    }
+    ssize_t nbytes = send(call->fd, call->remaining.data(),
+                          call->remaining.size(), MSG_NOSIGNAL);
+    if (nbytes > 0) {
+      call->remaining.remove_prefix(nbytes);
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return false;
+    } else if (errno != EINTR) {
+      *status = Status::IOError(strerror(errno));
+      return true;
+    }
+  }
+  std::string* const buf = &call->out->extra_buf;
+  while (true) {
+    ssize_t rv = RecvInPlace(call->fd, buf, &call->received, buf_sz_, 0);
+    if (rv > 0) {
+      continue;
+    } else if (rv == 0) {  // End of message
+      buf->resize(call->received);
+      call->out->contents = *buf;
+      return true;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return false;
+    } else if (errno != EINTR) {
+      *status = Status::IOError(strerror(errno));
+      return true;
+    }
+  }
+}
+
+int PosixTCPCli::Progress(uint64_t timeout) RPCNOEXCEPT {
+  const uint64_t begin = CurrentMicros();
+  std::vector<struct pollfd> pos;
+  std::vector<AsyncCall*> finished;
+  std::vector<Status> results;
+  while (!calls_.empty()) {
+    pos.resize(calls_.size());
+    uint64_t wait = timeout;
+    const uint64_t now = CurrentMicros();
+    for (size_t i = 0; i < calls_.size(); i++) {
+      AsyncCall* const call = calls_[i];
+      pos[i].fd = call->fd;
+      pos[i].events = call->sending ? POLLOUT : POLLIN;
+      pos[i].revents = 0;
+      const uint64_t deadline = call->start + rpc_timeout_;
+      wait = std::min(wait, deadline > now ? deadline - now : 0);
+    }
+    const uint64_t elapsed = now - begin;
+    wait = std::min(wait, timeout > elapsed ? timeout - elapsed : 0);
+    int rv = poll(&pos[0], pos.size(), static_cast<int>((wait + 999) / 1000));
+    if (rv == -1 && errno != EINTR) {
+      break;
+    }
+    const uint64_t after = CurrentMicros();
+    size_t j = 0;
+    for (size_t i = 0; i < calls_.size(); i++) {
+      AsyncCall* const call = calls_[i];
+      Status status;
+      bool finish = false;
+      if (pos[i].revents != 0) {
+        finish = Advance(call, &status);
+      }
+      if (!finish && after - call->start >= rpc_timeout_) {
+        status = Status::Disconnected("timeout");
+        finish = true;
+      }
+      if (finish) {
+        close(call->fd);
+        finished.push_back(call);
+        results.push_back(status);
+      } else {
+        calls_[j++] = call;
+      }
+    }
+    calls_.resize(j);
+    if (!finished.empty() || after - begin >= timeout) {
+      break;
+    }
+  }
+  // Callbacks may start new calls so they are invoked last
+  for (size_t i = 0; i < finished.size(); i++) {
+    finished[i]->done(results[i], finished[i]->arg);
+    delete finished[i];
+  }
+  return static_cast<int>(calls_.size());
+}
+
 }  // namespace pdlfs
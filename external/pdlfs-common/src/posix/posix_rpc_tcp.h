@@ -14,9 +14,18 @@
 
 #include <stddef.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
 
 namespace pdlfs {
-// RPC srv impl using TCP.
+// RPC srv impl using TCP. On Linux, each background thread runs an
+// epoll-based reactor multiplexing any number of connections. All reactors
+// accept from the server's one listening socket, which is added to each
+// reactor with EPOLLEXCLUSIVE where available so that a new connection only
+// wakes up one reactor. The socket is never opened with SO_REUSEPORT so no
+// other process can bind the same port and steal connections. Calls are
+// handed to options_.extra_workers when set so that long calls do not
+// block a reactor.
 class PosixTCPServer : public PosixSocketServer {
  public:
   PosixTCPServer(const RPCOptions& options, uint64_t timeout,
@@ -31,6 +40,40 @@ class PosixTCPServer : public PosixSocketServer {
   virtual std::string GetUri();
 
  private:
+#if defined(PDLFS_OS_LINUX)
+  struct Reactor;
+  // State for each incoming connection. Each connection carries exactly one
+  // call: the caller sends its request and shuts down its side of the
+  // connection, after which we send our reply and close the connection.
+  // Connections of failed calls are reset instead of replied to.
+  // Connections are reused across calls to avoid allocating memory.
+  struct Connection {
+    enum State { kReading, kCalling, kWriting };
+    Reactor* reactor;
+    int fd;
+    State state;
+    uint64_t start;  // Time the current state was entered
+    rpc::If::Message in;
+    rpc::If::Message out;
+    size_t received;  // Number of request bytes received
+    size_t sent;      // Number of reply bytes sent
+    bool failed;      // True if the call returned a non-OK status
+    Connection* next;
+    Connection* prev;
+  };
+  Status OpenReactor(Reactor* r);
+  void CloseReactor(Reactor* r);
+  void Accept(Reactor* r);
+  void HandleRead(Connection* c);
+  void HandleWrite(Connection* c);
+  void Dispatch(Connection* c);  // May send call to bg worker pool
+  void Rearm(Connection* c, uint32_t events);
+  void Close(Connection* c);
+  void ProcessCall(Connection* c);
+  static void ProcessCallWrapper(void* arg);
+  // State below protected by mutex_
+  int bg_count_;  // Total number of bg work items pending
+#else
   // State for each incoming procedure call.
   struct CallState {
     struct sockaddr_storage addr;  // Location of the caller
@@ -38,6 +81,7 @@ class PosixTCPServer : public PosixSocketServer {
     int fd;
   };
   void HandleIncomingCall(CallState* call);
+#endif
   virtual Status BGLoop(int myid);
   const uint64_t rpc_timeout_;  // In microseconds
   const size_t buf_sz_;         // Buffer size for reading peer data
@@ -47,12 +91,26 @@ class PosixTCPServer : public PosixSocketServer {
 class PosixTCPCli : public rpc::If {
  public:
   explicit PosixTCPCli(uint64_t timeout, size_t buf_sz = 4000);
-  virtual ~PosixTCPCli() {}
+  virtual ~PosixTCPCli();
 
   // Each call creates a new socket, followed by a connection operation, a send,
   // and a receive.
   virtual Status Call(Message& in, Message& out) RPCNOEXCEPT;
 
+  // Same as above, but the request is the concatenation of iovcnt pieces of
+  // memory sent with a single gathering write. This allows a caller to put a
+  // header in front of a large payload without first copying them into one
+  // buffer. The iov array is modified as data is sent. The reply is received
+  // directly into out.extra_buf.
+  Status Call(struct iovec* iov, int iovcnt, Message& out) RPCNOEXCEPT;
+
+  // Asynchronous calls use non-blocking sockets that are polled together by
+  // Progress(). Calls still outstanding when the client is deleted finish
+  // with an error.
+  virtual void CallAsync(Message& in, Message& out, Callback done,
+                         void* arg) RPCNOEXCEPT;
+  virtual int Progress(uint64_t timeout) RPCNOEXCEPT;
+
   // If we fail to resolve the uri, we will record the error and return it at
   // the next Call() invocation.
   void SetTarget(const std::string& uri);
@@ -62,8 +120,12 @@ class PosixTCPCli : public rpc::If {
   void operator=(const PosixTCPCli&);
   PosixTCPCli(const PosixTCPCli& other);
   Status OpenAndConnect(int* fd);
+  struct AsyncCall;
+  // Return true if the call has finished. Set *status accordingly.
+  bool Advance(AsyncCall* call, Status* status);
   const uint64_t rpc_timeout_;  // In microseconds
   const size_t buf_sz_;
+  std::vector<AsyncCall*> calls_;  // Outstanding async calls
   PosixSocketAddr addr_;
   Status status_;
 };
@@ -85,6 +85,7 @@ inline bool TypeOnRados(FileType type) {
     case kDBLockFile:
     case kTempFile:
     case kInfoLogFile:
+    case kIdentityFile:
     default:  // This includes all foreign files
       return false;
   }
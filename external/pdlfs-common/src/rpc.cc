@@ -39,6 +39,7 @@ RPCOptions::RPCOptions()
       info_log(NULL),
       fs(NULL),
       addr_cache_size(128),
+      udp_retransmit_timeout(200000),
       udp_max_unexpected_msgsz(1432),
       udp_max_expected_msgsz(1432),
       udp_srv_rcvbuf(-1),
@@ -117,6 +118,28 @@ namespace rpc {
 
 If::~If() {}
 
+void If::CallAsync(Message& in, Message& out, Callback done,
+                   void* arg) RPCNOEXCEPT {
+  done(Call(in, out), arg);
+}
+
+int If::Progress(uint64_t timeout) RPCNOEXCEPT { return 0; }
+
+void Future::Done(const Status& status, void* arg) {
+  Future* const f = reinterpret_cast<Future*>(arg);
+  f->status_ = status;
+  f->done_ = true;
+}
+
+Status Future::Wait(If* const stub) {
+  while (!done_) {
+    if (stub->Progress(1000 * 1000) == 0 && !done_) {
+      return Status::AssertionFailed("Call not outstanding");
+    }
+  }
+  return status_;
+}
+
 namespace {
 #if defined(PDLFS_MARGO_RPC)
 class MargoRPCImpl : public RPC {
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/rpc_sched.h"
+
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/mutexlock.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+namespace pdlfs {
+
+RPCClassifier::~RPCClassifier() {}
+
+int RPCClassifier::Weight(uint64_t cls) { return 1; }
+
+bool RPCClassifier::EncodeRejection(const Status& status,
+                                    const rpc::If::Message& in,
+                                    rpc::If::Message& out) {
+  return false;
+}
+
+RPCSchedulerOptions::RPCSchedulerOptions()
+    : max_outstanding_calls(4),
+      max_queue_depth(64),
+      max_wait_micros(0),
+      max_classes(1024),
+      classifier(NULL) {}
+
+RPCSchedulerStats::RPCSchedulerStats()
+    : calls(0), rejected(0), expired(0), queue_depth(0), max_queue_depth(0) {
+  wait_micros.Clear();
+}
+
+// A call waiting for its turn.
+struct RPCScheduler::Waiter {
+  explicit Waiter(port::Mutex* mu) : cv(mu), done(false), expired(false) {}
+  port::CondVar cv;
+  uint64_t enqueued;
+  bool done;  // True once the call is either admitted or dropped
+  bool expired;
+};
+
+struct RPCScheduler::Class {
+  std::deque<Waiter*> queue;
+  int weight;
+  int deficit;  // Calls the class may still start in the current round
+  bool active;  // True iff the class is in active_
+  RPCSchedulerStats stats;
+};
+
+RPCScheduler::RPCScheduler(const RPCSchedulerOptions& options, rpc::If* fs)
+    : options_(options),
+      fs_(fs),
+      num_classes_(0),
+      next_sweep_(options_.max_classes),
+      running_(0) {}
+
+RPCScheduler::~RPCScheduler() {
+  assert(active_.empty());
+  struct Deleter : public HashMap<Class>::Visitor {
+    virtual void visit(const Slice& key, Class* c) { delete c; }
+  };
+  Deleter deleter;
+  classes_.VisitAll(&deleter);
+}
+
+RPCScheduler::Class* RPCScheduler::GetClass(uint64_t cls) {
+  mutex_.AssertHeld();
+  char tmp[8];
+  EncodeFixed64(tmp, cls);
+  const Slice key(tmp, sizeof(tmp));
+  Class* c = classes_.Lookup(key);
+  if (c == NULL) {
+    MaybeForgetClasses();
+    c = new Class;
+    c->weight = 1;
+    if (options_.classifier != NULL) {
+      c->weight = std::max(1, options_.classifier->Weight(cls));
+    }
+    c->deficit = 0;
+    c->active = false;
+    classes_.Insert(key, c);
+    num_classes_++;
+  }
+  return c;
+}
+
+// Classes without waiting calls are not referenced outside classes_. The
+// next sweep happens once the number of classes doubles so that sweeps cost
+// O(1) per new class even when few classes are idle.
+void RPCScheduler::MaybeForgetClasses() {
+  mutex_.AssertHeld();
+  if (num_classes_ < next_sweep_) {
+    return;
+  }
+  struct Collector : public HashMap<Class>::Visitor {
+    virtual void visit(const Slice& key, Class* c) {
+      if (c->queue.empty()) {
+        keys.push_back(key.ToString());
+      }
+    }
+    std::vector<std::string> keys;
+  };
+  Collector collector;
+  classes_.VisitAll(&collector);
+  for (size_t i = 0; i < collector.keys.size(); i++) {
+    delete classes_.Erase(collector.keys[i]);
+    num_classes_--;
+  }
+  next_sweep_ = std::max(options_.max_classes, 2 * num_classes_);
+}
+
+Status RPCScheduler::Reject(const Status& status, Message& in, Message& out) {
+  if (options_.classifier != NULL &&
+      options_.classifier->EncodeRejection(status, in, out)) {
+    return Status::OK();
+  } else {
+    return status;
+  }
+}
+
+// Start waiting calls while there are free slots. Each class at the front of
+// the active list receives a credit equal to its weight when its turn
+// begins, and moves to the back of the list once the credit is used up or
+// its queue is empty.
+void RPCScheduler::Dispatch() {
+  mutex_.AssertHeld();
+  while (running_ < options_.max_outstanding_calls && !active_.empty()) {
+    Class* const c = active_.front();
+    if (c->deficit <= 0) {
+      c->deficit += c->weight;
+    }
+    Waiter* const w = c->queue.front();
+    c->queue.pop_front();
+    c->stats.queue_depth--;
+    const uint64_t wait = CurrentMicros() - w->enqueued;
+    if (options_.max_wait_micros != 0 && wait > options_.max_wait_micros) {
+      c->stats.expired++;
+      w->expired = true;
+    } else {
+      c->stats.calls++;
+      c->stats.wait_micros.Add(wait);
+      c->deficit--;
+      running_++;
+    }
+    w->done = true;
+    w->cv.Signal();
+    if (c->queue.empty()) {
+      active_.pop_front();
+      c->active = false;
+      c->deficit = 0;
+    } else if (c->deficit <= 0) {
+      active_.pop_front();
+      active_.push_back(c);
+    }
+  }
+}
+
+Status RPCScheduler::Call(Message& in, Message& out) RPCNOEXCEPT {
+  const uint64_t cls =
+      options_.classifier != NULL ? options_.classifier->Classify(in) : 0;
+  Status rejection;
+  {
+    MutexLock ml(&mutex_);
+    Class* const c = GetClass(cls);
+    if (running_ < options_.max_outstanding_calls && active_.empty()) {
+      c->stats.calls++;
+      c->stats.wait_micros.Add(0);
+      running_++;
+    } else if (c->queue.size() >= options_.max_queue_depth) {
+      c->stats.rejected++;
+      rejection = Status::BufferFull("Too many queued calls");
+    } else {
+      Waiter w(&mutex_);
+      w.enqueued = CurrentMicros();
+      c->queue.push_back(&w);
+      c->stats.queue_depth++;
+      if (c->stats.queue_depth > c->stats.max_queue_depth) {
+        c->stats.max_queue_depth = c->stats.queue_depth;
+      }
+      if (!c->active) {
+        c->active = true;
+        active_.push_back(c);
+      }
+      Dispatch();
+      while (!w.done) {
+        w.cv.Wait();
+      }
+      if (w.expired) {
+        rejection = Status::TryAgain("Call waited too long");
+      }
+    }
+  }
+  if (!rejection.ok()) {  // Encode the rejection without holding mutex_
+    return Reject(rejection, in, out);
+  }
+
+  Status status = fs_->Call(in, out);
+
+  MutexLock ml(&mutex_);
+  running_--;
+  Dispatch();
+  return status;
+}
+
+bool RPCScheduler::GetStats(uint64_t cls, RPCSchedulerStats* stats) {
+  MutexLock ml(&mutex_);
+  char tmp[8];
+  EncodeFixed64(tmp, cls);
+  Class* const c = classes_.Lookup(Slice(tmp, sizeof(tmp)));
+  if (c == NULL) {
+    return false;
+  }
+  *stats = c->stats;
+  return true;
+}
+
+std::string RPCScheduler::GetUsageInfo() {
+  struct Printer : public HashMap<Class>::Visitor {
+    virtual void visit(const Slice& key, Class* c) {
+      char tmp[300];
+      const RPCSchedulerStats& s = c->stats;
+      snprintf(tmp, sizeof(tmp),
+               "class %llu (weight %d): %llu calls, %llu rejected, "
+               "%llu expired, queue depth %llu (max %llu), "
+               "wait p50 %.0f us, p99 %.0f us\n",
+               static_cast<unsigned long long>(DecodeFixed64(key.data())),
+               c->weight, static_cast<unsigned long long>(s.calls),
+               static_cast<unsigned long long>(s.rejected),
+               static_cast<unsigned long long>(s.expired),
+               static_cast<unsigned long long>(s.queue_depth),
+               static_cast<unsigned long long>(s.max_queue_depth),
+               s.wait_micros.Percentile(50), s.wait_micros.Percentile(99));
+      result.append(tmp);
+    }
+    std::string result;
+  };
+  Printer printer;
+  MutexLock ml(&mutex_);
+  classes_.VisitAll(&printer);
+  return printer.result;
+}
+
+}  // namespace pdlfs
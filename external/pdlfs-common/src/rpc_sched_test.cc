@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "pdlfs-common/rpc_sched.h"
+
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/mutexlock.h"
+#include "pdlfs-common/testharness.h"
+
+#include <stdio.h>
+
+namespace pdlfs {
+
+// Requests are single letters. Each letter is a class whose weight is given
+// by weights_.
+class RPCSchedTest : public rpc::If, public RPCClassifier {
+ public:
+  RPCSchedTest()
+      : cv_(&mu_), gate_open_(true), pending_(0), encode_rejections_(false) {
+    memset(weights_, 0, sizeof(weights_));
+  }
+
+  virtual uint64_t Classify(const Message& in) { return in.contents[0]; }
+
+  virtual int Weight(uint64_t cls) {
+    return weights_[cls] != 0 ? weights_[cls] : 1;
+  }
+
+  virtual bool EncodeRejection(const Status& status, const Message& in,
+                               Message& out) {
+    if (!encode_rejections_) {
+      return false;
+    }
+    out.extra_buf = "rejected: " + status.ToString();
+    out.contents = out.extra_buf;
+    return true;
+  }
+
+  // Record the order of calls. Calls block while the gate is closed.
+  virtual Status Call(Message& in, Message& out) RPCNOEXCEPT {
+    MutexLock ml(&mu_);
+    while (!gate_open_) {
+      cv_.Wait();
+    }
+    order_.append(in.contents.data(), 1);
+    return Status::OK();
+  }
+
+  void SetGate(bool open) {
+    MutexLock ml(&mu_);
+    gate_open_ = open;
+    cv_.SignalAll();
+  }
+
+  struct Caller {
+    RPCSchedTest* t;
+    char op;
+    Status status;
+  };
+
+  static void CallerBody(void* arg) {
+    Caller* const c = reinterpret_cast<Caller*>(arg);
+    rpc::If::Message in, out;
+    in.contents = Slice(&c->op, 1);
+    Status s = c->t->sched_->Call(in, out);
+    MutexLock ml(&c->t->mu_);
+    c->status = s;
+    c->t->pending_--;
+    c->t->cv_.SignalAll();
+  }
+
+  // Issue a call from a new thread.
+  void Start(Caller* c, char op) {
+    c->t = this;
+    c->op = op;
+    {
+      MutexLock ml(&mu_);
+      pending_++;
+    }
+    Env::Default()->StartThread(CallerBody, c);
+  }
+
+  // Wait until a given number of calls of a class have started.
+  void WaitForCalls(char op, uint64_t calls) {
+    RPCSchedulerStats stats;
+    while (!sched_->GetStats(op, &stats) || stats.calls != calls) {
+      SleepForMicroseconds(1000);
+    }
+  }
+
+  // Wait until the queue of a class reaches a given depth.
+  void WaitForQueueDepth(char op, size_t depth) {
+    RPCSchedulerStats stats;
+    while (!sched_->GetStats(op, &stats) || stats.queue_depth != depth) {
+      SleepForMicroseconds(1000);
+    }
+  }
+
+  void WaitForAll() {
+    MutexLock ml(&mu_);
+    while (pending_ != 0) {
+      cv_.Wait();
+    }
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  bool gate_open_;
+  int pending_;
+  bool encode_rejections_;
+  std::string order_;
+  int weights_[256];
+  RPCScheduler* sched_;
+};
+
+TEST(RPCSchedTest, Passthrough) {
+  RPCSchedulerOptions options;
+  options.classifier = this;
+  RPCScheduler sched(options, this);
+  sched_ = &sched;
+  rpc::If::Message in, out;
+  in.contents = Slice("a");
+  ASSERT_OK(sched.Call(in, out));
+  in.contents = Slice("b");
+  ASSERT_OK(sched.Call(in, out));
+  ASSERT_EQ(order_, "ab");
+  RPCSchedulerStats stats;
+  ASSERT_TRUE(sched.GetStats('a', &stats));
+  ASSERT_EQ(stats.calls, 1);
+  ASSERT_FALSE(sched.GetStats('c', &stats));
+  fprintf(stderr, "%s", sched.GetUsageInfo().c_str());
+}
+
+// Calls of competing classes interleave according to their weights.
+TEST(RPCSchedTest, WeightedRoundRobin) {
+  weights_['a'] = 2;
+  RPCSchedulerOptions options;
+  options.max_outstanding_calls = 1;
+  options.classifier = this;
+  RPCScheduler sched(options, this);
+  sched_ = &sched;
+  SetGate(false);
+  Caller callers[10];
+  Start(&callers[0], 'x');  // Occupies the only slot
+  WaitForCalls('x', 1);
+  for (int i = 0; i < 6; i++) {
+    Start(&callers[1 + i], 'a');
+    WaitForQueueDepth('a', i + 1);
+  }
+  for (int i = 0; i < 3; i++) {
+    Start(&callers[7 + i], 'b');
+    WaitForQueueDepth('b', i + 1);
+  }
+  SetGate(true);
+  WaitForAll();
+  ASSERT_EQ(order_, "xaabaabaab");
+  for (int i = 0; i < 10; i++) {
+    ASSERT_OK(callers[i].status);
+  }
+  RPCSchedulerStats stats;
+  ASSERT_TRUE(sched.GetStats('a', &stats));
+  ASSERT_EQ(stats.calls, 6);
+  ASSERT_EQ(stats.max_queue_depth, 6);
+  ASSERT_EQ(stats.queue_depth, 0);
+  fprintf(stderr, "%s", sched.GetUsageInfo().c_str());
+}
+
+// A flood of calls from one class does not delay another class by more
+// than one call per round.
+TEST(RPCSchedTest, Isolation) {
+  RPCSchedulerOptions options;
+  options.max_outstanding_calls = 1;
+  options.classifier = this;
+  RPCScheduler sched(options, this);
+  sched_ = &sched;
+  SetGate(false);
+  Caller callers[21];
+  for (int i = 0; i < 20; i++) {
+    Start(&callers[i], 'a');
+  }
+  WaitForQueueDepth('a', 19);
+  Start(&callers[20], 'b');
+  WaitForQueueDepth('b', 1);
+  SetGate(true);
+  WaitForAll();
+  ASSERT_EQ(order_.find('b'), 2);
+}
+
+TEST(RPCSchedTest, Rejection) {
+  RPCSchedulerOptions options;
+  options.max_outstanding_calls = 1;
+  options.max_queue_depth = 2;
+  options.classifier = this;
+  RPCScheduler sched(options, this);
+  sched_ = &sched;
+  SetGate(false);
+  Caller callers[4];
+  Start(&callers[0], 'a');
+  Start(&callers[1], 'a');
+  Start(&callers[2], 'a');
+  WaitForQueueDepth('a', 2);
+  rpc::If::Message in, out;
+  in.contents = Slice("a");
+  ASSERT_TRUE(sched.Call(in, out).IsBufferFull());
+  encode_rejections_ = true;
+  ASSERT_OK(sched.Call(in, out));
+  ASSERT_TRUE(out.contents.starts_with("rejected: "));
+  Start(&callers[3], 'b');  // Other classes have their own queues
+  WaitForQueueDepth('b', 1);
+  SetGate(true);
+  WaitForAll();
+  for (int i = 0; i < 4; i++) {
+    ASSERT_OK(callers[i].status);
+  }
+  RPCSchedulerStats stats;
+  ASSERT_TRUE(sched.GetStats('a', &stats));
+  ASSERT_EQ(stats.rejected, 2);
+  ASSERT_EQ(stats.calls, 3);
+}
+
+// Idle classes are forgotten once there are too many classes. Classes with
+// waiting calls are kept.
+TEST(RPCSchedTest, ForgetIdleClasses) {
+  RPCSchedulerOptions options;
+  options.max_outstanding_calls = 1;
+  options.max_classes = 3;
+  options.classifier = this;
+  RPCScheduler sched(options, this);
+  sched_ = &sched;
+  SetGate(false);
+  Caller callers[4];
+  Start(&callers[0], 'x');  // Occupies the only slot
+  WaitForCalls('x', 1);
+  Start(&callers[1], 'y');
+  WaitForQueueDepth('y', 1);
+  Start(&callers[2], 'z');
+  WaitForQueueDepth('z', 1);
+  Start(&callers[3], 'w');
+  WaitForQueueDepth('w', 1);
+  RPCSchedulerStats stats;
+  ASSERT_FALSE(sched.GetStats('x', &stats));
+  ASSERT_TRUE(sched.GetStats('y', &stats));
+  ASSERT_TRUE(sched.GetStats('z', &stats));
+  SetGate(true);
+  WaitForAll();
+  ASSERT_EQ(order_, "xyzw");
+  for (int i = 0; i < 4; i++) {
+    ASSERT_OK(callers[i].status);
+  }
+}
+
+TEST(RPCSchedTest, Expiration) {
+  RPCSchedulerOptions options;
+  options.max_outstanding_calls = 1;
+  options.max_wait_micros = 20000;
+  options.classifier = this;
+  RPCScheduler sched(options, this);
+  sched_ = &sched;
+  SetGate(false);
+  Caller callers[2];
+  Start(&callers[0], 'a');
+  WaitForCalls('a', 1);
+  Start(&callers[1], 'b');
+  WaitForQueueDepth('b', 1);
+  SleepForMicroseconds(50000);
+  SetGate(true);
+  WaitForAll();
+  ASSERT_OK(callers[0].status);
+  ASSERT_TRUE(callers[1].status.IsTryAgain());
+  ASSERT_EQ(order_, "a");
+  RPCSchedulerStats stats;
+  ASSERT_TRUE(sched.GetStats('b', &stats));
+  ASSERT_EQ(stats.expired, 1);
+  ASSERT_EQ(stats.calls, 0);
+}
+
+}  // namespace pdlfs
+
+int main(int argc, char** argv) {
+  return ::pdlfs::test::RunAllTests(&argc, &argv);
+}
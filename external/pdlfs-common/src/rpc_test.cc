@@ -10,33 +10,64 @@
  */
 #include "pdlfs-common/rpc.h"
 
+#include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/port.h"
 #include "pdlfs-common/testharness.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
 
 namespace pdlfs {
 
 class RPCTest : public rpc::If {
  public:
-  RPCTest() {}
+  RPCTest() : calls_(0), delay_micros_(0) {}
 
+  // Echo the input. Requests starting with "big" get a large reply. Requests
+  // starting with "err" fail.
   virtual Status Call(Message& in, Message& out) RPCNOEXCEPT {
-    out.extra_buf.assign(in.contents.data(), in.contents.size());
+    {
+      MutexLock ml(&mu_);
+      calls_++;
+    }
+    if (delay_micros_ != 0) {
+      SleepForMicroseconds(delay_micros_);
+    }
+    if (in.contents.starts_with("err")) {
+      return Status::IOError("Call failed");
+    } else if (in.contents.starts_with("big")) {
+      out.extra_buf.assign(100000, 'z');
+    } else {
+      out.extra_buf.assign(in.contents.data(), in.contents.size());
+    }
     out.contents = out.extra_buf;
     return Status::OK();
   }
 
+  int NumCalls() {
+    MutexLock ml(&mu_);
+    return calls_;
+  }
+
   RPC* Open(const std::string& uri, int num_rpc_threads = 1,
             ThreadPool* extra_worker = NULL) {
-    RPCOptions options;
-    options.num_rpc_threads = num_rpc_threads;
-    options.extra_workers = extra_worker;
-    options.uri = uri;
-    options.fs = this;
-    return RPC::Open(options);
+    options_.num_rpc_threads = num_rpc_threads;
+    options_.extra_workers = extra_worker;
+    options_.uri = uri;
+    options_.fs = this;
+    return RPC::Open(options_);
   }
+
+  RPCOptions options_;
+  port::Mutex mu_;
+  int calls_;
+  int delay_micros_;
 };
 
 TEST(RPCTest, Addr) {
@@ -48,8 +79,9 @@ TEST(RPCTest, Addr) {
 }
 
 TEST(RPCTest, Open) {
-  const char* uris[2] = {"udp://127.0.0.1:22222", "tcp://127.0.0.1:22222"};
-  for (int i = 0; i < 2; i++) {
+  const char* uris[3] = {"udp://127.0.0.1:22222", "tcp://127.0.0.1:22222",
+                         "hybrid://127.0.0.1:22222"};
+  for (int i = 0; i < 3; i++) {
     fprintf(stderr, "Uri: %s\n", uris[i]);
     RPC* rpc = Open(uris[i]);
     ASSERT_TRUE(rpc != NULL);
@@ -63,8 +95,9 @@ TEST(RPCTest, Open) {
 
 TEST(RPCTest, SendAndRecv) {
   ThreadPool* extra_worker = ThreadPool::NewFixed(1, true);
-  const char* uris[2] = {"udp://127.0.0.1:22222", "tcp://127.0.0.1:22222"};
-  for (int i = 0; i < 2; i++) {
+  const char* uris[3] = {"udp://127.0.0.1:22222", "tcp://127.0.0.1:22222",
+                         "hybrid://127.0.0.1:22222"};
+  for (int i = 0; i < 3; i++) {
     for (int j = 0; j < 2; j++) {
       RPC* rpc;
       if (j == 0) {
@@ -93,6 +126,334 @@ TEST(RPCTest, SendAndRecv) {
   delete extra_worker;
 }
 
+TEST(RPCTest, HybridLargeMessages) {
+  RPC* rpc = Open("hybrid://127.0.0.1:0");
+  ASSERT_OK(rpc->Start());
+  rpc::If* client = rpc->OpenStubFor(rpc->GetUri());
+  rpc::If::Message in, out;
+  // Small request, large reply
+  in.contents = Slice("big");
+  ASSERT_OK(client->Call(in, out));
+  ASSERT_EQ(out.contents.ToString(), std::string(100000, 'z'));
+  // Large request
+  std::string msg(50000, 'x');
+  in.contents = msg;
+  ASSERT_OK(client->Call(in, out));
+  ASSERT_TRUE(out.contents == in.contents);
+  // Small request, small reply
+  in.contents = Slice("xxyyzz");
+  ASSERT_OK(client->Call(in, out));
+  ASSERT_TRUE(out.contents == in.contents);
+  ASSERT_EQ(NumCalls(), 3);
+  delete client;
+  delete rpc;
+}
+
+// Messages much larger than socket buffers are received in place. Failed
+// calls, both small and large, are reported to the client.
+TEST(RPCTest, HugeMessages) {
+  const char* uris[2] = {"tcp://127.0.0.1:0", "hybrid://127.0.0.1:0"};
+  std::string msg;
+  for (int i = 0; i < (8 << 20); i++) {
+    msg.push_back(static_cast<char>(i * 131 + (i >> 12)));
+  }
+  for (int i = 0; i < 2; i++) {
+    fprintf(stderr, "Uri: %s\n", uris[i]);
+    RPC* rpc = Open(uris[i]);
+    ASSERT_OK(rpc->Start());
+    rpc::If* client = rpc->OpenStubFor(rpc->GetUri());
+    for (int j = 0; j < 3; j++) {
+      rpc::If::Message in, out;
+      in.contents = Slice(msg.data(), msg.size() >> j);
+      ASSERT_OK(client->Call(in, out));
+      ASSERT_TRUE(out.contents == in.contents);
+    }
+    {
+      rpc::If::Message in, out;
+      in.contents = Slice("err");
+      ASSERT_TRUE(client->Call(in, out).IsIOError());
+      std::string err = "err" + std::string(100000, 'x');
+      in.contents = err;
+      ASSERT_TRUE(client->Call(in, out).IsIOError());
+    }
+    delete client;
+    delete rpc;
+  }
+}
+
+// Requests resent while being executed must not be executed again.
+TEST(RPCTest, HybridRetransmission) {
+  options_.udp_retransmit_timeout = 10000;
+  delay_micros_ = 100000;
+  RPC* rpc = Open("hybrid://127.0.0.1:0");
+  ASSERT_OK(rpc->Start());
+  rpc::If* client = rpc->OpenStubFor(rpc->GetUri());
+  rpc::If::Message in, out;
+  in.contents = Slice("xxyyzz");
+  ASSERT_OK(client->Call(in, out));
+  ASSERT_TRUE(out.contents == in.contents);
+  ASSERT_EQ(NumCalls(), 1);
+  delay_micros_ = 0;
+  // Late replies to the earlier request are ignored
+  in.contents = Slice("aabbcc");
+  ASSERT_OK(client->Call(in, out));
+  ASSERT_TRUE(out.contents == in.contents);
+  ASSERT_EQ(NumCalls(), 2);
+  delete client;
+  delete rpc;
+}
+
+// Clients number their requests alike. Their replies must not be mixed up.
+TEST(RPCTest, HybridManyClients) {
+  RPC* rpc = Open("hybrid://127.0.0.1:0");
+  ASSERT_OK(rpc->Start());
+  rpc::If* clients[2];
+  for (int i = 0; i < 2; i++) {
+    clients[i] = rpc->OpenStubFor(rpc->GetUri());
+  }
+  for (int j = 0; j < 3; j++) {
+    for (int i = 0; i < 2; i++) {
+      char msg[20];
+      snprintf(msg, sizeof(msg), "client%d-%d", i, j);
+      rpc::If::Message in, out;
+      in.contents = Slice(msg);
+      ASSERT_OK(clients[i]->Call(in, out));
+      ASSERT_EQ(out.contents.ToString(), std::string(msg));
+    }
+  }
+  ASSERT_EQ(NumCalls(), 6);
+  for (int i = 0; i < 2; i++) {
+    delete clients[i];
+  }
+  delete rpc;
+}
+
+// Idle connections must not keep a single-threaded server from serving
+// others.
+TEST(RPCTest, TCPIdleConnections) {
+  RPC* rpc = Open("tcp://127.0.0.1:0");
+  ASSERT_OK(rpc->Start());
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(rpc->GetPort());
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int fds[8];
+  for (int i = 0; i < 8; i++) {
+    fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_TRUE(fds[i] != -1);
+    ASSERT_TRUE(connect(fds[i], reinterpret_cast<struct sockaddr*>(&addr),
+                        sizeof(addr)) == 0);
+    ASSERT_TRUE(send(fds[i], "xx", 2, 0) == 2);  // Never finished
+  }
+  char uri[50];
+  snprintf(uri, sizeof(uri), "tcp://127.0.0.1:%d", rpc->GetPort());
+  rpc::If* client = rpc->OpenStubFor(uri);
+  const uint64_t start = CurrentMicros();
+  rpc::If::Message in, out;
+  in.contents = Slice("xxyyzz");
+  ASSERT_OK(client->Call(in, out));
+  ASSERT_TRUE(out.contents == in.contents);
+  ASSERT_LT(CurrentMicros() - start, 1000000);
+  for (int i = 0; i < 8; i++) {
+    close(fds[i]);
+  }
+  delete client;
+  delete rpc;
+}
+
+#if defined(SO_REUSEPORT)
+TEST(RPCTest, TCPExclusivePort) {
+  RPC* rpc = Open("tcp://127.0.0.1:0", 4);
+  ASSERT_OK(rpc->Start());
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(rpc->GetPort());
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  // Another socket must not be able to share the port and take connections
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_TRUE(fd != -1);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  ASSERT_TRUE(
+      bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1);
+  close(fd);
+  char uri[50];
+  snprintf(uri, sizeof(uri), "tcp://127.0.0.1:%d", rpc->GetPort());
+  rpc::If* client = rpc->OpenStubFor(uri);
+  for (int i = 0; i < 10; i++) {
+    rpc::If::Message in, out;
+    in.contents = Slice("xxyyzz");
+    ASSERT_OK(client->Call(in, out));
+    ASSERT_TRUE(out.contents == in.contents);
+  }
+  delete client;
+  delete rpc;
+}
+#endif
+
+namespace {
+struct TCPClientState {
+  rpc::If* client;
+  int id;
+  port::Mutex* mu;
+  port::CondVar* cv;
+  int* done;
+  Status status;
+};
+
+void TCPClientBody(void* arg) {
+  TCPClientState* const state = reinterpret_cast<TCPClientState*>(arg);
+  Status s;
+  for (int i = 0; i < 100 && s.ok(); i++) {
+    // Mix small messages with large ones needing many recv() and send() calls
+    std::string msg((i % 10 == 0) ? (256 << 10) : 10, 'a' + state->id);
+    rpc::If::Message in, out;
+    in.contents = msg;
+    s = state->client->Call(in, out);
+    if (s.ok() && out.contents != in.contents) {
+      s = Status::Corruption("Bad reply");
+    }
+  }
+  MutexLock ml(state->mu);
+  state->status = s;
+  ++*state->done;
+  state->cv->SignalAll();
+}
+}  // namespace
+
+TEST(RPCTest, TCPConcurrentCalls) {
+  ThreadPool* extra_worker = ThreadPool::NewFixed(2, true);
+  for (int j = 0; j < 2; j++) {
+    RPC* rpc = Open("tcp://127.0.0.1:0", 2, j == 0 ? NULL : extra_worker);
+    ASSERT_OK(rpc->Start());
+    char uri[50];
+    snprintf(uri, sizeof(uri), "tcp://127.0.0.1:%d", rpc->GetPort());
+    port::Mutex mu;
+    port::CondVar cv(&mu);
+    int done = 0;
+    TCPClientState states[8];
+    for (int i = 0; i < 8; i++) {
+      states[i].client = rpc->OpenStubFor(uri);
+      states[i].id = i;
+      states[i].mu = &mu;
+      states[i].cv = &cv;
+      states[i].done = &done;
+      Env::Default()->StartThread(TCPClientBody, &states[i]);
+    }
+    {
+      MutexLock ml(&mu);
+      while (done < 8) {
+        cv.Wait();
+      }
+    }
+    for (int i = 0; i < 8; i++) {
+      ASSERT_OK(states[i].status);
+      delete states[i].client;
+    }
+    ASSERT_OK(rpc->Stop());
+    delete rpc;
+  }
+  delete extra_worker;
+}
+
+namespace {
+struct AsyncState {
+  rpc::If::Message in, out;
+  std::string msg;
+  Status status;
+  int* done;
+};
+
+void AsyncDone(const Status& status, void* arg) {
+  AsyncState* const state = reinterpret_cast<AsyncState*>(arg);
+  state->status = status;
+  ++*state->done;
+}
+}  // namespace
+
+// A single thread keeps many calls outstanding across two servers.
+TEST(RPCTest, AsyncCalls) {
+  const char* uris[3] = {"udp://127.0.0.1:0", "tcp://127.0.0.1:0",
+                         "hybrid://127.0.0.1:0"};
+  for (int i = 0; i < 3; i++) {
+    fprintf(stderr, "Uri: %s\n", uris[i]);
+    RPC* rpcs[2];
+    rpc::If* stubs[2];
+    for (int j = 0; j < 2; j++) {
+      rpcs[j] = Open(uris[i], 2);
+      ASSERT_OK(rpcs[j]->Start());
+      stubs[j] = rpcs[j]->OpenStubFor(rpcs[j]->GetUri());
+    }
+    const int n = 200;
+    AsyncState* states = new AsyncState[n];
+    int done = 0;
+    for (int k = 0; k < n; k++) {
+      char tmp[20];
+      snprintf(tmp, sizeof(tmp), "call-%d", k);
+      states[k].msg = tmp;
+      const bool big = (i != 0 && k % 20 == 0);  // UDP cannot send them
+      if (big) {  // Some calls have large replies
+        states[k].msg = "big" + states[k].msg;
+      }
+      states[k].in.contents = states[k].msg;
+      states[k].done = &done;
+      stubs[k % 2]->CallAsync(states[k].in, states[k].out, AsyncDone,
+                              &states[k]);
+    }
+    while (stubs[0]->Progress(1000) + stubs[1]->Progress(1000) != 0) {
+    }
+    ASSERT_EQ(done, n);
+    for (int k = 0; k < n; k++) {
+      ASSERT_OK(states[k].status);
+      if (i != 0 && k % 20 == 0) {
+        ASSERT_EQ(states[k].out.contents.size(), 100000);
+      } else {
+        ASSERT_EQ(states[k].out.contents.ToString(), states[k].msg);
+      }
+    }
+    delete[] states;
+    // Futures
+    rpc::If::Message in1, out1, in2, out2;
+    in1.contents = Slice("abc");
+    in2.contents = Slice("xyz");
+    rpc::Future f1, f2;
+    stubs[0]->CallAsync(in1, out1, rpc::Future::Done, &f1);
+    stubs[0]->CallAsync(in2, out2, rpc::Future::Done, &f2);
+    ASSERT_OK(f2.Wait(stubs[0]));
+    ASSERT_OK(f1.Wait(stubs[0]));
+    ASSERT_EQ(out1.contents.ToString(), "abc");
+    ASSERT_EQ(out2.contents.ToString(), "xyz");
+    for (int j = 0; j < 2; j++) {
+      delete stubs[j];
+      delete rpcs[j];
+    }
+  }
+}
+
+// Async calls to a server that never replies time out.
+TEST(RPCTest, AsyncTimeout) {
+  const char* uris[2] = {"tcp://127.0.0.1:0", "hybrid://127.0.0.1:0"};
+  for (int i = 0; i < 2; i++) {
+    fprintf(stderr, "Uri: %s\n", uris[i]);
+    options_.rpc_timeout = 300 * 1000;
+    options_.udp_retransmit_timeout = 50 * 1000;
+    delay_micros_ = 600 * 1000;
+    RPC* rpc = Open(uris[i]);
+    ASSERT_OK(rpc->Start());
+    rpc::If* client = rpc->OpenStubFor(rpc->GetUri());
+    rpc::If::Message in, out;
+    in.contents = Slice("xxyyzz");
+    rpc::Future f;
+    client->CallAsync(in, out, rpc::Future::Done, &f);
+    ASSERT_TRUE(f.Wait(client).IsDisconnected());
+    delete client;
+    delete rpc;
+    delay_micros_ = 0;
+  }
+}
+
 namespace {
 int GetOptionFromEnv(const char* key, int def) {
   const char* env = getenv(key);
@@ -171,20 +532,58 @@ class RPCBenchServer : public RPCBench, public rpc::If {
 
 class RPCBenchClient : public RPCBench {
  public:
-  explicit RPCBenchClient(const char* uri) : RPCBench(rpc::kClientOnly, uri) {
+  explicit RPCBenchClient(const char* uri)
+      : RPCBench(rpc::kClientOnly, uri), client_(NULL), remaining_(0) {
     rpc_ = RPC::Open(options_);
   }
 
+  struct Slot {
+    RPCBenchClient* cli;
+    rpc::If::Message in, out;
+  };
+
+  // Reissue a call as soon as the previous call in the slot completes.
+  static void Done(const Status& status, void* arg) {
+    Slot* const slot = reinterpret_cast<Slot*>(arg);
+    RPCBenchClient* const cli = slot->cli;
+    if (!status.ok()) {
+      cli->status_ = status;
+    } else if (cli->remaining_ > 0) {
+      --cli->remaining_;
+      slot->in.contents = Slice("xxx");
+      cli->client_->CallAsync(slot->in, slot->out, Done, slot);
+    }
+  }
+
+  // Keep "depth" calls outstanding from a single thread.
+  Status RunAsync(int nrpcs, int depth) {
+    std::vector<Slot> slots(depth);
+    remaining_ = nrpcs;
+    for (int i = 0; i < depth && remaining_ > 0; i++) {
+      slots[i].cli = this;
+      Done(Status::OK(), &slots[i]);
+    }
+    while (client_->Progress(1000 * 1000) != 0) {
+    }
+    return status_;
+  }
+
   void Run() {
     rpc::If* client = rpc_->OpenStubFor(options_.uri);
     int nrpcs = GetOption("RPC_NUM_SENDRECV", 1000 * 1000);
+    int depth = GetOption("RPC_ASYNC_DEPTH", 1);
     rpc::If::Message in, out;
     Status status;
-    for (int i = 0; i < nrpcs; ++i) {
-      in.contents = Slice("xxx");
-      status = client->Call(in, out);
-      if (!status.ok()) {
-        break;
+    if (depth > 1) {
+      client_ = client;
+      status = RunAsync(nrpcs, depth);
+    } else {
+      for (int i = 0; i < nrpcs; ++i) {
+        in.contents = Slice("xxx");
+        status = client->Call(in, out);
+        if (!status.ok()) {
+          break;
+        }
       }
     }
     if (status.ok()) {
@@ -197,6 +596,11 @@ class RPCBenchClient : public RPCBench {
     }
     delete client;
   }
+
+ private:
+  rpc::If* client_;
+  int remaining_;
+  Status status_;
 };
 
 }  // namespace pdlfs
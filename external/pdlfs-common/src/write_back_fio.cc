@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "write_back_fio.h"
+
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/mutexlock.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace pdlfs {
+
+WriteBackFioOptions::WriteBackFioOptions()
+    : write_buffer_size(64 << 10), max_buffered_bytes(8 << 20) {}
+
+Fio* Fio::WriteBack(const WriteBackFioOptions& options, Fio* base) {
+  return new WriteBackFio(options, base);
+}
+
+struct WriteBackFio::File : public Fio::Handle {
+  Fentry fentry;
+  std::string key;  // Identifies the underlying file
+  Handle* base;
+  bool append_only;
+
+  // State below is protected by mu
+  port::Mutex mu;
+  std::string buf;  // Dirty data at [buf_off, buf_off + buf.size())
+  uint64_t buf_off;
+  uint64_t pos;  // Position of the next sequential read or write
+  uint64_t size;
+  uint64_t mtime;
+  Status error;  // Sticky error from a background flush
+
+  // State below is protected by WriteBackFio::mutex_
+  File* next;
+  File* prev;
+  size_t charge;  // Bytes of buf accounted in usage_
+  int refs;
+};
+
+WriteBackFio::WriteBackFio(const WriteBackFioOptions& options, Fio* base)
+    : options_(options), base_(base), lru_(new File), usage_(0) {
+  lru_->next = lru_;
+  lru_->prev = lru_;
+}
+
+WriteBackFio::~WriteBackFio() {
+  assert(lru_->next == lru_);  // All files must have been closed
+  delete lru_;
+  delete base_;
+}
+
+WriteBackFio::File* WriteBackFio::NewFile(const Fentry& fentry, Handle* base,
+                                          bool append_only, uint64_t mtime,
+                                          uint64_t size) {
+  File* const f = new File;
+  f->fentry = fentry;
+  f->key = fentry.UntypedKeyPrefix();
+  f->base = base;
+  f->append_only = append_only;
+  f->buf_off = 0;
+  f->pos = 0;
+  f->size = size;
+  f->mtime = mtime;
+  f->next = f->prev = NULL;
+  f->charge = 0;
+  f->refs = 1;
+  return f;
+}
+
+void WriteBackFio::Unref(File* f) {
+  mutex_.AssertHeld();
+  assert(f->refs > 0);
+  if (--f->refs == 0) {
+    assert(f->charge == 0);
+    delete f;
+  }
+}
+
+// Update the global usage with the current size of a file's buffer and
+// move the file to the most-recently-written end of the lru list.
+// REQUIRES: f->mu has been locked.
+void WriteBackFio::Charge(File* f) {
+  f->mu.AssertHeld();
+  MutexLock ml(&mutex_);
+  if (f->next != NULL) {  // Remove from list
+    f->next->prev = f->prev;
+    f->prev->next = f->next;
+    f->next = f->prev = NULL;
+  }
+  usage_ -= f->charge;
+  f->charge = f->buf.size();
+  usage_ += f->charge;
+  if (f->charge != 0) {  // Append to the newest end
+    f->next = lru_;
+    f->prev = lru_->prev;
+    f->prev->next = f;
+    f->next->prev = f;
+  }
+}
+
+// Flush buffers in lru order until usage drops within budget. A failed
+// flush leaves the victim's data buffered and stops eviction; the error
+// is reported by the victim's next write, flush, or close.
+// REQUIRES: no File::mu is held by the caller.
+void WriteBackFio::MaybeEvict() {
+  bool failed = false;
+  while (!failed) {
+    File* victim;
+    {
+      MutexLock ml(&mutex_);
+      if (usage_ <= options_.max_buffered_bytes || lru_->next == lru_) {
+        break;
+      }
+      victim = lru_->next;
+      victim->refs++;
+    }
+    {
+      MutexLock ml(&victim->mu);
+      Status s = FlushBuffer(victim);
+      if (!s.ok()) {
+        if (victim->error.ok()) {
+          victim->error = s;
+        }
+        failed = true;
+      }
+      Charge(victim);
+    }
+    MutexLock ml(&mutex_);
+    Unref(victim);
+  }
+}
+
+// Return the error of an earlier failed flush of a file. The flush is retried
+// first, and the error is cleared if the retry succeeds.
+// REQUIRES: f->mu has been locked.
+Status WriteBackFio::CheckError(File* f) {
+  f->mu.AssertHeld();
+  if (!f->error.ok()) {
+    f->error = FlushBuffer(f);
+  }
+  return f->error;
+}
+
+// Buffered data is kept if it cannot be written.
+// REQUIRES: f->mu has been locked.
+Status WriteBackFio::FlushBuffer(File* f) {
+  f->mu.AssertHeld();
+  Status s;
+  if (!f->buf.empty()) {
+    s = base_->Pwrite(f->fentry, f->base, f->buf, f->buf_off);
+    if (s.ok()) {
+      f->buf.clear();
+    }
+  }
+  return s;
+}
+
+// REQUIRES: f->mu has been locked.
+Status WriteBackFio::BufferWrite(File* f, const Slice& data, uint64_t off) {
+  f->mu.AssertHeld();
+  Status s;
+  const uint64_t buf_end = f->buf_off + f->buf.size();
+  if (!f->buf.empty() && (off < f->buf_off || off > buf_end)) {
+    s = FlushBuffer(f);
+  }
+  if (s.ok()) {
+    if (data.size() >= options_.write_buffer_size) {
+      s = FlushBuffer(f);
+      if (s.ok()) {
+        s = base_->Pwrite(f->fentry, f->base, data, off);
+      }
+    } else {
+      if (f->buf.empty()) {
+        f->buf_off = off;
+      }
+      const size_t start = off - f->buf_off;
+      const size_t overlap = std::min(f->buf.size() - start, data.size());
+      f->buf.replace(start, overlap, data.data(), data.size());
+      if (f->buf.size() >= options_.write_buffer_size) {
+        s = FlushBuffer(f);
+      }
+    }
+  }
+  if (s.ok()) {
+    f->size = std::max(f->size, off + data.size());
+    f->mtime = CurrentMicros();
+  }
+  return s;
+}
+
+Status WriteBackFio::Creat(const Fentry& fentry, bool append_only,
+                           Handle** fh) {
+  Handle* base;
+  Status s = base_->Creat(fentry, append_only, &base);
+  if (s.ok()) {
+    *fh = NewFile(fentry, base, append_only, CurrentMicros(), 0);
+  }
+  return s;
+}
+
+Status WriteBackFio::Open(const Fentry& fentry, bool create_if_missing,
+                          bool truncate_if_exists, bool append_only,
+                          uint64_t* mtime, uint64_t* size, Handle** fh) {
+  Handle* base;
+  Status s = base_->Open(fentry, create_if_missing, truncate_if_exists,
+                         append_only, mtime, size, &base);
+  if (s.ok()) {
+    *fh = NewFile(fentry, base, append_only, *mtime, *size);
+  }
+  return s;
+}
+
+Status WriteBackFio::Fstat(const Fentry& fentry, Handle* fh, uint64_t* mtime,
+                           uint64_t* size, bool skip_cache) {
+  File* const f = static_cast<File*>(fh);
+  MutexLock ml(&f->mu);
+  Status s;
+  if (skip_cache) {
+    s = FlushBuffer(f);
+    Charge(f);
+    if (s.ok()) {
+      s = base_->Fstat(fentry, f->base, &f->mtime, &f->size, true);
+    }
+  }
+  if (s.ok()) {
+    *mtime = f->mtime;
+    *size = f->size;
+  }
+  return s;
+}
+
+Status WriteBackFio::Write(const Fentry& fentry, Handle* fh,
+                           const Slice& data) {
+  File* const f = static_cast<File*>(fh);
+  Status s;
+  {
+    MutexLock ml(&f->mu);
+    const uint64_t off = f->append_only ? f->size : f->pos;
+    s = CheckError(f);
+    if (s.ok()) {
+      s = BufferWrite(f, data, off);
+    }
+    if (s.ok()) {
+      f->pos = off + data.size();
+    }
+    Charge(f);
+  }
+  MaybeEvict();
+  return s;
+}
+
+Status WriteBackFio::Pwrite(const Fentry& fentry, Handle* fh,
+                            const Slice& data, uint64_t off) {
+  File* const f = static_cast<File*>(fh);
+  Status s;
+  {
+    MutexLock ml(&f->mu);
+    s = CheckError(f);
+    if (s.ok()) {
+      s = BufferWrite(f, data, f->append_only ? f->size : off);
+    }
+    Charge(f);
+  }
+  MaybeEvict();
+  return s;
+}
+
+Status WriteBackFio::Read(const Fentry& fentry, Handle* fh, Slice* result,
+                          uint64_t size, char* scratch) {
+  File* const f = static_cast<File*>(fh);
+  MutexLock ml(&f->mu);
+  Status s = FlushBuffer(f);
+  Charge(f);
+  if (s.ok()) {
+    s = base_->Pread(fentry, f->base, result, f->pos, size, scratch);
+    if (s.ok()) {
+      f->pos += result->size();
+    }
+  }
+  return s;
+}
+
+Status WriteBackFio::Pread(const Fentry& fentry, Handle* fh, Slice* result,
+                           uint64_t off, uint64_t size, char* scratch) {
+  File* const f = static_cast<File*>(fh);
+  MutexLock ml(&f->mu);
+  Status s;
+  if (!f->buf.empty() && off < f->buf_off + f->buf.size() &&
+      f->buf_off < off + size) {
+    s = FlushBuffer(f);
+    Charge(f);
+  }
+  if (s.ok()) {
+    s = base_->Pread(fentry, f->base, result, off, size, scratch);
+  }
+  return s;
+}
+
+// A vectored or asynchronous call. Requests are forwarded to the base Fio
+// with base handles in place of write-back handles.
+struct WriteBackFio::Batch {
+  bool write;
+  Request* reqs;
+  size_t n;
+  std::vector<Request> base_reqs;  // Requests forwarded to the base Fio
+  std::vector<size_t> index;       // Position in reqs of each base request
+  void (*done)(void*);
+  void* arg;
+};
+
+// Reads are preceded by flushing buffered data they overlap, and writes by
+// flushing all buffered data of their files so that the buffered data
+// written later does not overwrite them. Requests that fail to flush are
+// completed with the error and are not forwarded.
+void WriteBackFio::PrepareBatch(Batch* b) {
+  for (size_t i = 0; i < b->n; i++) {
+    Request* const r = &b->reqs[i];
+    File* const f = static_cast<File*>(r->fh);
+    Request base_req = *r;
+    base_req.fh = f->base;
+    Status s;
+    {
+      MutexLock ml(&f->mu);
+      if (b->write) {
+        s = CheckError(f);
+        if (s.ok()) {
+          s = FlushBuffer(f);
+        }
+        if (f->append_only) {
+          base_req.off = f->size;
+        }
+      } else if (!f->buf.empty() && r->off < f->buf_off + f->buf.size() &&
+                 f->buf_off < r->off + r->size) {
+        s = FlushBuffer(f);
+      }
+      Charge(f);
+    }
+    if (s.ok()) {
+      b->base_reqs.push_back(base_req);
+      b->index.push_back(i);
+    } else {
+      r->status = s;
+    }
+  }
+}
+
+// Copy the outcome of base requests back and return OK iff all requests
+// succeeded, otherwise the first error in request order.
+Status WriteBackFio::FinishBatch(Batch* b) {
+  for (size_t j = 0; j < b->base_reqs.size(); j++) {
+    const Request& base_req = b->base_reqs[j];
+    Request* const r = &b->reqs[b->index[j]];
+    r->status = base_req.status;
+    if (!b->write) {
+      r->result = base_req.result;
+    } else if (base_req.status.ok()) {
+      File* const f = static_cast<File*>(r->fh);
+      MutexLock ml(&f->mu);
+      f->size = std::max(f->size, base_req.off + base_req.data.size());
+      f->mtime = CurrentMicros();
+    }
+  }
+  Status s;
+  for (size_t i = 0; s.ok() && i < b->n; i++) {
+    s = b->reqs[i].status;
+  }
+  return s;
+}
+
+void WriteBackFio::BatchDone(void* arg) {
+  Batch* const b = reinterpret_cast<Batch*>(arg);
+  FinishBatch(b);
+  (*b->done)(b->arg);
+  delete b;
+}
+
+Status WriteBackFio::Preadv(Request* reqs, size_t n) {
+  Batch b;
+  b.write = false;
+  b.reqs = reqs;
+  b.n = n;
+  PrepareBatch(&b);
+  if (!b.base_reqs.empty()) {
+    base_->Preadv(&b.base_reqs[0], b.base_reqs.size());
+  }
+  return FinishBatch(&b);
+}
+
+Status WriteBackFio::Pwritev(Request* reqs, size_t n) {
+  Batch b;
+  b.write = true;
+  b.reqs = reqs;
+  b.n = n;
+  PrepareBatch(&b);
+  if (!b.base_reqs.empty()) {
+    base_->Pwritev(&b.base_reqs[0], b.base_reqs.size());
+  }
+  return FinishBatch(&b);
+}
+
+void WriteBackFio::AsyncPreadv(Request* reqs, size_t n, void (*done)(void*),
+                               void* arg) {
+  Batch* const b = new Batch;
+  b->write = false;
+  b->reqs = reqs;
+  b->n = n;
+  b->done = done;
+  b->arg = arg;
+  PrepareBatch(b);
+  if (!b->base_reqs.empty()) {
+    base_->AsyncPreadv(&b->base_reqs[0], b->base_reqs.size(), BatchDone, b);
+  } else {
+    BatchDone(b);
+  }
+}
+
+void WriteBackFio::AsyncPwritev(Request* reqs, size_t n, void (*done)(void*),
+                                void* arg) {
+  Batch* const b = new Batch;
+  b->write = true;
+  b->reqs = reqs;
+  b->n = n;
+  b->done = done;
+  b->arg = arg;
+  PrepareBatch(b);
+  if (!b->base_reqs.empty()) {
+    base_->AsyncPwritev(&b->base_reqs[0], b->base_reqs.size(), BatchDone, b);
+  } else {
+    BatchDone(b);
+  }
+}
+
+Status WriteBackFio::Ftrunc(const Fentry& fentry, Handle* fh, uint64_t size) {
+  File* const f = static_cast<File*>(fh);
+  MutexLock ml(&f->mu);
+  Status s = FlushBuffer(f);
+  Charge(f);
+  if (s.ok()) {
+    s = base_->Ftrunc(fentry, f->base, size);
+    if (s.ok()) {
+      f->size = size;
+      f->mtime = CurrentMicros();
+    }
+  }
+  return s;
+}
+
+Status WriteBackFio::Flush(const Fentry& fentry, Handle* fh,
+                           bool force_sync) {
+  File* const f = static_cast<File*>(fh);
+  MutexLock ml(&f->mu);
+  Status s = CheckError(f);
+  if (s.ok()) {
+    s = FlushBuffer(f);
+  }
+  Charge(f);
+  if (s.ok()) {
+    s = base_->Flush(fentry, f->base, force_sync);
+  }
+  return s;
+}
+
+Status WriteBackFio::Close(const Fentry& fentry, Handle* fh) {
+  File* const f = static_cast<File*>(fh);
+  Status s;
+  {
+    MutexLock ml(&f->mu);
+    s = CheckError(f);
+    if (s.ok()) {
+      s = FlushBuffer(f);
+    }
+    f->buf.clear();  // Unwritten data is dropped along with the handle
+    Charge(f);
+  }
+  Status c = base_->Close(fentry, f->base);
+  if (s.ok()) {
+    s = c;
+  }
+  MutexLock ml(&mutex_);
+  Unref(f);
+  return s;
+}
+
+// Data buffered by open handles of the file is written first so that it
+// cannot bring truncated data back when it is flushed later. Only handles
+// with buffered data need to be visited, and they are all in the lru list.
+Status WriteBackFio::Trunc(const Fentry& fentry, uint64_t size) {
+  const std::string key = fentry.UntypedKeyPrefix();
+  std::vector<File*> files;
+  {
+    MutexLock ml(&mutex_);
+    for (File* f = lru_->next; f != lru_; f = f->next) {
+      if (f->key == key) {
+        f->refs++;
+        files.push_back(f);
+      }
+    }
+  }
+  Status s;
+  for (size_t i = 0; i < files.size(); i++) {
+    File* const f = files[i];
+    MutexLock ml(&f->mu);
+    if (s.ok()) {
+      s = FlushBuffer(f);
+      Charge(f);
+    }
+  }
+  if (s.ok()) {
+    s = base_->Trunc(fentry, size);
+  }
+  if (s.ok()) {
+    for (size_t i = 0; i < files.size(); i++) {
+      MutexLock ml(&files[i]->mu);
+      files[i]->size = size;
+    }
+  }
+  MutexLock ml(&mutex_);
+  for (size_t i = 0; i < files.size(); i++) {
+    Unref(files[i]);
+  }
+  return s;
+}
+
+Status WriteBackFio::Stat(const Fentry& fentry, uint64_t* mtime,
+                          uint64_t* size) {
+  return base_->Stat(fentry, mtime, size);
+}
+
+Status WriteBackFio::Drop(const Fentry& fentry) {
+  return base_->Drop(fentry);
+}
+
+size_t WriteBackFio::TEST_BufferedBytes() {
+  MutexLock ml(&mutex_);
+  return usage_;
+}
+
+}  // namespace pdlfs
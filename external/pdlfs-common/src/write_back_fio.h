@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#pragma once
+
+#include "pdlfs-common/fio.h"
+#include "pdlfs-common/port.h"
+
+#include <string>
+
+namespace pdlfs {
+
+// A Fio decorator buffering writes per open handle. Each handle holds at
+// most one dirty extent. Adjacent or overlapping writes are merged into the
+// extent, and all other writes flush it first. Handles with dirty data are
+// kept in an lru list so that the oldest extents can be flushed when the
+// global budget is exceeded.
+//
+// Sequential Read() and Write() calls are turned into positional calls on
+// the base Fio using a per-handle file position. Vectored and asynchronous
+// calls are forwarded to the base Fio after flushing buffered data that
+// they may conflict with.
+//
+// An error flushing a handle's data in the background is remembered and
+// returned by the next Write(), Pwrite(), Flush(), or Close() on the handle
+// unless flushing the data again succeeds.
+class WriteBackFio : public Fio {
+ public:
+  WriteBackFio(const WriteBackFioOptions& options, Fio* base);
+  virtual ~WriteBackFio();
+
+  virtual Status Creat(const Fentry& fentry, bool append_only, Handle** fh);
+  virtual Status Open(const Fentry& fentry, bool create_if_missing,
+                      bool truncate_if_exists, bool append_only,
+                      uint64_t* mtime, uint64_t* size, Handle** fh);
+  virtual Status Fstat(const Fentry& fentry, Handle* fh, uint64_t* mtime,
+                       uint64_t* size, bool skip_cache = false);
+  virtual Status Write(const Fentry& fentry, Handle* fh, const Slice& data);
+  virtual Status Pwrite(const Fentry& fentry, Handle* fh, const Slice& data,
+                        uint64_t off);
+  virtual Status Read(const Fentry& fentry, Handle* fh, Slice* result,
+                      uint64_t size, char* scratch);
+  virtual Status Pread(const Fentry& fentry, Handle* fh, Slice* result,
+                       uint64_t off, uint64_t size, char* scratch);
+  virtual Status Preadv(Request* reqs, size_t n);
+  virtual Status Pwritev(Request* reqs, size_t n);
+  virtual void AsyncPreadv(Request* reqs, size_t n, void (*done)(void*),
+                           void* arg);
+  virtual void AsyncPwritev(Request* reqs, size_t n, void (*done)(void*),
+                            void* arg);
+  virtual Status Ftrunc(const Fentry& fentry, Handle* fh, uint64_t size);
+  virtual Status Flush(const Fentry& fentry, Handle* fh,
+                       bool force_sync = false);
+  virtual Status Close(const Fentry& fentry, Handle* fh);
+
+  virtual Status Trunc(const Fentry& fentry, uint64_t size);
+  virtual Status Stat(const Fentry& fentry, uint64_t* mtime, uint64_t* size);
+  virtual Status Drop(const Fentry& fentry);
+
+  // Total number of bytes currently buffered.
+  size_t TEST_BufferedBytes();
+
+ private:
+  struct File;
+  struct Batch;
+  static void BatchDone(void* arg);
+  void PrepareBatch(Batch* b);
+  static Status FinishBatch(Batch* b);
+  File* NewFile(const Fentry& fentry, Handle* base, bool append_only,
+                uint64_t mtime, uint64_t size);
+  Status BufferWrite(File* f, const Slice& data, uint64_t off);
+  Status CheckError(File* f);
+  Status FlushBuffer(File* f);
+  void Charge(File* f);
+  void MaybeEvict();
+  void Unref(File* f);
+
+  // No copying allowed
+  void operator=(const WriteBackFio&);
+  WriteBackFio(const WriteBackFio&);
+
+  const WriteBackFioOptions options_;
+  Fio* const base_;
+
+  // State below is protected by mutex_. Lock order: File::mu then mutex_.
+  port::Mutex mutex_;
+  File* lru_;  // Dummy head of the list of files with buffered data
+  size_t usage_;
+};
+
+}  // namespace pdlfs
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+#include "write_back_fio.h"
+#include "posix/posix_fio.h"
+
+#include "pdlfs-common/testharness.h"
+
+namespace pdlfs {
+
+// Count calls that reach the backing store.
+class CountingFio : public PosixFio {
+ public:
+  explicit CountingFio(const char* root)
+      : PosixFio(root), writes(0), fail_writes(false) {}
+
+  virtual Status Write(const Fentry& fentry, Handle* fh, const Slice& data) {
+    writes++;
+    return PosixFio::Write(fentry, fh, data);
+  }
+
+  virtual Status Pwrite(const Fentry& fentry, Handle* fh, const Slice& data,
+                        uint64_t off) {
+    writes++;
+    if (fail_writes) {
+      return Status::IOError("Injected write error");
+    }
+    return PosixFio::Pwrite(fentry, fh, data, off);
+  }
+
+  int writes;
+  bool fail_writes;
+};
+
+class WriteBackFioTest {
+ public:
+  WriteBackFioTest() {
+    root_ = test::TmpDir() + "/write_back_fio_test";
+    base_ = new CountingFio(root_.c_str());
+    options_.write_buffer_size = 1000;
+    options_.max_buffered_bytes = 1500;
+    fio_ = new WriteBackFio(options_, base_);
+    for (int i = 0; i < 2; i++) {
+      entries_[i].stat.SetInodeNo(100 + i);
+      fio_->Drop(entries_[i]);
+    }
+  }
+
+  ~WriteBackFioTest() {
+    for (int i = 0; i < 2; i++) {
+      fio_->Drop(entries_[i]);
+    }
+    delete fio_;
+  }
+
+  std::string ReadAll(Fio::Handle* fh, int i) {
+    char scratch[4000];
+    Slice result;
+    ASSERT_OK(fio_->Pread(entries_[i], fh, &result, 0, sizeof(scratch),
+                          scratch));
+    return result.ToString();
+  }
+
+  WriteBackFioOptions options_;
+  Fentry entries_[2];
+  std::string root_;
+  CountingFio* base_;
+  WriteBackFio* fio_;
+};
+
+TEST(WriteBackFioTest, CoalesceAppends) {
+  Fio::Handle* fh;
+  ASSERT_OK(fio_->Creat(entries_[0], false, &fh));
+  std::string expected;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(fio_->Write(entries_[0], fh, "abcde"));
+    expected += "abcde";
+  }
+  ASSERT_EQ(base_->writes, 0);
+  ASSERT_EQ(fio_->TEST_BufferedBytes(), 500);
+  uint64_t mtime, size;
+  ASSERT_OK(fio_->Fstat(entries_[0], fh, &mtime, &size));
+  ASSERT_EQ(size, 500);
+  ASSERT_EQ(base_->writes, 0);
+  ASSERT_EQ(ReadAll(fh, 0), expected);
+  ASSERT_EQ(base_->writes, 1);
+  ASSERT_EQ(fio_->TEST_BufferedBytes(), 0);
+  ASSERT_OK(fio_->Close(entries_[0], fh));
+}
+
+TEST(WriteBackFioTest, OverlappingWrites) {
+  Fio::Handle* fh;
+  ASSERT_OK(fio_->Creat(entries_[0], false, &fh));
+  ASSERT_OK(fio_->Pwrite(entries_[0], fh, "0123456789", 0));
+  ASSERT_OK(fio_->Pwrite(entries_[0], fh, "xyz", 8));
+  ASSERT_OK(fio_->Pwrite(entries_[0], fh, "ab", 2));
+  ASSERT_EQ(base_->writes, 0);
+  // Not adjacent to the buffered extent
+  ASSERT_OK(fio_->Pwrite(entries_[0], fh, "k", 20));
+  ASSERT_EQ(base_->writes, 1);
+  ASSERT_OK(fio_->Flush(entries_[0], fh));
+  ASSERT_EQ(base_->writes, 2);
+  ASSERT_EQ(ReadAll(fh, 0), std::string("01ab4567xyz") +
+                                std::string(9, '\0') + "k");
+  ASSERT_OK(fio_->Close(entries_[0], fh));
+}
+
+TEST(WriteBackFioTest, SkipCache) {
+  Fio::Handle* fh;
+  ASSERT_OK(fio_->Creat(entries_[0], false, &fh));
+  ASSERT_OK(fio_->Write(entries_[0], fh, "abc"));
+  uint64_t mtime, size;
+  ASSERT_OK(fio_->Stat(entries_[0], &mtime, &size));
+  ASSERT_EQ(size, 0);
+  ASSERT_OK(fio_->Fstat(entries_[0], fh, &mtime, &size, true));
+  ASSERT_EQ(size, 3);
+  ASSERT_OK(fio_->Stat(entries_[0], &mtime, &size));
+  ASSERT_EQ(size, 3);
+  ASSERT_OK(fio_->Close(entries_[0], fh));
+}
+
+TEST(WriteBackFioTest, MemoryBudget) {
+  Fio::Handle* fh[2];
+  for (int i = 0; i < 2; i++) {
+    ASSERT_OK(fio_->Creat(entries_[i], false, &fh[i]));
+  }
+  ASSERT_OK(fio_->Write(entries_[0], fh[0], std::string(900, 'a')));
+  ASSERT_OK(fio_->Write(entries_[1], fh[1], std::string(500, 'b')));
+  ASSERT_EQ(base_->writes, 0);
+  // Exceeds the budget; the least recently written file is flushed
+  ASSERT_OK(fio_->Write(entries_[1], fh[1], std::string(200, 'b')));
+  ASSERT_EQ(base_->writes, 1);
+  ASSERT_EQ(fio_->TEST_BufferedBytes(), 700);
+  // Reaches the per-file buffer size
+  ASSERT_OK(fio_->Write(entries_[1], fh[1], std::string(300, 'b')));
+  ASSERT_EQ(base_->writes, 2);
+  ASSERT_EQ(fio_->TEST_BufferedBytes(), 0);
+  // Large writes are not buffered
+  ASSERT_OK(fio_->Write(entries_[0], fh[0], std::string(1000, 'a')));
+  ASSERT_EQ(base_->writes, 3);
+  for (int i = 0; i < 2; i++) {
+    ASSERT_OK(fio_->Close(entries_[i], fh[i]));
+  }
+  ASSERT_EQ(base_->writes, 3);
+  uint64_t mtime, size;
+  ASSERT_OK(fio_->Stat(entries_[0], &mtime, &size));
+  ASSERT_EQ(size, 1900);
+  ASSERT_OK(fio_->Stat(entries_[1], &mtime, &size));
+  ASSERT_EQ(size, 1000);
+}
+
+TEST(WriteBackFioTest, StickyError) {
+  Fio::Handle* fh[2];
+  for (int i = 0; i < 2; i++) {
+    ASSERT_OK(fio_->Creat(entries_[i], false, &fh[i]));
+  }
+  ASSERT_OK(fio_->Write(entries_[0], fh[0], std::string(900, 'a')));
+  ASSERT_OK(fio_->Write(entries_[1], fh[1], std::string(500, 'b')));
+  base_->fail_writes = true;
+  // Evicting the first file fails; its data stays buffered
+  ASSERT_OK(fio_->Write(entries_[1], fh[1], std::string(200, 'b')));
+  ASSERT_EQ(base_->writes, 1);
+  ASSERT_EQ(fio_->TEST_BufferedBytes(), 1600);
+  // The flush is retried and fails again
+  ASSERT_TRUE(fio_->Write(entries_[0], fh[0], "a").IsIOError());
+  ASSERT_TRUE(fio_->Flush(entries_[0], fh[0]).IsIOError());
+  ASSERT_EQ(fio_->TEST_BufferedBytes(), 1600);
+  // The error is cleared once a retry succeeds
+  base_->fail_writes = false;
+  ASSERT_OK(fio_->Write(entries_[0], fh[0], "a"));
+  ASSERT_OK(fio_->Flush(entries_[0], fh[0]));
+  for (int i = 0; i < 2; i++) {
+    ASSERT_OK(fio_->Close(entries_[i], fh[i]));
+  }
+  ASSERT_EQ(fio_->TEST_BufferedBytes(), 0);
+  uint64_t mtime, size;
+  ASSERT_OK(fio_->Stat(entries_[0], &mtime, &size));
+  ASSERT_EQ(size, 901);
+  ASSERT_OK(fio_->Stat(entries_[1], &mtime, &size));
+  ASSERT_EQ(size, 700);
+}
+
+// Truncating a file by name must not be undone by data buffered by its open
+// handles.
+TEST(WriteBackFioTest, TruncFlushesBuffers) {
+  Fio::Handle* fh;
+  ASSERT_OK(fio_->Creat(entries_[0], false, &fh));
+  ASSERT_OK(fio_->Write(entries_[0], fh, "0123456789"));
+  ASSERT_OK(fio_->Trunc(entries_[0], 4));
+  ASSERT_EQ(fio_->TEST_BufferedBytes(), 0);
+  ASSERT_OK(fio_->Flush(entries_[0], fh));
+  uint64_t mtime, size;
+  ASSERT_OK(fio_->Stat(entries_[0], &mtime, &size));
+  ASSERT_EQ(size, 4);
+  ASSERT_OK(fio_->Fstat(entries_[0], fh, &mtime, &size));
+  ASSERT_EQ(size, 4);
+  ASSERT_EQ(ReadAll(fh, 0), "0123");
+  ASSERT_OK(fio_->Close(entries_[0], fh));
+}
+
+TEST(WriteBackFioTest, VectoredCalls) {
+  Fio::Handle* fh;
+  ASSERT_OK(fio_->Creat(entries_[0], false, &fh));
+  ASSERT_OK(fio_->Pwrite(entries_[0], fh, "kkkk", 0));
+  Fio::Request req;
+  req.fentry = &entries_[0];
+  req.fh = fh;
+  req.off = 1;
+  req.data = "xy";
+  // Buffered data is written first so it does not overwrite the request
+  ASSERT_OK(fio_->Pwritev(&req, 1));
+  ASSERT_EQ(fio_->TEST_BufferedBytes(), 0);
+  ASSERT_OK(fio_->Pwrite(entries_[0], fh, "z", 4));
+  char scratch[10];
+  req.off = 0;
+  req.size = sizeof(scratch);
+  req.scratch = scratch;
+  ASSERT_OK(fio_->Preadv(&req, 1));
+  ASSERT_EQ(req.result, "kxykz");
+  uint64_t mtime, size;
+  ASSERT_OK(fio_->Fstat(entries_[0], fh, &mtime, &size));
+  ASSERT_EQ(size, 5);
+  ASSERT_OK(fio_->Close(entries_[0], fh));
+}
+
+}  // namespace pdlfs
+
+int main(int argc, char** argv) {
+  return ::pdlfs::test::RunAllTests(&argc, &argv);
+}
@@ -9,6 +9,7 @@
 #include "pdlfs-common/cache.h"
 #include "pdlfs-common/crc32c.h"
 #include "pdlfs-common/env.h"
+#include "pdlfs-common/env_faults.h"
 #include "pdlfs-common/histogram.h"
 #include "pdlfs-common/leveldb/db/db.h"
 #include "pdlfs-common/leveldb/db/write_batch.h"
@@ -102,6 +103,25 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Size of the bloom filter kept by each memtable (no filter if == 0)
+static int FLAGS_memtable_bloom_bytes = 0;
+
+// Length of key prefixes used to hash memtable entries (no hashing if == 0)
+static int FLAGS_memtable_prefix_len = 0;
+
+// Latency in microseconds added to each file read, append, and sync to
+// emulate slow storage (no latency if == 0)
+static int FLAGS_read_latency_us = 0;
+static int FLAGS_append_latency_us = 0;
+static int FLAGS_sync_latency_us = 0;
+
+// Max number of bytes read and written per second (unlimited if == 0)
+static int FLAGS_io_bytes_per_sec = 0;
+
+// Stall all file io for stall_us every stall_period_us (no stalls if == 0)
+static int FLAGS_stall_period_us = 0;
+static int FLAGS_stall_us = 0;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -717,6 +737,8 @@ class Benchmark {
     options.max_open_files = FLAGS_open_files;
 #endif
     options.filter_policy = filter_policy_;
+    options.memtable_bloom_bytes = FLAGS_memtable_bloom_bytes;
+    options.memtable_prefix_len = FLAGS_memtable_prefix_len;
 #if 0 /* XXXCDC: not imported into our options yet */
     options.reuse_logs = FLAGS_reuse_logs;
 #endif
@@ -991,6 +1013,23 @@ int main(int argc, char** argv) {
       FLAGS_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--memtable_bloom_bytes=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_memtable_bloom_bytes = n;
+    } else if (sscanf(argv[i], "--memtable_prefix_len=%d%c", &n, &junk) == 1) {
+      FLAGS_memtable_prefix_len = n;
+    } else if (sscanf(argv[i], "--read_latency_us=%d%c", &n, &junk) == 1) {
+      FLAGS_read_latency_us = n;
+    } else if (sscanf(argv[i], "--append_latency_us=%d%c", &n, &junk) == 1) {
+      FLAGS_append_latency_us = n;
+    } else if (sscanf(argv[i], "--sync_latency_us=%d%c", &n, &junk) == 1) {
+      FLAGS_sync_latency_us = n;
+    } else if (sscanf(argv[i], "--io_bytes_per_sec=%d%c", &n, &junk) == 1) {
+      FLAGS_io_bytes_per_sec = n;
+    } else if (sscanf(argv[i], "--stall_period_us=%d%c", &n, &junk) == 1) {
+      FLAGS_stall_period_us = n;
+    } else if (sscanf(argv[i], "--stall_us=%d%c", &n, &junk) == 1) {
+      FLAGS_stall_us = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
@@ -1002,6 +1041,22 @@ int main(int argc, char** argv) {
   }
 
   pdlfs::g_env = pdlfs::Env::Default();
+  pdlfs::FaultInjectionEnv* slow_env = NULL;
+  if (FLAGS_read_latency_us != 0 || FLAGS_append_latency_us != 0 ||
+      FLAGS_sync_latency_us != 0 || FLAGS_io_bytes_per_sec != 0 ||
+      FLAGS_stall_period_us != 0) {
+    pdlfs::FaultInjectionOptions options;
+    options.read.min_micros = options.read.max_micros = FLAGS_read_latency_us;
+    options.append.min_micros = options.append.max_micros =
+        FLAGS_append_latency_us;
+    options.sync.min_micros = options.sync.max_micros = FLAGS_sync_latency_us;
+    options.read_bytes_per_sec = FLAGS_io_bytes_per_sec;
+    options.write_bytes_per_sec = FLAGS_io_bytes_per_sec;
+    options.stall_period_micros = FLAGS_stall_period_us;
+    options.stall_micros = FLAGS_stall_us;
+    slow_env = new pdlfs::FaultInjectionEnv(pdlfs::g_env, options);
+    pdlfs::g_env = slow_env;
+  }
 
   // Choose a location for the test database if none given with --db=<path>
   if (FLAGS_db == NULL) {
@@ -1010,7 +1065,10 @@ int main(int argc, char** argv) {
     FLAGS_db = default_db_path.c_str();
   }
 
-  pdlfs::Benchmark benchmark;
-  benchmark.Run();
+  {
+    pdlfs::Benchmark benchmark;
+    benchmark.Run();
+  }
+  delete slow_env;
   return 0;
 }
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2019 Carnegie Mellon University,
+ * Copyright (c) 2019 Triad National Security, LLC, as operator of
+ *     Los Alamos National Laboratory.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+/*
+ * pdlfs_ect_partition: build an ECT partition from the Table files written
+ * by DB::Dump() so that the dumped keys can be served read-only through
+ * ECTPartition. Assumes the dump was written by a db using the default
+ * bytewise comparator.
+ */
+#include "pdlfs-common/ect_partition.h"
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/leveldb/options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <dump_dir> <partition_file>\n", argv[0]);
+    exit(1);
+  }
+  pdlfs::DBOptions options;
+  size_t n = 0;
+  const uint64_t start = pdlfs::CurrentMicros();
+  pdlfs::Status s =
+      pdlfs::BuildECTPartitionFromDump(options, argv[1], argv[2], &n);
+  if (!s.ok()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    exit(1);
+  }
+  uint64_t size = 0;
+  options.env->GetFileSize(argv[2], &size);
+  fprintf(stdout, "%s: %llu records, %llu bytes, %.3f s\n", argv[2],
+          static_cast<unsigned long long>(n),
+          static_cast<unsigned long long>(size),
+          (pdlfs::CurrentMicros() - start) / 1e6);
+  return 0;
+}